@@ -107,7 +107,10 @@ char *usage = "Serial Usage: ./idx_write -g 32x32x32 -l 32x32x32 -v 2 -t 4 -f ou
                      "  -r: restructured box dimension\n"
                      "  -f: file name template (without .idx)\n"
                      "  -t: number of timesteps\n"
-                     "  -v: number of variables (or file containing a list of variables)\n";
+                     "  -v: number of variables (or file containing a list of variables)\n"
+                     "  -b: zfp bit rate (fixed rate)\n"
+                     "  -p: zfp precision in bits (fixed precision)\n"
+                     "  -a: zfp absolute error tolerance (fixed accuracy)\n";
 
 static int generate_vars();
 static void parse_args(int argc, char **argv);
@@ -117,6 +120,8 @@ static void set_pidx_variable(int var);
 static void set_pidx_file(int ts);
 static void destroy_synthetic_simulation_data();
 static uint32_t bit_rate = 0;
+static int precision = 0;
+static double tolerance = 0;
 
 int main(int argc, char **argv)
 {
@@ -179,7 +184,7 @@ int main(int argc, char **argv)
 //----------------------------------------------------------------
 static void parse_args(int argc, char **argv)
 {
-  char flags[] = "g:l:f:t:v:b:";
+  char flags[] = "g:l:f:t:v:b:p:a:";
   int one_opt = 0;
 
   while ((one_opt = getopt(argc, argv, flags)) != EOF)
@@ -227,6 +232,16 @@ static void parse_args(int argc, char **argv)
         terminate_with_error_msg("Invalid bit rate\n%s", usage);
       break;
 
+    case('p'): // compression precision
+      if (sscanf(optarg, "%d", &precision) < 0 || precision < 1)
+        terminate_with_error_msg("Invalid precision\n%s", usage);
+      break;
+
+    case('a'): // compression error tolerance
+      if (sscanf(optarg, "%lf", &tolerance) < 0 || tolerance <= 0)
+        terminate_with_error_msg("Invalid tolerance\n%s", usage);
+      break;
+
     default:
       terminate_with_error_msg("Wrong arguments\n%s", usage);
     }
@@ -473,12 +488,26 @@ static void set_pidx_file(int ts)
   // we can instruct PIDX to cache and reuse these information for the next timesteps
   PIDX_set_cache_time_step(file, 0);
 
-  PIDX_set_compression_type(file, PIDX_CHUNKING_ZFP);
-  
-  if(!bit_rate)
-    bit_rate = bpv[0];
-  
-  PIDX_set_lossy_compression_bit_rate(file, bit_rate);
+  // Variable rate zfp (fixed precision or fixed accuracy), otherwise fixed rate
+  if (precision)
+  {
+    PIDX_set_compression_type(file, PIDX_CHUNKING_ZFP_PRECISION);
+    PIDX_set_lossy_compression_precision(file, precision);
+  }
+  else if (tolerance)
+  {
+    PIDX_set_compression_type(file, PIDX_CHUNKING_ZFP_ACCURACY);
+    PIDX_set_lossy_compression_accuracy(file, tolerance);
+  }
+  else
+  {
+    PIDX_set_compression_type(file, PIDX_CHUNKING_ZFP);
+
+    if(!bit_rate)
+      bit_rate = bpv[0];
+
+    PIDX_set_lossy_compression_bit_rate(file, bit_rate);
+  }
 
   return;
 }
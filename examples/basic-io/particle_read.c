@@ -111,6 +111,7 @@ static char output_file_template[512] = "test_idx";
 static unsigned char *data = NULL;
 static uint64_t particle_count = 0;
 static int checkpoint_restart = 1;
+static int lod_level = PIDX_PARTICLES_ALL_LOD_LEVELS;
 
 static PIDX_point local_offset, local_size;
 static PIDX_physical_point physical_local_offset, physical_local_size;
@@ -130,7 +131,8 @@ static char *usage = "Serial Usage: ./particle_read -g 32x32x32 -l 32x32x32 -v 0
                      "  -f: IDX input filename\n"
                      "  -t: time step index to read\n"
                      "  -v: variable index to read\n"
-                     "  -c: read all vars to simulate checkpoint/restart";
+                     "  -c: read all vars to simulate checkpoint/restart\n"
+                     "  -d: finest level of detail to read (default all)";
 
 
 static void init_mpi(int argc, char **argv);
@@ -143,6 +145,9 @@ static void create_pidx_var_point_and_access();
 static void set_pidx_file(int ts);
 static void set_pidx_variable_and_create_buffer();
 static void shutdown_mpi();
+#if DEBUG_PRINT_OUTPUT
+static char** read_sorted_lines(FILE *fp, int *line_count);
+#endif
 
 int main(int argc, char **argv)
 {
@@ -179,8 +184,8 @@ int main(int argc, char **argv)
     // TODO WILL: the data should be a pointer to a pointer, since PIDX internally
     // will be in charge of allocating the data buffer. So this data param will take
     // a double pointer.
-    PIDX_variable_read_particle_data_layout(variable, physical_local_offset, physical_local_size,
-        (void**)&data, &particle_count, PIDX_row_major);
+    PIDX_variable_read_particle_data_layout_lod(variable, physical_local_offset, physical_local_size,
+        (void**)&data, &particle_count, lod_level, PIDX_row_major);
   }
   else
   {
@@ -199,9 +204,9 @@ int main(int argc, char **argv)
       ret = PIDX_get_next_variable(file, &checkpoint_vars[i]);
       if (ret != PIDX_success) terminate_with_error_msg("PIDX_get_next_variable");
 
-      ret = PIDX_variable_read_particle_data_layout(checkpoint_vars[i], physical_local_offset, physical_local_size,
-          &checkpoint_data[i], &checkpoint_particle_counts[i], PIDX_row_major);
-      if (ret != PIDX_success) terminate_with_error_msg("PIDX_variable_read_particle_data_layout");
+      ret = PIDX_variable_read_particle_data_layout_lod(checkpoint_vars[i], physical_local_offset, physical_local_size,
+          &checkpoint_data[i], &checkpoint_particle_counts[i], lod_level, PIDX_row_major);
+      if (ret != PIDX_success) terminate_with_error_msg("PIDX_variable_read_particle_data_layout_lod");
       if (i + 1 < variable_count)
       {
         ret = PIDX_read_next_variable(file, checkpoint_vars[i]);
@@ -289,9 +294,11 @@ int main(int argc, char **argv)
   fclose(fp);
   
   int error_count = 0;
-  int ch1, ch2;
 
   // Verify output of read and write (TODO check for RST mode)
+  // PIDX returns the particles in the spatial order of the files, so the
+  // lines are compared once sorted. Reads of a coarse level of detail return
+  // a subset of the particles that were written
   char rank_filename_verify[PATH_MAX];
   sprintf(rank_filename_verify, "%s_w_%d", output_file_template, rank);
   FILE *fpv = fopen(rank_filename_verify, "r");
@@ -301,16 +308,38 @@ int main(int argc, char **argv)
     printf("Cannot verify rank %d looking for file %s and %s for reading ", rank, rank_filename, rank_filename_verify);
     exit(1);
   } else {
-    ch1 = getc(fp);
-    ch2 = getc(fpv);
-    
-    while ((ch1 != EOF) && (ch2 != EOF) && (ch1 == ch2)) {
-      ch1 = getc(fp);
-      ch2 = getc(fpv);
+    int line_count1 = 0, line_count2 = 0;
+    char **lines1 = read_sorted_lines(fp, &line_count1);
+    char **lines2 = read_sorted_lines(fpv, &line_count2);
+
+    if (lod_level == PIDX_PARTICLES_ALL_LOD_LEVELS)
+    {
+      if (line_count1 != line_count2)
+        error_count++;
+      for (int l = 0; l < line_count1 && error_count == 0; l++)
+        if (strcmp(lines1[l], lines2[l]) != 0)
+          error_count++;
     }
-    
-    if(ch1 != ch2)
-      error_count++;
+    else
+    {
+      int l2 = 0;
+      for (int l = 0; l < line_count1 && error_count == 0; l++)
+      {
+        while (l2 < line_count2 && strcmp(lines2[l2], lines1[l]) < 0)
+          l2++;
+        if (l2 == line_count2 || strcmp(lines2[l2], lines1[l]) != 0)
+          error_count++;
+        l2++;
+      }
+      printf("Rank %d read %d of %d particles up to level %d\n", rank, line_count1, line_count2, lod_level);
+    }
+
+    for (int l = 0; l < line_count1; l++)
+      free(lines1[l]);
+    for (int l = 0; l < line_count2; l++)
+      free(lines2[l]);
+    free(lines1);
+    free(lines2);
     
     fclose(fpv);
     fclose(fp);
@@ -356,7 +385,7 @@ static void init_mpi(int argc, char **argv)
 
 static void parse_args(int argc, char **argv)
 {
-  char flags[] = "g:l:f:t:v:c";
+  char flags[] = "g:l:f:t:v:cd:";
   int one_opt = 0;
 
   while ((one_opt = getopt(argc, argv, flags)) != EOF)
@@ -396,6 +425,11 @@ static void parse_args(int argc, char **argv)
       checkpoint_restart = 1;
       break;
 
+    case('d'): // finest level of detail
+      if (sscanf(optarg, "%d", &lod_level) < 0)
+        terminate_with_error_msg("Invalid level of detail\n%s", usage);
+      break;
+
     default:
       terminate_with_error_msg("Wrong arguments\n%s", usage);
     }
@@ -533,3 +567,34 @@ static void shutdown_mpi()
   MPI_Finalize();
 #endif
 }
+
+
+
+#if DEBUG_PRINT_OUTPUT
+//----------------------------------------------------------------
+static int compare_lines(const void *a, const void *b)
+{
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static char** read_sorted_lines(FILE *fp, int *line_count)
+{
+  int max_count = 1024;
+  char **lines = malloc(sizeof(*lines) * max_count);
+  char line[1024];
+
+  *line_count = 0;
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    if (*line_count == max_count)
+    {
+      max_count = max_count * 2;
+      lines = realloc(lines, sizeof(*lines) * max_count);
+    }
+    lines[(*line_count)++] = strdup(line);
+  }
+
+  qsort(lines, *line_count, sizeof(*lines), compare_lines);
+  return lines;
+}
+#endif
@@ -125,6 +125,8 @@ static int variable_count = 7;
 
 
 static int mode = 0;
+static int lod_level_count = 0;
+static int shared_file_count = 0;
 static int time_step_count = 1;
 static uint64_t particle_count = 32;
 static char output_file_template[512];
@@ -168,7 +170,9 @@ static char *usage = "Serial Usage: ./idx_write -g 32x32x32 -l 32x32x32 -v 2 -t
                      "  -f: file name template (without .idx)\n"
                      "  -t: number of timesteps\n"
                      "  -p: number of particles per patch\n"
-                     "  -m: I/O mode (0 for ffp, 1 for rst) \n";
+                     "  -m: I/O mode (0 for ffp, 1 for rst) \n"
+                     "  -d: number of levels of detail of the particle files\n"
+                     "  -a: number of shared files (0 for one file per patch)\n";
 
 int main(int argc, char **argv)
 {
@@ -237,7 +241,7 @@ static void init_mpi(int argc, char **argv)
 //----------------------------------------------------------------
 static void parse_args(int argc, char **argv)
 {
-  char flags[] = "g:l:f:t:p:m:";
+  char flags[] = "g:l:f:t:p:m:d:a:";
   int one_opt = 0;
 
   while ((one_opt = getopt(argc, argv, flags)) != EOF)
@@ -276,6 +280,16 @@ static void parse_args(int argc, char **argv)
         terminate_with_error_msg("Invalid variable file\n%s", usage);
       break;
 
+    case('d'): // levels of detail
+      if (sscanf(optarg, "%d", &lod_level_count) < 0)
+        terminate_with_error_msg("Invalid levels of detail\n%s", usage);
+      break;
+
+    case('a'): // shared files
+      if (sscanf(optarg, "%d", &shared_file_count) < 0)
+        terminate_with_error_msg("Invalid shared file count\n%s", usage);
+      break;
+
     default:
       terminate_with_error_msg("Wrong arguments\n%s", usage);
     }
@@ -595,6 +609,12 @@ static void set_pidx_file(int ts)
   PIDX_set_variable_count(file, variable_count);
   // Set which variable will be used internally as position (default 0)
   PIDX_set_particles_position_variable_index(file, PARTICLES_POSITION_VAR);
+  // Store the particles coarse to fine so that reads can stop at a level of detail
+  if (PIDX_set_particles_lod_level_count(file, lod_level_count) != PIDX_success)
+    terminate_with_error_msg("PIDX_set_particles_lod_level_count\n");
+  // Aggregate the particle files of all the processes into a few shared files
+  if (PIDX_set_shared_file_count(file, shared_file_count) != PIDX_success)
+    terminate_with_error_msg("PIDX_set_shared_file_count\n");
 
   // Select I/O mode (PIDX_IDX_IO for the multires, PIDX_RAW_IO for non-multires)
   if (mode == 0)
@@ -101,6 +101,7 @@ char output_file_name[512];
 unsigned char **data;
 static unsigned long long rst_box_size[PIDX_MAX_DIMENSIONS];
 static PIDX_point rst_box;
+static int shared_file_count = 0;
 
 
 char *usage = "Serial Usage: ./idx_write -g 32x32x32 -l 32x32x32 -r 40x40x40 -v 2 -t 4 -f output_idx_file_name\n"
@@ -110,7 +111,8 @@ char *usage = "Serial Usage: ./idx_write -g 32x32x32 -l 32x32x32 -r 40x40x40 -v
                      "  -r: restructured box dimension\n"
                      "  -f: file name template (without .idx)\n"
                      "  -t: number of timesteps\n"
-                     "  -v: number of variables (or file containing a list of variables)\n";
+                     "  -v: number of variables (or file containing a list of variables)\n"
+                     "  -a: number of shared files (0 for one file per restructured box)\n";
 
 static int generate_vars();
 static void parse_args(int argc, char **argv);
@@ -178,7 +180,7 @@ int main(int argc, char **argv)
 //----------------------------------------------------------------
 static void parse_args(int argc, char **argv)
 {
-  char flags[] = "g:l:r:f:t:v:";
+  char flags[] = "g:l:r:f:t:v:a:";
   int one_opt = 0;
 
   while ((one_opt = getopt(argc, argv, flags)) != EOF)
@@ -228,6 +230,11 @@ static void parse_args(int argc, char **argv)
       }
       break;
 
+    case('a'): // shared files
+      if (sscanf(optarg, "%d", &shared_file_count) < 0)
+        terminate_with_error_msg("Invalid shared file count\n%s", usage);
+      break;
+
     default:
       terminate_with_error_msg("Wrong arguments\n%s", usage);
     }
@@ -463,6 +470,10 @@ static void set_pidx_file(int ts)
 
   PIDX_set_restructuring_box(file, rst_box);
 
+  // Aggregate the restructured boxes of all the processes into a few shared files
+  if (PIDX_set_shared_file_count(file, shared_file_count) != PIDX_success)
+    terminate_with_error_msg("PIDX_set_shared_file_count\n");
+
   return;
 }
 
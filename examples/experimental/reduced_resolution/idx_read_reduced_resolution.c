@@ -281,10 +281,10 @@ static void set_pidx_file(int ts)
 
   printf("off %lld %lld %lld size %lld %lld %lld \n", local_offset[0], local_offset[1], local_offset[2], local_size[0],local_size[1],local_size[2]);
   
-  uint64_t num_samples;
-  PIDX_get_box_for_resolution(file, max_resolution, local_offset, local_size, &num_samples);
+  uint64_t num_samples[PIDX_MAX_DIMENSIONS];
+  PIDX_get_box_for_resolution(file, max_resolution, local_offset, local_size, num_samples);
   
-  printf("buffer size: %lld\n", num_samples);
+  printf("buffer size: %lld %lld %lld\n", num_samples[0], num_samples[1], num_samples[2]);
 
 }
 
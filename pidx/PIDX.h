@@ -215,6 +215,25 @@ PIDX_return_code PIDX_get_variable_count(PIDX_file file, int* variable_count);
 /// \return The variable index.
 ///
 PIDX_return_code PIDX_set_particles_position_variable_index(PIDX_file file, uint32_t var_index);
+
+///
+/// Sets the number of levels of detail of the particle files. The particles of
+/// every file are then stored coarse to fine, level 0 holding one particle out
+/// of 2^(level_count - 1) along the Z-order curve and every further level doubling
+/// the density, so reading the first levels gives a spatially uniform subsample.
+/// \param file The IDX file handler.
+/// \param level_count Number of levels (0 or 1 stores a single level).
+/// \return PIDX_err_unsupported_flags if level_count is more than PIDX_PARTICLES_MAX_LOD_LEVELS.
+///
+PIDX_return_code PIDX_set_particles_lod_level_count(PIDX_file file, int level_count);
+
+///
+/// Gets the number of levels of detail of the particle files.
+/// \param file The IDX file handler.
+/// \param level_count The number of levels.
+/// \return
+///
+PIDX_return_code PIDX_get_particles_lod_level_count(PIDX_file file, int* level_count);
   
 ///
 /// Sets the current time step for IDX file.
@@ -280,10 +299,12 @@ PIDX_return_code PIDX_get_block_count(PIDX_file file, int* block_count);
 
 
 ///
-/// \brief PIDX_set_resolution
+/// \brief PIDX_set_resolution Sets the number of finest HZ levels left out by the reads and writes of the file.
+/// A write keeps every 2^k-th sample along each axis (k being the number of levels of that axis left out) and
+/// stores it as a coarser dataset, whose .idx holds the shortened bitstring and the coarse box. Reduced writes
+/// are only supported by the PIDX_IDX_IO mode.
 /// \param file
-/// \param resolution_from
-/// \param resolution_to
+/// \param resolution_to Number of finest levels left out (0 for the full resolution)
 /// \return
 ///
 PIDX_return_code PIDX_set_resolution(PIDX_file file, int resolution_to);
@@ -301,11 +322,13 @@ PIDX_return_code PIDX_get_resolution(PIDX_file file, int *resolution_to);
 
   
 ///
-/// \brief PIDX_get_box_for_resolution
+/// \brief PIDX_get_box_for_resolution Number of samples along every axis of a box once the resolution_to finest
+/// HZ levels are left out, that is the dimensions of the buffer PIDX_read_variable fills at that resolution
 /// \param file
 /// \param resolution_to
 /// \param offset of the box
 /// \param size of the box
+/// \param buffer_size samples along x, y and z
 /// \return
 ///
 PIDX_return_code PIDX_get_box_for_resolution(PIDX_file file, int resolution_to, PIDX_point offset, PIDX_point size, uint64_t* buffer_size);
@@ -465,6 +488,38 @@ PIDX_return_code PIDX_get_lossy_compression_bit_rate(PIDX_file file, int *compre
 
 
 
+///
+/// \brief PIDX_set_lossy_compression_precision Fixed precision zfp (PIDX_CHUNKING_ZFP_PRECISION), every 4x4x4 chunk
+/// is coded with the given number of bit planes and takes as many bytes as it needs
+/// \param file
+/// \param precision between 1 and 64
+/// \return
+///
+PIDX_return_code PIDX_set_lossy_compression_precision(PIDX_file file, int precision);
+
+
+
+///
+/// \brief PIDX_set_lossy_compression_accuracy Fixed accuracy zfp (PIDX_CHUNKING_ZFP_ACCURACY), every 4x4x4 chunk
+/// is coded to the given absolute error tolerance and takes as many bytes as it needs
+/// \param file
+/// \param tolerance
+/// \return
+///
+PIDX_return_code PIDX_set_lossy_compression_accuracy(PIDX_file file, double tolerance);
+
+
+
+///
+/// \brief PIDX_get_lossy_compression_parameter
+/// \param file
+/// \param parameter precision or tolerance of the variable rate zfp modes
+/// \return
+///
+PIDX_return_code PIDX_get_lossy_compression_parameter(PIDX_file file, double *parameter);
+
+
+
 ///
 /// \brief PIDX_set_io_mode
 /// \param file
@@ -547,6 +602,242 @@ PIDX_return_code PIDX_get_variable_pile_length(PIDX_file file, int* var_pipe_len
 
 
 
+///
+/// \brief PIDX_set_pipelined_io Overlaps the file io of a variable pack with the HZ encoding and
+/// aggregation of the next pack (double buffered aggregation buffers). Only used by PIDX_IDX_IO writes.
+/// \param file
+/// \param pipelined_io 1 to enable, 0 (default) to disable
+/// \return
+///
+PIDX_return_code PIDX_set_pipelined_io(PIDX_file file, int pipelined_io);
+
+
+
+///
+/// \brief PIDX_get_pipelined_io
+/// \param file
+/// \param pipelined_io
+/// \return
+///
+PIDX_return_code PIDX_get_pipelined_io(PIDX_file file, int* pipelined_io);
+
+
+
+///
+/// \brief PIDX_set_async_io Makes PIDX_flush return as soon as the aggregator writes are issued.
+/// The binary files stay open and the aggregation buffers stay allocated until the writes are
+/// completed at the next PIDX_flush or at PIDX_close. Only used by PIDX_IDX_IO writes.
+/// \param file
+/// \param async_io 1 to enable, 0 (default) to disable
+/// \return
+///
+PIDX_return_code PIDX_set_async_io(PIDX_file file, int async_io);
+
+
+
+///
+/// \brief PIDX_get_async_io
+/// \param file
+/// \param async_io
+/// \return
+///
+PIDX_return_code PIDX_get_async_io(PIDX_file file, int* async_io);
+
+
+
+///
+/// \brief PIDX_set_aggregation_mode Selects how the HZ encoded samples are moved to the aggregators.
+/// PIDX_AGG_ONE_SIDED (default) puts every run into a MPI window of the aggregator, PIDX_AGG_ALLTOALLV
+/// and PIDX_AGG_NEIGHBOR_ALLTOALLV send all the runs for an aggregator in one message, the latter only
+/// between processes and their aggregators. Used by PIDX_IDX_IO writes and reads.
+/// \param file
+/// \param aggregation_mode
+/// \return
+///
+PIDX_return_code PIDX_set_aggregation_mode(PIDX_file file, int aggregation_mode);
+
+
+
+///
+/// \brief PIDX_get_aggregation_mode
+/// \param file
+/// \param aggregation_mode
+/// \return
+///
+PIDX_return_code PIDX_get_aggregation_mode(PIDX_file file, int* aggregation_mode);
+
+
+
+///
+/// \brief PIDX_set_aggregator_placement Selects where the aggregators are placed. PIDX_AGG_PLACEMENT_UNIFORM
+/// (default) places them at regular intervals of the partition ranks. PIDX_AGG_PLACEMENT_NODE_AWARE spreads them
+/// across the nodes (MPI_COMM_TYPE_SHARED) so that every node receives about the same number of bytes, and
+/// avoids processes that already aggregate for another aggregation group.
+/// \param file
+/// \param aggregator_placement
+/// \return
+///
+PIDX_return_code PIDX_set_aggregator_placement(PIDX_file file, int aggregator_placement);
+
+
+
+///
+/// \brief PIDX_get_aggregator_placement
+/// \param file
+/// \param aggregator_placement
+/// \return
+///
+PIDX_return_code PIDX_get_aggregator_placement(PIDX_file file, int* aggregator_placement);
+
+
+
+///
+/// \brief PIDX_get_aggregator_count Number of aggregators in the aggregator map, the latest placement of the
+/// aggregators of every variable written or read, as seen from the partition of the calling process
+/// \param file
+/// \param aggregator_count
+/// \return
+///
+PIDX_return_code PIDX_get_aggregator_count(PIDX_file file, int* aggregator_count);
+
+
+
+///
+/// \brief PIDX_get_aggregator_map Copies the aggregator map into aggregator_map (PIDX_get_aggregator_count entries)
+/// \param file
+/// \param aggregator_map
+/// \return
+///
+PIDX_return_code PIDX_get_aggregator_map(PIDX_file file, PIDX_aggregator* aggregator_map);
+
+
+
+///
+/// \brief PIDX_set_steady_state_io For runs whose decomposition does not change between time steps: the
+/// restructuring plan (with its persistent requests), the aggregator assignment, the aggregation buffers and the
+/// MPI windows are created on the first flush and reused by the following ones as long as the patches, the block
+/// layout and the partition stay the same. They are kept in the meta data cache (PIDX_set_meta_data_cache) across
+/// time steps and freed by PIDX_free_metadata_cache, which then has to be called by all processes. Without a cache
+/// they are kept until PIDX_close. The aggregation state is not reused with PIDX_set_async_io.
+/// \param file
+/// \param steady_state_io 1 to enable, 0 (default) to disable
+/// \return
+///
+PIDX_return_code PIDX_set_steady_state_io(PIDX_file file, int steady_state_io);
+
+
+
+///
+/// \brief PIDX_get_steady_state_io
+/// \param file
+/// \param steady_state_io
+/// \return
+///
+PIDX_return_code PIDX_get_steady_state_io(PIDX_file file, int* steady_state_io);
+
+
+
+///
+/// \brief PIDX_set_collective_raw_read Two phase reads of raw datasets (PIDX_RAW_IO), e.g. for restarts on a
+/// different number of processes. With reader_count > 0, that many processes (spread over the communicator)
+/// read whole writer files with one large read each, and send every process the parts of them it needs.
+/// With 0 (default) every process reads the parts of the writer files it needs itself.
+/// \param file
+/// \param reader_count
+/// \return
+///
+PIDX_return_code PIDX_set_collective_raw_read(PIDX_file file, int reader_count);
+
+
+
+///
+/// \brief PIDX_get_collective_raw_read
+/// \param file
+/// \param reader_count
+/// \return
+///
+PIDX_return_code PIDX_get_collective_raw_read(PIDX_file file, int* reader_count);
+
+
+
+///
+/// \brief PIDX_set_shared_file_count Particle (PIDX_PARTICLE_IO) and raw (PIDX_RAW_IO) writes create one file per
+/// process and patch. With file_count > 0 the processes are split in file_count groups of consecutive ranks, and
+/// an aggregator per group writes the data of the whole group into one shared file, with a directory of its
+/// (process, patch, variable) extents. The OFFSET_SIZE (particle) and _INDEX (raw) metadata then point into the
+/// shared files. Reads find the layout in the .idx file.
+/// \param file
+/// \param file_count 0 (default) for one file per process and patch
+/// \return
+///
+PIDX_return_code PIDX_set_shared_file_count(PIDX_file file, int file_count);
+
+
+
+///
+/// \brief PIDX_get_shared_file_count
+/// \param file
+/// \param file_count
+/// \return
+///
+PIDX_return_code PIDX_get_shared_file_count(PIDX_file file, int* file_count);
+
+
+
+///
+/// \brief PIDX_set_thread_count Sets the number of threads each process uses to HZ encode
+/// (and decode) and zfp compress its restructured super patch. Has no effect if PIDX is built without OpenMP.
+/// \param file
+/// \param thread_count 1 (default) for serial encoding
+/// \return
+///
+PIDX_return_code PIDX_set_thread_count(PIDX_file file, int thread_count);
+
+
+
+///
+/// \brief PIDX_get_thread_count
+/// \param file
+/// \param thread_count
+/// \return
+///
+PIDX_return_code PIDX_get_thread_count(PIDX_file file, int* thread_count);
+
+
+
+///
+/// \brief PIDX_set_memory_budget Sets the number of bytes each process may hold during a write (simulation
+/// patches included). The restructuring box, the number of variables worked at once (variable pipe length) and
+/// the levels aggregated are then chosen to fit in the budget, whenever the process counts allow it.
+/// \param file
+/// \param bytes 0 (default) for no budget
+/// \return
+///
+PIDX_return_code PIDX_set_memory_budget(PIDX_file file, uint64_t bytes);
+
+
+
+///
+/// \brief PIDX_get_memory_budget
+/// \param file
+/// \param bytes
+/// \return
+///
+PIDX_return_code PIDX_get_memory_budget(PIDX_file file, uint64_t* bytes);
+
+
+
+///
+/// \brief PIDX_get_memory_high_water_mark Gets the peak of the bytes the calling process held at once
+/// during the last flush of the file (simulation patches, restructuring, chunking, HZ and aggregation buffers)
+/// \param file
+/// \param bytes
+/// \return
+///
+PIDX_return_code PIDX_get_memory_high_water_mark(PIDX_file file, uint64_t* bytes);
+
+
+
 ///
 /// \brief PIDX_save_big_endian
 /// \param file
@@ -732,6 +1023,23 @@ PIDX_return_code PIDX_variable_read_particle_data_layout(PIDX_variable variable,
 
 
 
+///
+/// \brief PIDX_variable_read_particle_data_layout_lod Same as PIDX_variable_read_particle_data_layout, but reads only
+/// the particles of the levels of detail 0 to level (see PIDX_set_particles_lod_level_count). Every level roughly
+/// doubles the number of particles read, the finest level completes the dataset.
+/// \param variable
+/// \param offset
+/// \param dims
+/// \param write_to_this_buffer
+/// \param number_of_particles
+/// \param level finest level of detail to read, PIDX_PARTICLES_ALL_LOD_LEVELS reads all the particles
+/// \param data_layout
+/// \return
+///
+PIDX_return_code PIDX_variable_read_particle_data_layout_lod(PIDX_variable variable, PIDX_physical_point offset, PIDX_physical_point dims, void** write_to_this_buffer, uint64_t* number_of_particles, int level, PIDX_data_layout data_layout);
+
+
+
 
 ///
 /// \brief PIDX_read_next_variable Read function used for restarting a simulation from checkpoint dump.
@@ -803,7 +1111,10 @@ PIDX_return_code PIDX_get_current_variable(PIDX_file file, PIDX_variable* variab
 
 
 ///
-/// \brief PIDX_read_variable
+/// \brief PIDX_read_variable Reads the box [offset, offset + dims) of a variable of the current time step from
+/// the calling process alone, without any communication. Only the blocks holding samples of the box are read.
+/// With PIDX_set_resolution the finest levels are left out and the buffer holds the coarser samples of the box,
+/// sized by PIDX_get_box_for_resolution. Supported for uncompressed IDX datasets.
 /// \param file
 /// \param variable
 /// \param offset
@@ -816,6 +1127,51 @@ PIDX_return_code PIDX_read_variable(PIDX_file file, PIDX_variable variable, PIDX
 
 
 
+typedef idx_box_query PIDX_progressive_read;
+
+///
+/// \brief PIDX_progressive_read_begin Starts a coarse to fine read of the box [offset, offset + dims) of a variable
+/// of the current time step, from the calling process alone. The buffer is the one PIDX_read_variable fills at the
+/// resolution set with PIDX_set_resolution. Nothing is read until PIDX_progressive_read_next.
+/// \param file
+/// \param variable
+/// \param offset
+/// \param dims
+/// \param dst_buffer
+/// \param layout
+/// \param read handle of the read
+/// \return
+///
+PIDX_return_code PIDX_progressive_read_begin(PIDX_file file, PIDX_variable variable, PIDX_point offset, PIDX_point dims, void* dst_buffer, PIDX_data_layout layout, PIDX_progressive_read* read);
+
+
+
+///
+/// \brief PIDX_progressive_read_next Reads the next HZ level of the box into the buffer (the coarsest levels,
+/// stored together in the first block, come all in the first call). Levels already read are never read again.
+/// After the call the buffer holds valid samples along every axis at every buffer_stride-th sample starting from
+/// buffer_offset, the read is complete when level equals level_count.
+/// \param read
+/// \param level number of HZ levels now in the buffer
+/// \param level_count number of HZ levels of the read
+/// \param buffer_offset first valid sample of the buffer along every axis
+/// \param buffer_stride distance between the valid samples of the buffer along every axis
+/// \return
+///
+PIDX_return_code PIDX_progressive_read_next(PIDX_progressive_read read, int* level, int* level_count, PIDX_point buffer_offset, PIDX_point buffer_stride);
+
+
+
+///
+/// \brief PIDX_progressive_read_end Closes the files opened by the read and frees it, the read can be ended at
+/// any level
+/// \param read
+/// \return
+///
+PIDX_return_code PIDX_progressive_read_end(PIDX_progressive_read read);
+
+
+
 ///
 /// \brief PIDX_write_variable
 /// \param file
@@ -58,6 +58,28 @@ PIDX_return_code PIDX_flush(PIDX_file file)
     return PIDX_err_variable;
   }
 
+  // complete the aggregator writes left in flight by the previous flush (async io)
+  if (file_io_complete_deferred(file->idx) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_flush;
+  }
+
+  // variables only read through PIDX_read_variable have no patches left for the collective read
+  if (file->flags == PIDX_MODE_RDONLY)
+  {
+    int patch_count = 0;
+    for (int j = file->local_variable_index; j < file->local_variable_index + file->local_variable_count; j++)
+      patch_count = patch_count + file->idx->variable[j]->sim_patch_count;
+
+    if (patch_count == 0)
+    {
+      file->local_variable_index = file->variable_index_tracker;
+      file->local_variable_count = 0;
+      return PIDX_success;
+    }
+  }
+
   file->io = PIDX_io_init(file->idx, file->idx_c, file->idx_dbg, file->meta_data_cache, file->idx_b, file->restructured_grid, file->time, file->fs_block_size, file->variable_index_tracker);
   if (file->io == NULL)
   {
@@ -134,6 +156,17 @@ PIDX_return_code PIDX_close(PIDX_file file)
     return PIDX_err_io;
   }
 
+  // complete the aggregator writes still in flight (async io) and close the binary files
+  if (file->idx->async_io_state != NULL)
+  {
+    if (PIDX_file_io_async_destroy(file->idx->async_io_state) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+    file->idx->async_io_state = NULL;
+  }
+
   PIDX_time time = file->time;
   time->sim_end = PIDX_get_time();
 
@@ -152,6 +185,23 @@ PIDX_return_code PIDX_close(PIDX_file file)
 
   PIDX_dump_state_finalize(file);
 
+  free(file->idx->compression_scratch);
+  free(file->idx->aggregator_map);
+  if (PIDX_agg_cache_free(file->idx->agg_cache) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_close;
+  }
+  if (PIDX_agg_node_map_free(file->idx->agg_node_map) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_close;
+  }
+  if (PIDX_idx_rst_plan_free(file->idx->idx_rst_plan) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_close;
+  }
   free(file->idx);
   free(file->restructured_grid);
   free(file->time);
@@ -227,6 +277,12 @@ static void PIDX_debug_output(PIDX_file file, int svi, int evi, int io_type)
   double max_time = total_time;
   MPI_Allreduce(&total_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, file->idx_c->simulation_comm);
 
+  // peaks of the memory held in every phase and at once, by the process holding the most
+  uint64_t memory[PIDX_MEMORY_PHASE_COUNT + 1];
+  memcpy(memory, time->memory_peak, sizeof(time->memory_peak));
+  memory[PIDX_MEMORY_PHASE_COUNT] = time->memory_high_water_mark;
+  MPI_Allreduce(MPI_IN_PLACE, memory, PIDX_MEMORY_PHASE_COUNT + 1, MPI_UINT64_T, MPI_MAX, file->idx_c->simulation_comm);
+
   if (io_type == PIDX_IDX_IO || io_type == PIDX_LOCAL_PARTITION_IDX_IO)
   {
     if (max_time == total_time)
@@ -250,7 +306,7 @@ static void PIDX_debug_output(PIDX_file file, int svi, int evi, int io_type)
       double hz_init = 0, hz_meta_data = 0, hz_buffer = 0, hz = 0, hz_compress = 0, hz_buffer_free = 0, hz_cleanup = 0, hz_total = 0, hz_all = 0;
       double chunk_init = 0, chunk_meta = 0, chunk_buffer = 0, chunk = 0, chunk_buffer_free = 0, chunk_cleanup = 0, chunk_total = 0, chunk_all = 0;
       double compression_init = 0, compression = 0, compression_total = 0, compression_all = 0;
-      double io = 0, io_all = 0;
+      double io = 0, io_all = 0, io_wait_all = 0, io_hidden_all = 0;
 
       for (int si = svi; si < evi; si++)
       {
@@ -407,6 +463,20 @@ static void PIDX_debug_output(PIDX_file file, int svi, int evi, int io_type)
 #if DETAIL_OUTPUT
         fprintf(stderr, "IO [%d]        :[%d] %.4f\n", file->idx->variable_count, si, io);
 #endif
+
+        // pipelined io: time spent waiting for the writes is on the critical path, the time
+        // between issuing and waiting is hidden behind the hz encoding and aggregation of the next pack
+        if (file->idx->pipelined_io == 1 && file->idx->async_io == 0 && file->idx->variable_tracker[si] == 1)
+        {
+          double io_wait = time->io_wait_end[si] - time->io_wait_start[si];
+          double io_hidden = time->io_wait_start[si] - time->io_end[si];
+          io_all = io_all + io_wait;
+          io_wait_all = io_wait_all + io_wait;
+          io_hidden_all = io_hidden_all + io_hidden;
+#if DETAIL_OUTPUT
+          fprintf(stderr, "IO WAIT       :[%d] %.4f hidden %.4f\n", si, io_wait, io_hidden);
+#endif
+        }
       }
 
       grp_rst_hz_chunk_agg_io = grp_rst_hz_chunk_agg_io + rst_all + hz_all + hz_io_all + chunk_all + compression_all + agg_all + io_all;
@@ -417,6 +487,18 @@ static void PIDX_debug_output(PIDX_file file, int svi, int evi, int io_type)
 
       fprintf(stderr, "[%s %d %d (%d %d %d)] IRPICCHHAI      :[%.4f + %.4f + %.4f + %.4f + %.4f + %.4f + %.4f + %.4f + %.4f + %.4f = %.4f] + %.4f [%.4f %.4f]\n", file->idx->filename, file->idx->current_time_step, (evi - svi), (int)file->idx->bounds[0], (int)file->idx->bounds[1], (int)file->idx->bounds[2], pre_group_total, rst_all, partition_time, post_group_total, chunk_all, compression_all, hz_all, hz_io_all, agg_all, io_all, grp_rst_hz_chunk_agg_io, (time->SX - time->sim_start), grp_rst_hz_chunk_agg_io + (time->SX - time->sim_start), max_time);
 #endif
+
+      if (file->idx->pipelined_io == 1 && file->idx->async_io == 0)
+        fprintf(stderr, "[%s %d] PIPELINE [IO issue + IO wait] [%.4f + %.4f] IO hidden behind HZ + AGG %.4f\n", file->idx->filename, file->idx->current_time_step, io_all - io_wait_all, io_wait_all, io_hidden_all);
+
+      if (time->hz_cache_hit_count + time->hz_cache_miss_count != 0)
+        fprintf(stderr, "[%s %d] HZ CACHE [hit + miss] [%d + %d]\n", file->idx->filename, file->idx->current_time_step, time->hz_cache_hit_count, time->hz_cache_miss_count);
+
+      if (memory[PIDX_MEMORY_PHASE_COUNT] != 0)
+      {
+        double mib = 1024.0 * 1024.0;
+        fprintf(stderr, "[%s %d] MEMORY MiB [sim + rst + chunk + hz + agg] [%.2f + %.2f + %.2f + %.2f + %.2f] peak %.2f budget %.2f\n", file->idx->filename, file->idx->current_time_step, memory[PIDX_MEMORY_SIM] / mib, memory[PIDX_MEMORY_RST] / mib, memory[PIDX_MEMORY_CHUNK] / mib, memory[PIDX_MEMORY_HZ] / mib, memory[PIDX_MEMORY_AGG] / mib, memory[PIDX_MEMORY_PHASE_COUNT] / mib, file->idx->memory_budget / mib);
+      }
     }
   }
   else if (io_type == PIDX_PARTICLE_IO)
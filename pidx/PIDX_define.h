@@ -47,7 +47,7 @@ extern "C" {
 
 #undef PARTICLE_OPTIMIZED
 
-#define PIDX_CURR_METADATA_VERSION "6.1"
+#define PIDX_CURR_METADATA_VERSION "6.2"
   
 #define PIDX_MAX_DIMENSIONS 3
 #define MULTI_BOX 0
@@ -102,6 +102,36 @@ enum boundary_type {power_two_block = 1,
 #define PIDX_CHUNKING_ONLY 1
 #define PIDX_CHUNKING_ZFP 2
 
+// Variable rate zfp: every 4x4x4 chunk is coded to a fixed precision (bits) or to a fixed absolute error tolerance,
+// the compressed chunks of a block are packed densely by the aggregators and the block sizes recorded in the header
+#define PIDX_CHUNKING_ZFP_PRECISION 3
+#define PIDX_CHUNKING_ZFP_ACCURACY 4
+
+// Aggregation backends: one sided MPI_Put/MPI_Get into a window per aggregator, or two sided where
+// every process packs all its runs for an aggregator into one message of a MPI_Alltoallv (over the
+// partition) or a MPI_Neighbor_alltoallv (over the graph of processes and their aggregators)
+#define PIDX_AGG_ONE_SIDED 0
+#define PIDX_AGG_ALLTOALLV 1
+#define PIDX_AGG_NEIGHBOR_ALLTOALLV 2
+
+// Aggregator placement: every aggregator_interval ranks of the partition, or spread across the nodes
+// (MPI_COMM_TYPE_SHARED) balancing the bytes every node receives
+#define PIDX_AGG_PLACEMENT_UNIFORM 0
+#define PIDX_AGG_PLACEMENT_NODE_AWARE 1
+
+// Phases of the write holding buffers (memory accounting, see PIDX_set_memory_budget)
+#define PIDX_MEMORY_SIM                          0    // simulation patches
+#define PIDX_MEMORY_RST                          1    // restructured super patches (and their staging buffers)
+#define PIDX_MEMORY_CHUNK                        2    // chunked super patches
+#define PIDX_MEMORY_HZ                           3    // HZ buffers
+#define PIDX_MEMORY_AGG                          4    // aggregation buffers
+#define PIDX_MEMORY_PHASE_COUNT                  5
+
+// Levels of detail of the particle files (see PIDX_set_particles_lod_level_count), reads
+// with level PIDX_PARTICLES_ALL_LOD_LEVELS return every particle of the box
+#define PIDX_PARTICLES_MAX_LOD_LEVELS 32
+#define PIDX_PARTICLES_ALL_LOD_LEVELS -1
+
 // Data in buffer is in row order
 #define PIDX_row_major                           0
 
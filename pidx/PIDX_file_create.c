@@ -174,10 +174,12 @@ PIDX_return_code PIDX_file_create(const char* filename, PIDX_flags flags, PIDX_a
 
   (*file)->idx->compression_factor = 1;
   (*file)->idx->compression_bit_rate = 64;
+  (*file)->idx->compression_parameter = 0;
   for (i=0;i<PIDX_MAX_DIMENSIONS;i++)
     (*file)->idx->chunk_size[i] = 1;
 
   (*file)->idx->particles_position_variable_index = 0;
+  (*file)->idx->particles_lod_level_count = 0;
   
   (*file)->idx->maxh = 0;
   (*file)->idx->max_file_count = 0;
@@ -70,8 +70,8 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
   memset((*file)->time, 0, sizeof (*((*file)->time)));
   (*file)->time->sim_start = PIDX_get_time();
 
-  (*file)->meta_data_cache = malloc(sizeof (*((*file)->meta_data_cache)));
-  memset((*file)->meta_data_cache, 0, sizeof (*((*file)->meta_data_cache)));
+  // reads only cache HZ indices if the application sets a cache (PIDX_set_meta_data_cache)
+  (*file)->meta_data_cache = NULL;
 
   (*file)->restructured_grid = malloc(sizeof(*(*file)->restructured_grid ));
   memset((*file)->restructured_grid , 0, sizeof(*(*file)->restructured_grid));
@@ -130,6 +130,7 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
   memset((*file)->idx->bitSequence, 0, 512);
 
   (*file)->idx->compression_bit_rate = 64;
+  (*file)->idx->compression_parameter = 0;
   (*file)->idx->compression_factor = 1;
   for (i=0;i<PIDX_MAX_DIMENSIONS;i++)
     (*file)->idx->chunk_size[i] = 1;
@@ -199,6 +200,7 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
   MPI_Bcast((*file)->idx->partition_size, PIDX_MAX_DIMENSIONS, MPI_INT, 0, (*file)->idx_c->simulation_comm);
   MPI_Bcast((*file)->idx->partition_offset, PIDX_MAX_DIMENSIONS, MPI_INT, 0, (*file)->idx_c->simulation_comm);
   MPI_Bcast(&((*file)->idx->compression_bit_rate), 1, MPI_FLOAT, 0, (*file)->idx_c->simulation_comm);
+  MPI_Bcast(&((*file)->idx->compression_parameter), 1, MPI_DOUBLE, 0, (*file)->idx_c->simulation_comm);
   MPI_Bcast(&((*file)->idx->compression_type), 1, MPI_INT, 0, (*file)->idx_c->simulation_comm);
   MPI_Bcast(&((*file)->idx->io_type), 1, MPI_INT, 0, (*file)->idx_c->simulation_comm);
   MPI_Bcast(&((*file)->fs_block_size), 1, MPI_INT, 0, (*file)->idx_c->simulation_comm);
@@ -235,7 +237,11 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
     (*file)->idx->samples_per_block = (int)pow(2, (*file)->idx->bits_per_block);
   
   if ((*file)->idx->io_type != PIDX_PARTICLE_IO || (*file)->idx->io_type != PIDX_RST_PARTICLE_IO)
+  {
     MPI_Bcast(&((*file)->idx->particles_position_variable_index), 1, MPI_INT, 0, (*file)->idx_c->simulation_comm);
+    MPI_Bcast(&((*file)->idx->particles_lod_level_count), 1, MPI_INT, 0, (*file)->idx_c->simulation_comm);
+  }
+  MPI_Bcast(&((*file)->idx->shared_file_count), 1, MPI_INT, 0, (*file)->idx_c->simulation_comm);
 
   if ((*file)->idx_c->simulation_rank != 0)
   {
@@ -327,8 +333,8 @@ PIDX_return_code PIDX_serial_file_open(const char* filename, PIDX_flags flags, P
   memset((*file)->time, 0, sizeof (*((*file)->time)));
   (*file)->time->sim_start = 0;
   
-  (*file)->meta_data_cache = malloc(sizeof (*((*file)->meta_data_cache)));
-  memset((*file)->meta_data_cache, 0, sizeof (*((*file)->meta_data_cache)));
+  // reads only cache HZ indices if the application sets a cache (PIDX_set_meta_data_cache)
+  (*file)->meta_data_cache = NULL;
   
   (*file)->restructured_grid = malloc(sizeof(*(*file)->restructured_grid ));
   memset((*file)->restructured_grid , 0, sizeof(*(*file)->restructured_grid));
@@ -383,6 +389,7 @@ PIDX_return_code PIDX_serial_file_open(const char* filename, PIDX_flags flags, P
   memset((*file)->idx->bitSequence, 0, 512);
 
   (*file)->idx->compression_bit_rate = 64;
+  (*file)->idx->compression_parameter = 0;
   (*file)->idx->compression_factor = 1;
   for (i=0;i<PIDX_MAX_DIMENSIONS;i++)
     (*file)->idx->chunk_size[i] = 1;
@@ -113,6 +113,31 @@ PIDX_return_code PIDX_set_particles_position_variable_index(PIDX_file file, uint
 }
 
 
+PIDX_return_code PIDX_set_particles_lod_level_count(PIDX_file file, int level_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (level_count < 0 || level_count > PIDX_PARTICLES_MAX_LOD_LEVELS)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->particles_lod_level_count = level_count;
+
+  return PIDX_success;
+}
+
+
+PIDX_return_code PIDX_get_particles_lod_level_count(PIDX_file file, int* level_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *level_count = file->idx->particles_lod_level_count;
+
+  return PIDX_success;
+}
+
+
 PIDX_return_code PIDX_set_physical_dims(PIDX_file file, PIDX_physical_point dims)
 {
   if (!file)
@@ -247,138 +272,14 @@ PIDX_return_code PIDX_get_resolution(PIDX_file file, int *hz_to)
 
 PIDX_return_code PIDX_get_box_for_resolution(PIDX_file file, int resolution_to, PIDX_point offset, PIDX_point size, uint64_t* buffer_size)
 {
-  // Bounding box of the super patch the process is holding
-  int **restructured_box;
-  
-  // For every HZ level what is the starting xyz coordinate
-  int **start_xyz_per_hz_level;
-  
-  // For every HZ level what is the ending xyz coordinate
-  int **end_xyz_per_hz_level;
-  
-  int maxH = strlen(file->idx->bitSequence);//file->idx->maxh;
-  
-  restructured_box = (int**) malloc(2 * sizeof (int*));
-  memset(restructured_box, 0, 2 * sizeof (int*));
-  restructured_box[0] = (int*) malloc(PIDX_MAX_DIMENSIONS * sizeof (int));
-  restructured_box[1] = (int*) malloc(PIDX_MAX_DIMENSIONS * sizeof (int));
-  memset(restructured_box[0], 0, PIDX_MAX_DIMENSIONS * sizeof (int));
-  memset(restructured_box[1], 0, PIDX_MAX_DIMENSIONS * sizeof (int));
-  
-  int** outputBox = (int**)malloc(2* sizeof(int*));
-  memset(outputBox, 0, 2* sizeof(int*));
-  outputBox[0] = (int*)malloc(PIDX_MAX_DIMENSIONS * sizeof(int));
-  outputBox[1] = (int*)malloc(PIDX_MAX_DIMENSIONS * sizeof(int));
-  memset(outputBox[0], 0, PIDX_MAX_DIMENSIONS * sizeof(int));
-  memset(outputBox[1], 0, PIDX_MAX_DIMENSIONS * sizeof(int));
-  
-  int output_set = 0;
-  
-  for (uint32_t d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-  {
-    restructured_box[0][d] = offset[d];
-    restructured_box[1][d] = offset[d] + size[d] - 1;
-  }
-  
-  int** nsamples_per_level;
-  nsamples_per_level = malloc(sizeof (int*) * maxH);
-  memset(nsamples_per_level, 0, sizeof (int*) * maxH);
-  
-  uint64_t* start_hz_index = malloc(sizeof (uint64_t) * maxH);
-  uint64_t* end_hz_index = malloc(sizeof (uint64_t) * maxH);
-  memset(start_hz_index, 0, sizeof (uint64_t) * maxH);
-  memset(end_hz_index, 0, sizeof (uint64_t) * maxH);
-
-  start_xyz_per_hz_level = malloc(sizeof (int*) * maxH);
-  end_xyz_per_hz_level = malloc(sizeof (int*) * maxH);
-  memset(start_xyz_per_hz_level, 0, sizeof (int*) * maxH);
-  memset(end_xyz_per_hz_level, 0, sizeof (int*) * maxH);
-  
-  for (uint32_t j = 0; j < maxH; j++)
-  {
-    start_xyz_per_hz_level[j] = malloc(sizeof (int) * PIDX_MAX_DIMENSIONS);
-    memset(start_xyz_per_hz_level[j], 0, sizeof (int) * PIDX_MAX_DIMENSIONS);
-    
-    end_xyz_per_hz_level[j] = malloc(sizeof (int) * PIDX_MAX_DIMENSIONS);
-    memset(end_xyz_per_hz_level[j], 0, sizeof (int) * PIDX_MAX_DIMENSIONS);
-    
-    nsamples_per_level[j] = malloc(sizeof (int) * PIDX_MAX_DIMENSIONS);
-    memset(nsamples_per_level[j], 0, sizeof (int) * PIDX_MAX_DIMENSIONS);
-  }
-  
-  buffer_size[0] = 1;
-  buffer_size[1] = 1;
-  buffer_size[2] = 1;
-  
-  // In case we want to write a subset of the resolution and not all levels
-  for (uint32_t j = 0; j < maxH - resolution_to; j++)
-  {
-    int** alignedBox = (int**)malloc(2* sizeof(int*));
-    memset(alignedBox, 0, 2* sizeof(int*));
-    alignedBox[0] = (int*)malloc(PIDX_MAX_DIMENSIONS * sizeof(int));
-    alignedBox[1] = (int*)malloc(PIDX_MAX_DIMENSIONS * sizeof(int));
-    memset(alignedBox[0], 0, PIDX_MAX_DIMENSIONS * sizeof(int));
-    memset(alignedBox[1], 0, PIDX_MAX_DIMENSIONS * sizeof(int));
-    
-    // Visus API call to compute start and end HZ for every HZ level
-    int ret = AlignBox((maxH - 1), j, file->idx->bitPattern, restructured_box, start_xyz_per_hz_level, end_xyz_per_hz_level, nsamples_per_level, alignedBox);
-    
-    if(ret == PIDX_success)
-    {
-      //printf("%d BOX %d %d %d - %d %d %d\n", file->idx_c->simulation_rank, alignedBox[0][0], alignedBox[0][1], alignedBox[0][2],alignedBox[1][0], alignedBox[1][1], alignedBox[1][2]);
-      
-      if(output_set==0)
-      {
-        for (uint32_t d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-        {
-          outputBox[0][d] = alignedBox[0][d];
-          outputBox[1][d] = alignedBox[1][d];
-        }
-        output_set = 1;
-      }
-    
-      GetBoxUnion(outputBox, alignedBox, outputBox);
-      freeBox(alignedBox);
-    }
-    
-//    if (file->idx_c->simulation_rank == 3)
-     printf("%d: Level %d : %d %d %d\n", file->idx_c->simulation_rank, j, nsamples_per_level[j][0], nsamples_per_level[j][1], nsamples_per_level[j][2]);
-
-//    printf("Level %d : %d %d %d start %lld %lld %lld end %lld %lld %lld\n", j, nsamples_per_level[j][0], nsamples_per_level[j][1], nsamples_per_level[j][2], start_xyz_per_hz_level[0], start_xyz_per_hz_level[1],start_xyz_per_hz_level[2], end_xyz_per_hz_level[0],end_xyz_per_hz_level[1],end_xyz_per_hz_level[2]);
-    
-    //*buffer_size = *buffer_size + nsamples_per_level[j][0]*nsamples_per_level[j][1]*nsamples_per_level[j][2];
-    
-    char c = file->idx->bitSequence[j];
-    
-    if(c=='0')
-      buffer_size[0] += nsamples_per_level[j][0];
-    else if(c=='1')
-      buffer_size[1] += nsamples_per_level[j][1];
-    else if(c=='2')
-      buffer_size[2] += nsamples_per_level[j][2];
-    
-    //printf("buff size %lld\n", *buffer_size);
-    
-  }
-  
-  printf("%d: Output box %d %d %d - %d %d %d\n", file->idx_c->simulation_rank, outputBox[0][0], outputBox[0][1], outputBox[0][2], outputBox[1][0], outputBox[1][1], outputBox[1][2]);
-
-  
-  for (uint32_t j = 0; j < maxH; j++)
-  {
-    free(start_xyz_per_hz_level[j]);
-    free(end_xyz_per_hz_level[j]);
-    free(nsamples_per_level[j]);
-  }
-  
-  free(start_xyz_per_hz_level);
-  free(end_xyz_per_hz_level);
-  free(nsamples_per_level);
+  if (file == NULL)
+    return PIDX_err_file;
 
-  freeBox(restructured_box);
-  freeBox(outputBox);
+  if (resolution_to < 0)
+    return PIDX_err_size;
 
-  return PIDX_success;
+  // Samples of the box along every axis once the resolution_to finest levels are left out
+  return idx_box_query_size(file->idx, resolution_to, offset, size, buffer_size);
 }
 
 
@@ -498,15 +399,21 @@ PIDX_return_code PIDX_set_compression_type(PIDX_file file, int compression_type)
   if (!file)
     return PIDX_err_file;
 
-  if (compression_type != PIDX_NO_COMPRESSION && compression_type != PIDX_CHUNKING_ONLY && compression_type != PIDX_CHUNKING_ZFP)
+  if (compression_type != PIDX_NO_COMPRESSION && compression_type != PIDX_CHUNKING_ONLY && compression_type != PIDX_CHUNKING_ZFP && compression_type != PIDX_CHUNKING_ZFP_PRECISION && compression_type != PIDX_CHUNKING_ZFP_ACCURACY)
     return PIDX_err_unsupported_compression_type;
 
   file->idx->compression_type = compression_type;
 
   if (file->idx->compression_type == PIDX_NO_COMPRESSION)
     return PIDX_success;
-  else if (file->idx->compression_type == PIDX_CHUNKING_ONLY || file->idx->compression_type == PIDX_CHUNKING_ZFP)
+  else
   {
+    // defaults of the variable rate modes, see PIDX_set_lossy_compression_precision/accuracy
+    if (file->idx->compression_type == PIDX_CHUNKING_ZFP_PRECISION)
+      file->idx->compression_parameter = 32;
+    else if (file->idx->compression_type == PIDX_CHUNKING_ZFP_ACCURACY)
+      file->idx->compression_parameter = 1e-6;
+
     file->idx->chunk_size[0] = 4;
     file->idx->chunk_size[1] = 4;
     file->idx->chunk_size[2] = 4;
@@ -669,6 +576,56 @@ PIDX_return_code PIDX_get_lossy_compression_bit_rate(PIDX_file file, int *compre
 
 
 
+PIDX_return_code PIDX_set_lossy_compression_precision(PIDX_file file, int precision)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (file->idx->compression_type != PIDX_CHUNKING_ZFP_PRECISION)
+    return PIDX_err_unsupported_compression_type;
+
+  if (precision < 1 || precision > 64)
+    return PIDX_err_unsupported_flags;
+
+  // the compressed chunks keep the slot of the uncompressed chunk until they are packed at file io,
+  // so blocks_per_file and bits_per_block stay as they are (compression_factor is 1)
+  file->idx->compression_parameter = precision;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_lossy_compression_accuracy(PIDX_file file, double tolerance)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (file->idx->compression_type != PIDX_CHUNKING_ZFP_ACCURACY)
+    return PIDX_err_unsupported_compression_type;
+
+  if (!(tolerance > 0))
+    return PIDX_err_unsupported_flags;
+
+  file->idx->compression_parameter = tolerance;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_lossy_compression_parameter(PIDX_file file, double *parameter)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *parameter = file->idx->compression_parameter;
+
+  return PIDX_success;
+}
+
+
+
 PIDX_return_code PIDX_set_io_mode(PIDX_file file, enum PIDX_io_type io_type)
 {
   if (file == NULL)
@@ -773,6 +730,282 @@ PIDX_return_code PIDX_get_variable_pile_length(PIDX_file file, int* var_pipe_len
 
 
 
+PIDX_return_code PIDX_set_pipelined_io(PIDX_file file, int pipelined_io)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (pipelined_io != 0 && pipelined_io != 1)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->pipelined_io = pipelined_io;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_pipelined_io(PIDX_file file, int* pipelined_io)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *pipelined_io = file->idx->pipelined_io;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_async_io(PIDX_file file, int async_io)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (async_io != 0 && async_io != 1)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->async_io = async_io;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_async_io(PIDX_file file, int* async_io)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *async_io = file->idx->async_io;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_aggregation_mode(PIDX_file file, int aggregation_mode)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (aggregation_mode != PIDX_AGG_ONE_SIDED && aggregation_mode != PIDX_AGG_ALLTOALLV && aggregation_mode != PIDX_AGG_NEIGHBOR_ALLTOALLV)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->aggregation_mode = aggregation_mode;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_aggregation_mode(PIDX_file file, int* aggregation_mode)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *aggregation_mode = file->idx->aggregation_mode;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_aggregator_placement(PIDX_file file, int aggregator_placement)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (aggregator_placement != PIDX_AGG_PLACEMENT_UNIFORM && aggregator_placement != PIDX_AGG_PLACEMENT_NODE_AWARE)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->aggregator_placement = aggregator_placement;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_aggregator_placement(PIDX_file file, int* aggregator_placement)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *aggregator_placement = file->idx->aggregator_placement;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_aggregator_count(PIDX_file file, int* aggregator_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *aggregator_count = file->idx->aggregator_count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_aggregator_map(PIDX_file file, PIDX_aggregator* aggregator_map)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  memcpy(aggregator_map, file->idx->aggregator_map, file->idx->aggregator_count * sizeof(*aggregator_map));
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_steady_state_io(PIDX_file file, int steady_state_io)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (steady_state_io != 0 && steady_state_io != 1)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->steady_state_io = steady_state_io;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_steady_state_io(PIDX_file file, int* steady_state_io)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *steady_state_io = file->idx->steady_state_io;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_collective_raw_read(PIDX_file file, int reader_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (reader_count < 0)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->raw_read_reader_count = reader_count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_collective_raw_read(PIDX_file file, int* reader_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *reader_count = file->idx->raw_read_reader_count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_shared_file_count(PIDX_file file, int file_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (file_count < 0)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->shared_file_count = file_count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_shared_file_count(PIDX_file file, int* file_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *file_count = file->idx->shared_file_count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_thread_count(PIDX_file file, int thread_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (thread_count < 1)
+    return PIDX_err_unsupported_flags;
+
+  file->idx->thread_count = thread_count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_thread_count(PIDX_file file, int* thread_count)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *thread_count = (file->idx->thread_count > 1) ? file->idx->thread_count : 1;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_set_memory_budget(PIDX_file file, uint64_t bytes)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  file->idx->memory_budget = bytes;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_memory_budget(PIDX_file file, uint64_t* bytes)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *bytes = file->idx->memory_budget;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_get_memory_high_water_mark(PIDX_file file, uint64_t* bytes)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  *bytes = file->time->memory_high_water_mark;
+
+  return PIDX_success;
+}
+
+
+
 PIDX_return_code PIDX_save_big_endian(PIDX_file file)
 {
   file->idx->endian = 0;
@@ -134,6 +134,7 @@ extern "C" {
 #include "./io/idx/hz_buffer.h"
 #include "./io/idx/data_aggregation.h"
 #include "./io/idx/file_io.h"
+#include "./io/idx/box_query.h"
 #include "./io/idx/timming.h"
 
 #ifdef __cplusplus
@@ -206,10 +206,20 @@ PIDX_return_code PIDX_get_next_variable(PIDX_file file, PIDX_variable* variable)
 
 
 PIDX_return_code PIDX_variable_read_particle_data_layout(PIDX_variable variable, PIDX_physical_point offset, PIDX_physical_point dims, void** write_to_this_buffer, uint64_t* number_of_particles, PIDX_data_layout data_layout)
+{
+  return PIDX_variable_read_particle_data_layout_lod(variable, offset, dims, write_to_this_buffer, number_of_particles, PIDX_PARTICLES_ALL_LOD_LEVELS, data_layout);
+}
+
+
+
+PIDX_return_code PIDX_variable_read_particle_data_layout_lod(PIDX_variable variable, PIDX_physical_point offset, PIDX_physical_point dims, void** write_to_this_buffer, uint64_t* number_of_particles, int level, PIDX_data_layout data_layout)
 {
   if (!variable)
     return PIDX_err_variable;
 
+  if (level < PIDX_PARTICLES_ALL_LOD_LEVELS)
+    return PIDX_err_variable;
+
   variable->sim_patch[variable->sim_patch_count] = malloc(sizeof(*(variable->sim_patch[variable->sim_patch_count])));
   memset(variable->sim_patch[variable->sim_patch_count], 0, sizeof(*(variable->sim_patch[variable->sim_patch_count])));
 
@@ -220,6 +230,7 @@ PIDX_return_code PIDX_variable_read_particle_data_layout(PIDX_variable variable,
   variable->sim_patch[variable->sim_patch_count]->read_particle_buffer_capacity = 0;
   *number_of_particles = 0;
   variable->sim_patch[variable->sim_patch_count]->read_particle_count = number_of_particles;
+  variable->sim_patch[variable->sim_patch_count]->read_particle_level = level;
 
   variable->data_layout = data_layout;
   variable->sim_patch_count = variable->sim_patch_count + 1;
@@ -375,9 +386,92 @@ PIDX_return_code PIDX_get_current_variable(PIDX_file file, PIDX_variable* variab
 
 
 
+static int variable_index(PIDX_file file, PIDX_variable variable)
+{
+  for (int vi = 0; vi < file->idx->variable_count; vi++)
+  {
+    if (file->idx->variable[vi] == variable || strcmp(file->idx->variable[vi]->var_name, variable->var_name) == 0)
+      return vi;
+  }
+
+  return -1;
+}
+
+
+
 PIDX_return_code PIDX_read_variable(PIDX_file file, PIDX_variable variable, PIDX_point offset, PIDX_point dims, const void* read_from_this_buffer, PIDX_data_layout layout)
 {
-  return PIDX_err_not_implemented;
+  PIDX_progressive_read read;
+  PIDX_return_code ret = PIDX_progressive_read_begin(file, variable, offset, dims, (void*)read_from_this_buffer, layout, &read);
+  if (ret != PIDX_success)
+    return ret;
+
+  ret = idx_box_query_read_levels(read, file->idx->maxh);
+  if (ret != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    idx_box_query_destroy(read);
+    return ret;
+  }
+
+  return idx_box_query_destroy(read);
+}
+
+
+
+PIDX_return_code PIDX_progressive_read_begin(PIDX_file file, PIDX_variable variable, PIDX_point offset, PIDX_point dims, void* dst_buffer, PIDX_data_layout layout, PIDX_progressive_read* read)
+{
+  if (!file)
+    return PIDX_err_file;
+
+  if (!variable)
+    return PIDX_err_variable;
+
+  if (file->idx->io_type != PIDX_IDX_IO)
+    return PIDX_err_not_implemented;
+
+  int vi = variable_index(file, variable);
+  if (vi == -1)
+    return PIDX_err_variable;
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (offset[d] + dims[d] > file->idx->bounds[d])
+      return PIDX_err_box;
+  }
+
+  return idx_box_query_create(file->idx, vi, file->idx_b->reduced_resolution_factor, offset, dims, dst_buffer, layout, read);
+}
+
+
+
+PIDX_return_code PIDX_progressive_read_next(PIDX_progressive_read read, int* level, int* level_count, PIDX_point buffer_offset, PIDX_point buffer_stride)
+{
+  if (!read)
+    return PIDX_err_file;
+
+  PIDX_return_code ret = idx_box_query_progress(read, level, level_count, buffer_offset, buffer_stride);
+  if (ret != PIDX_success)
+    return ret;
+
+  ret = idx_box_query_read_levels(read, *level + 1);
+  if (ret != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return ret;
+  }
+
+  return idx_box_query_progress(read, level, level_count, buffer_offset, buffer_stride);
+}
+
+
+
+PIDX_return_code PIDX_progressive_read_end(PIDX_progressive_read read)
+{
+  if (!read)
+    return PIDX_err_file;
+
+  return idx_box_query_destroy(read);
 }
 
 
@@ -63,6 +63,10 @@ PIDX_agg_id PIDX_agg_init(idx_dataset idx_meta_data, idx_comm idx_c, idx_blocks
 
 PIDX_return_code PIDX_agg_finalize(PIDX_agg_id id)
 {
+  // in steady state io the graph belongs to the aggregation cache
+  if (id->cache == NULL)
+    PIDX_agg_graph_free(id->graph);
+
   free(id);
   id = 0;
 
@@ -53,10 +53,80 @@
 #ifndef __PIDX_AGG_H
 #define __PIDX_AGG_H 
 
+/// Sparse graph of the processes and their aggregators (PIDX_AGG_NEIGHBOR_ALLTOALLV), every edge goes both ways
+/// so that the replies of a read travel over the same communicator as the requests
+struct PIDX_agg_graph_struct
+{
+  MPI_Comm comm;
+  int in_degree;
+  int out_degree;
+  int *sources;
+  int *destinations;
+  int *weights;                       /// all 1 (explicit, MPI_UNWEIGHTED trips up gcc bound checks)
+};
+typedef struct PIDX_agg_graph_struct* PIDX_agg_graph;
+
+
+/// Node of every process of a partition (node aware placement), valid while the partition has the same processes
+struct PIDX_agg_node_map_struct
+{
+  MPI_Group group;
+  int nprocs;
+  int *node;
+};
+typedef struct PIDX_agg_node_map_struct* PIDX_agg_node_map;
+
+
+/// Aggregation state of one aggregation group of a variable pack, kept across flushes and time steps
+/// in steady state io (PIDX_set_steady_state_io)
+struct PIDX_agg_cache_struct
+{
+  /// The state is only reused if the aggregation matches this key
+  int svi;
+  int evi;
+  int agg_group;
+  int color;
+  int partition_rank;
+  int partition_nprocs;
+  int aggregator_placement;
+  int compression_factor;
+  uint64_t samples_per_block;
+  int *bpv;                           /// bits per value of the variables svi to evi
+  int efc;
+  int *existing_file_index;           /// efc entries
+  int *bcpf;                          /// block count of the existing files, efc entries
+  int block_count;
+  int *block_number;                  /// present blocks of the existing files, block_count entries
+
+  int **agg_r;                        /// Aggregator of every file and variable
+  int **agg_node;                     /// Node of every aggregator (node aware placement, else NULL)
+  int file_number;                    /// Aggregation buffer of this process
+  int var_number;
+  uint64_t buffer_size;
+  unsigned char* buffer;
+  MPI_Win win;                        /// Window on buffer, MPI_WIN_NULL until the first one sided aggregation
+  PIDX_agg_graph graph;               /// Neighbour graph, NULL until the first neighbour aggregation
+
+  MPI_Group group;                    /// Processes of partition_comm when the entry was stored
+  int is_stale;                       /// 1 once the key no longer matches, only the window and graph are left to free
+};
+typedef struct PIDX_agg_cache_struct* PIDX_agg_cache;
+
+struct PIDX_agg_cache_list_struct
+{
+  PIDX_agg_cache *entry;
+  int count;
+};
+typedef struct PIDX_agg_cache_list_struct* PIDX_agg_cache_list;
+
+
 struct PIDX_agg_struct
 {
   MPI_Win win;
 
+  PIDX_agg_cache cache;               /// Steady state io: buffer, window and graph owned by the cache (else NULL)
+  PIDX_agg_graph graph;               /// Neighbour graph of the aggregation group, built on first use
+
   idx_comm idx_c;
 
   idx_dataset idx;
@@ -94,6 +164,20 @@ PIDX_return_code PIDX_agg_meta_data_destroy(PIDX_agg_id agg_id, PIDX_block_layou
 PIDX_return_code PIDX_agg_buf_create_local_uniform_dist(PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl);
 
 
+/// Finds the node of every process of the partition (node[partition_rank] is the lowest partition rank on that node),
+/// map keeps them across flushes and they are only exchanged again when the processes of the partition change
+PIDX_return_code PIDX_agg_find_nodes(idx_comm idx_c, PIDX_agg_node_map* map, int* node);
+
+
+///
+PIDX_return_code PIDX_agg_node_map_free(PIDX_agg_node_map map);
+
+
+/// Places the aggregators of a group across the nodes balancing the bytes they receive, rank_load holds the
+/// bytes every process already aggregates for the previous groups and is updated
+PIDX_return_code PIDX_agg_buf_create_node_aware_dist(PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int* node, uint64_t* rank_load);
+
+
 ///
 PIDX_return_code PIDX_agg_buf_destroy(Agg_buffer agg_buffer);
 
@@ -102,6 +186,10 @@ PIDX_return_code PIDX_agg_buf_destroy(Agg_buffer agg_buffer);
 PIDX_return_code PIDX_agg_global_and_local(PIDX_agg_id agg_id, Agg_buffer agg_buffer, int layout_id, PIDX_block_layout local_block_layout, int PIDX_MODE);
 
 
+/// Frees a neighbour graph, collective over partition_comm
+void PIDX_agg_graph_free(PIDX_agg_graph graph);
+
+
 ///
 PIDX_return_code PIDX_agg_create_global_partition_localized_aggregation_buffer(PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int agg_offset);
 
@@ -112,4 +200,23 @@ PIDX_return_code PIDX_agg_create_local_partition_localized_aggregation_buffer(PI
 ///
 PIDX_return_code PIDX_agg_finalize(PIDX_agg_id agg_id);
 
+
+/// Finds the cached state of an aggregation group of the variable pack of agg_id, NULL if there is none or if
+/// the layout or the partition changed
+PIDX_agg_cache PIDX_agg_cache_find(PIDX_agg_cache_list list, PIDX_agg_id id, PIDX_block_layout lbl, int agg_group);
+
+
+/// Restores the aggregator assignment and the aggregation buffer of a group from its cached state, and the node
+/// of its aggregators (PIDX_agg_find_nodes) if node is not NULL
+PIDX_return_code PIDX_agg_cache_restore(PIDX_agg_cache cache, PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int* node);
+
+
+/// Moves the aggregator assignment and the aggregation buffer of a group into a new cache entry, collective over
+/// partition_comm (the previous entry of the group is freed, or becomes stale if the partition changed)
+PIDX_return_code PIDX_agg_cache_store(PIDX_agg_cache_list list, PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int agg_group, int* node);
+
+
+/// Frees the cached states, their windows and graphs, collective over the processes of every window
+PIDX_return_code PIDX_agg_cache_free(PIDX_agg_cache_list list);
+
 #endif //__PIDX_AGG_H
@@ -0,0 +1,313 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+#include "../../PIDX_inc.h"
+
+// Steady state io: when the decomposition does not change between flushes the aggregator assignment,
+// the aggregation buffers and the one sided windows are created on the first flush and reused after.
+// A window (and a neighbour graph) can only be freed by all the processes that created it, so an entry
+// whose key no longer matches is freed by the next store of its group if the partition is still made of
+// the same processes, else it is kept (as stale, without buffer) until PIDX_agg_cache_free.
+
+static PIDX_return_code free_entry(PIDX_agg_cache cache);
+
+
+static int key_matches(PIDX_agg_cache cache, PIDX_agg_id id, PIDX_block_layout lbl, int agg_group)
+{
+  if (cache->is_stale || cache->svi != id->fi || cache->evi != id->li || cache->agg_group != agg_group)
+    return 0;
+
+  if (cache->color != id->idx_c->color || cache->partition_rank != id->idx_c->partition_rank || cache->partition_nprocs != id->idx_c->partition_nprocs)
+    return 0;
+
+  if (cache->aggregator_placement != id->idx->aggregator_placement || cache->compression_factor != id->idx->compression_factor || cache->samples_per_block != id->idx->samples_per_block)
+    return 0;
+
+  for (int v = id->fi; v <= id->li; v++)
+  {
+    if (cache->bpv[v - id->fi] != id->idx->variable[v]->bpv)
+      return 0;
+  }
+
+  if (cache->efc != lbl->efc)
+    return 0;
+
+  for (int k = 0; k < lbl->efc; k++)
+  {
+    if (cache->existing_file_index[k] != lbl->existing_file_index[k] || cache->bcpf[k] != lbl->bcpf[lbl->existing_file_index[k]])
+      return 0;
+  }
+
+  // the blocks of the files lay out the aggregation buffer
+  int pos = 0;
+  for (int k = 0; k < lbl->efc; k++)
+  {
+    int first_block = lbl->existing_file_index[k] * id->idx->blocks_per_file;
+    for (int b = first_block; b < first_block + id->idx->blocks_per_file; b++)
+    {
+      if (PIDX_blocks_is_block_present(b, id->idx->bits_per_block, lbl))
+      {
+        if (pos == cache->block_count || cache->block_number[pos] != b)
+          return 0;
+        pos++;
+      }
+    }
+  }
+
+  return (pos == cache->block_count);
+}
+
+
+
+PIDX_agg_cache PIDX_agg_cache_find(PIDX_agg_cache_list list, PIDX_agg_id id, PIDX_block_layout lbl, int agg_group)
+{
+  for (int e = 0; e < list->count; e++)
+  {
+    if (key_matches(list->entry[e], id, lbl, agg_group))
+      return list->entry[e];
+  }
+
+  return NULL;
+}
+
+
+
+PIDX_return_code PIDX_agg_cache_restore(PIDX_agg_cache cache, PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int* node)
+{
+  int var_count = id->li - id->fi + 1;
+  for (int k = 0; k < lbl->efc; k++)
+  {
+    memcpy(id->agg_r[k], cache->agg_r[k], var_count * sizeof(*id->agg_r[k]));
+
+    if (node != NULL && cache->agg_node != NULL)
+    {
+      for (int v = 0; v < var_count; v++)
+        node[cache->agg_r[k][v]] = cache->agg_node[k][v];
+    }
+  }
+
+  ab->file_number = cache->file_number;
+  ab->var_number = cache->var_number;
+  ab->buffer_size = cache->buffer_size;
+  ab->buffer = cache->buffer;
+
+  // variable rate blocks are packed in place by the file io, the empty slots have to read zero again
+  if (ab->buffer_size != 0 && PIDX_compression_is_variable_rate(id->idx))
+    memset(ab->buffer, 0, ab->buffer_size);
+
+  id->cache = cache;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_agg_cache_store(PIDX_agg_cache_list list, PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int agg_group, int* node)
+{
+  int var_count = id->li - id->fi + 1;
+
+  MPI_Group group;
+  if (MPI_Comm_group(id->idx_c->partition_comm, &group) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+
+  // every process of the partition stores the group, so the previous state of the group is freed if it was
+  // created by the same processes, else it only keeps its window and graph
+  int kept = 0;
+  for (int e = 0; e < list->count; e++)
+  {
+    PIDX_agg_cache old = list->entry[e];
+    if (old->is_stale == 0 && old->svi == id->fi && old->evi == id->li && old->agg_group == agg_group)
+    {
+      int same_group = MPI_UNEQUAL;
+      MPI_Group_compare(old->group, group, &same_group);
+      if (same_group == MPI_IDENT)
+      {
+        if (free_entry(old) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          return PIDX_err_agg;
+        }
+        continue;
+      }
+
+      old->is_stale = 1;
+      free(old->buffer);
+      old->buffer = NULL;
+    }
+    list->entry[kept++] = old;
+  }
+  list->count = kept;
+
+  PIDX_agg_cache cache = malloc(sizeof(*cache));
+  memset(cache, 0, sizeof(*cache));
+
+  cache->svi = id->fi;
+  cache->evi = id->li;
+  cache->agg_group = agg_group;
+  cache->color = id->idx_c->color;
+  cache->partition_rank = id->idx_c->partition_rank;
+  cache->partition_nprocs = id->idx_c->partition_nprocs;
+  cache->aggregator_placement = id->idx->aggregator_placement;
+  cache->compression_factor = id->idx->compression_factor;
+  cache->samples_per_block = id->idx->samples_per_block;
+  cache->group = group;
+
+  cache->bpv = malloc(var_count * sizeof(*cache->bpv));
+  for (int v = id->fi; v <= id->li; v++)
+    cache->bpv[v - id->fi] = id->idx->variable[v]->bpv;
+
+  cache->efc = lbl->efc;
+  cache->existing_file_index = malloc(lbl->efc * sizeof(*cache->existing_file_index));
+  cache->bcpf = malloc(lbl->efc * sizeof(*cache->bcpf));
+  cache->agg_r = malloc(lbl->efc * sizeof(*cache->agg_r));
+  for (int k = 0; k < lbl->efc; k++)
+  {
+    cache->existing_file_index[k] = lbl->existing_file_index[k];
+    cache->bcpf[k] = lbl->bcpf[lbl->existing_file_index[k]];
+    cache->agg_r[k] = malloc(var_count * sizeof(*cache->agg_r[k]));
+    memcpy(cache->agg_r[k], id->agg_r[k], var_count * sizeof(*cache->agg_r[k]));
+  }
+
+  for (int k = 0; k < lbl->efc; k++)
+    cache->block_count += lbl->bcpf[lbl->existing_file_index[k]];
+  cache->block_number = malloc((cache->block_count + 1) * sizeof(*cache->block_number));
+  int pos = 0;
+  for (int k = 0; k < lbl->efc; k++)
+  {
+    int first_block = lbl->existing_file_index[k] * id->idx->blocks_per_file;
+    for (int b = first_block; b < first_block + id->idx->blocks_per_file && pos < cache->block_count; b++)
+    {
+      if (PIDX_blocks_is_block_present(b, id->idx->bits_per_block, lbl))
+        cache->block_number[pos++] = b;
+    }
+  }
+  cache->block_count = pos;
+
+  if (node != NULL)
+  {
+    cache->agg_node = malloc(lbl->efc * sizeof(*cache->agg_node));
+    for (int k = 0; k < lbl->efc; k++)
+    {
+      cache->agg_node[k] = malloc(var_count * sizeof(*cache->agg_node[k]));
+      for (int v = 0; v < var_count; v++)
+        cache->agg_node[k][v] = node[id->agg_r[k][v]];
+    }
+  }
+
+  cache->file_number = ab->file_number;
+  cache->var_number = ab->var_number;
+  cache->buffer_size = ab->buffer_size;
+  cache->buffer = ab->buffer;
+  cache->win = MPI_WIN_NULL;
+
+  PIDX_agg_cache *temp_entry = realloc(list->entry, (list->count + 1) * sizeof(*temp_entry));
+  if (temp_entry == NULL)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+  list->entry = temp_entry;
+  list->entry[list->count++] = cache;
+
+  id->cache = cache;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_agg_cache_free(PIDX_agg_cache_list list)
+{
+  if (list == NULL)
+    return PIDX_success;
+
+  // windows are freed in the order they were created
+  for (int e = 0; e < list->count; e++)
+  {
+    if (free_entry(list->entry[e]) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+  }
+
+  free(list->entry);
+  free(list);
+
+  return PIDX_success;
+}
+
+
+
+// Collective over the processes of the window and graph of the entry
+static PIDX_return_code free_entry(PIDX_agg_cache cache)
+{
+  if (cache->win != MPI_WIN_NULL)
+  {
+    if (MPI_Win_free(&cache->win) != MPI_SUCCESS)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+  }
+
+  PIDX_agg_graph_free(cache->graph);
+  MPI_Group_free(&cache->group);
+
+  for (int k = 0; k < cache->efc; k++)
+  {
+    free(cache->agg_r[k]);
+    if (cache->agg_node != NULL)
+      free(cache->agg_node[k]);
+  }
+  free(cache->agg_r);
+  free(cache->agg_node);
+  free(cache->bpv);
+  free(cache->existing_file_index);
+  free(cache->bcpf);
+  free(cache->block_number);
+  free(cache->buffer);
+  free(cache);
+
+  return PIDX_success;
+}
@@ -0,0 +1,335 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2010-2018 ViSUS L.L.C.,
+ * Scientific Computing and Imaging Institute of the University of Utah
+ *
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ *
+ */
+#include "../../PIDX_inc.h"
+
+// distributes aggregators across the nodes so that every node receives about the same number of bytes
+
+struct agg_placement_struct
+{
+  int file;                 /// Index of the file in the block layout
+  int var;                  /// Variable index relative to the first variable of the pack
+  uint64_t bytes;           /// Size of the aggregation buffer
+};
+typedef struct agg_placement_struct agg_placement;
+
+// Loads the placement is driven by, nodes are identified by their lowest rank so all are indexed by rank
+struct placement_load_struct
+{
+  uint64_t* rank_load;      /// Bytes every process aggregates
+  uint64_t* node_load;      /// Bytes every node aggregates
+  int* node_agg_count;      /// Aggregators of every node
+};
+typedef struct placement_load_struct placement_load;
+
+static int compare_placement(const void* a, const void* b);
+static int rank_before(int a, int b, const placement_load* load);
+static int node_before(int a, int b, const placement_load* load);
+static void sift_down(int* heap, int size, int i, int (*before)(int, int, const placement_load*), const placement_load* load);
+
+
+
+static int compare_placement(const void* a, const void* b)
+{
+  const agg_placement* pa = a;
+  const agg_placement* pb = b;
+
+  // largest buffers first, ties in file then variable order so that every process finds the same placement
+  if (pa->bytes != pb->bytes)
+    return (pa->bytes > pb->bytes) ? -1 : 1;
+  if (pa->file != pb->file)
+    return pa->file - pb->file;
+  return pa->var - pb->var;
+}
+
+
+
+// least loaded rank first, ties by rank
+static int rank_before(int a, int b, const placement_load* load)
+{
+  if (load->rank_load[a] != load->rank_load[b])
+    return load->rank_load[a] < load->rank_load[b];
+  return a < b;
+}
+
+
+
+// least loaded node first, then the node with the fewest aggregators, ties by node
+static int node_before(int a, int b, const placement_load* load)
+{
+  if (load->node_load[a] != load->node_load[b])
+    return load->node_load[a] < load->node_load[b];
+  if (load->node_agg_count[a] != load->node_agg_count[b])
+    return load->node_agg_count[a] < load->node_agg_count[b];
+  return a < b;
+}
+
+
+
+static void sift_down(int* heap, int size, int i, int (*before)(int, int, const placement_load*), const placement_load* load)
+{
+  while (1)
+  {
+    int first = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < size && before(heap[left], heap[first], load))
+      first = left;
+    if (right < size && before(heap[right], heap[first], load))
+      first = right;
+    if (first == i)
+      return;
+
+    int temp = heap[i];
+    heap[i] = heap[first];
+    heap[first] = temp;
+    i = first;
+  }
+}
+
+
+
+PIDX_return_code PIDX_agg_find_nodes(idx_comm idx_c, PIDX_agg_node_map* map, int* node)
+{
+  MPI_Group group;
+  if (MPI_Comm_group(idx_c->partition_comm, &group) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+
+  // the nodes are only exchanged again if the partition changed on any of its processes
+  int is_known = 0;
+  if (*map != NULL)
+  {
+    int same_group = MPI_UNEQUAL;
+    MPI_Group_compare((*map)->group, group, &same_group);
+    is_known = (same_group == MPI_IDENT);
+  }
+
+  if (MPI_Allreduce(MPI_IN_PLACE, &is_known, 1, MPI_INT, MPI_MIN, idx_c->partition_comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    MPI_Group_free(&group);
+    return PIDX_err_agg;
+  }
+
+  if (is_known == 1)
+  {
+    MPI_Group_free(&group);
+    memcpy(node, (*map)->node, idx_c->partition_nprocs * sizeof(*node));
+    return PIDX_success;
+  }
+
+  MPI_Comm node_comm;
+  if (MPI_Comm_split_type(idx_c->partition_comm, MPI_COMM_TYPE_SHARED, idx_c->partition_rank, MPI_INFO_NULL, &node_comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    MPI_Group_free(&group);
+    return PIDX_err_agg;
+  }
+
+  // a node is identified by the lowest rank of the partition running on it
+  int leader = idx_c->partition_rank;
+  if (MPI_Allreduce(MPI_IN_PLACE, &leader, 1, MPI_INT, MPI_MIN, node_comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    MPI_Comm_free(&node_comm);
+    MPI_Group_free(&group);
+    return PIDX_err_agg;
+  }
+  MPI_Comm_free(&node_comm);
+
+  if (MPI_Allgather(&leader, 1, MPI_INT, node, 1, MPI_INT, idx_c->partition_comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    MPI_Group_free(&group);
+    return PIDX_err_agg;
+  }
+
+  if (PIDX_agg_node_map_free(*map) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    MPI_Group_free(&group);
+    return PIDX_err_agg;
+  }
+
+  *map = malloc(sizeof(*(*map)));
+  (*map)->group = group;
+  (*map)->nprocs = idx_c->partition_nprocs;
+  (*map)->node = malloc(idx_c->partition_nprocs * sizeof(*(*map)->node));
+  memcpy((*map)->node, node, idx_c->partition_nprocs * sizeof(*node));
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_agg_node_map_free(PIDX_agg_node_map map)
+{
+  if (map == NULL)
+    return PIDX_success;
+
+  MPI_Group_free(&map->group);
+  free(map->node);
+  free(map);
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_agg_buf_create_node_aware_dist(PIDX_agg_id id, Agg_buffer ab, PIDX_block_layout lbl, int* node, uint64_t* rank_load)
+{
+  int nprocs = id->idx_c->partition_nprocs;
+  int var_count = id->li - id->fi + 1;
+  int agg_count = lbl->efc * var_count;
+  assert(agg_count <= nprocs);
+
+  int chunk_size = id->idx->chunk_size[0] * id->idx->chunk_size[1] * id->idx->chunk_size[2];
+
+  agg_placement* placement = malloc(agg_count * sizeof(*placement));
+  for (int k = 0; k < lbl->efc; k++)
+  {
+    for (int i = id->fi; i <= id->li; i++)
+    {
+      agg_placement* p = &placement[k * var_count + (i - id->fi)];
+      int bpdt = (chunk_size * id->idx->variable[i]->bpv/8) / (id->idx->compression_factor);
+
+      p->file = k;
+      p->var = i - id->fi;
+      p->bytes = (uint64_t)lbl->bcpf[lbl->existing_file_index[k]] * id->idx->samples_per_block * bpdt;
+    }
+  }
+  qsort(placement, agg_count, sizeof(*placement), compare_placement);
+
+  // bytes per node (the aggregators of the previous groups included)
+  placement_load load;
+  load.rank_load = rank_load;
+  load.node_load = calloc(nprocs, sizeof(*load.node_load));
+  load.node_agg_count = calloc(nprocs, sizeof(*load.node_agg_count));
+
+  // the ranks of every node are a min heap on their load (a process has one aggregation buffer per group,
+  // so a rank leaves its heap once it is picked), the nodes with a free rank are a min heap on their load
+  int* node_first = calloc(nprocs, sizeof(*node_first));
+  int* node_free = calloc(nprocs, sizeof(*node_free));
+  int* rank_heap = malloc(nprocs * sizeof(*rank_heap));
+  int* node_heap = malloc(nprocs * sizeof(*node_heap));
+  int node_heap_size = 0;
+
+  for (int r = 0; r < nprocs; r++)
+  {
+    load.node_load[node[r]] += rank_load[r];
+    load.node_agg_count[node[r]] += (rank_load[r] != 0);
+    node_free[node[r]]++;
+  }
+
+  int first = 0;
+  for (int n = 0; n < nprocs; n++)
+  {
+    node_first[n] = first;
+    first = first + node_free[n];
+    node_free[n] = 0;
+  }
+
+  for (int r = 0; r < nprocs; r++)
+    rank_heap[node_first[node[r]] + node_free[node[r]]++] = r;
+
+  for (int n = 0; n < nprocs; n++)
+  {
+    if (node_free[n] == 0)
+      continue;
+
+    for (int i = node_free[n] / 2 - 1; i >= 0; i--)
+      sift_down(rank_heap + node_first[n], node_free[n], i, rank_before, &load);
+    node_heap[node_heap_size++] = n;
+  }
+  for (int i = node_heap_size / 2 - 1; i >= 0; i--)
+    sift_down(node_heap, node_heap_size, i, node_before, &load);
+
+  PIDX_return_code ret = PIDX_success;
+  for (int a = 0; a < agg_count; a++)
+  {
+    // least loaded node with a free rank, then least loaded free rank on it
+    assert(node_heap_size > 0);
+    int n = node_heap[0];
+    int* ranks = rank_heap + node_first[n];
+    int best = ranks[0];
+    ranks[0] = ranks[--node_free[n]];
+    sift_down(ranks, node_free[n], 0, rank_before, &load);
+
+    agg_placement* p = &placement[a];
+    id->agg_r[p->file][p->var] = best;
+    rank_load[best] += p->bytes;
+    load.node_load[n] += p->bytes;
+    load.node_agg_count[n]++;
+
+    // the load of the node only grew, so it can only move down the heap
+    if (node_free[n] == 0)
+      node_heap[0] = node_heap[--node_heap_size];
+    sift_down(node_heap, node_heap_size, 0, node_before, &load);
+
+    if (id->idx_c->partition_rank == best)
+    {
+      ab->file_number = lbl->existing_file_index[p->file];
+      ab->var_number = id->fi + p->var;
+      ab->buffer_size = p->bytes;
+
+      ab->buffer = malloc(ab->buffer_size);
+      if (ab->buffer == NULL)
+      {
+        fprintf(stderr, " Error in malloc %lld: Line %d File %s\n", (long long) ab->buffer_size, __LINE__, __FILE__);
+        ret = PIDX_err_agg;
+        break;
+      }
+      memset(ab->buffer, 0, ab->buffer_size);
+    }
+  }
+
+  free(placement);
+  free(load.node_load);
+  free(load.node_agg_count);
+  free(node_first);
+  free(node_free);
+  free(rank_heap);
+  free(node_heap);
+
+  return ret;
+}
@@ -53,14 +53,52 @@
 
 #define PIDX_ACTIVE_TARGET
 
+
+// A contiguous run of HZ samples moved between a process and an aggregator by the two sided
+// (PIDX_AGG_ALLTOALLV and PIDX_AGG_NEIGHBOR_ALLTOALLV) aggregation modes
+struct agg_run_struct
+{
+  int rank;                 /// Rank of the aggregator in partition_comm
+  uint64_t offset;          /// Byte offset of the run in the aggregation buffer
+  uint64_t size;            /// Size of the run in bytes
+  unsigned char* buffer;    /// Samples of the run in the local HZ buffer
+};
+typedef struct agg_run_struct agg_run;
+
+struct agg_run_list_struct
+{
+  agg_run* run;
+  uint64_t count;
+  uint64_t capacity;
+};
+typedef struct agg_run_list_struct* agg_run_list;
+
+// Header of a run in the messages of the two sided modes
+#define PIDX_AGG_RUN_HEADER_SIZE (2 * sizeof(uint64_t))
+
 static PIDX_return_code create_window(PIDX_agg_id id, Agg_buffer ab);
-static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl, int mode);
-static int write_samples(PIDX_agg_id id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, uint64_t buffer_offset, PIDX_block_layout layout, int mode);
+static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl, agg_run_list runs, int mode);
+static int write_samples(PIDX_agg_id id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, uint64_t buffer_offset, PIDX_block_layout layout, agg_run_list runs, int mode);
+static PIDX_return_code two_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl, int mode);
+static PIDX_return_code exchange(PIDX_agg_id id, unsigned char* send_buffer, int* send_count, unsigned char* recv_buffer, int* recv_count);
+static PIDX_return_code exchange_counts(PIDX_agg_id id, int* send_count, int* recv_count);
+static PIDX_return_code create_graph(PIDX_agg_id id, int* send_count);
 
 
 // Perform aggregation
 PIDX_return_code PIDX_agg_global_and_local(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl,  int MODE)
 {
+  if (id->idx->aggregation_mode != PIDX_AGG_ONE_SIDED)
+  {
+    if (two_sided_data_com(id, ab, layout_id, lbl, MODE) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+
+    return PIDX_success;
+  }
+
   // Steps for aggregation
   // Step 1: Create one sided Windows
   // Step 2: RMA fence for synchronization - begin data transfer
@@ -68,12 +106,20 @@ PIDX_return_code PIDX_agg_global_and_local(PIDX_agg_id id, Agg_buffer ab, int la
   // Step 4: RMA fence for synchronization - end data transfer
   // Step 5: Free the MPI windows
 
-  // Step 1
-  if (create_window(id, ab) != PIDX_success)
+  // Step 1 (steady state io creates the window once and keeps it in the cache)
+  if (id->cache == NULL || id->cache->win == MPI_WIN_NULL)
   {
-    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_agg;
+    if (create_window(id, ab) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+
+    if (id->cache != NULL)
+      id->cache->win = id->win;
   }
+  else
+    id->win = id->cache->win;
 
 #ifdef PIDX_ACTIVE_TARGET
   if (MPI_Win_fence(0, id->win) != MPI_SUCCESS)
@@ -83,7 +129,7 @@ PIDX_return_code PIDX_agg_global_and_local(PIDX_agg_id id, Agg_buffer ab, int la
   }
 #endif
 
-  if (one_sided_data_com(id, ab, layout_id, lbl, MODE) != PIDX_success)
+  if (one_sided_data_com(id, ab, layout_id, lbl, NULL, MODE) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
     return PIDX_err_agg;
@@ -97,6 +143,9 @@ PIDX_return_code PIDX_agg_global_and_local(PIDX_agg_id id, Agg_buffer ab, int la
   }
 #endif
 
+  if (id->cache != NULL)
+    return PIDX_success;
+
   if (MPI_Win_free(&(id->win)) != MPI_SUCCESS)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
@@ -138,7 +187,9 @@ static PIDX_return_code create_window(PIDX_agg_id id, Agg_buffer ab)
 
 
 
-static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl, int mode)
+// Walks through the HZ runs of every variable, with runs == NULL the runs are put into (or fetched from)
+// the aggregator windows, otherwise they are only recorded for the two sided modes
+static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl, agg_run_list runs, int mode)
 {
   int ret = 0;
   uint64_t index = 0, count = 0;
@@ -165,7 +216,7 @@ static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int la
           index = 0;
           count = hz_buf->end_hz_index[i] - hz_buf->start_hz_index[i] + 1;  // all samples in the hz level local to the process
 
-          ret = write_samples(id, v, hz_buf->start_hz_index[i], count, hz_buf->buffer[i], 0, lbl, mode);
+          ret = write_samples(id, v, hz_buf->start_hz_index[i], count, hz_buf->buffer[i], 0, lbl, runs, mode);
           if (ret != PIDX_success)
           {
             fprintf(stderr, " Error in aggregate Line %d File %s\n", __LINE__, __FILE__);
@@ -189,7 +240,7 @@ static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int la
           if (end_block_index == start_block_index)
           {
             count = (hz_buf->end_hz_index[i] - hz_buf->start_hz_index[i] + 1);
-            ret = write_samples(id, v, hz_buf->start_hz_index[i], count, hz_buf->buffer[i], 0, lbl, mode);
+            ret = write_samples(id, v, hz_buf->start_hz_index[i], count, hz_buf->buffer[i], 0, lbl, runs, mode);
             if (ret != PIDX_success)
             {
               fprintf(stderr, " Error in aggregate Line %d File %s\n", __LINE__, __FILE__);
@@ -220,7 +271,7 @@ static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int la
                   count = id->idx->samples_per_block;
                 }
 
-                ret = write_samples(id, v, index + hz_buf->start_hz_index[i], count, hz_buf->buffer[i], send_index, lbl, mode);
+                ret = write_samples(id, v, index + hz_buf->start_hz_index[i], count, hz_buf->buffer[i], send_index, lbl, runs, mode);
                 if (ret != PIDX_success)
                 {
                   fprintf(stderr, "[%s] [%d] write_read_samples() failed.\n", __FILE__, __LINE__);
@@ -242,7 +293,7 @@ static PIDX_return_code one_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int la
 
 
 
-static int write_samples(PIDX_agg_id id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, uint64_t buffer_offset, PIDX_block_layout layout, int mode)
+static int write_samples(PIDX_agg_id id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, uint64_t buffer_offset, PIDX_block_layout layout, agg_run_list runs, int mode)
 {
   int block_number, file_index, file_count, block_negative_offset = 0;
   uint64_t samples_per_file = id->idx->samples_per_block * id->idx->blocks_per_file;
@@ -281,6 +332,36 @@ static int write_samples(PIDX_agg_id id, int variable_index, uint64_t hz_start_i
     int file_no = hz_start_index / samples_per_file;
     int target_rank = id->agg_r[layout->inverse_existing_file_index[file_no]][variable_index - id->fi];
 
+    if (runs != NULL)
+    {
+      if (runs->count == runs->capacity)
+      {
+        runs->capacity = (runs->capacity == 0) ? 64 : 2 * runs->capacity;
+        agg_run* temp_run = realloc(runs->run, runs->capacity * sizeof(*temp_run));
+        if (temp_run == NULL)
+        {
+          fprintf(stderr, " Error in realloc Line %d File %s\n", __LINE__, __FILE__);
+          return PIDX_err_agg;
+        }
+        runs->run = temp_run;
+      }
+
+      // same displacement as the MPI_Put below, in units of the window of the target
+      int tcs = id->idx->chunk_size[0] * id->idx->chunk_size[1] * id->idx->chunk_size[2];
+      int disp_unit = tcs * (var->bpv/8) / (id->idx->compression_factor);
+
+      agg_run* run = &runs->run[runs->count++];
+      run->rank = target_rank;
+      run->offset = (data_offset / bytes_per_datatype) * disp_unit;
+      run->size = file_count * bytes_per_datatype;
+      run->buffer = hz_buffer;
+
+      hz_count -= file_count;
+      hz_start_index += file_count;
+      hz_buffer += file_count * bytes_per_datatype;
+      continue;
+    }
+
 
 #ifndef PIDX_ACTIVE_TARGET
     MPI_Win_lock(MPI_LOCK_SHARED, target_rank, 0 , id->win);
@@ -315,3 +396,414 @@ static int write_samples(PIDX_agg_id id, int variable_index, uint64_t hz_start_i
 
   return PIDX_success;
 }
+
+
+
+// Two sided aggregation: every process packs all its runs for an aggregator in one message
+//
+// Write: the runs (header + samples) are sent to the aggregators, which copy them into their buffer
+// Read: the run headers are sent to the aggregators, which reply with the samples in the same order
+static PIDX_return_code two_sided_data_com(PIDX_agg_id id, Agg_buffer ab, int layout_id, PIDX_block_layout lbl, int mode)
+{
+  PIDX_return_code ret = PIDX_err_agg;
+  int nprocs = id->idx_c->partition_nprocs;
+  struct agg_run_list_struct runs;
+  memset(&runs, 0, sizeof(runs));
+
+  int *send_count = NULL, *recv_count = NULL, *send_offset = NULL;
+  int *reply_count = NULL, *fetch_count = NULL;
+  uint64_t *send_total = NULL;
+  unsigned char *send_buffer = NULL, *recv_buffer = NULL;
+  unsigned char *reply_buffer = NULL, *fetch_buffer = NULL;
+
+  if (one_sided_data_com(id, ab, layout_id, lbl, &runs, mode) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    goto cleanup;
+  }
+
+  send_count = calloc(nprocs, sizeof(*send_count));
+  recv_count = calloc(nprocs, sizeof(*recv_count));
+  send_offset = calloc(nprocs, sizeof(*send_offset));
+  send_total = calloc(nprocs, sizeof(*send_total));
+
+  // a message carries the run headers, and the samples too when writing
+  for (uint64_t r = 0; r < runs.count; r++)
+    send_total[runs.run[r].rank] += PIDX_AGG_RUN_HEADER_SIZE + ((mode == PIDX_WRITE) ? runs.run[r].size : 0);
+
+  uint64_t send_size = 0;
+  for (int i = 0; i < nprocs; i++)
+  {
+    send_offset[i] = send_size;
+    send_count[i] = send_total[i];
+    send_size += send_total[i];
+  }
+
+  // MPI counts and displacements are int
+  if (send_size > INT_MAX)
+  {
+    fprintf(stderr, "Aggregation message of %lld bytes is too large for the two sided aggregation modes, File %s Line %d\n", (long long)send_size, __FILE__, __LINE__);
+    goto cleanup;
+  }
+
+  send_buffer = malloc(send_size + 1);
+  for (uint64_t r = 0; r < runs.count; r++)
+  {
+    agg_run* run = &runs.run[r];
+    unsigned char* message = send_buffer + send_offset[run->rank];
+    uint64_t header[2] = {run->offset, run->size};
+
+    memcpy(message, header, PIDX_AGG_RUN_HEADER_SIZE);
+    if (mode == PIDX_WRITE)
+      memcpy(message + PIDX_AGG_RUN_HEADER_SIZE, run->buffer, run->size);
+
+    send_offset[run->rank] += PIDX_AGG_RUN_HEADER_SIZE + ((mode == PIDX_WRITE) ? run->size : 0);
+  }
+
+  if (exchange_counts(id, send_count, recv_count) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    goto cleanup;
+  }
+
+  uint64_t recv_size = 0;
+  for (int i = 0; i < nprocs; i++)
+    recv_size += recv_count[i];
+
+  if (recv_size > INT_MAX)
+  {
+    fprintf(stderr, "Aggregation message of %lld bytes is too large for the two sided aggregation modes, File %s Line %d\n", (long long)recv_size, __FILE__, __LINE__);
+    goto cleanup;
+  }
+
+  recv_buffer = malloc(recv_size + 1);
+  if (exchange(id, send_buffer, send_count, recv_buffer, recv_count) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    goto cleanup;
+  }
+
+  if (mode == PIDX_WRITE)
+  {
+    // messages only arrive at aggregators
+    uint64_t position = 0;
+    while (position < recv_size)
+    {
+      uint64_t header[2];
+      memcpy(header, recv_buffer + position, PIDX_AGG_RUN_HEADER_SIZE);
+      assert(header[0] + header[1] <= ab->buffer_size);
+
+      memcpy(ab->buffer + header[0], recv_buffer + position + PIDX_AGG_RUN_HEADER_SIZE, header[1]);
+      position += PIDX_AGG_RUN_HEADER_SIZE + header[1];
+    }
+  }
+  else
+  {
+    // the aggregator replies to every request with the samples of its runs
+    reply_count = calloc(nprocs, sizeof(*reply_count));
+    fetch_count = calloc(nprocs, sizeof(*fetch_count));
+    uint64_t reply_size = 0;
+    uint64_t position = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+      uint64_t end = position + recv_count[i];
+      uint64_t count = 0;
+      for (; position < end; position += PIDX_AGG_RUN_HEADER_SIZE)
+      {
+        uint64_t header[2];
+        memcpy(header, recv_buffer + position, PIDX_AGG_RUN_HEADER_SIZE);
+        count += header[1];
+      }
+      reply_count[i] = count;
+      reply_size += count;
+    }
+
+    for (uint64_t r = 0; r < runs.count; r++)
+      fetch_count[runs.run[r].rank] += runs.run[r].size;
+
+    uint64_t fetch_size = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+      send_offset[i] = fetch_size;
+      fetch_size += fetch_count[i];
+    }
+
+    if (reply_size > INT_MAX || fetch_size > INT_MAX)
+    {
+      fprintf(stderr, "Aggregation message is too large for the two sided aggregation modes, File %s Line %d\n", __FILE__, __LINE__);
+      goto cleanup;
+    }
+
+    reply_buffer = malloc(reply_size + 1);
+    uint64_t reply_position = 0;
+    for (position = 0; position < recv_size; position += PIDX_AGG_RUN_HEADER_SIZE)
+    {
+      uint64_t header[2];
+      memcpy(header, recv_buffer + position, PIDX_AGG_RUN_HEADER_SIZE);
+      assert(header[0] + header[1] <= ab->buffer_size);
+
+      memcpy(reply_buffer + reply_position, ab->buffer + header[0], header[1]);
+      reply_position += header[1];
+    }
+
+    // the replies travel the other way, over the same (symmetric) graph
+    fetch_buffer = malloc(fetch_size + 1);
+    if (exchange(id, reply_buffer, reply_count, fetch_buffer, fetch_count) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      goto cleanup;
+    }
+
+    // the samples come back in the order the runs were requested
+    for (uint64_t r = 0; r < runs.count; r++)
+    {
+      agg_run* run = &runs.run[r];
+      memcpy(run->buffer, fetch_buffer + send_offset[run->rank], run->size);
+      send_offset[run->rank] += run->size;
+    }
+  }
+
+  ret = PIDX_success;
+
+cleanup:
+  free(reply_buffer);
+  free(fetch_buffer);
+  free(reply_count);
+  free(fetch_count);
+  free(send_buffer);
+  free(recv_buffer);
+  free(send_count);
+  free(recv_count);
+  free(send_offset);
+  free(send_total);
+  free(runs.run);
+
+  return ret;
+}
+
+
+
+// Builds the neighbour graph of the aggregation group from the processes this one sends to. The graph is
+// made symmetric (the union of the sources and destinations of every process) so that it also serves the
+// replies of a read
+static PIDX_return_code create_graph(PIDX_agg_id id, int* send_count)
+{
+  int nprocs = id->idx_c->partition_nprocs;
+
+  PIDX_agg_graph graph = malloc(sizeof(*graph));
+  memset(graph, 0, sizeof(*graph));
+  graph->comm = MPI_COMM_NULL;
+  graph->sources = malloc(nprocs * sizeof(*graph->sources));
+  graph->destinations = malloc(nprocs * sizeof(*graph->destinations));
+  graph->weights = malloc(nprocs * sizeof(*graph->weights));
+  for (int i = 0; i < nprocs; i++)
+  {
+    graph->weights[i] = 1;
+    if (send_count[i] != 0)
+      graph->destinations[graph->out_degree++] = i;
+  }
+
+  // every process only knows where its runs go, MPI finds out where they come from
+  MPI_Comm forward_comm;
+  int source = id->idx_c->partition_rank;
+  if (MPI_Dist_graph_create(id->idx_c->partition_comm, (graph->out_degree != 0), &source, &graph->out_degree, graph->destinations, graph->weights, MPI_INFO_NULL, 0, &forward_comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    PIDX_agg_graph_free(graph);
+    return PIDX_err_agg;
+  }
+
+  int in_degree, out_degree, weighted;
+  MPI_Dist_graph_neighbors_count(forward_comm, &in_degree, &out_degree, &weighted);
+  MPI_Dist_graph_neighbors(forward_comm, in_degree, graph->sources, graph->weights, out_degree, graph->destinations, graph->weights);
+  MPI_Comm_free(&forward_comm);
+
+  int *is_neighbor = calloc(nprocs, sizeof(*is_neighbor));
+  for (int i = 0; i < in_degree; i++)
+    is_neighbor[graph->sources[i]] = 1;
+  for (int i = 0; i < out_degree; i++)
+    is_neighbor[graph->destinations[i]] = 1;
+
+  int degree = 0;
+  for (int i = 0; i < nprocs; i++)
+  {
+    graph->weights[i] = 1;
+    if (is_neighbor[i] == 1)
+    {
+      graph->sources[degree] = i;
+      graph->destinations[degree] = i;
+      degree++;
+    }
+  }
+  free(is_neighbor);
+
+  graph->in_degree = degree;
+  graph->out_degree = degree;
+  if (MPI_Dist_graph_create_adjacent(id->idx_c->partition_comm, graph->in_degree, graph->sources, graph->weights, graph->out_degree, graph->destinations, graph->weights, MPI_INFO_NULL, 0, &graph->comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    PIDX_agg_graph_free(graph);
+    return PIDX_err_agg;
+  }
+
+  id->graph = graph;
+  if (id->cache != NULL)
+    id->cache->graph = graph;
+
+  return PIDX_success;
+}
+
+
+
+// PIDX_AGG_ALLTOALLV exchanges the message sizes with everyone, PIDX_AGG_NEIGHBOR_ALLTOALLV only exchanges
+// them along the edges of the neighbour graph. The graph is built on the first call of the aggregation group
+// and kept with it (with its cache entry in steady state io)
+static PIDX_return_code exchange_counts(PIDX_agg_id id, int* send_count, int* recv_count)
+{
+  int nprocs = id->idx_c->partition_nprocs;
+
+  if (id->idx->aggregation_mode == PIDX_AGG_ALLTOALLV)
+  {
+    if (MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, id->idx_c->partition_comm) != MPI_SUCCESS)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+
+    return PIDX_success;
+  }
+
+  if (id->graph == NULL && id->cache != NULL)
+    id->graph = id->cache->graph;
+
+  // a cached graph is only kept if it still reaches every process this one sends to, on all the processes
+  if (id->graph != NULL && id->cache != NULL)
+  {
+    int *is_neighbor = calloc(nprocs, sizeof(*is_neighbor));
+    for (int i = 0; i < id->graph->out_degree; i++)
+      is_neighbor[id->graph->destinations[i]] = 1;
+
+    int is_stale = 0;
+    for (int i = 0; i < nprocs; i++)
+    {
+      if (send_count[i] != 0 && is_neighbor[i] == 0)
+        is_stale = 1;
+    }
+    free(is_neighbor);
+
+    if (MPI_Allreduce(MPI_IN_PLACE, &is_stale, 1, MPI_INT, MPI_MAX, id->idx_c->partition_comm) != MPI_SUCCESS)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+
+    if (is_stale == 1)
+    {
+      PIDX_agg_graph_free(id->graph);
+      id->graph = NULL;
+      id->cache->graph = NULL;
+    }
+  }
+
+  if (id->graph == NULL && create_graph(id, send_count) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+
+  PIDX_agg_graph graph = id->graph;
+  int *neighbor_send_count = malloc((graph->out_degree + 1) * sizeof(*neighbor_send_count));
+  int *neighbor_recv_count = malloc((graph->in_degree + 1) * sizeof(*neighbor_recv_count));
+  for (int i = 0; i < graph->out_degree; i++)
+    neighbor_send_count[i] = send_count[graph->destinations[i]];
+
+  int ret = MPI_Neighbor_alltoall(neighbor_send_count, 1, MPI_INT, neighbor_recv_count, 1, MPI_INT, graph->comm);
+  if (ret == MPI_SUCCESS)
+  {
+    memset(recv_count, 0, nprocs * sizeof(*recv_count));
+    for (int i = 0; i < graph->in_degree; i++)
+      recv_count[graph->sources[i]] = neighbor_recv_count[i];
+  }
+
+  free(neighbor_send_count);
+  free(neighbor_recv_count);
+
+  if (ret != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+
+  return PIDX_success;
+}
+
+
+
+void PIDX_agg_graph_free(PIDX_agg_graph graph)
+{
+  if (graph == NULL)
+    return;
+
+  if (graph->comm != MPI_COMM_NULL)
+    MPI_Comm_free(&graph->comm);
+
+  free(graph->sources);
+  free(graph->destinations);
+  free(graph->weights);
+  free(graph);
+}
+
+
+
+// Messages are laid out by rank in both buffers, in PIDX_AGG_ALLTOALLV mode the exchange is a
+// MPI_Alltoallv over partition_comm, otherwise a MPI_Neighbor_alltoallv over the neighbour graph
+static PIDX_return_code exchange(PIDX_agg_id id, unsigned char* send_buffer, int* send_count, unsigned char* recv_buffer, int* recv_count)
+{
+  int nprocs = id->idx_c->partition_nprocs;
+  int *send_displ = malloc(nprocs * sizeof(*send_displ));
+  int *recv_displ = malloc(nprocs * sizeof(*recv_displ));
+
+  send_displ[0] = 0;
+  recv_displ[0] = 0;
+  for (int i = 1; i < nprocs; i++)
+  {
+    send_displ[i] = send_displ[i - 1] + send_count[i - 1];
+    recv_displ[i] = recv_displ[i - 1] + recv_count[i - 1];
+  }
+
+  int ret = MPI_SUCCESS;
+  PIDX_agg_graph graph = id->graph;
+  if (id->idx->aggregation_mode == PIDX_AGG_ALLTOALLV)
+    ret = MPI_Alltoallv(send_buffer, send_count, send_displ, MPI_BYTE, recv_buffer, recv_count, recv_displ, MPI_BYTE, id->idx_c->partition_comm);
+  else
+  {
+    int *neighbor_send = malloc(2 * (graph->out_degree + 1) * sizeof(*neighbor_send));
+    int *neighbor_recv = malloc(2 * (graph->in_degree + 1) * sizeof(*neighbor_recv));
+    for (int i = 0; i < graph->out_degree; i++)
+    {
+      neighbor_send[i] = send_count[graph->destinations[i]];
+      neighbor_send[graph->out_degree + i] = send_displ[graph->destinations[i]];
+    }
+    for (int i = 0; i < graph->in_degree; i++)
+    {
+      neighbor_recv[i] = recv_count[graph->sources[i]];
+      neighbor_recv[graph->in_degree + i] = recv_displ[graph->sources[i]];
+    }
+
+    ret = MPI_Neighbor_alltoallv(send_buffer, neighbor_send, neighbor_send + graph->out_degree, MPI_BYTE, recv_buffer, neighbor_recv, neighbor_recv + graph->in_degree, MPI_BYTE, graph->comm);
+
+    free(neighbor_send);
+    free(neighbor_recv);
+  }
+
+  free(send_displ);
+  free(recv_displ);
+
+  if (ret != MPI_SUCCESS)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+
+  return PIDX_success;
+}
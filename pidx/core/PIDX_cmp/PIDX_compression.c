@@ -52,8 +52,11 @@
 
 #include "../../PIDX_inc.h"
 
-static int compress_buffer(PIDX_comp_id comp_id, unsigned char* buffer, int nx, int ny, int nz, int bps, int vps, float bit_rate);
-static int decompress_buffer(PIDX_comp_id comp_id, unsigned char* buffer, int nx, int ny, int nz, int bps, int vps, float bit_rate);
+static uint64_t code_fixed_rate(PIDX_comp_id comp_id, int mode, unsigned char* input, unsigned char* output, uint64_t chunk_count, int bps, float bit_rate);
+static int set_variable_rate_mode(PIDX_comp_id comp_id, zfp_stream* zfp, zfp_type type, uint64_t slot_size);
+static int code_slots(PIDX_comp_id comp_id, int mode, unsigned char* buffer, uint64_t chunk_count, int bps);
+static unsigned char* get_scratch(PIDX_comp_id comp_id, uint64_t size);
+static void swap_scratch(PIDX_comp_id comp_id, PIDX_patch patch, uint64_t size);
 
 ///Struct for restructuring ID
 struct PIDX_comp_id_struct
@@ -65,118 +68,285 @@ struct PIDX_comp_id_struct
   int first_index;
   int last_index;
 
+  /// zfp output buffer, kept in the meta data cache across time steps or in idx for the variables of one file
+  unsigned char** scratch;
+  uint64_t* scratch_size;
 };
 
 
-static int compress_buffer(PIDX_comp_id comp_id, unsigned char* buffer, int nx, int ny, int nz, int bps, int vps, float bit_rate)
+
+static int get_thread_count(PIDX_comp_id comp_id)
 {
-  uint64_t total_bytes = 0;
+#if defined(_OPENMP)
+  return (comp_id->idx->thread_count > 1) ? comp_id->idx->thread_count : 1;
+#else
+  return 1;
+#endif
+}
 
-  if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP)
-  {
-    uint64_t* chunk_dim = comp_id->idx->chunk_size;
-    assert(chunk_dim[0] == 4 && chunk_dim[1] == 4 && chunk_dim[2] == 4);
-    uint64_t total_chunk_dim = (uint64_t)chunk_dim[0] * (uint64_t)chunk_dim[1] * (uint64_t)chunk_dim[2];
-    //uint64_t chunk_bytes = total_chunk_dim * bytes_per_sample;
-    //zfp_type type = (bytes_per_sample == 4) ? zfp_type_float : zfp_type_double;
 
-    uint64_t chunk_bytes = total_chunk_dim * bps;
-    zfp_type type = (bps == 4) ? zfp_type_float : zfp_type_double;
 
-    zfp_field* field = zfp_field_3d(NULL, type, nx, ny, nz);
+// Fixed rate zfp codes every 4x4x4 chunk into the same number of bits. When that is a whole number of words of the
+// bit stream, the chunks are split in as many ranges as there are threads, every range having its own stream
+// that starts at the known offset of its first chunk in the output. Otherwise the chunks are coded in one stream.
+static uint64_t code_fixed_rate(PIDX_comp_id comp_id, int mode, unsigned char* input, unsigned char* output, uint64_t chunk_count, int bps, float bit_rate)
+{
+  uint64_t* chunk_dim = comp_id->idx->chunk_size;
+  assert(chunk_dim[0] == 4 && chunk_dim[1] == 4 && chunk_dim[2] == 4);
+  uint64_t chunk_bytes = chunk_dim[0] * chunk_dim[1] * chunk_dim[2] * bps;
+  zfp_type type = (bps == 4) ? zfp_type_float : zfp_type_double;
+
+  uint maxbits;
+  zfp_stream* zfp = zfp_stream_open(NULL);
+  zfp_stream_set_rate(zfp, bit_rate, type, 3, 0);
+  zfp_stream_params(zfp, NULL, &maxbits, NULL, NULL);
+  zfp_stream_close(zfp);
+  assert(maxbits % CHAR_BIT == 0);
+
+  int thread_count = (maxbits % stream_word_bits == 0) ? get_thread_count(comp_id) : 1;
+  if ((uint64_t)thread_count > chunk_count)
+    thread_count = (chunk_count > 0) ? chunk_count : 1;
+
+#if defined(_OPENMP)
+#pragma omp parallel for num_threads(thread_count) schedule(static)
+#endif
+  for (int t = 0; t < thread_count; t++)
+  {
+    uint64_t first = chunk_count * t / thread_count;
+    uint64_t last = chunk_count * (t + 1) / thread_count;
+    unsigned char* compressed = (mode == PIDX_WRITE) ? output : input;
+
     zfp_stream* zfp = zfp_stream_open(NULL);
     zfp_stream_set_rate(zfp, bit_rate, type, 3, 0);
-    uint64_t bytes_max = zfp_stream_maximum_size(zfp, field);
-    bytes_max = bytes_max * vps;
+    bitstream* stream = stream_open(compressed + first * (maxbits / CHAR_BIT), (last - first) * (maxbits / CHAR_BIT));
+    zfp_stream_set_bit_stream(zfp, stream);
+
+    for (uint64_t c = first; c < last; c++)
+    {
+      if (mode == PIDX_WRITE)
+      {
+        if (type == zfp_type_float)
+          zfp_encode_block_float_3(zfp, (float*)(input + c * chunk_bytes));
+        else
+          zfp_encode_block_double_3(zfp, (double*)(input + c * chunk_bytes));
+      }
+      else
+      {
+        if (type == zfp_type_float)
+          zfp_decode_block_float_3(zfp, (float*)(output + c * chunk_bytes));
+        else
+          zfp_decode_block_double_3(zfp, (double*)(output + c * chunk_bytes));
+      }
+    }
+
+    if (mode == PIDX_WRITE)
+      zfp_stream_flush(zfp);
+
+    zfp_stream_close(zfp);
+    stream_close(stream);
+  }
+
+  return chunk_count * (maxbits / CHAR_BIT);
+}
+
+
+
+static int set_variable_rate_mode(PIDX_comp_id comp_id, zfp_stream* zfp, zfp_type type, uint64_t slot_size)
+{
+  if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP_PRECISION)
+  {
+    if (comp_id->idx->compression_parameter < 1)
+      return PIDX_err_compress;
+    zfp_stream_set_precision(zfp, (uint)comp_id->idx->compression_parameter, type);
+  }
+  else
+  {
+    if (!(comp_id->idx->compression_parameter > 0))
+      return PIDX_err_compress;
+    zfp_stream_set_accuracy(zfp, comp_id->idx->compression_parameter, type);
+  }
+
+  // a stream never outgrows its slot, the (rare) chunks that would are coded with fewer bit planes
+  uint minbits, maxbits, maxprec;
+  int minexp;
+  zfp_stream_params(zfp, &minbits, &maxbits, &maxprec, &minexp);
+  zfp_stream_set_params(zfp, minbits, (slot_size - PIDX_ZFP_SLOT_HEADER_SIZE) * CHAR_BIT, maxprec, minexp);
+
+  return PIDX_success;
+}
+
+
+
+// Variable rate chunks are coded in place, every chunk in its own slot, so the chunks are independent and
+// are shared among the threads
+static int code_slots(PIDX_comp_id comp_id, int mode, unsigned char* buffer, uint64_t chunk_count, int bps)
+{
+  uint64_t* chunk_dim = comp_id->idx->chunk_size;
+  assert(chunk_dim[0] == 4 && chunk_dim[1] == 4 && chunk_dim[2] == 4);
+  uint64_t slot_size = chunk_dim[0] * chunk_dim[1] * chunk_dim[2] * bps;
+  uint64_t stream_capacity = slot_size - PIDX_ZFP_SLOT_HEADER_SIZE;
+  zfp_type type = (bps == 4) ? zfp_type_float : zfp_type_double;
+
+  int ret = PIDX_success;
+
+#if defined(_OPENMP)
+  int thread_count = get_thread_count(comp_id);
+#pragma omp parallel num_threads(thread_count)
+#endif
+  {
+    zfp_stream* zfp = zfp_stream_open(NULL);
+    int mode_ret = set_variable_rate_mode(comp_id, zfp, type, slot_size);
 
-    unsigned char* output = malloc(bytes_max);
-    bitstream* stream = stream_open(output, bytes_max);
+    // streams are read and written in 64 bit words, so they are coded in an aligned scratch buffer
+    uint64_t* scratch = malloc(stream_capacity);
+    bitstream* stream = stream_open(scratch, stream_capacity);
     zfp_stream_set_bit_stream(zfp, stream);
-    uint64_t i = 0;
-    uint64_t length = (uint64_t)nx * (uint64_t)ny * (uint64_t)nz;
 
-    for (i = 0; i < length * bps * vps; i += chunk_bytes)
+#if defined(_OPENMP)
+#pragma omp for schedule(static)
+#endif
+    for (uint64_t c = 0; c < chunk_count; c++)
     {
-      uint64_t bits = 0;
-      if (type == zfp_type_float)
-        bits = zfp_encode_block_float_3(zfp, (float*)(buffer + i));
-      else if (type == zfp_type_double)
-        bits = zfp_encode_block_double_3(zfp, (double*)(buffer + i));
-
-      assert(bits % CHAR_BIT == 0);
-      total_bytes += bits / CHAR_BIT;
+      unsigned char* slot = buffer + c * slot_size;
+      if (mode_ret != PIDX_success)
+        continue;
+
+      uint64_t bytes;
+      if (mode == PIDX_WRITE)
+      {
+        zfp_stream_rewind(zfp);
+        if (type == zfp_type_float)
+          zfp_encode_block_float_3(zfp, (float*)slot);
+        else
+          zfp_encode_block_double_3(zfp, (double*)slot);
+        zfp_stream_flush(zfp);
+
+        bytes = stream_size(stream);
+        memcpy(slot, &bytes, PIDX_ZFP_SLOT_HEADER_SIZE);
+        memcpy(slot + PIDX_ZFP_SLOT_HEADER_SIZE, scratch, bytes);
+        memset(slot + PIDX_ZFP_SLOT_HEADER_SIZE + bytes, 0, stream_capacity - bytes);
+      }
+      else
+      {
+        memcpy(&bytes, slot, PIDX_ZFP_SLOT_HEADER_SIZE);
+        if (bytes > stream_capacity)
+        {
+          mode_ret = PIDX_err_compress;
+          continue;
+        }
+
+        // slots that never received a chunk (nothing was written there) read back as zeros
+        if (bytes == 0)
+        {
+          memset(slot, 0, slot_size);
+          continue;
+        }
+
+        memset(scratch, 0, stream_capacity);
+        memcpy(scratch, slot + PIDX_ZFP_SLOT_HEADER_SIZE, bytes);
+        zfp_stream_rewind(zfp);
+        if (type == zfp_type_float)
+          zfp_decode_block_float_3(zfp, (float*)slot);
+        else
+          zfp_decode_block_double_3(zfp, (double*)slot);
+      }
+    }
+
+    if (mode_ret != PIDX_success)
+    {
+#if defined(_OPENMP)
+#pragma omp critical
+#endif
+      ret = mode_ret;
     }
-    memcpy(buffer, output, total_bytes);
-    free(output);
+
+    free(scratch);
     zfp_stream_close(zfp);
     stream_close(stream);
-    zfp_field_free(field);
   }
 
-  return total_bytes;
+  return ret;
 }
 
 
-static int decompress_buffer(PIDX_comp_id comp_id, unsigned char* buffer, int nx, int ny, int nz, int bps, int vps, float bit_rate)
+
+static unsigned char* get_scratch(PIDX_comp_id comp_id, uint64_t size)
 {
-   uint64_t total_bytes = 0;
-
-   if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP)
-   {
-     uint64_t* chunk_dim = comp_id->idx->chunk_size;
-     assert(chunk_dim[0] == 4 && chunk_dim[1] == 4 && chunk_dim[2] == 4);
-     uint64_t total_chunk_dim = (uint64_t)chunk_dim[0] * (uint64_t)chunk_dim[1] * (uint64_t)chunk_dim[2];
-
-     //uint64_t chunk_bytes = total_chunk_dim * bytes_per_sample;
-     //zfp_type type = (bytes_per_sample == 4) ? zfp_type_float : zfp_type_double;
-
-     uint64_t chunk_bytes = total_chunk_dim * bps;
-     zfp_type type = (bps == 4) ? zfp_type_float : zfp_type_double;
-
-     zfp_field* field = zfp_field_3d(NULL, type, nx, ny, nz);
-     zfp_stream* zfp = zfp_stream_open(NULL);
-     zfp_stream_set_rate(zfp, bit_rate, type, 3, 0);
-
-     unsigned char* temp_buffer = malloc(nx * ny * nz * bps * vps);
-     bitstream* stream = stream_open(buffer, (nx * ny * nz * bps * vps) / comp_id->idx->compression_factor);
-     zfp_stream_set_bit_stream(zfp, stream);
-     uint64_t i = 0;
-     uint64_t length = (uint64_t)nx * (uint64_t)ny * (uint64_t)nz;
-
-     for (i = 0; i < length * bps * vps; i += chunk_bytes)
-     {
-       uint64_t bits = 0;
-       if (type == zfp_type_float)
-         bits = zfp_decode_block_float_3(zfp, (float*)(temp_buffer + i));
-       else if (type == zfp_type_double)
-         bits = zfp_decode_block_double_3(zfp, (double*)(temp_buffer + i));
-
-       assert(bits % CHAR_BIT == 0);
-       total_bytes += bits / CHAR_BIT;
-     }
-
-     unsigned char *temp_buffer2 = realloc(buffer, nx * ny * nz * bps * vps);
-     if (temp_buffer2 == NULL)
-     {
-       fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
-       return PIDX_err_rst;
-     }
-     else
-       buffer = temp_buffer2;
-
-     memcpy(buffer, temp_buffer, nx * ny * nz * bps * vps);
-
-     free(temp_buffer);
-     zfp_stream_close(zfp);
-     stream_close(stream);
-     zfp_field_free(field);
-   }
-
-   return total_bytes;
+  if (*comp_id->scratch_size < size)
+  {
+    free(*comp_id->scratch);
+    *comp_id->scratch = malloc(size);
+    *comp_id->scratch_size = (*comp_id->scratch == NULL) ? 0 : size;
+  }
+
+  return *comp_id->scratch;
 }
 
+
+
+// The patch takes over the scratch buffer it was coded into, its previous buffer (at least size bytes)
+// becomes the scratch buffer of the next variable or time step
+static void swap_scratch(PIDX_comp_id comp_id, PIDX_patch patch, uint64_t size)
+{
+  unsigned char* buffer = patch->buffer;
+  patch->buffer = *comp_id->scratch;
+  *comp_id->scratch = buffer;
+  *comp_id->scratch_size = size;
+}
+
+
+
+int PIDX_compression_is_variable_rate(idx_dataset idx_meta_data)
+{
+  return idx_meta_data->compression_type == PIDX_CHUNKING_ZFP_PRECISION || idx_meta_data->compression_type == PIDX_CHUNKING_ZFP_ACCURACY;
+}
+
+
+
+uint64_t PIDX_compression_pack_block(unsigned char* block, uint64_t slot_count, uint64_t slot_size)
+{
+  // packed entries never start after their slot, so the block can be packed front to back in place
+  uint64_t packed_size = 0;
+  for (uint64_t s = 0; s < slot_count; s++)
+  {
+    uint64_t bytes;
+    memcpy(&bytes, block + s * slot_size, PIDX_ZFP_SLOT_HEADER_SIZE);
+    if (bytes > slot_size - PIDX_ZFP_SLOT_HEADER_SIZE)
+      bytes = 0;
+
+    memmove(block + packed_size, block + s * slot_size, PIDX_ZFP_SLOT_HEADER_SIZE + bytes);
+    packed_size = packed_size + PIDX_ZFP_SLOT_HEADER_SIZE + bytes;
+  }
+
+  return packed_size;
+}
+
+
+
+PIDX_return_code PIDX_compression_unpack_block(const unsigned char* packed, uint64_t packed_size, unsigned char* block, uint64_t slot_count, uint64_t slot_size)
+{
+  uint64_t offset = 0;
+  for (uint64_t s = 0; s < slot_count; s++)
+  {
+    uint64_t bytes;
+    if (offset + PIDX_ZFP_SLOT_HEADER_SIZE > packed_size)
+      return PIDX_err_compress;
+
+    memcpy(&bytes, packed + offset, PIDX_ZFP_SLOT_HEADER_SIZE);
+    if (bytes > slot_size - PIDX_ZFP_SLOT_HEADER_SIZE || offset + PIDX_ZFP_SLOT_HEADER_SIZE + bytes > packed_size)
+      return PIDX_err_compress;
+
+    memcpy(block + s * slot_size, packed + offset, PIDX_ZFP_SLOT_HEADER_SIZE + bytes);
+    offset = offset + PIDX_ZFP_SLOT_HEADER_SIZE + bytes;
+  }
+
+  return PIDX_success;
+}
+
+
+
 PIDX_comp_id PIDX_compression_init(idx_dataset idx_meta_data,
-                                   idx_comm idx_c, int start_var_index, int end_var_index)
+                                   idx_comm idx_c, PIDX_metadata_cache meta_data_cache, int start_var_index, int end_var_index)
 {
   PIDX_comp_id comp_id;
 
@@ -189,6 +359,17 @@ PIDX_comp_id PIDX_compression_init(idx_dataset idx_meta_data,
   comp_id->first_index = start_var_index;
   comp_id->last_index = end_var_index;
 
+  if (meta_data_cache != NULL)
+  {
+    comp_id->scratch = &meta_data_cache->compression_scratch;
+    comp_id->scratch_size = &meta_data_cache->compression_scratch_size;
+  }
+  else
+  {
+    comp_id->scratch = &idx_meta_data->compression_scratch;
+    comp_id->scratch_size = &idx_meta_data->compression_scratch_size;
+  }
+
   return comp_id;
 }
 
@@ -197,31 +378,32 @@ PIDX_return_code PIDX_compression(PIDX_comp_id comp_id)
   if (comp_id->idx->compression_type == PIDX_NO_COMPRESSION || comp_id->idx->compression_type == PIDX_CHUNKING_ONLY)
     return PIDX_success;
 
-  if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP)
+  for (int v = comp_id->first_index; v <= comp_id->last_index; v++)
   {
-    int v;
+    PIDX_variable var = comp_id->idx->variable[v];
+    PIDX_patch patch = var->chunked_super_patch->restructured_patch;
+
+    int values = 0;
+    int bits = 0;
+    PIDX_get_datatype_details(var->type_name, &values, &bits);
+
+    uint64_t chunk_count = (patch->size[0] * patch->size[1] * patch->size[2] * values) / (comp_id->idx->chunk_size[0] * comp_id->idx->chunk_size[1] * comp_id->idx->chunk_size[2]);
 
-    for (v = comp_id->first_index; v <= comp_id->last_index; v++)
+    // compressed in place, every chunk stays in its slot
+    if (PIDX_compression_is_variable_rate(comp_id->idx))
     {
-      PIDX_variable var = comp_id->idx->variable[v];
-      PIDX_patch patch = var->chunked_super_patch->restructured_patch;
-      unsigned char* buffer = patch->buffer;
-      int nx = patch->size[0];
-      int ny = patch->size[1];
-      int nz = patch->size[2];
-      float bit_rate = comp_id->idx->compression_bit_rate;
-
-
-      int values = 0;
-      int bits = 0;
-      PIDX_get_datatype_details(var->type_name, &values, &bits);
-
-      int compressed_bytes = compress_buffer(comp_id, buffer, nx, ny, nz, bits/CHAR_BIT, values, bit_rate);
-      unsigned char* temp_buffer = realloc(patch->buffer, compressed_bytes);
-      if (temp_buffer == NULL)
+      if (code_slots(comp_id, PIDX_WRITE, patch->buffer, chunk_count, bits/CHAR_BIT) != PIDX_success)
         return PIDX_err_compress;
-      else
-        patch->buffer = temp_buffer;
+    }
+    else if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP)
+    {
+      uint64_t bytes = patch->size[0] * patch->size[1] * patch->size[2] * values * (bits/CHAR_BIT);
+      unsigned char* output = get_scratch(comp_id, bytes);
+      if (output == NULL)
+        return PIDX_err_compress;
+
+      code_fixed_rate(comp_id, PIDX_WRITE, patch->buffer, output, chunk_count, bits/CHAR_BIT, comp_id->idx->compression_bit_rate);
+      swap_scratch(comp_id, patch, bytes);
     }
   }
 
@@ -233,28 +415,33 @@ PIDX_return_code PIDX_decompression(PIDX_comp_id comp_id)
   if (comp_id->idx->compression_type == PIDX_NO_COMPRESSION || comp_id->idx->compression_type == PIDX_CHUNKING_ONLY)
     return PIDX_success;
 
-  if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP)
+  for (int v = comp_id->first_index; v <= comp_id->last_index; v++)
   {
-    int v, ret = 0;
-    for (v = comp_id->first_index; v <= comp_id->last_index; v++)
-    {
-      PIDX_variable var = comp_id->idx->variable[v];
+    PIDX_variable var = comp_id->idx->variable[v];
+    PIDX_patch patch = var->chunked_super_patch->restructured_patch;
 
-      PIDX_patch patch = var->chunked_super_patch->restructured_patch;
-      unsigned char* buffer = patch->buffer;
-      int nx = patch->size[0];
-      int ny = patch->size[1];
-      int nz = patch->size[2];
-      float bit_rate = comp_id->idx->compression_bit_rate;
+    int values = 0;
+    int bits = 0;
+    PIDX_get_datatype_details(var->type_name, &values, &bits);
 
-      int values = 0;
-      int bits = 0;
-      PIDX_get_datatype_details(var->type_name, &values, &bits);
+    uint64_t chunk_count = (patch->size[0] * patch->size[1] * patch->size[2] * values) / (comp_id->idx->chunk_size[0] * comp_id->idx->chunk_size[1] * comp_id->idx->chunk_size[2]);
 
-      ret = decompress_buffer(comp_id, buffer, nx, ny, nz, bits/CHAR_BIT, values, bit_rate);
-      if (ret == -1)
+    if (PIDX_compression_is_variable_rate(comp_id->idx))
+    {
+      if (code_slots(comp_id, PIDX_READ, patch->buffer, chunk_count, bits/CHAR_BIT) != PIDX_success)
         return PIDX_err_compress;
     }
+    else if (comp_id->idx->compression_type == PIDX_CHUNKING_ZFP)
+    {
+      // the chunked patch buffer is allocated for the uncompressed chunks (PIDX_chunk_buf_create)
+      uint64_t bytes = patch->size[0] * patch->size[1] * patch->size[2] * values * (bits/CHAR_BIT);
+      unsigned char* output = get_scratch(comp_id, bytes);
+      if (output == NULL)
+        return PIDX_err_compress;
+
+      code_fixed_rate(comp_id, PIDX_READ, patch->buffer, output, chunk_count, bits/CHAR_BIT, comp_id->idx->compression_bit_rate);
+      swap_scratch(comp_id, patch, bytes);
+    }
   }
 
   return PIDX_success;
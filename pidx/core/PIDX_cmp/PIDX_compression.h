@@ -46,7 +46,7 @@
 struct PIDX_comp_id_struct;
 typedef struct PIDX_comp_id_struct* PIDX_comp_id;
 
-PIDX_comp_id PIDX_compression_init(idx_dataset idx_meta_data, idx_comm idx_c, int start_var_index, int end_var_index );
+PIDX_comp_id PIDX_compression_init(idx_dataset idx_meta_data, idx_comm idx_c, PIDX_metadata_cache meta_data_cache, int start_var_index, int end_var_index );
 
 
 ///
@@ -61,4 +61,44 @@ PIDX_return_code PIDX_decompression(PIDX_comp_id id);
 
 ///
 PIDX_return_code PIDX_compression_finalize(PIDX_comp_id id);
+
+
+
+///
+/// \brief PIDX_compression_is_variable_rate
+/// \param idx_meta_data
+/// \return 1 for the zfp modes whose chunks compress to a variable number of bytes (fixed precision and fixed accuracy)
+///
+int PIDX_compression_is_variable_rate(idx_dataset idx_meta_data);
+
+
+
+/// In the variable rate modes a compressed 4x4x4 chunk keeps the slot of the uncompressed chunk all the way from
+/// compression to file io (compression_factor is 1), the slot starts with the byte count of its zfp stream
+/// (uint64_t) followed by the stream itself. Files store the blocks packed, slot headers followed by their streams.
+#define PIDX_ZFP_SLOT_HEADER_SIZE 8
+
+
+
+///
+/// \brief PIDX_compression_pack_block Packs the slots of an idx block in place
+/// \param block
+/// \param slot_count number of chunks in the block (samples_per_block * vps)
+/// \param slot_size bytes of an uncompressed chunk
+/// \return packed size of the block in bytes
+///
+uint64_t PIDX_compression_pack_block(unsigned char* block, uint64_t slot_count, uint64_t slot_size);
+
+
+
+///
+/// \brief PIDX_compression_unpack_block Expands a block packed by PIDX_compression_pack_block back into its slots
+/// \param packed
+/// \param packed_size
+/// \param block slot_count * slot_size bytes
+/// \param slot_count
+/// \param slot_size
+/// \return PIDX_err_compress if the packed block is corrupt
+///
+PIDX_return_code PIDX_compression_unpack_block(const unsigned char* packed, uint64_t packed_size, unsigned char* block, uint64_t slot_count, uint64_t slot_size);
 #endif
@@ -58,11 +58,62 @@ PIDX_file_io_id PIDX_file_io_init(idx_dataset idx_meta_data, idx_comm idx_c, int
   io_id->first_index = first_index;
   io_id->last_index = last_index;
 
+  io_id->fh = MPI_FILE_NULL;
+  io_id->request = MPI_REQUEST_NULL;
+
   return io_id;
 }
 
 
 
+PIDX_return_code PIDX_file_io_pack_blocks(PIDX_file_io_id io_id, Agg_buffer agg_buf, PIDX_block_layout block_layout, MPI_File fh, uint64_t data_offset, uint64_t* packed_size)
+{
+  int ret;
+  MPI_Status status;
+  PIDX_variable var = io_id->idx->variable[agg_buf->var_number];
+  int bpf = io_id->idx->blocks_per_file;
+
+  uint64_t slot_size = io_id->idx->chunk_size[0] * io_id->idx->chunk_size[1] * io_id->idx->chunk_size[2] * (var->bpv/8);
+  uint64_t slot_count = (uint64_t)io_id->idx->samples_per_block * var->vps;
+
+  uint64_t total_header_size = (10 + (10 * bpf)) * sizeof (uint32_t) * io_id->idx->variable_count;
+  uint32_t* headers = malloc(total_header_size);
+  memset(headers, 0, total_header_size);
+
+  // the present blocks follow each other in the aggregation buffer, they are packed one after the other
+  uint64_t offset = 0;
+  int block_count = 0;
+  for (int i = 0; i < bpf; i++)
+  {
+    if (PIDX_blocks_is_block_present(agg_buf->file_number * bpf + i, io_id->idx->bits_per_block, block_layout))
+    {
+      unsigned char* block = agg_buf->buffer + (uint64_t)block_count * slot_count * slot_size;
+      uint64_t size = PIDX_compression_pack_block(block, slot_count, slot_size);
+      memmove(agg_buf->buffer + offset, block, size);
+
+      PIDX_header_io_set_block(headers, i + bpf * agg_buf->var_number, data_offset + offset, size);
+      offset = offset + size;
+      block_count++;
+    }
+  }
+
+  // the aggregator owns all the blocks of its variable in this file, so it writes their header entries
+  uint64_t entries_offset = (10 + (uint64_t)10 * bpf * agg_buf->var_number);
+  ret = MPI_File_write_at(fh, entries_offset * sizeof (uint32_t), headers + entries_offset, 10 * bpf * sizeof (uint32_t), MPI_BYTE, &status);
+  free(headers);
+  if (ret != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  *packed_size = offset;
+
+  return PIDX_success;
+}
+
+
+
 int PIDX_file_io_finalize(PIDX_file_io_id io_id)
 {
 
@@ -62,10 +62,30 @@ struct PIDX_file_io_struct
 
   int first_index;
   int last_index;
+
+  MPI_File fh;                  ///< file handle kept open while a non-blocking write is in flight
+  MPI_Request request;          ///< request of the non-blocking write (MPI_REQUEST_NULL if nothing was issued)
 };
 typedef struct PIDX_file_io_struct* PIDX_file_io_id;
 
 
+/// Non-blocking aggregator writes whose completion is deferred to the next PIDX_flush or to PIDX_close.
+/// The binary files are opened once per process and kept open until the writes complete.
+struct PIDX_file_io_async_struct
+{
+  int request_count;
+  int request_capacity;
+  MPI_Request *request;         ///< one request per issued write
+  unsigned char **buffer;       ///< aggregation buffer owned by every request, freed once the write completes
+
+  int file_count;
+  int file_capacity;
+  int *file_number;             ///< binary files held open by this process
+  MPI_File *fh;
+};
+typedef struct PIDX_file_io_async_struct* PIDX_file_io_async;
+
+
 /// Creates the IO ID.
 /// \param idx_meta_data All infor regarding the idx file passed from PIDX.c
 /// \param idx_derived_ptr All derived idx related derived metadata passed from PIDX.c
@@ -80,6 +100,146 @@ PIDX_file_io_id PIDX_file_io_init(idx_dataset idx_meta_data, idx_comm idx_c, int
 int PIDX_file_io_async_write(PIDX_file_io_id io_id, Agg_buffer agg_buf, PIDX_block_layout block_layout, MPI_Request* req, MPI_File *fp, char* filename_template);
 
 
+///
+/// \brief PIDX_file_io_async_wait Completes the write issued by PIDX_file_io_async_write and closes the file
+/// \param io_id
+/// \return
+///
+PIDX_return_code PIDX_file_io_async_wait(PIDX_file_io_id io_id);
+
+
+///
+/// \brief PIDX_file_io_async_create
+/// \return
+///
+PIDX_file_io_async PIDX_file_io_async_create();
+
+
+///
+/// \brief PIDX_file_io_async_defer_write Issues the write of agg_buf and hands its buffer over to async
+/// \param io_id
+/// \param async
+/// \param agg_buf
+/// \param block_layout
+/// \param filename_template
+/// \return
+///
+PIDX_return_code PIDX_file_io_async_defer_write(PIDX_file_io_id io_id, PIDX_file_io_async async, Agg_buffer agg_buf, PIDX_block_layout block_layout, char* filename_template);
+
+
+///
+/// \brief PIDX_file_io_async_complete Waits for all the deferred writes, frees their buffers and closes the files
+/// \param async
+/// \return
+///
+PIDX_return_code PIDX_file_io_async_complete(PIDX_file_io_async async);
+
+
+///
+/// \brief PIDX_file_io_async_destroy
+/// \param async
+/// \return
+///
+PIDX_return_code PIDX_file_io_async_destroy(PIDX_file_io_async async);
+
+
+///
+/// \brief PIDX_file_io_pack_blocks Packs the blocks of a variable rate compressed aggregation buffer in place
+/// (see PIDX_compression_pack_block) and writes their offsets and packed sizes into the header of the file
+/// \param io_id
+/// \param agg_buf
+/// \param block_layout
+/// \param fh binary file of the aggregator, open for writing
+/// \param data_offset file offset the aggregation buffer is written at
+/// \param packed_size bytes of the aggregation buffer to write
+/// \return
+///
+PIDX_return_code PIDX_file_io_pack_blocks(PIDX_file_io_id io_id, Agg_buffer agg_buf, PIDX_block_layout block_layout, MPI_File fh, uint64_t data_offset, uint64_t* packed_size);
+
+
+/// Variable of the extent holding the brick index of a particle patch. It is larger than any variable
+/// index, so writing the variables 0 to PIDX_SHARED_FILE_INDEX_VARIABLE writes all the extents.
+#define PIDX_SHARED_FILE_INDEX_VARIABLE UINT32_MAX
+
+
+/// One extent of a shared file: the bytes of one variable of one patch of one process
+struct PIDX_shared_file_extent_struct
+{
+  uint32_t rank;
+  uint32_t patch;
+  uint32_t variable;
+  uint32_t reserved;
+  uint64_t offset;              ///< byte offset in the shared file
+  uint64_t size;
+};
+typedef struct PIDX_shared_file_extent_struct PIDX_shared_file_extent;
+
+
+/// Shared file of the particle and raw layouts (see PIDX_set_shared_file_count), written by one aggregator
+/// for a group of consecutive processes. The file starts with a header and the directory of its extents,
+/// then come the extents of the processes in rank order, the extents of a process in the order it listed them.
+struct PIDX_shared_file_struct
+{
+  MPI_Comm comm;                ///< processes of the file, the aggregator is rank 0
+  int file;                     ///< file number, the file is shared_<file> of the time step directory
+  int fp;                       ///< open file (aggregator only)
+  int rank;                     ///< rank of this process in the communicator the file was created over
+
+  int extent_count;             ///< extents of this process, with their offsets
+  PIDX_shared_file_extent *extent;
+
+  int file_extent_count;        ///< extents of all the processes of the file (aggregator only)
+  PIDX_shared_file_extent *file_extent;
+};
+typedef struct PIDX_shared_file_struct* PIDX_shared_file;
+
+
+///
+/// \brief PIDX_shared_file_name Path of a shared file
+/// \param name buffer of PATH_MAX characters
+/// \param directory_path dataset path without the .idx extension
+/// \param time_step
+/// \param file
+///
+void PIDX_shared_file_name(char *name, const char *directory_path, int time_step, int file);
+
+
+///
+/// \brief PIDX_shared_file_create Places the extents of all the processes of comm in file_count shared files
+/// and writes the directories (collective). The aggregator of every file keeps it open until PIDX_shared_file_free.
+/// \param comm
+/// \param file_count number of aggregators and files (at most the number of processes)
+/// \param directory_path dataset path without the .idx extension
+/// \param time_step
+/// \param extent extents of this process, patch, variable and size are set by the caller
+/// \param extent_count
+/// \param shared_file the placement of the extents of this process in its file
+/// \return
+///
+PIDX_return_code PIDX_shared_file_create(MPI_Comm comm, int file_count, const char *directory_path, int time_step, const PIDX_shared_file_extent *extent, int extent_count, PIDX_shared_file *shared_file);
+
+
+///
+/// \brief PIDX_shared_file_write Sends the extents of the variables first_variable to last_variable to the
+/// aggregator, which writes them (collective over the processes of the file). Extents are sent in messages of
+/// at most 64 MiB, the aggregator holds two of them at a time.
+/// \param shared_file
+/// \param first_variable
+/// \param last_variable
+/// \param buffer buffer[i] holds the bytes of the extent i of this process (only read for the variables written)
+/// \return the same code on every process of the file, an error on one of them fails the write for all
+///
+PIDX_return_code PIDX_shared_file_write(PIDX_shared_file shared_file, uint32_t first_variable, uint32_t last_variable, unsigned char **buffer);
+
+
+///
+/// \brief PIDX_shared_file_free
+/// \param shared_file
+/// \return
+///
+PIDX_return_code PIDX_shared_file_free(PIDX_shared_file shared_file);
+
+
 PIDX_return_code PIDX_file_io_blocking_write(PIDX_file_io_id io_id, Agg_buffer agg_buf, PIDX_block_layout block_layout, char* filename_template);
 
 
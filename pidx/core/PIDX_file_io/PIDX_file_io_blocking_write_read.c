@@ -85,23 +85,50 @@ PIDX_return_code PIDX_file_io_blocking_read(PIDX_file_io_id io_id, Agg_buffer ag
       return PIDX_err_io;
     }
 
-    int data_size = 0;
+    uint64_t data_size = 0;
     int block_count = 0;
+    int large_offsets = PIDX_header_io_large_offsets(io_id->idx);
+    PIDX_variable var = io_id->idx->variable[agg_buf->var_number];
+    uint64_t slot_count = (uint64_t)io_id->idx->samples_per_block * var->vps;
+    uint64_t block_size = (slot_count * (var->bpv/8) * tck) / io_id->idx->compression_factor;
+    unsigned char* packed = NULL;
     for (i = 0; i < io_id->idx->blocks_per_file; i++)
     {
       if (PIDX_blocks_is_block_present(agg_buf->file_number * io_id->idx->blocks_per_file + i, io_id->idx->bits_per_block, block_layout))
       {
-        data_offset = htonl(headers[12 + ((i + (io_id->idx->blocks_per_file * agg_buf->var_number))*10 )]);
-        data_size = htonl(headers[14 + ((i + (io_id->idx->blocks_per_file * agg_buf->var_number))*10 )]);
+        data_offset = PIDX_header_io_get_block_offset(headers, i + (io_id->idx->blocks_per_file * agg_buf->var_number), large_offsets);
+        data_size = PIDX_header_io_get_block_size(headers, i + (io_id->idx->blocks_per_file * agg_buf->var_number), large_offsets);
 
-        int buffer_index = (block_count * io_id->idx->samples_per_block * (io_id->idx->variable[agg_buf->var_number]->bpv/8) * io_id->idx->variable[agg_buf->var_number]->vps * tck) / io_id->idx->compression_factor;
+        uint64_t buffer_index = ((uint64_t)block_count * io_id->idx->samples_per_block * (io_id->idx->variable[agg_buf->var_number]->bpv/8) * io_id->idx->variable[agg_buf->var_number]->vps * tck) / io_id->idx->compression_factor;
 
-        //fprintf(stderr, "DO and DS %d %d\n", data_offset, data_size);
-        ret = MPI_File_read_at(fp, data_offset, agg_buf->buffer + buffer_index, data_size, MPI_BYTE, &status);
-        if (ret != MPI_SUCCESS)
+        // packed blocks of the variable rate zfp modes are expanded back into their slots
+        if (PIDX_compression_is_variable_rate(io_id->idx) && data_size != 0 && data_size < block_size)
         {
-          fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_write_at() failed for filename %s.\n", (long long)  data_offset, __FILE__, __LINE__, file_name);
-          return PIDX_err_io;
+          if (packed == NULL)
+            packed = malloc(block_size);
+
+          ret = MPI_File_read_at(fp, data_offset, packed, data_size, MPI_BYTE, &status);
+          if (ret != MPI_SUCCESS)
+          {
+            fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_read_at() failed for filename %s.\n", (long long)  data_offset, __FILE__, __LINE__, file_name);
+            return PIDX_err_io;
+          }
+
+          if (PIDX_compression_unpack_block(packed, data_size, agg_buf->buffer + buffer_index, slot_count, block_size / slot_count) != PIDX_success)
+          {
+            fprintf(stderr, "[%s] [%d] corrupt block %d in %s.\n", __FILE__, __LINE__, i, file_name);
+            return PIDX_err_io;
+          }
+        }
+        else
+        {
+          //fprintf(stderr, "DO and DS %d %d\n", data_offset, data_size);
+          ret = MPI_File_read_at(fp, data_offset, agg_buf->buffer + buffer_index, data_size, MPI_BYTE, &status);
+          if (ret != MPI_SUCCESS)
+          {
+            fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_write_at() failed for filename %s.\n", (long long)  data_offset, __FILE__, __LINE__, file_name);
+            return PIDX_err_io;
+          }
         }
 
 #if 0
@@ -167,6 +194,7 @@ PIDX_return_code PIDX_file_io_blocking_read(PIDX_file_io_id io_id, Agg_buffer ag
 
     MPI_File_close(&fp);
     free(headers);
+    free(packed);
   }
 
   return PIDX_success;
@@ -214,8 +242,18 @@ PIDX_return_code PIDX_file_io_blocking_write(PIDX_file_io_id io_id, Agg_buffer a
     //for (i = 0; i < agg_buf->sample_number; i++)
     //  data_offset = (uint64_t) data_offset + agg_buf->buffer_size;
 
+    uint64_t write_size = agg_buf->buffer_size;
+    if (PIDX_compression_is_variable_rate(io_id->idx))
+    {
+      if (PIDX_file_io_pack_blocks(io_id, agg_buf, block_layout, fh, data_offset, &write_size) != PIDX_success)
+      {
+        fprintf(stderr, "[%s] [%d] PIDX_file_io_pack_blocks() failed.\n", __FILE__, __LINE__);
+        return PIDX_err_io;
+      }
+    }
+
     //fprintf(stderr, "DO %d DS %d\n", data_offset, agg_buf->buffer_size);
-    ret = MPI_File_write_at(fh, data_offset, agg_buf->buffer, agg_buf->buffer_size , MPI_BYTE, &status);
+    ret = MPI_File_write_at(fh, data_offset, agg_buf->buffer, write_size, MPI_BYTE, &status);
     if (ret != MPI_SUCCESS)
     {
       fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_write_at() failed for filename %s.\n", (long long)  data_offset, __FILE__, __LINE__, file_name);
@@ -224,7 +262,7 @@ PIDX_return_code PIDX_file_io_blocking_write(PIDX_file_io_id io_id, Agg_buffer a
 
     int write_count = 0;
     MPI_Get_count(&status, MPI_BYTE, &write_count);
-    if (write_count != agg_buf->buffer_size)
+    if (write_count != write_size)
     {
       fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
       return PIDX_err_io;
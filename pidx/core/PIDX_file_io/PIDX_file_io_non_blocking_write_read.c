@@ -60,11 +60,15 @@ PIDX_return_code PIDX_file_io_async_write(PIDX_file_io_id io_id, Agg_buffer agg_
   {
     generate_file_name(io_id->idx->blocks_per_file, filename_template, (unsigned int)agg_buf->file_number, file_name, PATH_MAX);
 
-    ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_WRONLY, MPI_INFO_NULL, (fh));
-    if (ret != MPI_SUCCESS)
+    // the file is only opened if the caller does not already hold it open
+    if (*fh == MPI_FILE_NULL)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() filename %s failed.\n", __FILE__, __LINE__, file_name);
-      return PIDX_err_io;
+      ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_WRONLY, MPI_INFO_NULL, (fh));
+      if (ret != MPI_SUCCESS)
+      {
+        fprintf(stderr, "[%s] [%d] MPI_File_open() filename %s failed.\n", __FILE__, __LINE__, file_name);
+        return PIDX_err_io;
+      }
     }
 
     uint64_t total_header_size;
@@ -87,6 +91,16 @@ PIDX_return_code PIDX_file_io_async_write(PIDX_file_io_id io_id, Agg_buffer agg_
     //for (i = 0; i < agg_buf->sample_number; i++)
     //  data_offset = (uint64_t) data_offset + agg_buf->buffer_size;
 
+    uint64_t write_size = agg_buf->buffer_size;
+    if (PIDX_compression_is_variable_rate(io_id->idx))
+    {
+      if (PIDX_file_io_pack_blocks(io_id, agg_buf, block_layout, *fh, data_offset, &write_size) != PIDX_success)
+      {
+        fprintf(stderr, "[%s] [%d] PIDX_file_io_pack_blocks() failed.\n", __FILE__, __LINE__);
+        return PIDX_err_io;
+      }
+    }
+
     if (io_id->idx->flip_endian == 1)
     {
       PIDX_variable curr_var = io_id->idx->variable[agg_buf->var_number];
@@ -118,7 +132,7 @@ PIDX_return_code PIDX_file_io_async_write(PIDX_file_io_id io_id, Agg_buffer agg_
       }
     }
 
-    ret = MPI_File_iwrite_at(*fh, data_offset, agg_buf->buffer, agg_buf->buffer_size, MPI_BYTE, request);
+    ret = MPI_File_iwrite_at(*fh, data_offset, agg_buf->buffer, write_size, MPI_BYTE, request);
     if (ret != MPI_SUCCESS)
     {
       fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_write_at() failed for filename %s.\n", (long long)  data_offset, __FILE__, __LINE__, file_name);
@@ -130,6 +144,150 @@ PIDX_return_code PIDX_file_io_async_write(PIDX_file_io_id io_id, Agg_buffer agg_
 }
 
 
+PIDX_return_code PIDX_file_io_async_wait(PIDX_file_io_id io_id)
+{
+  int ret;
+  MPI_Status status;
+
+  ret = MPI_Wait(&io_id->request, &status);
+  if (ret != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_Wait() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  if (io_id->fh != MPI_FILE_NULL)
+  {
+    ret = MPI_File_close(&io_id->fh);
+    if (ret != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_close() failed.\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+  }
+
+  return PIDX_success;
+}
+
+
+PIDX_file_io_async PIDX_file_io_async_create()
+{
+  PIDX_file_io_async async = malloc(sizeof (*async));
+  memset(async, 0, sizeof (*async));
+
+  return async;
+}
+
+
+
+PIDX_return_code PIDX_file_io_async_defer_write(PIDX_file_io_id io_id, PIDX_file_io_async async, Agg_buffer agg_buf, PIDX_block_layout block_layout, char* filename_template)
+{
+  if (agg_buf->var_number == -1 || agg_buf->file_number == -1)
+    return PIDX_success;
+
+  // look for the binary file among the ones this process already holds open
+  int f;
+  for (f = 0; f < async->file_count; f++)
+  {
+    if (async->file_number[f] == agg_buf->file_number)
+      break;
+  }
+
+  if (f == async->file_count)
+  {
+    if (async->file_count == async->file_capacity)
+    {
+      async->file_capacity = (async->file_capacity == 0) ? 8 : async->file_capacity * 2;
+      async->file_number = realloc(async->file_number, sizeof(*async->file_number) * async->file_capacity);
+      async->fh = realloc(async->fh, sizeof(*async->fh) * async->file_capacity);
+    }
+    async->file_number[f] = agg_buf->file_number;
+    async->fh[f] = MPI_FILE_NULL;
+    async->file_count++;
+  }
+
+  if (async->request_count == async->request_capacity)
+  {
+    async->request_capacity = (async->request_capacity == 0) ? 8 : async->request_capacity * 2;
+    async->request = realloc(async->request, sizeof(*async->request) * async->request_capacity);
+    async->buffer = realloc(async->buffer, sizeof(*async->buffer) * async->request_capacity);
+  }
+
+  int r = async->request_count;
+  async->request[r] = MPI_REQUEST_NULL;
+  if (PIDX_file_io_async_write(io_id, agg_buf, block_layout, &async->request[r], &async->fh[f], filename_template) != PIDX_success)
+  {
+    fprintf(stderr, "[%s] [%d] PIDX_file_io_async_write() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  // the request now owns the aggregation buffer, it is released in PIDX_file_io_async_complete
+  async->buffer[r] = agg_buf->buffer;
+  async->request_count++;
+
+  agg_buf->buffer = 0;
+  agg_buf->buffer_size = 0;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_file_io_async_complete(PIDX_file_io_async async)
+{
+  int ret;
+
+  if (async->request_count != 0)
+  {
+    ret = MPI_Waitall(async->request_count, async->request, MPI_STATUSES_IGNORE);
+    if (ret != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_Waitall() failed.\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+  }
+
+  for (int r = 0; r < async->request_count; r++)
+    free(async->buffer[r]);
+  async->request_count = 0;
+
+  for (int f = 0; f < async->file_count; f++)
+  {
+    if (async->fh[f] == MPI_FILE_NULL)
+      continue;
+
+    ret = MPI_File_close(&async->fh[f]);
+    if (ret != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_close() failed.\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+  }
+  async->file_count = 0;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_file_io_async_destroy(PIDX_file_io_async async)
+{
+  if (PIDX_file_io_async_complete(async) != PIDX_success)
+  {
+    fprintf(stderr, "[%s] [%d] PIDX_file_io_async_complete() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  free(async->request);
+  free(async->buffer);
+  free(async->file_number);
+  free(async->fh);
+  free(async);
+
+  return PIDX_success;
+}
+
+
 static void bit32_reverse_endian(unsigned char* val, unsigned char *outbuf)
 {
     unsigned char *data = ((unsigned char *)val) + 3;
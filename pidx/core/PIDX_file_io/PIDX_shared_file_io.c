@@ -0,0 +1,352 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/**
+ * \file PIDX_shared_file_io.c
+ *
+ * Shared files of the particle and raw layouts. Instead of one file per
+ * process and patch, the processes are split in groups of consecutive ranks
+ * and the aggregator of every group writes the extents of the whole group
+ * into one file, so a time step holds as many files as there are aggregators.
+ *
+ */
+
+#include "../../PIDX_inc.h"
+
+#define PIDX_SHARED_FILE_MAGIC 0x46485350
+#define PIDX_SHARED_FILE_VERSION 1
+#define PIDX_SHARED_FILE_HEADER_SIZE 4
+#define PIDX_SHARED_FILE_MESSAGE_SIZE (64 * 1024 * 1024)
+#define PIDX_SHARED_FILE_TAG 7271
+
+struct message
+{
+  int source;
+  uint64_t offset;
+  uint64_t size;
+};
+
+static int list_messages(const PIDX_shared_file_extent *extent, int extent_count, uint32_t first_variable, uint32_t last_variable, int aggregator_rank, struct message *message);
+
+
+void PIDX_shared_file_name(char *name, const char *directory_path, int time_step, int file)
+{
+  sprintf(name, "%s/time%09d/shared_%d", directory_path, time_step, file);
+}
+
+
+
+PIDX_return_code PIDX_shared_file_create(MPI_Comm comm, int file_count, const char *directory_path, int time_step, const PIDX_shared_file_extent *extent, int extent_count, PIDX_shared_file *shared_file)
+{
+  int rank = 0, nprocs = 1;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &nprocs);
+
+  if (file_count < 1)
+  {
+    fprintf(stderr, "[%s] [%d] Wrong number of shared files %d\n", __FILE__, __LINE__, file_count);
+    return PIDX_err_file;
+  }
+  if (file_count > nprocs)
+    file_count = nprocs;
+
+  PIDX_shared_file sf = malloc(sizeof (*sf));
+  memset(sf, 0, sizeof (*sf));
+  sf->fp = -1;
+
+  // Consecutive ranks share a file, they are usually on the same node
+  sf->file = (int)(((uint64_t)rank * file_count) / nprocs);
+  sf->rank = rank;
+  MPI_Comm_split(comm, sf->file, rank, &sf->comm);
+
+  int file_rank = 0, file_nprocs = 1;
+  MPI_Comm_rank(sf->comm, &file_rank);
+  MPI_Comm_size(sf->comm, &file_nprocs);
+
+  sf->extent_count = extent_count;
+  sf->extent = malloc(sizeof(*sf->extent) * (extent_count + 1));
+  for (int i = 0; i < extent_count; i++)
+  {
+    sf->extent[i] = extent[i];
+    sf->extent[i].rank = rank;
+    sf->extent[i].reserved = 0;
+  }
+
+  // The aggregator gathers the extents of the group and places them one after the other
+  int *counts = NULL, *displs = NULL;
+  int extent_bytes = extent_count * sizeof(*sf->extent);
+  if (file_rank == 0)
+  {
+    counts = malloc(sizeof(*counts) * file_nprocs);
+    displs = malloc(sizeof(*displs) * file_nprocs);
+  }
+  MPI_Gather(&extent_bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, sf->comm);
+
+  if (file_rank == 0)
+  {
+    int total_bytes = 0;
+    for (int i = 0; i < file_nprocs; i++)
+    {
+      displs[i] = total_bytes;
+      total_bytes = total_bytes + counts[i];
+    }
+    sf->file_extent_count = total_bytes / sizeof(*sf->file_extent);
+    sf->file_extent = malloc(total_bytes + 1);
+  }
+  MPI_Gatherv(sf->extent, extent_bytes, MPI_BYTE, sf->file_extent, counts, displs, MPI_BYTE, 0, sf->comm);
+
+  PIDX_return_code ret = PIDX_success;
+  if (file_rank == 0)
+  {
+    uint64_t header[PIDX_SHARED_FILE_HEADER_SIZE] = {PIDX_SHARED_FILE_MAGIC, PIDX_SHARED_FILE_VERSION, sf->file_extent_count, 0};
+    uint64_t directory_size = (uint64_t)sf->file_extent_count * sizeof(*sf->file_extent);
+    uint64_t offset = sizeof(header) + directory_size;
+    header[3] = offset;
+    for (int i = 0; i < sf->file_extent_count; i++)
+    {
+      sf->file_extent[i].offset = offset;
+      offset = offset + sf->file_extent[i].size;
+    }
+
+    char file_name[PATH_MAX];
+    PIDX_shared_file_name(file_name, directory_path, time_step, sf->file);
+
+    // No O_TRUNC: the raw layout writes the variables of a file in several passes with the same directory
+    sf->fp = open(file_name, O_CREAT | O_WRONLY, 0664);
+    if (sf->fp < 0)
+    {
+      fprintf(stderr, "Error opening file %s Error code %d\n", file_name, errno);
+      ret = PIDX_err_io;
+    }
+    else if (pwrite(sf->fp, header, sizeof(header), 0) != sizeof(header) ||
+             (directory_size != 0 && (uint64_t)pwrite(sf->fp, sf->file_extent, directory_size, sizeof(header)) != directory_size))
+    {
+      fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+      ret = PIDX_err_io;
+    }
+    // A file written again must not keep the old tail
+    else if (ftruncate(sf->fp, offset) != 0)
+    {
+      fprintf(stderr, "[%s] [%d] ftruncate() failed.\n", __FILE__, __LINE__);
+      ret = PIDX_err_io;
+    }
+  }
+
+  // Every process gets the offsets of its extents back
+  MPI_Scatterv(sf->file_extent, counts, displs, MPI_BYTE, sf->extent, extent_bytes, MPI_BYTE, 0, sf->comm);
+  free(counts);
+  free(displs);
+
+  MPI_Bcast(&ret, 1, MPI_INT, 0, sf->comm);
+  if (ret != PIDX_success)
+  {
+    PIDX_shared_file_free(sf);
+    return ret;
+  }
+
+  *shared_file = sf;
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_shared_file_write(PIDX_shared_file shared_file, uint32_t first_variable, uint32_t last_variable, unsigned char **buffer)
+{
+  int file_rank = 0;
+  MPI_Comm_rank(shared_file->comm, &file_rank);
+
+  // An error does not stop the exchange, every message posted is still completed so that no process of the
+  // file is left waiting, the outcome is agreed on at the end
+  PIDX_return_code ret = PIDX_success;
+
+  if (file_rank != 0)
+  {
+    // The extents are sent in order, MPI keeps the order of the messages between two processes
+    int count = list_messages(shared_file->extent, shared_file->extent_count, first_variable, last_variable, 0, NULL);
+    MPI_Request *req = malloc(sizeof(*req) * (count + 1));
+
+    int req_count = 0;
+    for (int i = 0; i < shared_file->extent_count && ret == PIDX_success; i++)
+    {
+      PIDX_shared_file_extent *e = &shared_file->extent[i];
+      if (e->variable < first_variable || e->variable > last_variable)
+        continue;
+
+      for (uint64_t sent = 0; sent < e->size; sent = sent + PIDX_SHARED_FILE_MESSAGE_SIZE)
+      {
+        uint64_t size = PIDX_MIN(e->size - sent, PIDX_SHARED_FILE_MESSAGE_SIZE);
+        if (MPI_Isend(buffer[i] + sent, (int)size, MPI_BYTE, 0, PIDX_SHARED_FILE_TAG, shared_file->comm, &req[req_count]) != MPI_SUCCESS)
+        {
+          fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+          ret = PIDX_err_mpi;
+          break;
+        }
+        req_count++;
+      }
+    }
+
+    if (MPI_Waitall(req_count, req, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+      ret = PIDX_err_mpi;
+    }
+    free(req);
+  }
+  else
+  {
+    // The aggregator writes its own extents from the buffers of the caller
+    for (int i = 0; i < shared_file->extent_count; i++)
+    {
+      PIDX_shared_file_extent *e = &shared_file->extent[i];
+      if (e->variable < first_variable || e->variable > last_variable || e->size == 0)
+        continue;
+
+      if ((uint64_t)pwrite(shared_file->fp, buffer[i], e->size, e->offset) != e->size)
+      {
+        fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+        ret = PIDX_err_io;
+        break;
+      }
+    }
+
+    // then receives the messages of the others, writing one while the next one arrives
+    PIDX_shared_file_extent *other = shared_file->file_extent + shared_file->extent_count;
+    int other_count = shared_file->file_extent_count - shared_file->extent_count;
+    int count = list_messages(other, other_count, first_variable, last_variable, shared_file->rank, NULL);
+    struct message *message = malloc(sizeof(*message) * (count + 1));
+    list_messages(other, other_count, first_variable, last_variable, shared_file->rank, message);
+
+    unsigned char *recv_buffer[2] = {NULL, NULL};
+    if (count > 0)
+    {
+      recv_buffer[0] = malloc(PIDX_SHARED_FILE_MESSAGE_SIZE);
+      recv_buffer[1] = count > 1 ? malloc(PIDX_SHARED_FILE_MESSAGE_SIZE) : NULL;
+    }
+
+    MPI_Request req[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    if (count > 0 && MPI_Irecv(recv_buffer[0], (int)message[0].size, MPI_BYTE, message[0].source, PIDX_SHARED_FILE_TAG, shared_file->comm, &req[0]) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+      ret = PIDX_err_mpi;
+    }
+
+    // After an error the messages are still received but no longer written
+    for (int m = 0; m < count; m++)
+    {
+      if (MPI_Wait(&req[m % 2], MPI_STATUS_IGNORE) != MPI_SUCCESS)
+      {
+        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+        ret = PIDX_err_mpi;
+      }
+
+      if (m + 1 < count && MPI_Irecv(recv_buffer[(m + 1) % 2], (int)message[m + 1].size, MPI_BYTE, message[m + 1].source, PIDX_SHARED_FILE_TAG, shared_file->comm, &req[(m + 1) % 2]) != MPI_SUCCESS)
+      {
+        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+        ret = PIDX_err_mpi;
+      }
+
+      if (ret == PIDX_success && (uint64_t)pwrite(shared_file->fp, recv_buffer[m % 2], message[m].size, message[m].offset) != message[m].size)
+      {
+        fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+        ret = PIDX_err_io;
+      }
+    }
+
+    free(recv_buffer[0]);
+    free(recv_buffer[1]);
+    free(message);
+  }
+
+  // Every process of the file returns the same outcome (error codes are positive, success is 0)
+  if (MPI_Allreduce(MPI_IN_PLACE, &ret, 1, MPI_INT, MPI_MAX, shared_file->comm) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+    return PIDX_err_mpi;
+  }
+
+  return ret;
+}
+
+
+
+PIDX_return_code PIDX_shared_file_free(PIDX_shared_file shared_file)
+{
+  if (shared_file == NULL)
+    return PIDX_success;
+
+  if (shared_file->fp >= 0)
+    close(shared_file->fp);
+  if (shared_file->comm != MPI_COMM_NULL)
+    MPI_Comm_free(&shared_file->comm);
+
+  free(shared_file->extent);
+  free(shared_file->file_extent);
+  free(shared_file);
+
+  return PIDX_success;
+}
+
+
+
+// Messages the extents of the variables [first_variable, last_variable] are sent in, the processes of a
+// file have consecutive ranks so the source of a message is its rank minus the rank of the aggregator
+static int list_messages(const PIDX_shared_file_extent *extent, int extent_count, uint32_t first_variable, uint32_t last_variable, int aggregator_rank, struct message *message)
+{
+  int count = 0;
+  for (int i = 0; i < extent_count; i++)
+  {
+    if (extent[i].variable < first_variable || extent[i].variable > last_variable)
+      continue;
+
+    for (uint64_t sent = 0; sent < extent[i].size; sent = sent + PIDX_SHARED_FILE_MESSAGE_SIZE)
+    {
+      if (message != NULL)
+      {
+        message[count].source = extent[i].rank - aggregator_rank;
+        message[count].offset = extent[i].offset + sent;
+        message[count].size = PIDX_MIN(extent[i].size - sent, PIDX_SHARED_FILE_MESSAGE_SIZE);
+      }
+      count++;
+    }
+  }
+
+  return count;
+}
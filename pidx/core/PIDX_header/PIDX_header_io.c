@@ -405,7 +405,14 @@ PIDX_return_code PIDX_header_io_global_idx_write (PIDX_header_io_id header_io, c
     else if (header_io->idx->io_type == PIDX_RAW_IO)
       fprintf(idx_file_p, "(io mode)\nraw\n");
     else if (header_io->idx->io_type == PIDX_PARTICLE_IO || header_io->idx->io_type == PIDX_RST_PARTICLE_IO)
+    {
       fprintf(idx_file_p, "(io mode)\nparticle\n(particles position var index)\n%d\n", header_io->idx->particles_position_variable_index);
+      if (header_io->idx->particles_lod_level_count > 1)
+        fprintf(idx_file_p, "(particles lod levels)\n%d\n", header_io->idx->particles_lod_level_count);
+    }
+
+    if ((header_io->idx->io_type == PIDX_RAW_IO || header_io->idx->io_type == PIDX_PARTICLE_IO) && header_io->idx->shared_file_count > 0)
+      fprintf(idx_file_p, "(shared files)\n%d\n", header_io->idx->shared_file_count);
 
     fprintf(idx_file_p, "(box)\n0 %lld 0 %lld 0 %lld 0 0 0 0\n", (long long)(header_io->idx->bounds[0] - 1), (long long)(header_io->idx->bounds[1] - 1), (long long)(header_io->idx->bounds[2] - 1));
     fprintf(idx_file_p, "(physical box)\n0 %f 0 %f 0 %f 0 0 0 0\n", header_io->idx->physical_bounds[0], header_io->idx->physical_bounds[1], header_io->idx->physical_bounds[2]);
@@ -419,6 +426,8 @@ PIDX_return_code PIDX_header_io_global_idx_write (PIDX_header_io_id header_io, c
 
     fprintf(idx_file_p, "(compression bit rate)\n%f\n", header_io->idx->compression_bit_rate);
     fprintf(idx_file_p, "(compression type)\n%d\n", header_io->idx->compression_type);
+    if (PIDX_compression_is_variable_rate(header_io->idx))
+      fprintf(idx_file_p, "(compression parameter)\n%.17g\n", header_io->idx->compression_parameter);
     
     fprintf(idx_file_p, "(fields)\n");
     for (int l = 0; l < header_io->last_index; l++)
@@ -526,7 +535,14 @@ PIDX_return_code PIDX_header_io_partition_idx_write (PIDX_header_io_id header_io
     else if (header_io->idx->io_type == PIDX_RAW_IO)
       fprintf(idx_file_p, "(io mode)\nraw\n");
     else if (header_io->idx->io_type == PIDX_PARTICLE_IO || header_io->idx->io_type == PIDX_RST_PARTICLE_IO)
+    {
       fprintf(idx_file_p, "(io mode)\nparticle\n(particles position var index)\n%d\n", header_io->idx->particles_position_variable_index);
+      if (header_io->idx->particles_lod_level_count > 1)
+        fprintf(idx_file_p, "(particles lod levels)\n%d\n", header_io->idx->particles_lod_level_count);
+    }
+
+    if ((header_io->idx->io_type == PIDX_RAW_IO || header_io->idx->io_type == PIDX_PARTICLE_IO) && header_io->idx->shared_file_count > 0)
+      fprintf(idx_file_p, "(shared files)\n%d\n", header_io->idx->shared_file_count);
 
     fprintf(idx_file_p, "(box)\n0 %lld 0 %lld 0 %lld 0 0 0 0\n", (long long)(header_io->idx->bounds[0] - 1), (long long)(header_io->idx->bounds[1] - 1), (long long)(header_io->idx->bounds[2] - 1));
 
@@ -546,6 +562,8 @@ PIDX_return_code PIDX_header_io_partition_idx_write (PIDX_header_io_id header_io
 
     fprintf(idx_file_p, "(compression bit rate)\n%f\n", header_io->idx->compression_bit_rate);
     fprintf(idx_file_p, "(compression type)\n%d\n", header_io->idx->compression_type);
+    if (PIDX_compression_is_variable_rate(header_io->idx))
+      fprintf(idx_file_p, "(compression parameter)\n%.17g\n", header_io->idx->compression_parameter);
 
     fprintf(idx_file_p, "(fields)\n");
     for (l = 0; l < header_io->last_index; l++)
@@ -653,7 +671,14 @@ PIDX_return_code PIDX_header_io_raw_idx_write (PIDX_header_io_id header_io, char
     else if (header_io->idx->io_type == PIDX_RAW_IO)
       fprintf(idx_file_p, "(io mode)\nraw\n");
     else if (header_io->idx->io_type == PIDX_PARTICLE_IO || header_io->idx->io_type == PIDX_RST_PARTICLE_IO)
+    {
       fprintf(idx_file_p, "(io mode)\nparticle\n(particles position var index)\n%d\n", header_io->idx->particles_position_variable_index);
+      if (header_io->idx->particles_lod_level_count > 1)
+        fprintf(idx_file_p, "(particles lod levels)\n%d\n", header_io->idx->particles_lod_level_count);
+    }
+
+    if ((header_io->idx->io_type == PIDX_RAW_IO || header_io->idx->io_type == PIDX_PARTICLE_IO) && header_io->idx->shared_file_count > 0)
+      fprintf(idx_file_p, "(shared files)\n%d\n", header_io->idx->shared_file_count);
 
     fprintf(idx_file_p, "(box)\n0 %lld 0 %lld 0 %lld 0 0 0 0\n", (long long)(header_io->idx->bounds[0] - 1), (long long)(header_io->idx->bounds[1] - 1), (long long)(header_io->idx->bounds[2] - 1));
     fprintf(idx_file_p, "(physical box)\n0 %f 0 %f 0 %f 0 0 0 0\n", header_io->idx->physical_bounds[0], header_io->idx->physical_bounds[1], header_io->idx->physical_bounds[2]);
@@ -707,19 +732,20 @@ static int write_meta_data(PIDX_header_io_id header_io_id, PIDX_block_layout blo
         for (uint32_t k = 0; k < j; k++)
           base_offset = base_offset + ((block_layout->bcpf[file_number]) * (header_io_id->idx->variable[k]->bpv / 8) * total_chunk_size * header_io_id->idx->samples_per_block * header_io_id->idx->variable[k]->vps) / (header_io_id->idx->compression_factor);
 
-        data_offset = ((i - block_negative_offset) * header_io_id->idx->samples_per_block) * (header_io_id->idx->variable[j]->bpv / 8) * total_chunk_size * header_io_id->idx->variable[j]->vps  / (header_io_id->idx->compression_factor);
+        data_offset = ((uint64_t)(i - block_negative_offset) * header_io_id->idx->samples_per_block) * (header_io_id->idx->variable[j]->bpv / 8) * total_chunk_size * header_io_id->idx->variable[j]->vps  / (header_io_id->idx->compression_factor);
 
-        data_offset = base_offset + data_offset + header_io_id->start_fs_block * header_io_id->fs_block_size;
+        data_offset = base_offset + data_offset + (uint64_t)header_io_id->start_fs_block * header_io_id->fs_block_size;
 
-        headers[12 + ((i + (header_io_id->idx->blocks_per_file * j))*10 )] = htonl(data_offset);
-        headers[14 + ((i + (header_io_id->idx->blocks_per_file * j))*10)] = htonl(header_io_id->idx->samples_per_block * (header_io_id->idx->variable[j]->bpv / 8) * total_chunk_size * header_io_id->idx->variable[j]->vps / (header_io_id->idx->compression_factor));
+        PIDX_header_io_set_block(headers, i + (header_io_id->idx->blocks_per_file * j), data_offset, (uint64_t)header_io_id->idx->samples_per_block * (header_io_id->idx->variable[j]->bpv / 8) * total_chunk_size * header_io_id->idx->variable[j]->vps / (header_io_id->idx->compression_factor));
 
         header_io_id->idx_b->block_offset_bitmap[j][file_number][i] = data_offset;
       }
     }
   }
 
-  if (mode == 1)
+  // With variable rate compression the aggregators write the header entries of their (packed) blocks themselves
+  // (PIDX_file_io_pack_blocks), the fixed size entries are only written when the blocks go straight from the hz buffers
+  if (mode == 1 && !(PIDX_compression_is_variable_rate(header_io_id->idx) && header_io_id->idx_b->agg_level > 0))
   {
     MPI_File fh;
     MPI_Status status;
@@ -755,6 +781,49 @@ static int write_meta_data(PIDX_header_io_id header_io_id, PIDX_block_layout blo
 
 
 
+int PIDX_header_io_large_offsets(idx_dataset idx_meta_data)
+{
+  // datasets being written (no version parsed) always use the current layout
+  if (strcmp(idx_meta_data->metadata_version, "6") == 0 || strcmp(idx_meta_data->metadata_version, "6.1") == 0)
+    return 0;
+
+  return 1;
+}
+
+
+
+void PIDX_header_io_set_block(uint32_t* headers, int block_index, uint64_t offset, uint64_t size)
+{
+  headers[12 + block_index * 10] = htonl((uint32_t)(offset & 0xFFFFFFFF));
+  headers[13 + block_index * 10] = htonl((uint32_t)(offset >> 32));
+  headers[14 + block_index * 10] = htonl((uint32_t)(size & 0xFFFFFFFF));
+  headers[15 + block_index * 10] = htonl((uint32_t)(size >> 32));
+}
+
+
+
+uint64_t PIDX_header_io_get_block_offset(const uint32_t* headers, int block_index, int large_offsets)
+{
+  uint64_t offset = ntohl(headers[12 + block_index * 10]);
+  if (large_offsets)
+    offset = offset | ((uint64_t)ntohl(headers[13 + block_index * 10]) << 32);
+
+  return offset;
+}
+
+
+
+uint64_t PIDX_header_io_get_block_size(const uint32_t* headers, int block_index, int large_offsets)
+{
+  uint64_t size = ntohl(headers[14 + block_index * 10]);
+  if (large_offsets)
+    size = size | ((uint64_t)ntohl(headers[15 + block_index * 10]) << 32);
+
+  return size;
+}
+
+
+
 PIDX_return_code PIDX_header_io_finalize(PIDX_header_io_id header_io_id)
 {
 
@@ -113,6 +113,52 @@ int PIDX_header_io_raw_dir_create(PIDX_header_io_id header_io_id, char* file_nam
 
 
 
+///
+/// \brief PIDX_header_io_large_offsets
+/// Block offsets and sizes in the binary file header are 32 bit up to metadata
+/// version 6.1. From 6.2 on the high 32 bits are stored in the word following
+/// each of them (words 3 and 5 of the ten word block entry), the low 32 bits stay
+/// where they were, so files smaller than 4 GiB are laid out as before.
+/// \param idx_meta_data
+/// \return 1 if the headers of the dataset carry 64 bit offsets and sizes
+///
+int PIDX_header_io_large_offsets(idx_dataset idx_meta_data);
+
+
+
+///
+/// \brief PIDX_header_io_set_block
+/// \param headers binary file header
+/// \param block_index i + blocks_per_file * variable_index
+/// \param offset
+/// \param size
+///
+void PIDX_header_io_set_block(uint32_t* headers, int block_index, uint64_t offset, uint64_t size);
+
+
+
+///
+/// \brief PIDX_header_io_get_block_offset
+/// \param headers binary file header
+/// \param block_index i + blocks_per_file * variable_index
+/// \param large_offsets as returned by PIDX_header_io_large_offsets
+/// \return
+///
+uint64_t PIDX_header_io_get_block_offset(const uint32_t* headers, int block_index, int large_offsets);
+
+
+
+///
+/// \brief PIDX_header_io_get_block_size
+/// \param headers binary file header
+/// \param block_index i + blocks_per_file * variable_index
+/// \param large_offsets as returned by PIDX_header_io_large_offsets
+/// \return
+///
+uint64_t PIDX_header_io_get_block_size(const uint32_t* headers, int block_index, int large_offsets);
+
+
+
 ///
 /// \brief PIDX_header_io_finalize
 /// \param header_io
@@ -75,6 +75,9 @@ struct PIDX_hz_encode_struct
   int last_index;
 
   int resolution_to;
+
+  int cache_hit_count;      ///< encodings that replayed the meta_data_cache
+  int cache_miss_count;     ///< encodings that had to (re)build the meta_data_cache
 };
 typedef struct PIDX_hz_encode_struct* PIDX_hz_encode_id;
 
@@ -126,6 +129,18 @@ PIDX_return_code PIDX_hz_encode_buf_create(PIDX_hz_encode_id id);
 PIDX_return_code PIDX_hz_encode_write_inverse(PIDX_hz_encode_id id, int start_hz_index, int end_hz_index);
 
 
+///
+/// \brief PIDX_hz_encode_patch Copies the samples of the restructured (chunked) super patch
+/// into (PIDX_WRITE) or out of (PIDX_READ) the HZ buffers. The rows of the patch are shared
+/// among idx->thread_count threads when PIDX is built with OpenMP. If a meta_data_cache is set
+/// the HZ indices are computed once and replayed as long as the patch and layout do not change
+/// \param id
+/// \param mode
+/// \return
+///
+PIDX_return_code PIDX_hz_encode_patch(PIDX_hz_encode_id id, int mode);
+
+
 ///
 /// \brief PIDX_hz_encode_write
 /// \param id
@@ -401,18 +401,41 @@ static int read_samples(PIDX_hz_encode_id id, int variable_index, uint64_t hz_st
     for (bl = 0; bl < blocks_to_read; bl++)
     {
       memset(temp_buffer, 0, block_size_bytes);
-      data_offset = ntohl(headers[12 + ((((block_number % id->idx->blocks_per_file) + bl) + (id->idx->blocks_per_file * variable_index))*10 )]);
-      data_size = ntohl(headers[14 + ((((block_number % id->idx->blocks_per_file) + bl) + (id->idx->blocks_per_file * variable_index))*10 )]);
+      data_offset = PIDX_header_io_get_block_offset(headers, ((block_number % id->idx->blocks_per_file) + bl) + (id->idx->blocks_per_file * variable_index), PIDX_header_io_large_offsets(id->idx));
+      data_size = PIDX_header_io_get_block_size(headers, ((block_number % id->idx->blocks_per_file) + bl) + (id->idx->blocks_per_file * variable_index), PIDX_header_io_large_offsets(id->idx));
 
       if (data_size == 0)
         continue;
 
       int ret;
-      ret = MPI_File_read_at(fp, data_offset, temp_buffer, block_size_bytes, MPI_BYTE, &status);
-      if (ret != MPI_SUCCESS)
+      // packed blocks of the variable rate zfp modes are expanded back into their slots
+      if (PIDX_compression_is_variable_rate(id->idx) && data_size < (uint64_t)block_size_bytes)
       {
-        fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-        return PIDX_err_io;
+        unsigned char *packed = malloc(data_size);
+        ret = MPI_File_read_at(fp, data_offset, packed, data_size, MPI_BYTE, &status);
+        if (ret != MPI_SUCCESS)
+        {
+          fprintf(stderr, "[%s] [%d] MPI_File_read_at() failed.\n", __FILE__, __LINE__);
+          return PIDX_err_io;
+        }
+
+        uint64_t slot_count = (uint64_t)id->idx->samples_per_block * curr_var->vps;
+        ret = PIDX_compression_unpack_block(packed, data_size, temp_buffer, slot_count, block_size_bytes / slot_count);
+        free(packed);
+        if (ret != PIDX_success)
+        {
+          fprintf(stderr, "[%s] [%d] PIDX_compression_unpack_block() failed.\n", __FILE__, __LINE__);
+          return PIDX_err_io;
+        }
+      }
+      else
+      {
+        ret = MPI_File_read_at(fp, data_offset, temp_buffer, block_size_bytes, MPI_BYTE, &status);
+        if (ret != MPI_SUCCESS)
+        {
+          fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
+          return PIDX_err_io;
+        }
       }
 
       if (bl == blocks_to_read - 1)
@@ -0,0 +1,464 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+
+#include "../../PIDX_inc.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+// Spreads the low bits of value onto the set bits of mask (bit deposit)
+static uint64_t deposit_bits(uint64_t value, uint64_t mask)
+{
+#if defined(__BMI2__)
+  return _pdep_u64(value, mask);
+#else
+  uint64_t result = 0;
+  for (uint64_t bit = 1; mask != 0; bit <<= 1)
+  {
+    if (value & bit)
+      result |= mask & (~mask + 1);
+    mask &= mask - 1;
+  }
+  return result;
+#endif
+}
+
+
+
+// Z order contribution of every coordinate of the patch along each axis.
+// The bitmask interleaves the axes, so the Z order of (i, j, k) is
+// axis_z[0][i - offset[0]] | axis_z[1][j - offset[1]] | axis_z[2][k - offset[2]]
+static uint64_t* create_axis_z_tables(PIDX_hz_encode_id id, const int offset[PIDX_MAX_DIMENSIONS], const int size[PIDX_MAX_DIMENSIONS], uint64_t* axis_z[PIDX_MAX_DIMENSIONS])
+{
+  uint64_t axis_mask[PIDX_MAX_DIMENSIONS] = {0, 0, 0};
+  int maxH = id->idx->maxh;
+
+  // bit cnt of the Z order comes from the axis bitPattern[maxH - 1 - cnt]
+  for (int cnt = 0; cnt < maxH - 1; cnt++)
+    axis_mask[(int)id->idx->bitPattern[maxH - 1 - cnt]] |= ((uint64_t) 1) << cnt;
+
+  uint64_t *tables = malloc(sizeof(*tables) * (size[0] + size[1] + size[2]));
+  if (tables == NULL)
+    return NULL;
+
+  axis_z[0] = tables;
+  axis_z[1] = axis_z[0] + size[0];
+  axis_z[2] = axis_z[1] + size[1];
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    for (int c = 0; c < size[d]; c++)
+      axis_z[d][c] = deposit_bits((uint64_t)(offset[d] + c), axis_mask[d]);
+
+  return tables;
+}
+
+
+
+// Converts a Z order into the HZ order: the Z order is prefixed with the
+// lastbitmask and all the trailing zeros plus the first one are shifted out
+static inline uint64_t z_to_hz(uint64_t z_order, uint64_t lastbitmask)
+{
+  z_order |= lastbitmask;
+#if defined(__GNUC__)
+  return z_order >> (__builtin_ctzll(z_order) + 1);
+#else
+  while (!(1 & z_order)) z_order >>= 1;
+  return z_order >> 1;
+#endif
+}
+
+
+
+// HZ level, same as getLeveL() but without going through floating point
+static inline int hz_to_level(uint64_t hz_order)
+{
+  if (hz_order == 0)
+    return 0;
+#if defined(__GNUC__)
+  return 64 - __builtin_clzll(hz_order);
+#else
+  int level = 0;
+  while (hz_order) { level++; hz_order >>= 1; }
+  return level;
+#endif
+}
+
+
+
+static inline void copy_samples(unsigned char* dest, const unsigned char* src, uint64_t count, int bytes_for_datatype)
+{
+  // constant sizes let the compiler inline the copy of a single sample
+  if (count == 1 && bytes_for_datatype == 4)
+    memcpy(dest, src, 4);
+  else if (count == 1 && bytes_for_datatype == 8)
+    memcpy(dest, src, 8);
+  else
+    memcpy(dest, src, count * bytes_for_datatype);
+}
+
+
+
+
+
+
+// Copies a run of count samples, contiguous both in the patch buffer and in
+// the HZ buffer of the given level, for all the variables of the group
+static void copy_run(PIDX_hz_encode_id id, int mode, const int* bytes_for_datatype, int level, uint64_t hz_order, uint64_t index, uint64_t count)
+{
+  for (int v1 = id->first_index; v1 <= id->last_index; v1++)
+  {
+    PIDX_variable var = id->idx->variable[v1];
+    int bytes = bytes_for_datatype[v1 - id->first_index];
+    unsigned char* hz_ptr = var->hz_buffer->buffer[level] + ((hz_order - var->hz_buffer->start_hz_index[level]) * bytes);
+    unsigned char* patch_ptr = var->chunked_super_patch->restructured_patch->buffer + (index * bytes);
+
+    if (mode == PIDX_WRITE)
+      copy_samples(hz_ptr, patch_ptr, count, bytes);
+    else
+      copy_samples(patch_ptr, hz_ptr, count, bytes);
+  }
+}
+
+
+
+// Geometry of the patch being encoded
+struct hz_patch_struct
+{
+  int offset[PIDX_MAX_DIMENSIONS];
+  int size[PIDX_MAX_DIMENSIONS];
+  uint64_t *axis_z[PIDX_MAX_DIMENSIONS];
+  uint64_t lastbitmask;
+  int level_cutoff;
+  int row_major;
+};
+
+
+
+// Visits the row (j, k) of the patch in application order. A run of samples
+// that are contiguous both in the patch buffer and in the HZ buffer of a level
+// is copied with a single memcpy per variable
+static void encode_row(PIDX_hz_encode_id id, const struct hz_patch_struct* patch, int mode, const int* bytes_for_datatype, uint64_t j, uint64_t k)
+{
+  const int *size = patch->size;
+  uint64_t z_jk = patch->axis_z[1][j] | patch->axis_z[2][k];
+
+  // current run: level, first HZ order and first patch index, sample count
+  int run_level = -1;
+  uint64_t run_hz = 0, run_index = 0, run_length = 0;
+
+  for (uint64_t i = 0; i < size[0]; i++)
+  {
+    uint64_t index;
+    if (patch->row_major)
+      index = ((uint64_t)size[0] * size[1] * k) + ((uint64_t)size[0] * j) + i;
+    else
+      index = ((uint64_t)size[2] * size[1] * i) + ((uint64_t)size[2] * j) + k;
+
+    uint64_t hz_order = z_to_hz(z_jk | patch->axis_z[0][i], patch->lastbitmask);
+    int level = hz_to_level(hz_order);
+
+    if (level >= patch->level_cutoff)
+      continue;
+
+    if (level == run_level && hz_order == run_hz + run_length && index == run_index + run_length)
+    {
+      run_length++;
+      continue;
+    }
+
+    if (run_length != 0)
+      copy_run(id, mode, bytes_for_datatype, run_level, run_hz, run_index, run_length);
+
+    run_level = level;
+    run_hz = hz_order;
+    run_index = index;
+    run_length = 1;
+  }
+
+  if (run_length != 0)
+    copy_run(id, mode, bytes_for_datatype, run_level, run_hz, run_index, run_length);
+}
+
+
+
+// The cached spans can be replayed only if they were built for the same patch and layout
+static int cache_matches(PIDX_metadata_cache cache, PIDX_hz_encode_id id, const struct hz_patch_struct* patch)
+{
+  if (cache->is_set == 0)
+    return 0;
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (cache->patch_offset[d] != patch->offset[d] || cache->patch_size[d] != patch->size[d] || cache->chunk_size[d] != id->idx->chunk_size[d])
+      return 0;
+  }
+
+  if (strcmp(cache->bitSequence, id->idx->bitSequence) != 0)
+    return 0;
+
+  if (cache->resolution_to != id->resolution_to || cache->data_layout != id->idx->variable[id->first_index]->data_layout)
+    return 0;
+
+  return 1;
+}
+
+
+
+static void close_span(PIDX_metadata_cache cache, PIDX_hz_span* span)
+{
+  if (span->count != 0)
+    cache->spans[cache->span_count++] = *span;
+  span->count = 0;
+}
+
+
+
+// Computes the HZ spans of the whole patch in memory order and keys them with
+// the patch and layout
+static PIDX_return_code build_cache(PIDX_metadata_cache cache, PIDX_hz_encode_id id, const struct hz_patch_struct* patch)
+{
+  const int *size = patch->size;
+  int maxH = id->idx->maxh;
+  PIDX_variable var0 = id->idx->variable[id->first_index];
+
+  // the fastest axis in memory is x for row major patches and z for column major ones
+  int fast = patch->row_major ? 0 : 2;
+  int slow = patch->row_major ? 2 : 0;
+
+  cache->is_set = 0;
+  cache->row_length = size[fast];
+  cache->row_count = (uint64_t)size[slow] * size[1];
+  cache->span_count = 0;
+
+  uint64_t capacity = cache->row_count * cache->row_length / 4 + cache->row_length;
+  free(cache->level_start);
+  free(cache->row_span);
+  free(cache->spans);
+  cache->level_start = malloc(sizeof(*cache->level_start) * maxH);
+  cache->row_span = malloc(sizeof(*cache->row_span) * (cache->row_count + 1));
+  cache->spans = malloc(sizeof(*cache->spans) * capacity);
+  if (cache->level_start == NULL || cache->row_span == NULL || cache->spans == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_hz;
+  }
+
+  for (int l = 0; l < maxH; l++)
+    cache->level_start[l] = var0->hz_buffer->start_hz_index[l];
+
+  uint64_t row = 0;
+  for (uint64_t a = 0; a < size[slow]; a++)
+    for (uint64_t b = 0; b < size[1]; b++, row++)
+    {
+      // a row has at most row_length spans
+      if (cache->span_count + cache->row_length > capacity)
+      {
+        capacity = capacity * 2 + cache->row_length;
+        PIDX_hz_span *spans = realloc(cache->spans, sizeof(*spans) * capacity);
+        if (spans == NULL)
+        {
+          fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+          return PIDX_err_hz;
+        }
+        cache->spans = spans;
+      }
+
+      cache->row_span[row] = cache->span_count;
+
+      uint64_t z_ab = patch->axis_z[slow][a] | patch->axis_z[1][b];
+      PIDX_hz_span span = {0, 0, 0, 0};
+      uint64_t span_hz = 0;
+
+      for (uint64_t c = 0; c < size[fast]; c++)
+      {
+        uint64_t hz_order = z_to_hz(z_ab | patch->axis_z[fast][c], patch->lastbitmask);
+        int level = hz_to_level(hz_order);
+        int skip = (level >= patch->level_cutoff);
+
+        if (span.count != 0 && span.count != UINT16_MAX && skip == span.skip &&
+            (skip || (level == span.level && hz_order == span_hz + span.count)))
+        {
+          span.count++;
+          continue;
+        }
+
+        close_span(cache, &span);
+
+        span.hz_offset = skip ? 0 : hz_order - cache->level_start[level];
+        span.level = skip ? 0 : level;
+        span.skip = skip;
+        span.count = 1;
+        span_hz = hz_order;
+      }
+      close_span(cache, &span);
+    }
+  cache->row_span[row] = cache->span_count;
+
+  // release the unused tail, the spans live as long as the cache
+  PIDX_hz_span *spans = realloc(cache->spans, sizeof(*spans) * (cache->span_count + 1));
+  if (spans != NULL)
+    cache->spans = spans;
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    cache->patch_offset[d] = patch->offset[d];
+    cache->patch_size[d] = patch->size[d];
+    cache->chunk_size[d] = id->idx->chunk_size[d];
+  }
+  memcpy(cache->bitSequence, id->idx->bitSequence, sizeof(cache->bitSequence));
+  cache->resolution_to = id->resolution_to;
+  cache->data_layout = var0->data_layout;
+  cache->is_set = 1;
+
+  return PIDX_success;
+}
+
+
+
+// Copies the samples of one memory row of the patch as recorded in the cache
+static void replay_row(PIDX_hz_encode_id id, PIDX_metadata_cache cache, int mode, const int* bytes_for_datatype, uint64_t row)
+{
+  uint64_t index = row * cache->row_length;
+  for (uint64_t s = cache->row_span[row]; s < cache->row_span[row + 1]; s++)
+  {
+    const PIDX_hz_span *span = &cache->spans[s];
+    if (!span->skip)
+      copy_run(id, mode, bytes_for_datatype, span->level, cache->level_start[span->level] + span->hz_offset, index, span->count);
+    index += span->count;
+  }
+}
+
+
+
+// Every sample maps to its own HZ slot, so the rows of the patch are split
+// into contiguous z slabs and encoded (or replayed from the cache) concurrently
+PIDX_return_code PIDX_hz_encode_patch(PIDX_hz_encode_id id, int mode)
+{
+  int maxH = id->idx->maxh;
+  int chunk_size = id->idx->chunk_size[0] * id->idx->chunk_size[1] * id->idx->chunk_size[2];
+  PIDX_variable var0 = id->idx->variable[id->first_index];
+  PIDX_metadata_cache cache = id->meta_data_cache;
+
+  struct hz_patch_struct patch;
+  patch.row_major = (var0->data_layout == PIDX_row_major);
+  patch.lastbitmask = ((uint64_t) 1) << (maxH - 1);
+  patch.level_cutoff = maxH - id->resolution_to;
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    patch.offset[d] = var0->chunked_super_patch->restructured_patch->offset[d] / id->idx->chunk_size[d];
+    patch.size[d] = var0->chunked_super_patch->restructured_patch->size[d] / id->idx->chunk_size[d];
+    if (var0->chunked_super_patch->restructured_patch->size[d] % id->idx->chunk_size[d] != 0)
+      patch.size[d]++;
+  }
+
+  int *bytes_for_datatype = malloc(sizeof(*bytes_for_datatype) * (id->last_index - id->first_index + 1));
+  if (bytes_for_datatype == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_hz;
+  }
+
+  for (int v1 = id->first_index; v1 <= id->last_index; v1++)
+    bytes_for_datatype[v1 - id->first_index] = ((id->idx->variable[v1]->bpv / 8) * chunk_size * id->idx->variable[v1]->vps) / id->idx->compression_factor;
+
+#if defined(_OPENMP)
+  int thread_count = (id->idx->thread_count > 1) ? id->idx->thread_count : 1;
+#endif
+
+  int cache_hit = (cache != NULL && cache_matches(cache, id, &patch));
+
+  // without a valid cache, the HZ indices of the patch are computed
+  uint64_t *tables = NULL;
+  if (!cache_hit)
+  {
+    tables = create_axis_z_tables(id, patch.offset, patch.size, patch.axis_z);
+    if (tables == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      free(bytes_for_datatype);
+      return PIDX_err_hz;
+    }
+  }
+
+  if (cache != NULL)
+  {
+    if (cache_hit)
+      id->cache_hit_count++;
+    else
+    {
+      id->cache_miss_count++;
+      if (build_cache(cache, id, &patch) != PIDX_success)
+      {
+        free(tables);
+        free(bytes_for_datatype);
+        return PIDX_err_hz;
+      }
+    }
+  }
+
+  if (cache != NULL && cache->is_set == 1)
+  {
+    int64_t row_count = (int64_t)cache->row_count;
+#if defined(_OPENMP)
+#pragma omp parallel for num_threads(thread_count) schedule(static)
+#endif
+    for (int64_t row = 0; row < row_count; row++)
+      replay_row(id, cache, mode, bytes_for_datatype, row);
+
+    free(tables);
+    free(bytes_for_datatype);
+    return PIDX_success;
+  }
+
+  int64_t row_count = (int64_t)patch.size[1] * patch.size[2];
+#if defined(_OPENMP)
+#pragma omp parallel for num_threads(thread_count) schedule(static)
+#endif
+  for (int64_t row = 0; row < row_count; row++)
+    encode_row(id, &patch, mode, bytes_for_datatype, row % patch.size[1], row / patch.size[1]);
+
+  free(tables);
+  free(bytes_for_datatype);
+
+  return PIDX_success;
+}
@@ -45,22 +45,9 @@
 
 PIDX_return_code PIDX_hz_encode_read(PIDX_hz_encode_id id)
 {
-  uint64_t z_order = 0, hz_order = 0, index = 0;
-  int level = 0, cnt = 0, s = 0, number_levels = 0;
-  uint64_t i = 0, j = 0, k = 0, l = 0;
-  int bytes_for_datatype;
-  uint64_t hz_index;
-  uint64_t total_chunked_patch_size = 1;
-
   int maxH = id->idx->maxh;
-
-  int chunk_size = id->idx->chunk_size[0] * id->idx->chunk_size[1] * id->idx->chunk_size[2];
-
   PIDX_variable var0 = id->idx->variable[id->first_index];
 
-  int chunked_patch_offset[PIDX_MAX_DIMENSIONS] = {0, 0, 0};
-  int chunked_patch_size[PIDX_MAX_DIMENSIONS] = {0, 0, 0};
-
   if (var0->sim_patch_count < 0)
   {
     fprintf(stderr, "[%s] [%d] id->idx_d->count not set.\n", __FILE__, __LINE__);
@@ -73,139 +60,7 @@ PIDX_return_code PIDX_hz_encode_read(PIDX_hz_encode_id id)
     return PIDX_err_hz;
   }
 
-
-
-  total_chunked_patch_size = 0;
-  for (l = 0; l < PIDX_MAX_DIMENSIONS; l++)
-  {
-    chunked_patch_offset[l] = var0->chunked_super_patch->restructured_patch->offset[l] / id->idx->chunk_size[l];
-    if (var0->chunked_super_patch->restructured_patch->size[l] % id->idx->chunk_size[l] == 0)
-      chunked_patch_size[l] = var0->chunked_super_patch->restructured_patch->size[l] / id->idx->chunk_size[l];
-    else
-      chunked_patch_size[l] = (var0->chunked_super_patch->restructured_patch->size[l] / id->idx->chunk_size[l]) + 1;
-
-    total_chunked_patch_size = total_chunked_patch_size * chunked_patch_size[l];
-  }
-
-  number_levels = maxH - 1;
-  Point3D xyzuv_Index;
-
-  if (var0->data_layout == PIDX_row_major)
-  {
-    for (k = chunked_patch_offset[2]; k < chunked_patch_offset[2] + chunked_patch_size[2]; k++)
-      for (j = chunked_patch_offset[1]; j < chunked_patch_offset[1] + chunked_patch_size[1]; j++)
-        for (i = chunked_patch_offset[0]; i < chunked_patch_offset[0] + chunked_patch_size[0]; i++)
-        {
-          index = (chunked_patch_size[0] * chunked_patch_size[1] * (k - chunked_patch_offset[2]))
-              + (chunked_patch_size[0] * (j - chunked_patch_offset[1]))
-              + (i - chunked_patch_offset[0]);
-
-          xyzuv_Index.x = i;
-          xyzuv_Index.y = j;
-          xyzuv_Index.z = k;
-
-          z_order = 0;
-          Point3D zero;
-          zero.x = 0;
-          zero.y = 0;
-          zero.z = 0;
-          memset(&zero, 0, sizeof (Point3D));
-
-          for (cnt = 0; memcmp(&xyzuv_Index, &zero, sizeof (Point3D)); cnt++, number_levels--)
-          {
-            int bit = id->idx->bitPattern[number_levels];
-            z_order |= ((uint64_t) PGET(xyzuv_Index, bit) & 1) << cnt;
-            PGET(xyzuv_Index, bit) >>= 1;
-          }
-
-          number_levels = maxH - 1;
-          uint64_t lastbitmask = ((uint64_t) 1) << number_levels;
-          z_order |= lastbitmask;
-          while (!(1 & z_order)) z_order >>= 1;
-          z_order >>= 1;
-
-          hz_order = z_order;
-
-          level = getLeveL(hz_order);
-
-          if (level > maxH - 1 - id->resolution_to)
-            continue;
-          
-          hz_index = hz_order - var0->hz_buffer->start_hz_index[level];
-          int v1;
-          for (v1 = id->first_index; v1 <= id->last_index; v1++)
-          {
-            hz_index = hz_order - id->idx->variable[v1]->hz_buffer->start_hz_index[level];
-            bytes_for_datatype = ((id->idx->variable[v1]->bpv / 8) * chunk_size * id->idx->variable[v1]->vps) / id->idx->compression_factor;
-
-            memcpy(id->idx->variable[v1]->chunked_super_patch->restructured_patch->buffer + (index * bytes_for_datatype), id->idx->variable[v1]->hz_buffer->buffer[level] + (hz_index * bytes_for_datatype), bytes_for_datatype);
-
-            /*
-            if (id->idx_d->color == 0)
-            {
-              double x1, x2;
-              memcpy(&x1, id->idx->variable[v1]->hz_buffer->buffer[level] + (hz_index * bytes_for_datatype), sizeof(double));
-              memcpy(&x2, id->idx->variable[v1]->hz_buffer->buffer[level] + (hz_index * bytes_for_datatype) + sizeof(double), sizeof(double));
-              fprintf(stderr, "xyz index - hz index :: %d - %d ----> %f %f\n", index, hz_index, x1, x2);
-            }
-            */
-
-          }
-        }
-  }
-  else
-  {
-    for (k = chunked_patch_offset[2]; k < chunked_patch_offset[2] + chunked_patch_size[2]; k++)
-      for (j = chunked_patch_offset[1]; j < chunked_patch_offset[1] + chunked_patch_size[1]; j++)
-        for (i = chunked_patch_offset[0]; i < chunked_patch_offset[0] + chunked_patch_size[0]; i++)
-        {
-          xyzuv_Index.x = i;
-          xyzuv_Index.y = j;
-          xyzuv_Index.z = k;
-
-          z_order = 0;
-          Point3D zero;
-          zero.x = 0;
-          zero.y = 0;
-          zero.z = 0;
-          memset(&zero, 0, sizeof (Point3D));
-
-          for (cnt = 0; memcmp(&xyzuv_Index, &zero, sizeof (Point3D)); cnt++, number_levels--)
-          {
-            int bit = id->idx->bitPattern[number_levels];
-            z_order |= ((uint64_t) PGET(xyzuv_Index, bit) & 1) << cnt;
-            PGET(xyzuv_Index, bit) >>= 1;
-          }
-
-          number_levels = maxH - 1;
-          uint64_t lastbitmask = ((uint64_t) 1) << number_levels;
-          z_order |= lastbitmask;
-          while (!(1 & z_order)) z_order >>= 1;
-          z_order >>= 1;
-
-          hz_order = z_order;
-          level = getLeveL(hz_order);
-          
-          if (level > maxH - 1 - id->resolution_to)
-            continue;
-
-          index = (chunked_patch_size[2] * chunked_patch_size[1] * (i - chunked_patch_offset[0]))
-              + (chunked_patch_size[2] * (j - chunked_patch_offset[1]))
-              + (k - chunked_patch_offset[2]);
-
-          int v1 = 0;
-          for (v1 = id->first_index; v1 <= id->last_index; v1++)
-          {
-            hz_index = hz_order - id->idx->variable[v1]->hz_buffer->start_hz_index[level];
-            bytes_for_datatype = id->idx->variable[v1]->bpv / 8;
-            for (s = 0; s < id->idx->variable[v1]->vps; s++)
-              memcpy(id->idx->variable[v1]->chunked_super_patch->restructured_patch->buffer + ((index * id->idx->variable[v1]->vps) + s) * bytes_for_datatype * chunk_size, id->idx->variable[v1]->hz_buffer->buffer[level] + ((hz_index * id->idx->variable[v1]->vps + s) * bytes_for_datatype * chunk_size), bytes_for_datatype * chunk_size);
-
-          }
-        }
-  }
-
-  return PIDX_success;
+  return PIDX_hz_encode_patch(id, PIDX_READ);
 }
 
 // Correct
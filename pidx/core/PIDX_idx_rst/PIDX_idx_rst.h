@@ -56,6 +56,48 @@
 #define __PIDX_IDX_RST_NEW_H
 
 
+/// Restructuring plan of one decomposition: the super patches a process intersects with, and the persistent
+/// requests and committed datatypes that move all the variables of a pack in one exchange.
+/// A plan lives for one flush, or is kept in a PIDX_idx_rst_plan_list and reused with steady state io.
+struct PIDX_idx_rst_plan_struct
+{
+  // The plan is only reused if the decomposition matches this key
+  MPI_Comm comm;                                  /// Simulation communicator
+  int first_index;                                /// First variable of the pack
+  int last_index;                                 /// Last variable of the pack
+  int *bytes_per_sample;                          /// vps * bpv / 8 of every variable of the pack
+  int patch_count;                                /// Number of local patches
+  uint64_t *patch_extent;                         /// Offset and size of every local patch
+  uint64_t box_bounds[PIDX_MAX_DIMENSIONS];       /// Bounds of the dataset
+  uint64_t chunk_size[PIDX_MAX_DIMENSIONS];       /// Chunk size (compression)
+  uint64_t grid_patch_size[PIDX_MAX_DIMENSIONS];  /// Size of the super patches of the restructured grid
+
+  int is_cached;                                  /// 1 if the plan belongs to a plan list
+
+  int super_patch_count;                          /// Number of super patches the process intersects with
+  PIDX_super_patch* super_patch;                  /// Super patches the process intersects with
+
+  unsigned char ***patch_buffer;                  /// [variable][patch] buffers of the held super patch (cached plans)
+  uint32_t patch_buffer_count;                    /// Number of patches of the held super patch
+
+  int req_count;                                  /// Number of persistent requests
+  MPI_Request *req;                               /// One send or receive per patch, covering all the variables
+  MPI_Datatype *type;                             /// Datatype of every request (absolute addresses)
+  int address_count;                              /// Number of buffers the datatypes refer to
+  MPI_Aint *address;                              /// Buffers the datatypes were built for
+};
+typedef struct PIDX_idx_rst_plan_struct* PIDX_idx_rst_plan;
+
+
+/// Restructuring plans of the variable packs of a run
+struct PIDX_idx_rst_plan_list_struct
+{
+  PIDX_idx_rst_plan *entry;
+  int count;
+};
+typedef struct PIDX_idx_rst_plan_list_struct* PIDX_idx_rst_plan_list;
+
+
 //Struct for restructuring ID
 struct PIDX_idx_rst_struct
 {
@@ -76,6 +118,8 @@ struct PIDX_idx_rst_struct
   uint64_t* sim_multi_patch_r_offset;
 
   int maximum_neighbor_count;
+
+  PIDX_idx_rst_plan plan;
 };
 typedef struct PIDX_idx_rst_struct* PIDX_idx_rst_id;
 
@@ -105,11 +149,52 @@ PIDX_return_code PIDX_idx_rst_finalize(PIDX_idx_rst_id id);
 
 
 
+/*
+ * Implementation in PIDX_idx_rst_plan.c
+ */
+///
+/// \brief PIDX_idx_rst_plan_find Finds a plan of the list computed for the same decomposition
+/// \param list
+/// \param rst_id
+/// \return the plan, or NULL
+///
+PIDX_idx_rst_plan PIDX_idx_rst_plan_find(PIDX_idx_rst_plan_list list, PIDX_idx_rst_id rst_id);
+
+
+
+///
+/// \brief PIDX_idx_rst_plan_store Keeps the plan of rst_id in the list, in place of the previous plan of the pack
+/// \param list
+/// \param rst_id
+/// \return
+///
+PIDX_return_code PIDX_idx_rst_plan_store(PIDX_idx_rst_plan_list list, PIDX_idx_rst_id rst_id);
+
+
+
+///
+/// \brief PIDX_idx_rst_plan_destroy Frees a plan with its requests, datatypes and buffers
+/// \param plan
+/// \return
+///
+PIDX_return_code PIDX_idx_rst_plan_destroy(PIDX_idx_rst_plan plan);
+
+
+
+///
+/// \brief PIDX_idx_rst_plan_free Frees a list and all its plans
+/// \param list
+/// \return
+///
+PIDX_return_code PIDX_idx_rst_plan_free(PIDX_idx_rst_plan_list list);
+
+
+
 /*
  * Implementation in PIDX_idx_rst_meta_data.c
  */
 ///
-/// \brief PIDX_idx_rst_meta_data_create
+/// \brief PIDX_idx_rst_meta_data_create Creates the plan of rst_id, unless rst_id->plan is already set to a reused one
 /// \param rst_id
 /// \return
 ///
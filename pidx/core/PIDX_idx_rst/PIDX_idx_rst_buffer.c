@@ -73,6 +73,39 @@ PIDX_return_code PIDX_idx_rst_buf_create(PIDX_idx_rst_id rst_id)
       if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
       {
         PIDX_super_patch patch_group = var->restructured_super_patch;
+        PIDX_idx_rst_plan plan = rst_id->plan;
+
+        // A cached plan owns the buffers, so that its persistent requests stay valid across flushes
+        if (plan != NULL && plan->is_cached == 1)
+        {
+          if (plan->patch_buffer == NULL)
+          {
+            plan->patch_buffer_count = patch_group->patch_count;
+            plan->patch_buffer = malloc((rst_id->last_index - rst_id->first_index + 1) * sizeof(*plan->patch_buffer));
+            memset(plan->patch_buffer, 0, (rst_id->last_index - rst_id->first_index + 1) * sizeof(*plan->patch_buffer));
+          }
+
+          if (plan->patch_buffer[v - rst_id->first_index] == NULL)
+          {
+            plan->patch_buffer[v - rst_id->first_index] = malloc(patch_group->patch_count * sizeof(*plan->patch_buffer[v - rst_id->first_index]));
+            for (j = 0; j < patch_group->patch_count; j++)
+            {
+              plan->patch_buffer[v - rst_id->first_index][j] = malloc(patch_group->patch[j]->size[0] * patch_group->patch[j]->size[1] * patch_group->patch[j]->size[2] * var->vps * var->bpv/8);
+              if (plan->patch_buffer[v - rst_id->first_index][j] == NULL)
+              {
+                fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+                return PIDX_err_rst;
+              }
+            }
+          }
+
+          for (j = 0; j < patch_group->patch_count; j++)
+            patch_group->patch[j]->buffer = plan->patch_buffer[v - rst_id->first_index][j];
+
+          cnt++;
+          continue;
+        }
+
         // Iterate through all the patches of the super patch and allocate buffer for them
         for (j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
         {
@@ -121,7 +154,9 @@ PIDX_return_code PIDX_idx_rst_buf_destroy(PIDX_idx_rst_id rst_id)
     // Iterate through all the patches of the super patch
     for (uint32_t j = 0; j < rst_id->idx_metadata->variable[v]->restructured_super_patch->patch_count; j++)
     {
-      free(var->restructured_super_patch->patch[j]->buffer);
+      // the buffers of a cached plan are kept for the next flush
+      if (rst_id->plan == NULL || rst_id->plan->is_cached == 0)
+        free(var->restructured_super_patch->patch[j]->buffer);
       var->restructured_super_patch->patch[j]->buffer = 0;
     }
   }
@@ -65,6 +65,25 @@ static void free_patch_extents(PIDX_idx_rst_id rst_id);
 
 PIDX_return_code PIDX_idx_rst_meta_data_create(PIDX_idx_rst_id rst_id)
 {
+  // A reused plan already holds the super patches of this decomposition,
+  // only the meta data of the variables has to be populated again
+  if (rst_id->plan != NULL)
+  {
+    PIDX_variable var0 = rst_id->idx_metadata->variable[rst_id->first_index];
+
+    rst_id->intersected_restructured_super_patch_count = rst_id->plan->super_patch_count;
+    rst_id->intersected_restructured_super_patch = rst_id->plan->super_patch;
+
+    var0->restructured_super_patch_count = 0;
+    for (int i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+    {
+      if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
+        var0->restructured_super_patch_count++;
+    }
+
+    return copy_reciever_patch_info(rst_id);
+  }
+
   // Gathers the extents of all patches
   // The outcome is stored in rst_id->sim_multi_patch_r_size and rst_id->sim_multi_patch_r_offset
   gather_all_patch_extents(rst_id);
@@ -89,6 +108,13 @@ PIDX_return_code PIDX_idx_rst_meta_data_create(PIDX_idx_rst_id rst_id)
   // Free the allocated patch extents
   free_patch_extents(rst_id);
 
+
+  // The super patches are the plan of this flush (kept for the next ones with steady state io)
+  rst_id->plan = malloc(sizeof(*rst_id->plan));
+  memset(rst_id->plan, 0, sizeof(*rst_id->plan));
+  rst_id->plan->super_patch_count = rst_id->intersected_restructured_super_patch_count;
+  rst_id->plan->super_patch = rst_id->intersected_restructured_super_patch;
+
   return PIDX_success;
 }
 
@@ -565,10 +591,8 @@ PIDX_return_code PIDX_idx_rst_meta_data_write(PIDX_idx_rst_id rst_id)
 PIDX_return_code PIDX_idx_rst_meta_data_destroy(PIDX_idx_rst_id rst_id)
 {
   PIDX_variable var0 = rst_id->idx_metadata->variable[rst_id->first_index];
-  if (var0->restructured_super_patch_count == 0)
-      return PIDX_success;
 
-  for (uint32_t v = rst_id->first_index; v <= rst_id->last_index; v++)
+  for (uint32_t v = rst_id->first_index; v <= rst_id->last_index && var0->restructured_super_patch_count != 0; v++)
   {
     PIDX_variable var = rst_id->idx_metadata->variable[v];
 
@@ -588,19 +612,17 @@ PIDX_return_code PIDX_idx_rst_meta_data_destroy(PIDX_idx_rst_id rst_id)
     var->restructured_super_patch = 0;
   }
 
-  for (uint32_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  // The super patches belong to the plan
+  if (rst_id->plan != NULL && rst_id->plan->is_cached == 0)
   {
-    PIDX_super_patch irsp = rst_id->intersected_restructured_super_patch[i];
-    for (uint32_t j = 0; j < irsp->patch_count; j++)
-      free(irsp->patch[j]);
-
-    free(irsp->source_patch);
-    free(irsp->patch);
-    free(irsp->restructured_patch);
-    free(irsp);
+    if (PIDX_idx_rst_plan_destroy(rst_id->plan) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
   }
+  rst_id->plan = NULL;
 
-  free(rst_id->intersected_restructured_super_patch);
   rst_id->intersected_restructured_super_patch = 0;
 
   return PIDX_success;
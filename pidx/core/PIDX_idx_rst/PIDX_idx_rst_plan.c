@@ -0,0 +1,232 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/**
+ * \file PIDX_idx_rst_plan.c
+ *
+ * Restructuring plans kept across flushes and time steps (steady state io).
+ * The plan is computed by PIDX_idx_rst_meta_data_create (all gathers of the
+ * patch extents) and can be reused as long as the decomposition is the same.
+ *
+ */
+
+#include "../../PIDX_inc.h"
+
+
+static int key_matches(PIDX_idx_rst_plan plan, PIDX_idx_rst_id rst_id)
+{
+  idx_dataset idx = rst_id->idx_metadata;
+  PIDX_variable var0 = idx->variable[rst_id->first_index];
+
+  if (plan->comm != rst_id->idx_c->simulation_comm || plan->first_index != rst_id->first_index || plan->last_index != rst_id->last_index)
+    return 0;
+
+  for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
+  {
+    if (plan->bytes_per_sample[v - rst_id->first_index] != idx->variable[v]->vps * idx->variable[v]->bpv/8)
+      return 0;
+  }
+
+  if (plan->patch_count != var0->sim_patch_count)
+    return 0;
+
+  for (int p = 0; p < var0->sim_patch_count; p++)
+  {
+    if (memcmp(&plan->patch_extent[p * 2 * PIDX_MAX_DIMENSIONS], var0->sim_patch[p]->offset, PIDX_MAX_DIMENSIONS * sizeof(uint64_t)) != 0)
+      return 0;
+    if (memcmp(&plan->patch_extent[p * 2 * PIDX_MAX_DIMENSIONS + PIDX_MAX_DIMENSIONS], var0->sim_patch[p]->size, PIDX_MAX_DIMENSIONS * sizeof(uint64_t)) != 0)
+      return 0;
+  }
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (plan->box_bounds[d] != idx->box_bounds[d] || plan->chunk_size[d] != idx->chunk_size[d] || plan->grid_patch_size[d] != rst_id->restructured_grid->patch_size[d])
+      return 0;
+  }
+
+  return 1;
+}
+
+
+
+PIDX_idx_rst_plan PIDX_idx_rst_plan_find(PIDX_idx_rst_plan_list list, PIDX_idx_rst_id rst_id)
+{
+  for (int e = 0; e < list->count; e++)
+  {
+    if (key_matches(list->entry[e], rst_id))
+      return list->entry[e];
+  }
+
+  return NULL;
+}
+
+
+
+PIDX_return_code PIDX_idx_rst_plan_store(PIDX_idx_rst_plan_list list, PIDX_idx_rst_id rst_id)
+{
+  idx_dataset idx = rst_id->idx_metadata;
+  PIDX_variable var0 = idx->variable[rst_id->first_index];
+  PIDX_idx_rst_plan plan = rst_id->plan;
+
+  plan->comm = rst_id->idx_c->simulation_comm;
+  plan->first_index = rst_id->first_index;
+  plan->last_index = rst_id->last_index;
+
+  plan->bytes_per_sample = malloc((rst_id->last_index - rst_id->first_index + 1) * sizeof(*plan->bytes_per_sample));
+  for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
+    plan->bytes_per_sample[v - rst_id->first_index] = idx->variable[v]->vps * idx->variable[v]->bpv/8;
+
+  plan->patch_count = var0->sim_patch_count;
+  plan->patch_extent = malloc(var0->sim_patch_count * 2 * PIDX_MAX_DIMENSIONS * sizeof(*plan->patch_extent));
+  for (int p = 0; p < var0->sim_patch_count; p++)
+  {
+    memcpy(&plan->patch_extent[p * 2 * PIDX_MAX_DIMENSIONS], var0->sim_patch[p]->offset, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+    memcpy(&plan->patch_extent[p * 2 * PIDX_MAX_DIMENSIONS + PIDX_MAX_DIMENSIONS], var0->sim_patch[p]->size, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  }
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    plan->box_bounds[d] = idx->box_bounds[d];
+    plan->chunk_size[d] = idx->chunk_size[d];
+    plan->grid_patch_size[d] = rst_id->restructured_grid->patch_size[d];
+  }
+
+  plan->is_cached = 1;
+
+  // a pack has one plan, the previous one described another decomposition
+  for (int e = 0; e < list->count; e++)
+  {
+    if (list->entry[e]->first_index == plan->first_index && list->entry[e]->last_index == plan->last_index)
+    {
+      if (PIDX_idx_rst_plan_destroy(list->entry[e]) != PIDX_success)
+      {
+        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+        return PIDX_err_rst;
+      }
+      list->entry[e] = plan;
+      return PIDX_success;
+    }
+  }
+
+  PIDX_idx_rst_plan *temp_entry = realloc(list->entry, (list->count + 1) * sizeof(*temp_entry));
+  if (temp_entry == NULL)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_rst;
+  }
+  list->entry = temp_entry;
+  list->entry[list->count++] = plan;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_idx_rst_plan_destroy(PIDX_idx_rst_plan plan)
+{
+  if (plan == NULL)
+    return PIDX_success;
+
+  // persistent requests are inactive between flushes, freeing them and their datatypes is local
+  for (int r = 0; r < plan->req_count; r++)
+  {
+    if (MPI_Request_free(&plan->req[r]) != MPI_SUCCESS || MPI_Type_free(&plan->type[r]) != MPI_SUCCESS)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_mpi;
+    }
+  }
+  free(plan->req);
+  free(plan->type);
+  free(plan->address);
+
+  if (plan->patch_buffer != NULL)
+  {
+    for (int v = 0; v <= plan->last_index - plan->first_index; v++)
+    {
+      for (uint32_t j = 0; j < plan->patch_buffer_count; j++)
+        free(plan->patch_buffer[v][j]);
+      free(plan->patch_buffer[v]);
+    }
+    free(plan->patch_buffer);
+  }
+
+  for (int i = 0; i < plan->super_patch_count; i++)
+  {
+    PIDX_super_patch irsp = plan->super_patch[i];
+    for (uint32_t j = 0; j < irsp->patch_count; j++)
+      free(irsp->patch[j]);
+
+    free(irsp->source_patch);
+    free(irsp->patch);
+    free(irsp->restructured_patch);
+    free(irsp);
+  }
+  free(plan->super_patch);
+
+  free(plan->bytes_per_sample);
+  free(plan->patch_extent);
+  free(plan);
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_idx_rst_plan_free(PIDX_idx_rst_plan_list list)
+{
+  if (list == NULL)
+    return PIDX_success;
+
+  for (int e = 0; e < list->count; e++)
+  {
+    if (PIDX_idx_rst_plan_destroy(list->entry[e]) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
+  }
+
+  free(list->entry);
+  free(list);
+
+  return PIDX_success;
+}
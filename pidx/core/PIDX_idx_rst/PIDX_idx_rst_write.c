@@ -53,227 +53,336 @@
 
 #include "../../PIDX_inc.h"
 
+static int exchange_addresses(PIDX_idx_rst_id rst_id, MPI_Aint* address);
+static PIDX_return_code create_exchange(PIDX_idx_rst_id rst_id);
+static PIDX_return_code free_exchange(PIDX_idx_rst_plan plan);
+static PIDX_return_code copy_local_patches(PIDX_idx_rst_id rst_id);
+static void dump_exchange(PIDX_idx_rst_id rst_id);
+
+
+// All the variables of the pack move in one exchange: there is one persistent send or receive per patch, and its
+// datatype spans the buffers of all the variables. The requests are created with the plan and only created again
+// when one of the buffers they refer to has moved (the simulation can hand in new buffers at every time step).
 PIDX_return_code PIDX_idx_rst_staged_write(PIDX_idx_rst_id rst_id)
 {
-  uint64_t index, count1 = 0, req_count = 0;
-  int *send_count, *send_offset;
-  uint64_t counter = 0, req_counter = 0, chunk_counter = 0;
-  uint64_t send_c;
-  uint64_t send_o;
-  int ret = 0;
-
-  MPI_Request *req;
-  MPI_Status *status;
-  MPI_Datatype *chunk_data_type;
+  PIDX_idx_rst_plan plan = rst_id->plan;
+  int do_io = (rst_id->idx_debug_metadata->debug_file_output_state != PIDX_NO_IO_AND_META_DATA_DUMP);
 
-  //creating ample requests and statuses
-  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
-    for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-      req_count++;
+  if (rst_id->idx_debug_metadata->debug_file_output_state == PIDX_META_DATA_DUMP_ONLY || rst_id->idx_debug_metadata->debug_file_output_state == PIDX_NO_IO_AND_META_DATA_DUMP)
+    dump_exchange(rst_id);
 
-  int end_index = 0;
-  for (uint32_t start_index = rst_id->first_index; start_index < (rst_id->last_index + 1); start_index = start_index + 1)
+  if (do_io)
   {
-    send_c = 0, send_o = 0, counter = 0, req_counter = 0, chunk_counter = 0;
-    end_index = ((start_index) >= (rst_id->last_index + 1)) ? (rst_id->last_index) : (start_index);
+    int address_count = exchange_addresses(rst_id, NULL);
+    MPI_Aint *address = malloc(address_count * sizeof(*address));
+    exchange_addresses(rst_id, address);
 
-    req = malloc(sizeof (*req) * req_count * 2 * (end_index - start_index + 1));
-    if (!req)
+    if (address_count != plan->address_count || (address_count != 0 && memcmp(address, plan->address, address_count * sizeof(*address)) != 0))
     {
-      fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-      return (-1);
+      if (free_exchange(plan) != PIDX_success)
+      {
+        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+        return PIDX_err_mpi;
+      }
+
+      plan->address_count = address_count;
+      plan->address = address;
+
+      if (create_exchange(rst_id) != PIDX_success)
+      {
+        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+        return PIDX_err_mpi;
+      }
     }
-    memset(req, 0, sizeof (*req) * req_count * 2 * (end_index - start_index + 1));
+    else
+      free(address);
 
-    status = malloc(sizeof (*status) * req_count * 2 * (end_index - start_index + 1));
-    if (!status)
+    if (plan->req_count != 0 && MPI_Startall(plan->req_count, plan->req) != MPI_SUCCESS)
     {
       fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-      return (-1);
+      return PIDX_err_mpi;
     }
-    memset(status, 0, sizeof (*status) * req_count * 2 * (end_index - start_index + 1));
+  }
 
-    chunk_data_type =  malloc(sizeof (*chunk_data_type) * req_count  * (end_index - start_index + 1));
-    if (!chunk_data_type)
+  // the patches a process holds itself are copied while the messages are in flight
+  copy_local_patches(rst_id);
+
+  if (do_io)
+  {
+    if (MPI_Waitall(plan->req_count, plan->req, MPI_STATUSES_IGNORE) != MPI_SUCCESS)
     {
       fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-      return (-1);
+      return PIDX_err_mpi;
     }
-    memset(chunk_data_type, 0, sizeof (*chunk_data_type) * req_count  * (end_index - start_index + 1));
+  }
+
+  return PIDX_success;
+}
+
+
+
+// Addresses of the buffers of all the messages, in the order of create_exchange (only counted if address is NULL)
+static int exchange_addresses(PIDX_idx_rst_id rst_id, MPI_Aint* address)
+{
+  int count = 0;
+
+  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  {
+    PIDX_super_patch irsp = rst_id->intersected_restructured_super_patch[i];
+    int is_holder = (rst_id->idx_c->simulation_rank == irsp->max_patch_rank);
 
-    for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+    for (uint64_t j = 0; j < irsp->patch_count; j++)
     {
-      if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
+      int is_source = (rst_id->idx_c->simulation_rank == irsp->source_patch[j].rank);
+      if (is_holder == is_source)
+        continue;
+
+      for (uint32_t v = rst_id->first_index; v <= rst_id->last_index; v++)
       {
-        for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-        {
-          uint64_t *reg_patch_offset = rst_id->intersected_restructured_super_patch[i]->patch[j]->offset;
-          uint64_t *reg_patch_count  = rst_id->intersected_restructured_super_patch[i]->patch[j]->size;
+        PIDX_variable var = rst_id->idx_metadata->variable[v];
+        if (address != NULL)
+          MPI_Get_address(is_holder ? var->restructured_super_patch->patch[j]->buffer : var->sim_patch[irsp->source_patch[j].index]->buffer, &address[count]);
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
 
-          if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank)
+
+
+static PIDX_return_code create_exchange(PIDX_idx_rst_id rst_id)
+{
+  PIDX_idx_rst_plan plan = rst_id->plan;
+  int var_count = rst_id->last_index - rst_id->first_index + 1;
+
+  plan->req_count = plan->address_count / var_count;
+  plan->req = malloc(plan->req_count * sizeof(*plan->req));
+  plan->type = malloc(plan->req_count * sizeof(*plan->type));
+
+  int *block_length = malloc(var_count * sizeof(*block_length));
+  MPI_Datatype *block_type = malloc(var_count * sizeof(*block_type));
+
+  int req_counter = 0;
+  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  {
+    PIDX_super_patch irsp = rst_id->intersected_restructured_super_patch[i];
+    int is_holder = (rst_id->idx_c->simulation_rank == irsp->max_patch_rank);
+
+    for (uint64_t j = 0; j < irsp->patch_count; j++)
+    {
+      int is_source = (rst_id->idx_c->simulation_rank == irsp->source_patch[j].rank);
+      if (is_holder == is_source)
+        continue;
+
+      uint64_t *reg_patch_offset = irsp->patch[j]->offset;
+      uint64_t *reg_patch_count = irsp->patch[j]->size;
+      int p_index = irsp->source_patch[j].index;
+
+      for (uint32_t v = rst_id->first_index; v <= rst_id->last_index; v++)
+      {
+        PIDX_variable var = rst_id->idx_metadata->variable[v];
+        uint64_t bytes_per_sample = var->vps * var->bpv/8;
+
+        // the receiver gets the patch of every variable contiguously
+        if (is_holder)
+        {
+          uint64_t length = reg_patch_count[0] * reg_patch_count[1] * reg_patch_count[2] * bytes_per_sample;
+          if (length > INT_MAX)
           {
-            count1 = 0;
-            int p_index = rst_id->intersected_restructured_super_patch[i]->source_patch[j].index;
-            uint64_t *sim_patch_offset = rst_id->idx_metadata->variable[start_index]->sim_patch[p_index]->offset;
-            uint64_t *sim_patch_count = rst_id->idx_metadata->variable[start_index]->sim_patch[p_index]->size;
-
-            for (uint64_t k1 = reg_patch_offset[2]; k1 < reg_patch_offset[2] + reg_patch_count[2]; k1++)
-              for (uint64_t j1 = reg_patch_offset[1]; j1 < reg_patch_offset[1] + reg_patch_count[1]; j1++)
-                for (uint64_t i1 = reg_patch_offset[0]; i1 < reg_patch_offset[0] + reg_patch_count[0]; i1 = i1 + reg_patch_count[0])
-                {
-                  index = (sim_patch_count[0] * sim_patch_count[1] * (k1 - sim_patch_offset[2])) +
-                          (sim_patch_count[0] * (j1 - sim_patch_offset[1])) +
-                          (i1 - sim_patch_offset[0]);
-
-                  for (uint64_t v = start_index; v <= end_index; v++)
-                  {
-                    PIDX_variable var = rst_id->idx_metadata->variable[v];
-                    send_o = index * var->vps;
-                    send_c = reg_patch_count[0] * var->vps;
-
-                    if (rst_id->idx_debug_metadata->debug_file_output_state != PIDX_NO_IO_AND_META_DATA_DUMP)
-                    {
-                      memcpy(var->restructured_super_patch->patch[j]->buffer + (count1 * send_c * var->bpv/8), var->sim_patch[p_index]->buffer + send_o * var->bpv/8, send_c * var->bpv/8);
-                    }
-
-                    if (rst_id->idx_debug_metadata->debug_file_output_state == PIDX_META_DATA_DUMP_ONLY || rst_id->idx_debug_metadata->debug_file_output_state == PIDX_NO_IO_AND_META_DATA_DUMP)
-                    {
-                      fprintf(rst_id->idx_debug_metadata->debug_file_output_fp, "[M] [%lld] Dest offset %lld Dest size %lld Source offset %lld Source size %lld\n", (unsigned long long)v, (unsigned long long)(count1 * send_c * var->bpv/8), (unsigned long long)(send_c * var->bpv/8), (unsigned long long)(send_o * var->bpv/8), (unsigned long long)(send_c * var->bpv/8));
-                      fflush(rst_id->idx_debug_metadata->debug_file_output_fp);
-                    }
-                  }
-                  count1++;
-                }
+            fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+            free(block_length);
+            free(block_type);
+            return PIDX_err_rst;
           }
-          else
-          {
-            for (uint64_t v = start_index; v <= end_index; v++)
-            {
-              PIDX_variable var = rst_id->idx_metadata->variable[v];
-              int length = (reg_patch_count[0] * reg_patch_count[1] * reg_patch_count[2]) * var->vps * var->bpv/8;
-              if (rst_id->idx_debug_metadata->debug_file_output_state != PIDX_NO_IO_AND_META_DATA_DUMP)
-              {
-                ret = MPI_Irecv(var->restructured_super_patch->patch[j]->buffer, length, MPI_BYTE, rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank, 123, rst_id->idx_c->simulation_comm, &req[req_counter]);
-                if (ret != MPI_SUCCESS)
-                {
-                  fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-                  return PIDX_err_mpi;
-                }
-              }
+          block_length[v - rst_id->first_index] = (int)length;
+          block_type[v - rst_id->first_index] = MPI_BYTE;
+          continue;
+        }
 
-              if (rst_id->idx_debug_metadata->debug_file_output_state == PIDX_META_DATA_DUMP_ONLY || rst_id->idx_debug_metadata->debug_file_output_state == PIDX_NO_IO_AND_META_DATA_DUMP)
-              {
-                fprintf(rst_id->idx_debug_metadata->debug_file_output_fp, "[N REC] [%lld] Dest offset 0 Dest size %d My rank %d Source rank %d\n", (unsigned long long)v, length, rst_id->idx_c->simulation_rank,  rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank);
-                fflush(rst_id->idx_debug_metadata->debug_file_output_fp);
-              }
+        // the sender picks the rows of the patch out of its simulation patch
+        uint64_t *sim_patch_count = var->sim_patch[p_index]->size;
+        uint64_t *sim_patch_offset = var->sim_patch[p_index]->offset;
+        int row_count = reg_patch_count[1] * reg_patch_count[2];
+        int *send_offset = malloc(row_count * sizeof(*send_offset));
+        int *send_count = malloc(row_count * sizeof(*send_count));
 
-              req_counter++;
-            }
+        int count1 = 0;
+        for (uint64_t k1 = reg_patch_offset[2]; k1 < reg_patch_offset[2] + reg_patch_count[2]; k1++)
+          for (uint64_t j1 = reg_patch_offset[1]; j1 < reg_patch_offset[1] + reg_patch_count[1]; j1++)
+          {
+            uint64_t index = (sim_patch_count[0] * sim_patch_count[1] * (k1 - sim_patch_offset[2])) +
+                             (sim_patch_count[0] * (j1 - sim_patch_offset[1])) +
+                             (reg_patch_offset[0] - sim_patch_offset[0]);
+            send_offset[count1] = index * bytes_per_sample;
+            send_count[count1] = reg_patch_count[0] * bytes_per_sample;
+            count1++;
           }
+
+        block_length[v - rst_id->first_index] = 1;
+        MPI_Type_indexed(count1, send_count, send_offset, MPI_BYTE, &block_type[v - rst_id->first_index]);
+
+        free(send_offset);
+        free(send_count);
+      }
+
+      // one datatype over the buffers of all the variables
+      if (MPI_Type_create_struct(var_count, block_length, &plan->address[req_counter * var_count], block_type, &plan->type[req_counter]) != MPI_SUCCESS)
+      {
+        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+        if (!is_holder)
+        {
+          for (int v = 0; v < var_count; v++)
+            MPI_Type_free(&block_type[v]);
         }
-        counter++;
-        assert(counter == 1);
+        free(block_length);
+        free(block_type);
+        return PIDX_err_mpi;
+      }
+      MPI_Type_commit(&plan->type[req_counter]);
+
+      if (!is_holder)
+      {
+        for (int v = 0; v < var_count; v++)
+          MPI_Type_free(&block_type[v]);
       }
+
+      // a sender has at most one patch in a super patch per simulation patch, its index tells the messages apart
+      int ret;
+      if (is_holder)
+        ret = MPI_Recv_init(MPI_BOTTOM, 1, plan->type[req_counter], irsp->source_patch[j].rank, p_index, rst_id->idx_c->simulation_comm, &plan->req[req_counter]);
       else
+        ret = MPI_Send_init(MPI_BOTTOM, 1, plan->type[req_counter], irsp->max_patch_rank, p_index, rst_id->idx_c->simulation_comm, &plan->req[req_counter]);
+
+      if (ret != MPI_SUCCESS)
       {
-        for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-        {
-          if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank)
-          {
-            for (uint64_t v = start_index; v <= end_index; v++)
-            {
-              PIDX_variable var = rst_id->idx_metadata->variable[v];
+        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+        free(block_length);
+        free(block_type);
+        return PIDX_err_mpi;
+      }
 
-              uint64_t *reg_patch_count = rst_id->intersected_restructured_super_patch[i]->patch[j]->size;
-              uint64_t *reg_patch_offset = rst_id->intersected_restructured_super_patch[i]->patch[j]->offset;
+      req_counter++;
+    }
+  }
 
-              send_offset = malloc(sizeof (int) * (reg_patch_count[1] * reg_patch_count[2]));
-              if (!send_offset)
-              {
-                fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-                return PIDX_err_mpi;
-              }
-              memset(send_offset, 0, sizeof (int) * (reg_patch_count[1] * reg_patch_count[2]));
+  free(block_length);
+  free(block_type);
 
-              send_count = malloc(sizeof (int) * (reg_patch_count[1] * reg_patch_count[2]));
-              if (!send_count)
-              {
-                fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-                return PIDX_err_mpi;
-              }
-              memset(send_count, 0, sizeof (int) * (reg_patch_count[1] * reg_patch_count[2]));
-
-              count1 = 0;
-              int p_index =  rst_id->intersected_restructured_super_patch[i]->source_patch[j].index;
-              uint64_t *sim_patch_count  = rst_id->idx_metadata->variable[start_index]->sim_patch[p_index]->size;
-              uint64_t *sim_patch_offset = rst_id->idx_metadata->variable[start_index]->sim_patch[p_index]->offset;
-
-              int total_send_count = 0;
-              for (uint64_t k1 = reg_patch_offset[2]; k1 < reg_patch_offset[2] + reg_patch_count[2]; k1++)
-                for (uint64_t j1 = reg_patch_offset[1]; j1 < reg_patch_offset[1] + reg_patch_count[1]; j1++)
-                  for (uint64_t i1 = reg_patch_offset[0]; i1 < reg_patch_offset[0] + reg_patch_count[0]; i1 = i1 + reg_patch_count[0])
-                  {
-                    index = (sim_patch_count[0] * sim_patch_count[1] * (k1 - sim_patch_offset[2])) +
-                            (sim_patch_count[0] * (j1 - sim_patch_offset[1])) +
-                            (i1 - sim_patch_offset[0]);
-                    send_offset[count1] = index * var->vps * var->bpv/8;
-                    send_count[count1] = reg_patch_count[0] * var->vps * var->bpv/8;
-                    total_send_count = total_send_count + send_count[count1];
-
-                    count1++;
-                  }
-
-              MPI_Type_indexed(count1, send_count, send_offset, MPI_BYTE, &chunk_data_type[chunk_counter]);
-              MPI_Type_commit(&chunk_data_type[chunk_counter]);
+  return PIDX_success;
+}
+
+
+
+static PIDX_return_code free_exchange(PIDX_idx_rst_plan plan)
+{
+  for (int r = 0; r < plan->req_count; r++)
+  {
+    if (MPI_Request_free(&plan->req[r]) != MPI_SUCCESS || MPI_Type_free(&plan->type[r]) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+      return PIDX_err_mpi;
+    }
+  }
+
+  free(plan->req);
+  free(plan->type);
+  free(plan->address);
+  plan->req = NULL;
+  plan->type = NULL;
+  plan->address = NULL;
+  plan->req_count = 0;
+  plan->address_count = 0;
+
+  return PIDX_success;
+}
+
+
+
+static PIDX_return_code copy_local_patches(PIDX_idx_rst_id rst_id)
+{
+  uint64_t index, count1 = 0;
+  uint64_t send_c;
+  uint64_t send_o;
+
+  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  {
+    if (rst_id->idx_c->simulation_rank != rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
+      continue;
+
+    for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
+    {
+      if (rst_id->idx_c->simulation_rank != rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank)
+        continue;
+
+      uint64_t *reg_patch_offset = rst_id->intersected_restructured_super_patch[i]->patch[j]->offset;
+      uint64_t *reg_patch_count  = rst_id->intersected_restructured_super_patch[i]->patch[j]->size;
+
+      count1 = 0;
+      int p_index = rst_id->intersected_restructured_super_patch[i]->source_patch[j].index;
+      uint64_t *sim_patch_offset = rst_id->idx_metadata->variable[rst_id->first_index]->sim_patch[p_index]->offset;
+      uint64_t *sim_patch_count = rst_id->idx_metadata->variable[rst_id->first_index]->sim_patch[p_index]->size;
+
+      for (uint64_t k1 = reg_patch_offset[2]; k1 < reg_patch_offset[2] + reg_patch_count[2]; k1++)
+        for (uint64_t j1 = reg_patch_offset[1]; j1 < reg_patch_offset[1] + reg_patch_count[1]; j1++)
+          for (uint64_t i1 = reg_patch_offset[0]; i1 < reg_patch_offset[0] + reg_patch_count[0]; i1 = i1 + reg_patch_count[0])
+          {
+            index = (sim_patch_count[0] * sim_patch_count[1] * (k1 - sim_patch_offset[2])) +
+                    (sim_patch_count[0] * (j1 - sim_patch_offset[1])) +
+                    (i1 - sim_patch_offset[0]);
+
+            for (uint64_t v = rst_id->first_index; v <= rst_id->last_index; v++)
+            {
+              PIDX_variable var = rst_id->idx_metadata->variable[v];
+              send_o = index * var->vps;
+              send_c = reg_patch_count[0] * var->vps;
 
               if (rst_id->idx_debug_metadata->debug_file_output_state != PIDX_NO_IO_AND_META_DATA_DUMP)
               {
-                ret = MPI_Isend(var->sim_patch[p_index]->buffer, 1, chunk_data_type[chunk_counter], rst_id->intersected_restructured_super_patch[i]->max_patch_rank, 123, rst_id->idx_c->simulation_comm, &req[req_counter]);
-                if (ret != MPI_SUCCESS)
-                {
-                  fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-                  return PIDX_err_mpi;
-                }
+                memcpy(var->restructured_super_patch->patch[j]->buffer + (count1 * send_c * var->bpv/8), var->sim_patch[p_index]->buffer + send_o * var->bpv/8, send_c * var->bpv/8);
               }
 
               if (rst_id->idx_debug_metadata->debug_file_output_state == PIDX_META_DATA_DUMP_ONLY || rst_id->idx_debug_metadata->debug_file_output_state == PIDX_NO_IO_AND_META_DATA_DUMP)
               {
-                fprintf(rst_id->idx_debug_metadata->debug_file_output_fp, "[N SND] [%lld] Source offset 0 Source size %d My rank %d Dest rank %d\n", (unsigned long long)v, total_send_count, rst_id->idx_c->simulation_rank,  rst_id->intersected_restructured_super_patch[i]->max_patch_rank);
+                fprintf(rst_id->idx_debug_metadata->debug_file_output_fp, "[M] [%lld] Dest offset %lld Dest size %lld Source offset %lld Source size %lld\n", (unsigned long long)v, (unsigned long long)(count1 * send_c * var->bpv/8), (unsigned long long)(send_c * var->bpv/8), (unsigned long long)(send_o * var->bpv/8), (unsigned long long)(send_c * var->bpv/8));
                 fflush(rst_id->idx_debug_metadata->debug_file_output_fp);
               }
-
-              req_counter++;
-              chunk_counter++;
-
-              free(send_offset);
-              free(send_count);
             }
+            count1++;
           }
-        }
-      }
     }
+  }
+
+  return PIDX_success;
+}
+
+
+
+static void dump_exchange(PIDX_idx_rst_id rst_id)
+{
+  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  {
+    PIDX_super_patch irsp = rst_id->intersected_restructured_super_patch[i];
+    int is_holder = (rst_id->idx_c->simulation_rank == irsp->max_patch_rank);
 
-    if (rst_id->idx_debug_metadata->debug_file_output_state != PIDX_NO_IO_AND_META_DATA_DUMP)
+    for (uint64_t j = 0; j < irsp->patch_count; j++)
     {
-      ret = MPI_Waitall(req_counter, req, status);
-      if (ret != MPI_SUCCESS)
-      {
-        fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-        return (-1);
-      }
-    }
+      int is_source = (rst_id->idx_c->simulation_rank == irsp->source_patch[j].rank);
+      if (is_holder == is_source)
+        continue;
 
-    for (uint64_t i = 0; i < chunk_counter; i++)
-      MPI_Type_free(&chunk_data_type[i]);
-    free(chunk_data_type);
-    chunk_data_type = 0;
+      uint64_t length = 0;
+      for (uint32_t v = rst_id->first_index; v <= rst_id->last_index; v++)
+        length = length + irsp->patch[j]->size[0] * irsp->patch[j]->size[1] * irsp->patch[j]->size[2] * rst_id->idx_metadata->variable[v]->vps * rst_id->idx_metadata->variable[v]->bpv/8;
 
-    free(req);
-    req = 0;
-    free(status);
-    status = 0;
-    req_counter = 0;
+      if (is_holder)
+        fprintf(rst_id->idx_debug_metadata->debug_file_output_fp, "[N REC] [%d - %d] Dest offset 0 Dest size %lld My rank %d Source rank %d\n", rst_id->first_index, rst_id->last_index, (unsigned long long)length, rst_id->idx_c->simulation_rank, irsp->source_patch[j].rank);
+      else
+        fprintf(rst_id->idx_debug_metadata->debug_file_output_fp, "[N SND] [%d - %d] Source offset 0 Source size %lld My rank %d Dest rank %d\n", rst_id->first_index, rst_id->last_index, (unsigned long long)length, rst_id->idx_c->simulation_rank, irsp->max_patch_rank);
+    }
   }
+  fflush(rst_id->idx_debug_metadata->debug_file_output_fp);
 
-  return PIDX_success;
+  return;
 }
@@ -67,10 +67,7 @@ PIDX_particles_rst_id PIDX_particles_rst_init(idx_dataset idx_meta_data, idx_com
   particles_rst_id->first_index = var_start_index;
   particles_rst_id->last_index = var_end_index;
 
-  particles_rst_id->maximum_neighbor_count = 256;
-
-  particles_rst_id->intersected_restructured_super_patch_count = 0;
-  particles_rst_id->sim_max_patch_count = 0;
+  particles_rst_id->graph_comm = MPI_COMM_NULL;
 
   particles_rst_id->restructured_grid = restructured_grid;
 
@@ -80,8 +77,6 @@ PIDX_particles_rst_id PIDX_particles_rst_init(idx_dataset idx_meta_data, idx_com
 
 PIDX_return_code PIDX_particles_rst_finalize(PIDX_particles_rst_id particles_rst_id)
 {
-  particles_rst_id->intersected_restructured_super_patch_count = 0;
-  particles_rst_id->sim_max_patch_count = 0;
   free(particles_rst_id);
   particles_rst_id = 0;
 
@@ -56,6 +56,47 @@
 #define __PIDX_particles_rst_NEW_H
 
 
+/// Brick of a particle file: a run of particles that are consecutive in every variable
+/// once the file is sorted along the Z-order curve, with the bounds of their positions
+struct PIDX_particles_rst_index_brick_struct
+{
+  double lo[PIDX_MAX_DIMENSIONS];
+  double hi[PIDX_MAX_DIMENSIONS];                 /// inclusive
+  uint64_t first;
+  uint64_t count;
+};
+typedef struct PIDX_particles_rst_index_brick_struct PIDX_particles_rst_index_brick;
+
+
+/// Brick index of one particle file, stored after the variables of the file.
+/// order (write only) maps the sorted particles to the particles of the unsorted buffers.
+/// The particles of level l of detail are [level_end[l - 1], level_end[l]), each level is sorted
+/// and has its own bricks.
+struct PIDX_particles_rst_index_struct
+{
+  uint64_t particle_count;
+  uint64_t *order;
+
+  uint32_t level_count;
+  uint64_t *level_end;
+
+  uint32_t brick_count;
+  PIDX_particles_rst_index_brick *brick;
+};
+typedef struct PIDX_particles_rst_index_struct* PIDX_particles_rst_index;
+
+
+/// Particles [first, first + count) of a file selected by a query.
+/// inside is set when all of them lie in the queried box and need no test.
+struct PIDX_particles_rst_index_run_struct
+{
+  uint64_t first;
+  uint64_t count;
+  int inside;
+};
+typedef struct PIDX_particles_rst_index_run_struct PIDX_particles_rst_index_run;
+
+
 //Struct for restructuring ID
 struct PIDX_particles_rst_struct
 {
@@ -68,14 +109,31 @@ struct PIDX_particles_rst_struct
   int first_index;
   int last_index;
 
-  int intersected_restructured_super_patch_count;
-  PIDX_super_patch* intersected_restructured_super_patch;
+  /// Bytes of one particle in the variables [first_index, last_index]
+  uint64_t particle_size;
+
+  /// Processes this process sends particles to (holders of the restructured patches its particles
+  /// fall in), in the order of graph_comm. send_patch is the index of their restructured patch
+  int send_count;
+  int *send_rank;
+  uint64_t *send_patch;
+  uint64_t *send_particle_count;
 
-  int sim_max_patch_count;
-  double* sim_multi_patch_r_count;
-  double* sim_multi_patch_r_offset;
+  /// Processes this process receives particles from (only if it holds a restructured patch)
+  int recv_count;
+  int *recv_rank;
+  uint64_t *recv_particle_count;
 
-  int maximum_neighbor_count;
+  /// Restructured patch of every particle of the local patches
+  int particle_bin_count;
+  uint32_t **particle_bin;
+
+  /// Distributed graph of the senders and the holders of the restructured patches
+  MPI_Comm graph_comm;
+
+  /// One message per destination (source), holding all the variables of its particles one after the other
+  unsigned char *send_buffer;
+  unsigned char *recv_buffer;
 };
 typedef struct PIDX_particles_rst_struct* PIDX_particles_rst_id;
 
@@ -135,6 +193,7 @@ PIDX_return_code PIDX_particles_rst_meta_data_destroy(PIDX_particles_rst_id rst_
 
 
 
+
 /*
  * Implementation in PIDX_particles_rst_buffer.c
  */
@@ -237,4 +296,136 @@ PIDX_return_code PIDX_particles_rst_staged_write(PIDX_particles_rst_id rst_id);
 PIDX_return_code PIDX_particles_rst_read(PIDX_particles_rst_id rst_id);
 
 
+
+
+/*
+ * Implementation in PIDX_particles_rst_index.c
+ */
+///
+/// \brief PIDX_particles_rst_sorted_write Writes the variables [svi, evi) of one particle file sorted along
+/// the Z-order curve of the positions in the box (offset, size), followed by the brick index of the file.
+/// Files without the position variable among [svi, evi) are written unsorted and without index.
+/// With idx->particles_lod_level_count > 1 the particles are stored coarse to fine by level of detail.
+/// \param idx
+/// \param fp
+/// \param buffer buffer[v - svi] holds the particle_count samples of variable v
+/// \param svi
+/// \param evi
+/// \param particle_count
+/// \param offset
+/// \param size
+/// \param data_offset file offset of variable svi
+/// \return
+///
+PIDX_return_code PIDX_particles_rst_sorted_write(idx_dataset idx, int fp, unsigned char **buffer, int svi, int evi, uint64_t particle_count, const double *offset, const double *size, uint64_t data_offset);
+
+
+
+///
+/// \brief PIDX_particles_rst_sorted_pack Same as PIDX_particles_rst_sorted_write, but appends the sorted variables
+/// and the brick index to packed instead of writing them (for the extents of the shared files)
+/// \param idx
+/// \param buffer buffer[v - svi] holds the particle_count samples of variable v
+/// \param svi
+/// \param evi
+/// \param particle_count
+/// \param offset
+/// \param size
+/// \param packed
+/// \return
+///
+PIDX_return_code PIDX_particles_rst_sorted_pack(idx_dataset idx, unsigned char **buffer, int svi, int evi, uint64_t particle_count, const double *offset, const double *size, PIDX_buffer *packed);
+
+
+
+///
+/// \brief PIDX_particles_rst_index_load Reads the brick index at the end of a particle file
+/// \param fp
+/// \param data_offset first byte of the particle file in fp (0, or its offset in a shared file)
+/// \param data_size bytes of the particle file
+/// \param particle_count number of particles the file is expected to hold
+/// \return the index, or NULL if the file has no index (it was written unsorted)
+///
+PIDX_particles_rst_index PIDX_particles_rst_index_load(int fp, uint64_t data_offset, uint64_t data_size, uint64_t particle_count);
+
+
+
+///
+/// \brief PIDX_particles_rst_index_query Finds the particles of the bricks that intersect box (physical bounds),
+/// consecutive bricks are merged into one run
+/// \param index
+/// \param box
+/// \param level finest level of detail to read (PIDX_PARTICLES_ALL_LOD_LEVELS for all of them)
+/// \param run
+/// \param run_count
+/// \return
+///
+PIDX_return_code PIDX_particles_rst_index_query(PIDX_particles_rst_index index, PIDX_patch box, int level, PIDX_particles_rst_index_run **run, int *run_count);
+
+
+
+///
+/// \brief PIDX_particles_rst_index_free
+/// \param index
+/// \return
+///
+PIDX_return_code PIDX_particles_rst_index_free(PIDX_particles_rst_index index);
+
+
+
+
+/*
+ * Implementation in PIDX_particles_rst_bin.c
+ */
+///
+/// \brief PIDX_particles_rst_bin Finds the cell of a regular grid every particle falls in, cell (i, j, k) is
+/// bin i + cell_count[0] * (j + cell_count[1] * k). Particles outside the grid go to its boundary cells
+/// \param position PIDX_MAX_DIMENSIONS doubles per particle
+/// \param particle_count
+/// \param origin
+/// \param cell_size
+/// \param cell_count
+/// \param bin
+/// \return
+///
+PIDX_return_code PIDX_particles_rst_bin(const double *position, uint64_t particle_count, const double *origin, const double *cell_size, const uint64_t *cell_count, uint32_t *bin);
+
+
+
+///
+/// \brief PIDX_particles_rst_select Finds the particles inside the box [lo, hi] (closed bounds)
+/// \param position PIDX_MAX_DIMENSIONS doubles per particle
+/// \param particle_count
+/// \param lo
+/// \param hi
+/// \param selected indices of the particles inside the box, in increasing order (up to particle_count of them)
+/// \return the number of particles inside the box
+///
+uint64_t PIDX_particles_rst_select(const double *position, uint64_t particle_count, const double *lo, const double *hi, uint64_t *selected);
+
+
+
+///
+/// \brief PIDX_particles_rst_bin_sort Stable counting sort of the particles by bin
+/// \param bin
+/// \param particle_count
+/// \param bin_count
+/// \param bin_particle_count number of particles of every bin
+/// \param order the particles of bin 0, then the particles of bin 1...
+///
+void PIDX_particles_rst_bin_sort(const uint32_t *bin, uint64_t particle_count, uint32_t bin_count, uint64_t *bin_particle_count, uint64_t *order);
+
+
+
+///
+/// \brief PIDX_particles_rst_gather dst[i] = src[order[i]] for samples of bytes_per_sample bytes
+/// \param dst
+/// \param src
+/// \param order
+/// \param count
+/// \param bytes_per_sample
+///
+void PIDX_particles_rst_gather(unsigned char *dst, const unsigned char *src, const uint64_t *order, uint64_t count, uint64_t bytes_per_sample);
+
+
 #endif
@@ -0,0 +1,271 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/**
+ * \file PIDX_particles_rst_bin.c
+ *
+ * Bulk particle classification shared by the particle restructuring and the
+ * particle reads. A whole position array (PIDX_MAX_DIMENSIONS doubles per
+ * particle) is binned against a regular grid, or selected against a box, in one
+ * pass. On x86 processors with AVX2 four particles are classified at a time, the
+ * path is picked at run time so that the library does not need to be built for
+ * AVX2. Both paths compute the same floating point operations and give the same
+ * bins as the scalar code.
+ *
+ * The bins are then turned into a stable permutation (counting sort), and every
+ * variable is gathered with that permutation.
+ *
+ */
+
+#include "../../PIDX_inc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIDX_PARTICLES_RST_BIN_AVX2 1
+#include <immintrin.h>
+#endif
+
+static uint64_t bin_scalar(const double *position, uint64_t first, uint64_t count, const double *origin, const double *cell_size, const double *last_cell, const double *stride, uint32_t *bin);
+static uint64_t select_scalar(const double *position, uint64_t first, uint64_t count, const double *lo, const double *hi, uint64_t *selected, uint64_t selected_count);
+#if defined(PIDX_PARTICLES_RST_BIN_AVX2)
+static int have_avx2();
+static uint64_t bin_avx2(const double *position, uint64_t count, const double *origin, const double *cell_size, const double *last_cell, const double *stride, uint32_t *bin);
+static uint64_t select_avx2(const double *position, uint64_t count, const double *lo, const double *hi, uint64_t *selected, uint64_t *selected_count);
+#endif
+
+
+PIDX_return_code PIDX_particles_rst_bin(const double *position, uint64_t particle_count, const double *origin, const double *cell_size, const uint64_t *cell_count, uint32_t *bin)
+{
+  double last_cell[PIDX_MAX_DIMENSIONS];
+  double stride[PIDX_MAX_DIMENSIONS];
+  uint64_t bin_count = 1;
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    last_cell[d] = (double)(cell_count[d] - 1);
+    stride[d] = (double)bin_count;
+    bin_count = bin_count * cell_count[d];
+  }
+
+  // The vector path converts the bins through 32 bit signed integers
+  if (bin_count > INT32_MAX)
+  {
+    fprintf(stderr, "[%s] [%d] too many bins (%llu).\n", __FILE__, __LINE__, (unsigned long long)bin_count);
+    return PIDX_err_rst;
+  }
+
+  uint64_t first = 0;
+#if defined(PIDX_PARTICLES_RST_BIN_AVX2)
+  if (have_avx2())
+    first = bin_avx2(position, particle_count, origin, cell_size, last_cell, stride, bin);
+#endif
+  bin_scalar(position, first, particle_count, origin, cell_size, last_cell, stride, bin);
+
+  return PIDX_success;
+}
+
+
+
+uint64_t PIDX_particles_rst_select(const double *position, uint64_t particle_count, const double *lo, const double *hi, uint64_t *selected)
+{
+  uint64_t first = 0;
+  uint64_t selected_count = 0;
+#if defined(PIDX_PARTICLES_RST_BIN_AVX2)
+  if (have_avx2())
+    first = select_avx2(position, particle_count, lo, hi, selected, &selected_count);
+#endif
+
+  return select_scalar(position, first, particle_count, lo, hi, selected, selected_count);
+}
+
+
+
+void PIDX_particles_rst_bin_sort(const uint32_t *bin, uint64_t particle_count, uint32_t bin_count, uint64_t *bin_particle_count, uint64_t *order)
+{
+  memset(bin_particle_count, 0, bin_count * sizeof(*bin_particle_count));
+  for (uint64_t p = 0; p < particle_count; p++)
+    bin_particle_count[bin[p]]++;
+
+  uint64_t *next = malloc((bin_count + 1) * sizeof(*next));
+  next[0] = 0;
+  for (uint32_t b = 1; b < bin_count; b++)
+    next[b] = next[b - 1] + bin_particle_count[b - 1];
+
+  for (uint64_t p = 0; p < particle_count; p++)
+    order[next[bin[p]]++] = p;
+
+  free(next);
+}
+
+
+
+void PIDX_particles_rst_gather(unsigned char *dst, const unsigned char *src, const uint64_t *order, uint64_t count, uint64_t bytes_per_sample)
+{
+  // The common sample sizes get a copy of constant size
+  switch (bytes_per_sample)
+  {
+  case 4:
+    for (uint64_t i = 0; i < count; i++)
+      memcpy(dst + i * 4, src + order[i] * 4, 4);
+    break;
+
+  case 8:
+    for (uint64_t i = 0; i < count; i++)
+      memcpy(dst + i * 8, src + order[i] * 8, 8);
+    break;
+
+  case 24:
+    for (uint64_t i = 0; i < count; i++)
+      memcpy(dst + i * 24, src + order[i] * 24, 24);
+    break;
+
+  default:
+    for (uint64_t i = 0; i < count; i++)
+      memcpy(dst + i * bytes_per_sample, src + order[i] * bytes_per_sample, bytes_per_sample);
+    break;
+  }
+}
+
+
+
+// Particles below (or NaN) and past the grid go to its first and last cells
+static uint64_t bin_scalar(const double *position, uint64_t first, uint64_t count, const double *origin, const double *cell_size, const double *last_cell, const double *stride, uint32_t *bin)
+{
+  for (uint64_t p = first; p < count; p++)
+  {
+    const double *pos = position + p * PIDX_MAX_DIMENSIONS;
+    double index = 0;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      double cell = floor((pos[d] - origin[d]) / cell_size[d]);
+      cell = (cell > 0) ? cell : 0;
+      cell = (cell < last_cell[d]) ? cell : last_cell[d];
+      index = index + cell * stride[d];
+    }
+    bin[p] = (uint32_t)index;
+  }
+
+  return count;
+}
+
+
+
+// Closed bounds, as the bounds of the patches
+static uint64_t select_scalar(const double *position, uint64_t first, uint64_t count, const double *lo, const double *hi, uint64_t *selected, uint64_t selected_count)
+{
+  for (uint64_t p = first; p < count; p++)
+  {
+    const double *pos = position + p * PIDX_MAX_DIMENSIONS;
+    if (pos[0] >= lo[0] && pos[0] <= hi[0] && pos[1] >= lo[1] && pos[1] <= hi[1] && pos[2] >= lo[2] && pos[2] <= hi[2])
+      selected[selected_count++] = p;
+  }
+
+  return selected_count;
+}
+
+
+
+#if defined(PIDX_PARTICLES_RST_BIN_AVX2)
+static int have_avx2()
+{
+  static int avx2 = -1;
+  if (avx2 == -1)
+    avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+
+  return avx2;
+}
+
+
+
+// Classifies four particles at a time, returns the number of particles done
+__attribute__((target("avx2")))
+static uint64_t bin_avx2(const double *position, uint64_t count, const double *origin, const double *cell_size, const double *last_cell, const double *stride, uint32_t *bin)
+{
+  const __m128i coordinate = _mm_setr_epi32(0, PIDX_MAX_DIMENSIONS, 2 * PIDX_MAX_DIMENSIONS, 3 * PIDX_MAX_DIMENSIONS);
+  const __m256d zero = _mm256_setzero_pd();
+
+  uint64_t p = 0;
+  for (; p + 4 <= count; p = p + 4)
+  {
+    const double *pos = position + p * PIDX_MAX_DIMENSIONS;
+    __m256d index = zero;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      __m256d x = _mm256_i32gather_pd(pos + d, coordinate, sizeof(double));
+      __m256d cell = _mm256_floor_pd(_mm256_div_pd(_mm256_sub_pd(x, _mm256_set1_pd(origin[d])), _mm256_set1_pd(cell_size[d])));
+      // max returns its second operand for NaN
+      cell = _mm256_max_pd(cell, zero);
+      cell = _mm256_min_pd(cell, _mm256_set1_pd(last_cell[d]));
+      index = _mm256_add_pd(index, _mm256_mul_pd(cell, _mm256_set1_pd(stride[d])));
+    }
+    _mm_storeu_si128((__m128i*)(bin + p), _mm256_cvttpd_epi32(index));
+  }
+
+  return p;
+}
+
+
+
+__attribute__((target("avx2")))
+static uint64_t select_avx2(const double *position, uint64_t count, const double *lo, const double *hi, uint64_t *selected, uint64_t *selected_count)
+{
+  const __m128i coordinate = _mm_setr_epi32(0, PIDX_MAX_DIMENSIONS, 2 * PIDX_MAX_DIMENSIONS, 3 * PIDX_MAX_DIMENSIONS);
+  uint64_t n = *selected_count;
+
+  uint64_t p = 0;
+  for (; p + 4 <= count; p = p + 4)
+  {
+    const double *pos = position + p * PIDX_MAX_DIMENSIONS;
+    __m256d inside = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      __m256d x = _mm256_i32gather_pd(pos + d, coordinate, sizeof(double));
+      inside = _mm256_and_pd(inside, _mm256_cmp_pd(x, _mm256_set1_pd(lo[d]), _CMP_GE_OQ));
+      inside = _mm256_and_pd(inside, _mm256_cmp_pd(x, _mm256_set1_pd(hi[d]), _CMP_LE_OQ));
+    }
+
+    int mask = _mm256_movemask_pd(inside);
+    for (; mask != 0; mask = mask & (mask - 1))
+      selected[n++] = p + __builtin_ctz(mask);
+  }
+
+  *selected_count = n;
+  return p;
+}
+#endif
@@ -54,46 +54,57 @@
 #include "../../PIDX_inc.h"
 
 
-// Creates the buffers for all the patches that constitutes the super patch
+// Creates the buffers of the messages, the patches of the super patch point to the messages of their senders
 PIDX_return_code PIDX_particles_rst_buf_create(PIDX_particles_rst_id rst_id)
 {
+  uint64_t send_particle_count = 0;
+  for (int i = 0; i < rst_id->send_count; i++)
+    send_particle_count = send_particle_count + rst_id->send_particle_count[i];
 
-  // Iterate through all the super patch a process intersects with
-  for (int i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  uint64_t recv_particle_count = 0;
+  for (int j = 0; j < rst_id->recv_count; j++)
+    recv_particle_count = recv_particle_count + rst_id->recv_particle_count[j];
+
+  rst_id->send_buffer = malloc(send_particle_count * rst_id->particle_size + 1);
+  rst_id->recv_buffer = malloc(recv_particle_count * rst_id->particle_size + 1);
+  if (rst_id->send_buffer == NULL || rst_id->recv_buffer == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_rst;
+  }
+
+  PIDX_variable var0 = rst_id->idx_metadata->variable[rst_id->first_index];
+
+  // If the process does not hold a super patch
+  if (var0->restructured_super_patch_count == 0)
+    return PIDX_success;
+
+  // The message of sender j holds its particles of every variable one after the other
+  uint64_t message_offset = 0;
+  for (int j = 0; j < rst_id->recv_count; j++)
   {
-    // If the process is the target rank of a super patch then allocate buffer for the patches of the super patch
-    if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
+    uint64_t var_offset = 0;
+    for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
     {
-      // Allocate buffer for restructured patches (super patch) for all variables
-      for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
-      {
-        PIDX_variable var = rst_id->idx_metadata->variable[v];
-        PIDX_super_patch patch_group = var->restructured_super_patch;
-
-        // Iterate through all the patches of the super patch and allocate buffer for them
-        for (int j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-        {
-          patch_group->patch[j]->buffer = malloc(patch_group->patch[j]->particle_count * var->vps * var->bpv / CHAR_BIT);
-#if 0
-          if (patch_group->patch[j]->buffer == NULL)
-          {
-            fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
-            return PIDX_err_rst;
-          }
-          memset(patch_group->patch[j]->buffer, 0, (patch_group->patch[j]->particle_count * var->vps * var->bpv / CHAR_BIT));
-#endif
-        }
-      }
+      PIDX_variable var = rst_id->idx_metadata->variable[v];
+      var->restructured_super_patch->patch[j]->buffer = rst_id->recv_buffer + message_offset + var_offset;
+      var_offset = var_offset + rst_id->recv_particle_count[j] * ((var->vps * var->bpv) / CHAR_BIT);
     }
+    message_offset = message_offset + rst_id->recv_particle_count[j] * rst_id->particle_size;
   }
 
   return PIDX_success;
 }
 
 
-// Free all the patches that constitute a super patch
+// Free the messages the patches of the super patch point to
 PIDX_return_code PIDX_particles_rst_buf_destroy(PIDX_particles_rst_id rst_id)
 {
+  free(rst_id->send_buffer);
+  rst_id->send_buffer = 0;
+  free(rst_id->recv_buffer);
+  rst_id->recv_buffer = 0;
+
   PIDX_variable var0 = rst_id->idx_metadata->variable[rst_id->first_index];
 
   // If the process does not hold a super patch
@@ -107,10 +118,7 @@ PIDX_return_code PIDX_particles_rst_buf_destroy(PIDX_particles_rst_id rst_id)
 
     // Iterate through all the patches of the super patch
     for (int j = 0; j < rst_id->idx_metadata->variable[v]->restructured_super_patch->patch_count; j++)
-    {
-      free(var->restructured_super_patch->patch[j]->buffer);
       var->restructured_super_patch->patch[j]->buffer = 0;
-    }
   }
 
   return PIDX_success;
@@ -126,33 +134,26 @@ PIDX_return_code PIDX_particles_rst_aggregate_buf_create(PIDX_particles_rst_id r
   if (var0->restructured_super_patch_count == 0)
       return PIDX_success;
 
-  for (int i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  // Iterate through all the patches of the super patch and allocate buffer for them
+  uint64_t total_particle_count = 0;
+  for (int j = 0; j < var0->restructured_super_patch->patch_count; j++)
+    total_particle_count = total_particle_count + var0->restructured_super_patch->patch[j]->particle_count;
+
+  for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
   {
-    // If the process is the target rank of a super patch then allocate buffer for the patches of the super patch
-    if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
-    {
-      // Iterate through all the patches of the super patch and allocate buffer for them
-      uint64_t total_particle_count = 0;
-      for (int j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-        total_particle_count = total_particle_count + var0->restructured_super_patch->patch[j]->particle_count;
-
-      for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
-      {
-        PIDX_variable var = rst_id->idx_metadata->variable[v];
-        PIDX_super_patch patch_group = var->restructured_super_patch;
-        patch_group->restructured_patch->particle_count =  total_particle_count;
-
-        patch_group->restructured_patch->buffer = malloc(total_particle_count * var->vps * var->bpv / CHAR_BIT);
+    PIDX_variable var = rst_id->idx_metadata->variable[v];
+    PIDX_super_patch patch_group = var->restructured_super_patch;
+    patch_group->restructured_patch->particle_count =  total_particle_count;
+
+    patch_group->restructured_patch->buffer = malloc(total_particle_count * var->vps * var->bpv / CHAR_BIT);
 #if 0
-        if (patch_group->restructured_patch->buffer == NULL)
-        {
-          fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
-          return PIDX_err_rst;
-        }
-        memset(patch_group->restructured_patch->buffer, 0, (patch_group->restructured_patch->particle_count * var->vps * var->bpv / CHAR_BIT));
-#endif
-      }
+    if (patch_group->restructured_patch->buffer == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
     }
+    memset(patch_group->restructured_patch->buffer, 0, (patch_group->restructured_patch->particle_count * var->vps * var->bpv / CHAR_BIT));
+#endif
   }
 
   return PIDX_success;
@@ -0,0 +1,537 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/**
+ * \file PIDX_particles_rst_index.c
+ *
+ * Spatially sorted particle files. The writers order the particles of a file
+ * along a Z-order curve of their positions and append an index of bricks
+ * (octree leaves holding up to PIDX_PARTICLES_RST_INDEX_BRICK_SIZE particles,
+ * each a contiguous run in every variable) after the variables, so box
+ * queries only read the byte ranges of the bricks they intersect.
+ *
+ * With levels of detail the particle at position i of the curve goes to level
+ * level_count - 1 - min(trailing zeros of i, level_count - 1), and the levels are
+ * stored coarse to fine: the first levels of a file are then every 2^k-th particle
+ * along the curve, a spatially uniform subsample of the file.
+ *
+ * File layout: variables | brick_count bricks | level_count level ends | footer
+ * (a whole file, or an extent of a shared file)
+ *
+ */
+
+#include "../../PIDX_inc.h"
+
+#define PIDX_PARTICLES_RST_INDEX_MAGIC 0x49585050
+#define PIDX_PARTICLES_RST_INDEX_VERSION 1
+#define PIDX_PARTICLES_RST_INDEX_BRICK_SIZE 512
+#define PIDX_PARTICLES_RST_INDEX_KEY_BITS 21
+
+struct index_footer
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t brick_count;
+  uint32_t level_count;                           /// 0 in files written before levels of detail (one level)
+  uint64_t particle_count;
+};
+
+struct morton_key
+{
+  uint64_t key;
+  uint64_t particle;
+};
+
+static uint64_t spread_bits(uint64_t x);
+static int morton_compare(const void *a, const void *b);
+static PIDX_return_code index_create(const unsigned char *position, uint64_t particle_count, const double *offset, const double *size, int level_count, PIDX_particles_rst_index *created);
+static int particle_level(uint64_t i, int level_count);
+static PIDX_return_code add_bricks(PIDX_particles_rst_index index, const struct morton_key *key, uint64_t first, uint64_t count, int level, uint32_t *max_brick_count);
+static PIDX_return_code index_write(PIDX_particles_rst_index index, int fp, uint64_t offset);
+static void index_pack(PIDX_particles_rst_index index, PIDX_buffer *packed);
+
+
+PIDX_return_code PIDX_particles_rst_sorted_write(idx_dataset idx, int fp, unsigned char **buffer, int svi, int evi, uint64_t particle_count, const double *offset, const double *size, uint64_t data_offset)
+{
+  // Only files holding the positions (as 3*float64) can be sorted
+  int pvi = idx->particles_position_variable_index;
+  PIDX_variable pos_var = idx->variable[pvi];
+  PIDX_particles_rst_index index = NULL;
+  if (pvi >= svi && pvi < evi && strcmp(pos_var->type_name, FLOAT64_RGB) == 0 && particle_count != 0)
+  {
+    if (index_create(buffer[pvi - svi], particle_count, offset, size, idx->particles_lod_level_count, &index) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
+  }
+
+  unsigned char *sorted = NULL;
+  for (int v = svi; v < evi; v++)
+  {
+    PIDX_variable var = idx->variable[v];
+    uint64_t bytes_per_particle = (var->bpv/CHAR_BIT) * var->vps;
+    uint64_t buffer_size = particle_count * bytes_per_particle;
+
+    unsigned char *write_buffer = buffer[v - svi];
+    if (index != NULL)
+    {
+      // Gathers the variable in the sorted order, the buffers of the caller are left untouched
+      unsigned char *temp = realloc(sorted, buffer_size);
+      if (temp == NULL)
+      {
+        fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+        free(sorted);
+        PIDX_particles_rst_index_free(index);
+        return PIDX_err_rst;
+      }
+      sorted = temp;
+
+      PIDX_particles_rst_gather(sorted, write_buffer, index->order, particle_count, bytes_per_particle);
+      write_buffer = sorted;
+    }
+
+    uint64_t write_count = pwrite(fp, write_buffer, buffer_size, data_offset);
+    if (write_count != buffer_size)
+    {
+      fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+      free(sorted);
+      PIDX_particles_rst_index_free(index);
+      return PIDX_err_io;
+    }
+    data_offset = data_offset + buffer_size;
+  }
+  free(sorted);
+
+  if (index != NULL)
+  {
+    PIDX_return_code ret = index_write(index, fp, data_offset);
+    PIDX_particles_rst_index_free(index);
+    if (ret != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return ret;
+    }
+  }
+
+  // A file written again must not keep the old tail (and index)
+  else if (ftruncate(fp, data_offset) != 0)
+  {
+    fprintf(stderr, "[%s] [%d] ftruncate() failed.\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_particles_rst_sorted_pack(idx_dataset idx, unsigned char **buffer, int svi, int evi, uint64_t particle_count, const double *offset, const double *size, PIDX_buffer *packed)
+{
+  int pvi = idx->particles_position_variable_index;
+  PIDX_variable pos_var = idx->variable[pvi];
+  PIDX_particles_rst_index index = NULL;
+  if (pvi >= svi && pvi < evi && strcmp(pos_var->type_name, FLOAT64_RGB) == 0 && particle_count != 0)
+  {
+    if (index_create(buffer[pvi - svi], particle_count, offset, size, idx->particles_lod_level_count, &index) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
+  }
+
+  for (int v = svi; v < evi; v++)
+  {
+    PIDX_variable var = idx->variable[v];
+    uint64_t bytes_per_particle = (var->bpv/CHAR_BIT) * var->vps;
+
+    if (index != NULL)
+      PIDX_particles_rst_gather(PIDX_buffer_extend(packed, particle_count * bytes_per_particle), buffer[v - svi], index->order, particle_count, bytes_per_particle);
+    else
+      PIDX_buffer_append(packed, buffer[v - svi], particle_count * bytes_per_particle);
+  }
+
+  if (index != NULL)
+  {
+    index_pack(index, packed);
+    PIDX_particles_rst_index_free(index);
+  }
+
+  return PIDX_success;
+}
+
+
+
+PIDX_particles_rst_index PIDX_particles_rst_index_load(int fp, uint64_t data_offset, uint64_t data_size, uint64_t particle_count)
+{
+  if (data_size < sizeof(struct index_footer))
+    return NULL;
+
+  uint64_t data_end = data_offset + data_size;
+  struct index_footer footer;
+  if (pread(fp, &footer, sizeof(footer), data_end - sizeof(footer)) != sizeof(footer) ||
+      footer.magic != PIDX_PARTICLES_RST_INDEX_MAGIC || footer.version != PIDX_PARTICLES_RST_INDEX_VERSION ||
+      footer.particle_count != particle_count)
+    return NULL;
+
+  uint64_t brick_size = (uint64_t)footer.brick_count * sizeof(PIDX_particles_rst_index_brick);
+  uint64_t level_size = (uint64_t)footer.level_count * sizeof(uint64_t);
+  if (brick_size + level_size + sizeof(footer) > data_size)
+    return NULL;
+
+  PIDX_particles_rst_index index = malloc(sizeof (*index));
+  memset(index, 0, sizeof (*index));
+  index->particle_count = footer.particle_count;
+  index->brick_count = footer.brick_count;
+  index->brick = malloc(brick_size + 1);
+
+  if ((uint64_t)pread(fp, index->brick, brick_size, data_end - sizeof(footer) - level_size - brick_size) != brick_size)
+  {
+    fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
+    PIDX_particles_rst_index_free(index);
+    return NULL;
+  }
+
+  index->level_count = footer.level_count == 0 ? 1 : footer.level_count;
+  index->level_end = malloc(sizeof(*index->level_end) * index->level_count);
+  index->level_end[0] = index->particle_count;
+  if (level_size != 0 && (uint64_t)pread(fp, index->level_end, level_size, data_end - sizeof(footer) - level_size) != level_size)
+  {
+    fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
+    PIDX_particles_rst_index_free(index);
+    return NULL;
+  }
+
+  return index;
+}
+
+
+
+PIDX_return_code PIDX_particles_rst_index_query(PIDX_particles_rst_index index, PIDX_patch box, int level, PIDX_particles_rst_index_run **run, int *run_count)
+{
+  int count = 0;
+  int max_count = 16;
+  PIDX_particles_rst_index_run *r = malloc(sizeof(*r) * max_count);
+
+  // The levels are stored coarse to fine, so the levels up to level are a prefix of the file
+  uint64_t end = index->particle_count;
+  if (level >= 0 && level < (int)index->level_count)
+    end = index->level_end[level];
+
+  for (uint32_t b = 0; b < index->brick_count; b++)
+  {
+    PIDX_particles_rst_index_brick *brick = &index->brick[b];
+    if (brick->first >= end)
+      break;
+
+    // Same closed bounds as the per particle test of the readers
+    int intersects = 1;
+    int inside = 1;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      intersects = intersects && brick->lo[d] <= box->physical_offset[d] + box->physical_size[d] && box->physical_offset[d] <= brick->hi[d];
+      inside = inside && box->physical_offset[d] <= brick->lo[d] && brick->hi[d] <= box->physical_offset[d] + box->physical_size[d];
+    }
+    if (!intersects || brick->count == 0)
+      continue;
+
+    // Bricks are stored in file order, so neighbouring hits merge into one read
+    if (count != 0 && r[count - 1].first + r[count - 1].count == brick->first)
+    {
+      r[count - 1].count = r[count - 1].count + brick->count;
+      r[count - 1].inside = r[count - 1].inside && inside;
+      continue;
+    }
+
+    if (count == max_count)
+    {
+      max_count = max_count * 2;
+      PIDX_particles_rst_index_run *temp = realloc(r, sizeof(*r) * max_count);
+      if (temp == NULL)
+      {
+        fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+        free(r);
+        return PIDX_err_rst;
+      }
+      r = temp;
+    }
+
+    r[count].first = brick->first;
+    r[count].count = brick->count;
+    r[count].inside = inside;
+    count++;
+  }
+
+  *run = r;
+  *run_count = count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code PIDX_particles_rst_index_free(PIDX_particles_rst_index index)
+{
+  if (index == NULL)
+    return PIDX_success;
+
+  free(index->order);
+  free(index->level_end);
+  free(index->brick);
+  free(index);
+
+  return PIDX_success;
+}
+
+
+
+static PIDX_return_code index_create(const unsigned char *position, uint64_t particle_count, const double *offset, const double *size, int level_count, PIDX_particles_rst_index *created)
+{
+  PIDX_particles_rst_index index = malloc(sizeof (*index));
+  memset(index, 0, sizeof (*index));
+  index->particle_count = particle_count;
+
+  // Positions are quantized to 21 bits per axis of the box of the file
+  const double cells = (double)(1 << PIDX_PARTICLES_RST_INDEX_KEY_BITS);
+  struct morton_key *key = malloc(sizeof(*key) * particle_count);
+  for (uint64_t i = 0; i < particle_count; i++)
+  {
+    const double *pos = (const double*)(position + i * PIDX_MAX_DIMENSIONS * sizeof(double));
+    key[i].particle = i;
+    key[i].key = 0;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      double cell = size[d] > 0 ? ((pos[d] - offset[d]) / size[d]) * cells : 0;
+      cell = cell < 0 ? 0 : (cell > cells - 1 ? cells - 1 : cell);
+      key[i].key |= spread_bits((uint64_t)cell) << d;
+    }
+  }
+  qsort(key, particle_count, sizeof(*key), morton_compare);
+
+  // Groups the particles by level of detail, keeping the curve order within a level
+  index->level_count = level_count > 1 ? level_count : 1;
+  index->level_end = malloc(sizeof(*index->level_end) * index->level_count);
+  memset(index->level_end, 0, sizeof(*index->level_end) * index->level_count);
+  if (index->level_count > 1)
+  {
+    for (uint64_t i = 0; i < particle_count; i++)
+      index->level_end[particle_level(i, index->level_count)]++;
+    for (uint32_t l = 1; l < index->level_count; l++)
+      index->level_end[l] = index->level_end[l] + index->level_end[l - 1];
+
+    uint64_t *level_next = malloc(sizeof(*level_next) * index->level_count);
+    level_next[0] = 0;
+    for (uint32_t l = 1; l < index->level_count; l++)
+      level_next[l] = index->level_end[l - 1];
+
+    struct morton_key *level_key = malloc(sizeof(*level_key) * particle_count);
+    for (uint64_t i = 0; i < particle_count; i++)
+      level_key[level_next[particle_level(i, index->level_count)]++] = key[i];
+    free(level_next);
+    free(key);
+    key = level_key;
+  }
+  else
+    index->level_end[0] = particle_count;
+
+  index->order = malloc(sizeof(*index->order) * particle_count);
+  for (uint64_t i = 0; i < particle_count; i++)
+    index->order[i] = key[i].particle;
+
+  uint32_t max_brick_count = 64;
+  index->brick = malloc(sizeof(*index->brick) * max_brick_count);
+  for (uint32_t l = 0; l < index->level_count; l++)
+  {
+    uint64_t level_first = (l == 0) ? 0 : index->level_end[l - 1];
+    if (index->level_end[l] > level_first && add_bricks(index, key, level_first, index->level_end[l] - level_first, 0, &max_brick_count) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      free(key);
+      PIDX_particles_rst_index_free(index);
+      return PIDX_err_rst;
+    }
+  }
+  free(key);
+
+  // Bounds of the bricks from the actual positions
+  for (uint32_t b = 0; b < index->brick_count; b++)
+  {
+    PIDX_particles_rst_index_brick *brick = &index->brick[b];
+    const double *first_pos = (const double*)(position + index->order[brick->first] * PIDX_MAX_DIMENSIONS * sizeof(double));
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      brick->lo[d] = first_pos[d];
+      brick->hi[d] = first_pos[d];
+    }
+    for (uint64_t i = brick->first + 1; i < brick->first + brick->count; i++)
+    {
+      const double *pos = (const double*)(position + index->order[i] * PIDX_MAX_DIMENSIONS * sizeof(double));
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        if (pos[d] < brick->lo[d])
+          brick->lo[d] = pos[d];
+        if (pos[d] > brick->hi[d])
+          brick->hi[d] = pos[d];
+      }
+    }
+  }
+
+  *created = index;
+  return PIDX_success;
+}
+
+
+
+// Splits the octree node holding the sorted particles [first, first + count) into its
+// eight children until a node holds at most PIDX_PARTICLES_RST_INDEX_BRICK_SIZE particles
+static PIDX_return_code add_bricks(PIDX_particles_rst_index index, const struct morton_key *key, uint64_t first, uint64_t count, int level, uint32_t *max_brick_count)
+{
+  if (count <= PIDX_PARTICLES_RST_INDEX_BRICK_SIZE || level == PIDX_PARTICLES_RST_INDEX_KEY_BITS)
+  {
+    if (index->brick_count == *max_brick_count)
+    {
+      PIDX_particles_rst_index_brick *temp = realloc(index->brick, sizeof(*temp) * *max_brick_count * 2);
+      if (temp == NULL)
+      {
+        fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+        return PIDX_err_rst;
+      }
+      index->brick = temp;
+      *max_brick_count = *max_brick_count * 2;
+    }
+    index->brick[index->brick_count].first = first;
+    index->brick[index->brick_count].count = count;
+    index->brick_count++;
+    return PIDX_success;
+  }
+
+  const int shift = PIDX_MAX_DIMENSIONS * (PIDX_PARTICLES_RST_INDEX_KEY_BITS - 1 - level);
+  uint64_t child_first = first;
+  while (child_first < first + count)
+  {
+    uint64_t child = (key[child_first].key >> shift) & 7;
+    uint64_t child_end = child_first + 1;
+    while (child_end < first + count && ((key[child_end].key >> shift) & 7) == child)
+      child_end++;
+
+    if (add_bricks(index, key, child_first, child_end - child_first, level + 1, max_brick_count) != PIDX_success)
+      return PIDX_err_rst;
+    child_first = child_end;
+  }
+
+  return PIDX_success;
+}
+
+
+
+static PIDX_return_code index_write(PIDX_particles_rst_index index, int fp, uint64_t offset)
+{
+  PIDX_buffer packed = PIDX_buffer_create_empty();
+  index_pack(index, &packed);
+
+  if ((uint64_t)pwrite(fp, packed.buffer, packed.size, offset) != packed.size)
+  {
+    fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+    PIDX_buffer_free(&packed);
+    return PIDX_err_io;
+  }
+
+  if (ftruncate(fp, offset + packed.size) != 0)
+  {
+    fprintf(stderr, "[%s] [%d] ftruncate() failed.\n", __FILE__, __LINE__);
+    PIDX_buffer_free(&packed);
+    return PIDX_err_io;
+  }
+  PIDX_buffer_free(&packed);
+
+  return PIDX_success;
+}
+
+
+
+// Appends the bricks, the level ends and the footer
+static void index_pack(PIDX_particles_rst_index index, PIDX_buffer *packed)
+{
+  PIDX_buffer_append(packed, (unsigned char*)index->brick, (uint64_t)index->brick_count * sizeof(*index->brick));
+  PIDX_buffer_append(packed, (unsigned char*)index->level_end, (uint64_t)index->level_count * sizeof(*index->level_end));
+
+  struct index_footer footer = {PIDX_PARTICLES_RST_INDEX_MAGIC, PIDX_PARTICLES_RST_INDEX_VERSION, index->brick_count, index->level_count, index->particle_count};
+  PIDX_buffer_append(packed, (unsigned char*)&footer, sizeof(footer));
+}
+
+
+
+// Level of detail of the particle at position i of the curve
+static int particle_level(uint64_t i, int level_count)
+{
+  int trailing_zeros = 0;
+  while (trailing_zeros < level_count - 1 && (i == 0 || (i & ((uint64_t)1 << trailing_zeros)) == 0))
+    trailing_zeros++;
+
+  return level_count - 1 - trailing_zeros;
+}
+
+
+
+// Interleaves the low 21 bits of x with two zero bits between them
+static uint64_t spread_bits(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffff;
+  x = (x | x << 16) & 0x1f0000ff0000ff;
+  x = (x | x << 8) & 0x100f00f00f00f00f;
+  x = (x | x << 4) & 0x10c30c30c30c30c3;
+  x = (x | x << 2) & 0x1249249249249249;
+  return x;
+}
+
+
+
+static int morton_compare(const void *a, const void *b)
+{
+  const struct morton_key *ka = a;
+  const struct morton_key *kb = b;
+  if (ka->key != kb->key)
+    return ka->key < kb->key ? -1 : 1;
+
+  // Keeps the write order of particles in the same cell
+  return ka->particle < kb->particle ? -1 : (ka->particle > kb->particle);
+}
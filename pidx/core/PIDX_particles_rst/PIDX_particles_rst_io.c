@@ -75,28 +75,23 @@ PIDX_return_code PIDX_particles_rst_buf_aggregated_write(PIDX_particles_rst_id r
   sprintf(file_name, "%s/time%09d/%d_0", directory_path, rst_id->idx_metadata->current_time_step, rst_id->idx_c->simulation_rank);
   int fp = open(file_name, O_CREAT | O_WRONLY, 0664);
 
-  for (int v = rst_id->first_index; v < rst_id->last_index + 1; v = v + 1)
-  {
-    // copy the size and offset to output
-    PIDX_variable var_start = rst_id->idx_metadata->variable[v];
-    PIDX_patch out_patch = var_start->restructured_super_patch->restructured_patch;
+  PIDX_patch out_patch = var0->restructured_super_patch->restructured_patch;
 
-    int bits = 0;
-    PIDX_variable var = rst_id->idx_metadata->variable[v];
-    bits = (var->bpv/CHAR_BIT) * var->vps;
+  uint64_t data_offset = 0;
+  for (int v1 = 0; v1 < rst_id->first_index; v1++)
+    data_offset = data_offset + (out_patch->particle_count * (rst_id->idx_metadata->variable[v1]->vps * (rst_id->idx_metadata->variable[v1]->bpv/CHAR_BIT)));
 
-    int data_offset = 0;
-    for (int v1 = 0; v1 < v; v1++)
-      data_offset = data_offset + (out_patch->particle_count * (rst_id->idx_metadata->variable[v1]->vps * (rst_id->idx_metadata->variable[v1]->bpv/CHAR_BIT)));
+  unsigned char **buffer = malloc(sizeof(*buffer) * (rst_id->last_index - rst_id->first_index + 1));
+  for (int v = rst_id->first_index; v < rst_id->last_index + 1; v = v + 1)
+    buffer[v - rst_id->first_index] = rst_id->idx_metadata->variable[v]->restructured_super_patch->restructured_patch->buffer;
 
-    int buffer_size =  out_patch->particle_count * bits;
-    uint64_t write_count = pwrite(fp, var_start->restructured_super_patch->restructured_patch->buffer, buffer_size, data_offset);
-    if (write_count != buffer_size)
-    {
-      fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
-      return PIDX_err_io;
-    }
+  // Particles are written in Z-order of the super patch, followed by the brick index used by box reads
+  if (PIDX_particles_rst_sorted_write(rst_id->idx_metadata, fp, buffer, rst_id->first_index, rst_id->last_index + 1, out_patch->particle_count, out_patch->physical_offset, out_patch->physical_size, data_offset) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_io;
   }
+  free(buffer);
   close(fp);
 
   free(file_name);
@@ -53,201 +53,119 @@
 
 #include "../../PIDX_inc.h"
 
-#if 0
-static int pointInChunk(PIDX_patch p, const double *pos);
-#endif
+static void pack_particles(PIDX_particles_rst_id rst_id);
 
+
+// Sends every holder of a restructured patch all the variables of its particles in a single message
 PIDX_return_code PIDX_particles_rst_staged_write(PIDX_particles_rst_id rst_id)
 {
-  uint64_t req_count = 0;
-  // creating ample requests and statuses
-  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
-    for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-      req_count++;
+  pack_particles(rst_id);
 
-#if 0
-  unsigned char ***buffer;
-  buffer = malloc(sizeof(*buffer) * rst_id->idx_metadata->variable_count);
-#endif
+  // Counts and displacements are in particles, so that messages can be larger than INT_MAX bytes
+  int *send_count = malloc((rst_id->send_count + 1) * sizeof(*send_count));
+  int *send_displ = malloc((rst_id->send_count + 1) * sizeof(*send_displ));
+  int *recv_count = malloc((rst_id->recv_count + 1) * sizeof(*recv_count));
+  int *recv_displ = malloc((rst_id->recv_count + 1) * sizeof(*recv_displ));
 
-  MPI_Request *req = malloc(sizeof (*req) * req_count * 2 * rst_id->idx_metadata->variable_count);
-  MPI_Status *status = malloc(sizeof (*status) * req_count * 2 * rst_id->idx_metadata->variable_count);
+  uint64_t send_total = 0;
+  for (int i = 0; i < rst_id->send_count; i++)
+  {
+    send_count[i] = (int)rst_id->send_particle_count[i];
+    send_displ[i] = (int)send_total;
+    send_total = send_total + rst_id->send_particle_count[i];
+  }
 
-  for (uint64_t i = 0; i < rst_id->intersected_restructured_super_patch_count; i++)
+  uint64_t recv_total = 0;
+  for (int j = 0; j < rst_id->recv_count; j++)
   {
-    uint64_t req_counter = 0;
+    recv_count[j] = (int)rst_id->recv_particle_count[j];
+    recv_displ[j] = (int)recv_total;
+    recv_total = recv_total + rst_id->recv_particle_count[j];
+  }
 
-#if 0
-    memset(buffer, 0, sizeof(*buffer) * rst_id->idx_metadata->variable_count);
-#endif
+  if (send_total > INT_MAX || recv_total > INT_MAX || rst_id->particle_size > INT_MAX)
+  {
+    fprintf(stderr, "Restructuring message is too large, File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_rst;
+  }
 
-    // If we're the receiver of this restructured patch, queue up recvs for everyone sending us data
-    if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->max_patch_rank)
-    {
-      for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-      {
-        for (uint64_t v = 0; v < rst_id->idx_metadata->variable_count; v++)
-        {
-          PIDX_variable var = rst_id->idx_metadata->variable[v];
-          // TODO WILL: How is the length computed? How does the receiver of the restructured patch know
-          // the number of particles they're getting?
-          const int length = (int) (var->restructured_super_patch->patch[j]->particle_count) * ((var->vps * var->bpv) / CHAR_BIT);
-
-          //printf("[%d] Receiving %d from %d\n", rst_id->idx_c->simulation_rank, length, rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank);
-          const int ret = MPI_Irecv(var->restructured_super_patch->patch[j]->buffer, length, MPI_BYTE,
-              rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank, 123,
-              rst_id->idx_c->simulation_comm, &req[req_counter]);
-          if (ret != MPI_SUCCESS)
-          {
-            fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-            return PIDX_err_mpi;
-          }
-          req_counter++;
-        }
-      }
-    }
+  MPI_Datatype particle_type;
+  MPI_Type_contiguous((int)rst_id->particle_size, MPI_BYTE, &particle_type);
+  MPI_Type_commit(&particle_type);
 
-#if 0
-    int buffer_count = 0;
-    for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-    {
-      if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank)
-        buffer_count++;
-    }
+  int ret = MPI_Neighbor_alltoallv(rst_id->send_buffer, send_count, send_displ, particle_type, rst_id->recv_buffer, recv_count, recv_displ, particle_type, rst_id->graph_comm);
 
-    for (int v = 0; v < rst_id->idx_metadata->variable_count; v++)
-      buffer[v] = malloc(sizeof(*buffer[v]) * buffer_count);
+  MPI_Type_free(&particle_type);
+  free(send_count);
+  free(send_displ);
+  free(recv_count);
+  free(recv_displ);
 
-    buffer_count = 0;
-#endif
+  if (ret != MPI_SUCCESS)
+  {
+    fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+    return PIDX_err_mpi;
+  }
 
+  return PIDX_success;
+}
 
-    // If we're a sender for any patches in this restructured patch, send the data to the owner
-    for (uint64_t j = 0; j < rst_id->intersected_restructured_super_patch[i]->patch_count; j++)
-    {
-      if (rst_id->idx_c->simulation_rank == rst_id->intersected_restructured_super_patch[i]->source_patch[j].rank)
-      {
-        const size_t particles_to_send = rst_id->intersected_restructured_super_patch[i]->patch[j]->particle_count;
-#if 0
-        PIDX_patch reg_patch = malloc(sizeof (*reg_patch));
-        memset(reg_patch, 0, sizeof (*reg_patch));
-        for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-        {
-          reg_patch->physical_offset[d] = rst_id->intersected_restructured_super_patch[i]->restructured_patch->physical_offset[d];
-          reg_patch->physical_size[d] = rst_id->intersected_restructured_super_patch[i]->restructured_patch->physical_size[d];
-        }
-
-        PIDX_variable var0 = rst_id->idx_metadata->variable[rst_id->first_index];
-        const uint64_t bytes_per_pos_v0 = ((var0->vps * var0->bpv) / CHAR_BIT);
-        const int p_index = rst_id->intersected_restructured_super_patch[i]->source_patch[j].index;
-        // Optional: Do a validation check that we're writing the right number of particles
-        {
-          int counter = 0;
-          for (uint64_t p = 0; p < var0->sim_patch[p_index]->particle_count; ++p)
-          {
-            if (pointInChunk(reg_patch, (double*)(var0->sim_patch[p_index]->buffer + p * bytes_per_pos_v0)))
-              counter++;
-          }
-          assert(counter == particles_to_send);
-        }
-
-        // Allocate buffers for each var to hold the data we're sending
-        for (int v = 0; v < rst_id->idx_metadata->variable_count; v++)
-        {
-          PIDX_variable var = rst_id->idx_metadata->variable[v];
-          const uint64_t bytes_per_var = ((var->vps * var->bpv) / CHAR_BIT);
-          buffer[v][buffer_count] = malloc(particles_to_send * bytes_per_var);
-        }
-
-
-        // Populate each variable buffer we're going to send
-        uint32_t pcount = 0;
-        for (uint64_t p = 0; p < var0->sim_patch[p_index]->particle_count; ++p)
-        {
-          if (pointInChunk(reg_patch, (double*)(var0->sim_patch[p_index]->buffer + p * bytes_per_pos_v0)))
-          {
-            for (int v = 0; v < rst_id->idx_metadata->variable_count; v++)
-            {
-              PIDX_variable var = rst_id->idx_metadata->variable[v];
-              const uint64_t bytes_per_var = ((var->vps * var->bpv) / CHAR_BIT);
-              memcpy(buffer[v][buffer_count] + pcount * bytes_per_var,
-                  var->sim_patch[p_index]->buffer + p * bytes_per_var, bytes_per_var);
-            }
-            pcount++;
-          }
-        }
-        // Send the populated buffers over to the owner of this restructured patch
-        assert(pcount == particles_to_send);
-#endif
-
-        for (int v = 0; v < rst_id->idx_metadata->variable_count; v++)
-        {
-          PIDX_variable var = rst_id->idx_metadata->variable[v];
-          const uint64_t bytes_per_var = ((var->vps * var->bpv) / CHAR_BIT);
-
-          //printf("[%d] Sending %d to %d\n", rst_id->idx_c->simulation_rank, (int) particles_to_send * bytes_per_var, rst_id->intersected_restructured_super_patch[i]->max_patch_rank);
-
-          const int ret = MPI_Isend(rst_id->intersected_restructured_super_patch[i]->patch[j]->tbuffer[v], (int) particles_to_send * bytes_per_var, MPI_BYTE,
-              rst_id->intersected_restructured_super_patch[i]->max_patch_rank, 123,
-              rst_id->idx_c->simulation_comm, &req[req_counter]);
-#if 0
-          const int ret = MPI_Isend(buffer[v][buffer_count], (int) particles_to_send * bytes_per_var, MPI_BYTE,
-              rst_id->intersected_restructured_super_patch[i]->max_patch_rank, 123,
-              rst_id->idx_c->simulation_comm, &req[req_counter]);
-#endif
-          if (ret != MPI_SUCCESS)
-          {
-            fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-            return PIDX_err_mpi;
-          }
-          req_counter++;
-        }
-#if 0
-        free(reg_patch);
-        buffer_count++;
-#endif
-      }
-    }
 
-    // Wait for the pending sends/recvs for this restructured patch to complete
-    if (MPI_Waitall(req_counter, req, status) != MPI_SUCCESS)
-    {
-      fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
-      return PIDX_err_rst;
-    }
 
-#if 0
-    // Clean up the particle variable buffers
-    for (int v = 0; v < rst_id->idx_metadata->variable_count; v++)
-    {
-      for (uint64_t j = 0; j < buffer_count; j++)
-      {
-        free(buffer[v][j]);
-      }
-      free(buffer[v]);
-    }
-#endif
+// Copies the particles of the local patches to the message of their restructured patch,
+// each message holds the particles of every variable one after the other. The bins of the
+// particles become message indices, then every variable is gathered message by message
+static void pack_particles(PIDX_particles_rst_id rst_id)
+{
+  uint64_t *tpc = rst_id->restructured_grid->total_patch_count;
+
+  // Message of every restructured patch this process sends particles to
+  uint32_t *patch_message = malloc(tpc[0] * tpc[1] * tpc[2] * sizeof(*patch_message));
+  unsigned char **message = malloc((rst_id->send_count + 1) * sizeof(*message));
+  uint64_t *message_particle_count = calloc(rst_id->send_count + 1, sizeof(*message_particle_count));
+  uint64_t *patch_particle_count = malloc((rst_id->send_count + 1) * sizeof(*patch_particle_count));
+
+  uint64_t message_offset = 0;
+  for (int i = 0; i < rst_id->send_count; i++)
+  {
+    patch_message[rst_id->send_patch[i]] = i;
+    message[i] = rst_id->send_buffer + message_offset;
+    message_offset = message_offset + rst_id->send_particle_count[i] * rst_id->particle_size;
   }
 
-#if 0
-  free(buffer);
-#endif
+  for (int pc = 0; pc < rst_id->particle_bin_count; pc++)
+  {
+    const uint64_t particle_count = rst_id->idx_metadata->variable[rst_id->first_index]->sim_patch[pc]->particle_count;
+    uint32_t *bin = rst_id->particle_bin[pc];
+    for (uint64_t p = 0; p < particle_count; p++)
+      bin[p] = patch_message[bin[p]];
 
-  free(req);
-  free(status);
+    uint64_t *order = malloc((particle_count + 1) * sizeof(*order));
+    PIDX_particles_rst_bin_sort(bin, particle_count, rst_id->send_count, patch_particle_count, order);
 
-  return PIDX_success;
-}
+    uint64_t first = 0;
+    for (int i = 0; i < rst_id->send_count; i++)
+    {
+      uint64_t var_offset = 0;
+      for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
+      {
+        PIDX_variable var = rst_id->idx_metadata->variable[v];
+        const uint64_t bytes_per_var = (var->vps * var->bpv) / CHAR_BIT;
 
-#if 0
-static int pointInChunk(PIDX_patch p, const double *pos)
-{
-  int contains_point = 1;
-  for (int d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
-    contains_point = contains_point
-        && pos[d] >= p->physical_offset[d]
-        && pos[d] <= p->physical_offset[d] + p->physical_size[d];
+        PIDX_particles_rst_gather(message[i] + var_offset + message_particle_count[i] * bytes_per_var, var->sim_patch[pc]->buffer, order + first, patch_particle_count[i], bytes_per_var);
+        var_offset = var_offset + rst_id->send_particle_count[i] * bytes_per_var;
+      }
+      message_particle_count[i] = message_particle_count[i] + patch_particle_count[i];
+      first = first + patch_particle_count[i];
+    }
+
+    free(order);
+    free(bin);
+    rst_id->particle_bin[pc] = 0;
+  }
 
-  return contains_point;
+  free(patch_message);
+  free(message);
+  free(message_particle_count);
+  free(patch_particle_count);
 }
-#endif
@@ -56,6 +56,64 @@
 #define __PIDX_RAW_RST_NEW_H
 
 
+/// Box of one patch written by a raw writer (file <rank>_<patch> of the time step directory,
+/// or the bytes from data_offset of a shared file, see PIDX_set_shared_file_count)
+struct PIDX_raw_rst_index_entry_struct
+{
+  uint32_t rank;
+  uint32_t patch;
+  uint32_t offset[PIDX_MAX_DIMENSIONS];
+  uint32_t size[PIDX_MAX_DIMENSIONS];
+  int32_t file;                                   /// shared file number, -1 for the file <rank>_<patch>
+  uint32_t reserved;
+  uint64_t data_offset;                           /// byte offset of the patch in its file
+};
+typedef struct PIDX_raw_rst_index_entry_struct PIDX_raw_rst_index_entry;
+
+
+/// Node of the bounding volume hierarchy, stored in depth first order.
+/// Inner nodes have count = 0 and their first child right after them, skip is the next node
+/// once the subtree is done (or rejected).
+struct PIDX_raw_rst_index_node_struct
+{
+  uint32_t lo[PIDX_MAX_DIMENSIONS];
+  uint32_t hi[PIDX_MAX_DIMENSIONS];               /// exclusive
+  uint32_t first;
+  uint32_t count;
+  uint32_t skip;
+};
+typedef struct PIDX_raw_rst_index_node_struct PIDX_raw_rst_index_node;
+
+
+/// Spatial index over the boxes of all raw writers (the _INDEX file).
+/// Entries are sorted along a Z-order curve, and a query visits O(log n) nodes plus the hits.
+struct PIDX_raw_rst_index_struct
+{
+  uint32_t entry_count;
+  PIDX_raw_rst_index_entry *entry;
+
+  uint32_t node_count;
+  PIDX_raw_rst_index_node *node;
+};
+typedef struct PIDX_raw_rst_index_struct* PIDX_raw_rst_index;
+
+
+/// One read of a query: the part of a local patch found in a writer file
+struct PIDX_raw_rst_index_read_struct
+{
+  uint32_t entry;                                 /// position of the writer file in the index
+  uint32_t rank;
+  uint32_t patch;
+  int32_t file;                                   /// file and byte offset of the patch (see PIDX_raw_rst_index_entry)
+  uint64_t data_offset;
+  uint64_t file_offset[PIDX_MAX_DIMENSIONS];      /// box of the writer file
+  uint64_t file_size[PIDX_MAX_DIMENSIONS];
+  uint64_t offset[PIDX_MAX_DIMENSIONS];           /// intersection with the queried box
+  uint64_t size[PIDX_MAX_DIMENSIONS];
+};
+typedef struct PIDX_raw_rst_index_read_struct PIDX_raw_rst_index_read;
+
+
 //Struct for restructuring ID
 struct PIDX_raw_rst_struct
 {
@@ -81,6 +139,8 @@ struct PIDX_raw_rst_struct
   uint64_t* sim_raw_r_offset;
 
   int maximum_neighbor_count;
+
+  struct PIDX_shared_file_struct *shared_file;    ///< shared file of the super patches (NULL for one file per super patch)
 };
 typedef struct PIDX_raw_rst_struct* PIDX_raw_rst_id;
 
@@ -131,6 +191,16 @@ PIDX_return_code PIDX_raw_rst_meta_data_write(PIDX_raw_rst_id rst_id);
 
 
 
+///
+/// \brief PIDX_raw_rst_shared_file_create Places the super patches of all the processes in idx->shared_file_count
+/// shared files, one extent per super patch and variable (collective)
+/// \param rst_id
+/// \return
+///
+PIDX_return_code PIDX_raw_rst_shared_file_create(PIDX_raw_rst_id rst_id);
+
+
+
 ///
 /// \brief PIDX_raw_rst_meta_data_destroy
 /// \param rst_id
@@ -265,4 +335,77 @@ PIDX_return_code HELPER_raw_rst(PIDX_raw_rst_id rst_id);
 
 PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id);
 
+
+///
+/// \brief PIDX_raw_rst_collective_raw_read Two phase read: idx->raw_read_reader_count processes read whole
+/// writer files and send the parts of them every process needs (collective over simulation_comm)
+/// \param rst_id
+/// \return
+///
+PIDX_return_code PIDX_raw_rst_collective_raw_read(PIDX_raw_rst_id rst_id);
+
+
+
+/*
+ * Implementation in PIDX_raw_rst_index.c
+ */
+///
+/// \brief PIDX_raw_rst_index_create Builds the index over the writer boxes (takes ownership of entry)
+/// \param entry
+/// \param entry_count
+/// \return
+///
+PIDX_raw_rst_index PIDX_raw_rst_index_create(PIDX_raw_rst_index_entry *entry, uint32_t entry_count);
+
+
+
+///
+/// \brief PIDX_raw_rst_index_write Writes the index to path
+/// \param index
+/// \param path
+/// \return
+///
+PIDX_return_code PIDX_raw_rst_index_write(PIDX_raw_rst_index index, const char *path);
+
+
+
+///
+/// \brief PIDX_raw_rst_index_load Reads an index written by PIDX_raw_rst_index_write
+/// \param path
+/// \return the index, or NULL if the file does not exist or is not an index
+///
+PIDX_raw_rst_index PIDX_raw_rst_index_load(const char *path);
+
+
+
+///
+/// \brief PIDX_raw_rst_index_query Lists the writer files intersecting a box, in file order
+/// \param index
+/// \param box
+/// \param read (out) the reads, to be freed by the caller
+/// \param read_count (out)
+/// \return
+///
+PIDX_return_code PIDX_raw_rst_index_query(PIDX_raw_rst_index index, PIDX_patch box, PIDX_raw_rst_index_read **read, int *read_count);
+
+
+
+///
+/// \brief PIDX_raw_rst_index_bcast Sends the index of root to all the processes of comm
+/// \param index the index on root (NULL if root could not load it), ignored on the other processes
+/// \param root
+/// \param comm
+/// \return the index, or NULL on all processes if root had none
+///
+PIDX_raw_rst_index PIDX_raw_rst_index_bcast(PIDX_raw_rst_index index, int root, MPI_Comm comm);
+
+
+
+///
+/// \brief PIDX_raw_rst_index_free
+/// \param index
+/// \return
+///
+PIDX_return_code PIDX_raw_rst_index_free(PIDX_raw_rst_index index);
+
 #endif // __PIDX_raw_rst_NEW_H
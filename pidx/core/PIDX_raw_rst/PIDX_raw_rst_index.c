@@ -0,0 +1,428 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/**
+ * \file PIDX_raw_rst_index.c
+ *
+ * Spatial index over the patches of all raw writers. The writer builds it
+ * from the gathered _SIZE/_OFFSET data and saves it as <name>_INDEX, readers
+ * load it once and query it for every local patch instead of intersecting
+ * the patch with every writer box. Version 2 entries also hold the shared
+ * file and byte offset of every patch, version 1 files are still loaded.
+ *
+ */
+
+#include "../../PIDX_inc.h"
+
+#define PIDX_RAW_RST_INDEX_MAGIC 0x49585250
+#define PIDX_RAW_RST_INDEX_VERSION 2
+#define PIDX_RAW_RST_INDEX_LEAF_SIZE 4
+#define PIDX_RAW_RST_INDEX_HEADER_SIZE 4
+
+// Entry of the version 1 files, always in the file <rank>_<patch>
+struct index_entry_v1
+{
+  uint32_t rank;
+  uint32_t patch;
+  uint32_t offset[PIDX_MAX_DIMENSIONS];
+  uint32_t size[PIDX_MAX_DIMENSIONS];
+};
+
+struct morton_key
+{
+  uint64_t key;
+  uint32_t entry;
+};
+
+static uint64_t spread_bits(uint64_t x);
+static int morton_compare(const void *a, const void *b);
+static int read_compare(const void *a, const void *b);
+static uint32_t build_node(PIDX_raw_rst_index index, uint32_t first, uint32_t count);
+
+
+PIDX_raw_rst_index PIDX_raw_rst_index_create(PIDX_raw_rst_index_entry *entry, uint32_t entry_count)
+{
+  PIDX_raw_rst_index index = malloc(sizeof (*index));
+  memset(index, 0, sizeof (*index));
+
+  index->entry_count = entry_count;
+  if (entry_count == 0)
+  {
+    free(entry);
+    return index;
+  }
+
+  // Orders the boxes along a Z-order curve of their centers, scaled down to 21 bits per axis
+  uint64_t max_coordinate = 0;
+  for (uint32_t i = 0; i < entry_count; i++)
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      if ((uint64_t)entry[i].offset[d] + entry[i].size[d] > max_coordinate)
+        max_coordinate = (uint64_t)entry[i].offset[d] + entry[i].size[d];
+
+  int shift = 0;
+  while ((max_coordinate >> shift) >= (1 << 21))
+    shift++;
+
+  struct morton_key *key = malloc(sizeof(*key) * entry_count);
+  for (uint32_t i = 0; i < entry_count; i++)
+  {
+    key[i].entry = i;
+    key[i].key = 0;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      key[i].key |= spread_bits((((uint64_t)entry[i].offset[d] + entry[i].size[d] / 2) >> shift)) << d;
+  }
+  qsort(key, entry_count, sizeof(*key), morton_compare);
+
+  index->entry = malloc(sizeof(*index->entry) * entry_count);
+  for (uint32_t i = 0; i < entry_count; i++)
+    index->entry[i] = entry[key[i].entry];
+  free(key);
+  free(entry);
+
+  // Splitting the sorted boxes in halves gives a balanced hierarchy of at most 2n - 1 nodes
+  index->node = malloc(sizeof(*index->node) * 2 * entry_count);
+  build_node(index, 0, entry_count);
+
+  return index;
+}
+
+
+
+PIDX_return_code PIDX_raw_rst_index_write(PIDX_raw_rst_index index, const char *path)
+{
+  uint32_t header[PIDX_RAW_RST_INDEX_HEADER_SIZE] = {PIDX_RAW_RST_INDEX_MAGIC, PIDX_RAW_RST_INDEX_VERSION, index->entry_count, index->node_count};
+
+  int fp = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0664);
+  if (fp < 0)
+  {
+    fprintf(stderr, "Error opening file %s Error code %d\n", path, errno);
+    return PIDX_err_io;
+  }
+
+  uint64_t offset = 0;
+  uint64_t write_size = sizeof(header);
+  if (pwrite(fp, header, write_size, offset) != write_size)
+  {
+    fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+    close(fp);
+    return PIDX_err_io;
+  }
+  offset = offset + write_size;
+
+  write_size = (uint64_t)index->entry_count * sizeof(*index->entry);
+  if (write_size != 0 && pwrite(fp, index->entry, write_size, offset) != write_size)
+  {
+    fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+    close(fp);
+    return PIDX_err_io;
+  }
+  offset = offset + write_size;
+
+  write_size = (uint64_t)index->node_count * sizeof(*index->node);
+  if (write_size != 0 && pwrite(fp, index->node, write_size, offset) != write_size)
+  {
+    fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+    close(fp);
+    return PIDX_err_io;
+  }
+  close(fp);
+
+  return PIDX_success;
+}
+
+
+
+PIDX_raw_rst_index PIDX_raw_rst_index_load(const char *path)
+{
+  int fp = open(path, O_RDONLY);
+  if (fp < 0)
+    return NULL;
+
+  uint32_t header[PIDX_RAW_RST_INDEX_HEADER_SIZE];
+  if (pread(fp, header, sizeof(header), 0) != sizeof(header) || header[0] != PIDX_RAW_RST_INDEX_MAGIC || header[1] < 1 || header[1] > PIDX_RAW_RST_INDEX_VERSION)
+  {
+    close(fp);
+    return NULL;
+  }
+
+  PIDX_raw_rst_index index = malloc(sizeof (*index));
+  memset(index, 0, sizeof (*index));
+  index->entry_count = header[2];
+  index->node_count = header[3];
+
+  uint64_t entry_size = (uint64_t)index->entry_count * (header[1] == 1 ? sizeof(struct index_entry_v1) : sizeof(*index->entry));
+  uint64_t node_size = (uint64_t)index->node_count * sizeof(*index->node);
+  index->entry = malloc((uint64_t)index->entry_count * sizeof(*index->entry) + 1);
+  index->node = malloc(node_size + 1);
+
+  if ((uint64_t)pread(fp, index->entry, entry_size, sizeof(header)) != entry_size ||
+      (uint64_t)pread(fp, index->node, node_size, sizeof(header) + entry_size) != node_size)
+  {
+    fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
+    close(fp);
+    PIDX_raw_rst_index_free(index);
+    return NULL;
+  }
+  close(fp);
+
+  // Widens the version 1 entries in place, from the last one down
+  if (header[1] == 1)
+  {
+    struct index_entry_v1 *old_entry = (struct index_entry_v1*)index->entry;
+    for (int64_t i = (int64_t)index->entry_count - 1; i >= 0; i--)
+    {
+      struct index_entry_v1 e = old_entry[i];
+      index->entry[i].rank = e.rank;
+      index->entry[i].patch = e.patch;
+      memcpy(index->entry[i].offset, e.offset, sizeof(e.offset));
+      memcpy(index->entry[i].size, e.size, sizeof(e.size));
+      index->entry[i].file = -1;
+      index->entry[i].reserved = 0;
+      index->entry[i].data_offset = 0;
+    }
+  }
+
+  return index;
+}
+
+
+
+PIDX_return_code PIDX_raw_rst_index_query(PIDX_raw_rst_index index, PIDX_patch box, PIDX_raw_rst_index_read **read, int *read_count)
+{
+  int count = 0;
+  int max_count = 64;
+  PIDX_raw_rst_index_read *r = malloc(sizeof(*r) * max_count);
+
+  uint32_t n = 0;
+  while (n < index->node_count)
+  {
+    PIDX_raw_rst_index_node *node = &index->node[n];
+
+    int overlaps = 1;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      overlaps = overlaps && node->lo[d] < box->offset[d] + box->size[d] && box->offset[d] < node->hi[d];
+
+    if (!overlaps)
+    {
+      n = node->skip;
+      continue;
+    }
+
+    for (uint32_t i = node->first; i < node->first + node->count; i++)
+    {
+      PIDX_raw_rst_index_entry *entry = &index->entry[i];
+
+      int intersects = 1;
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+        intersects = intersects && entry->size[d] != 0 && entry->offset[d] < box->offset[d] + box->size[d] && box->offset[d] < (uint64_t)entry->offset[d] + entry->size[d];
+      if (!intersects)
+        continue;
+
+      if (count == max_count)
+      {
+        max_count = max_count * 2;
+        PIDX_raw_rst_index_read *temp = realloc(r, sizeof(*r) * max_count);
+        if (temp == NULL)
+        {
+          fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+          free(r);
+          return PIDX_err_rst;
+        }
+        r = temp;
+      }
+
+      r[count].entry = i;
+      r[count].rank = entry->rank;
+      r[count].patch = entry->patch;
+      r[count].file = entry->file;
+      r[count].data_offset = entry->data_offset;
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        uint64_t lo = entry->offset[d] > box->offset[d] ? entry->offset[d] : box->offset[d];
+        uint64_t hi = (uint64_t)entry->offset[d] + entry->size[d] < box->offset[d] + box->size[d] ? (uint64_t)entry->offset[d] + entry->size[d] : box->offset[d] + box->size[d];
+
+        r[count].file_offset[d] = entry->offset[d];
+        r[count].file_size[d] = entry->size[d];
+        r[count].offset[d] = lo;
+        r[count].size[d] = hi - lo;
+      }
+      count++;
+    }
+    n++;
+  }
+
+  qsort(r, count, sizeof(*r), read_compare);
+
+  *read = r;
+  *read_count = count;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_raw_rst_index PIDX_raw_rst_index_bcast(PIDX_raw_rst_index index, int root, MPI_Comm comm)
+{
+  int rank = 0;
+  MPI_Comm_rank(comm, &rank);
+
+  uint32_t header[3] = {0, 0, 0};
+  if (rank == root && index != NULL)
+  {
+    header[0] = 1;
+    header[1] = index->entry_count;
+    header[2] = index->node_count;
+  }
+  MPI_Bcast(header, 3, MPI_UINT32_T, root, comm);
+  if (header[0] == 0)
+    return NULL;
+
+  if (rank != root)
+  {
+    index = malloc(sizeof (*index));
+    memset(index, 0, sizeof (*index));
+    index->entry_count = header[1];
+    index->node_count = header[2];
+    index->entry = malloc(sizeof(*index->entry) * index->entry_count + 1);
+    index->node = malloc(sizeof(*index->node) * index->node_count + 1);
+  }
+
+  MPI_Bcast(index->entry, index->entry_count * sizeof(*index->entry), MPI_BYTE, root, comm);
+  MPI_Bcast(index->node, index->node_count * sizeof(*index->node), MPI_BYTE, root, comm);
+
+  return index;
+}
+
+
+
+PIDX_return_code PIDX_raw_rst_index_free(PIDX_raw_rst_index index)
+{
+  if (index == NULL)
+    return PIDX_success;
+
+  free(index->entry);
+  free(index->node);
+  free(index);
+
+  return PIDX_success;
+}
+
+
+
+static uint32_t build_node(PIDX_raw_rst_index index, uint32_t first, uint32_t count)
+{
+  uint32_t n = index->node_count++;
+  PIDX_raw_rst_index_node *node = &index->node[n];
+
+  if (count <= PIDX_RAW_RST_INDEX_LEAF_SIZE)
+  {
+    node->first = first;
+    node->count = count;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      node->lo[d] = UINT32_MAX;
+      node->hi[d] = 0;
+    }
+    for (uint32_t i = first; i < first + count; i++)
+    {
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        if (index->entry[i].offset[d] < node->lo[d])
+          node->lo[d] = index->entry[i].offset[d];
+        if (index->entry[i].offset[d] + index->entry[i].size[d] > node->hi[d])
+          node->hi[d] = index->entry[i].offset[d] + index->entry[i].size[d];
+      }
+    }
+  }
+  else
+  {
+    uint32_t left = build_node(index, first, count / 2);
+    uint32_t right = build_node(index, first + count / 2, count - count / 2);
+
+    node->first = first;
+    node->count = 0;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      node->lo[d] = index->node[left].lo[d] < index->node[right].lo[d] ? index->node[left].lo[d] : index->node[right].lo[d];
+      node->hi[d] = index->node[left].hi[d] > index->node[right].hi[d] ? index->node[left].hi[d] : index->node[right].hi[d];
+    }
+  }
+
+  node->skip = index->node_count;
+  return n;
+}
+
+
+
+static uint64_t spread_bits(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffff;
+  x = (x | x << 16) & 0x1f0000ff0000ff;
+  x = (x | x << 8) & 0x100f00f00f00f00f;
+  x = (x | x << 4) & 0x10c30c30c30c30c3;
+  x = (x | x << 2) & 0x1249249249249249;
+  return x;
+}
+
+
+
+static int morton_compare(const void *a, const void *b)
+{
+  const struct morton_key *ka = a;
+  const struct morton_key *kb = b;
+
+  if (ka->key != kb->key)
+    return ka->key < kb->key ? -1 : 1;
+  return ka->entry < kb->entry ? -1 : ka->entry > kb->entry;
+}
+
+
+
+static int read_compare(const void *a, const void *b)
+{
+  const PIDX_raw_rst_index_read *ra = a;
+  const PIDX_raw_rst_index_read *rb = b;
+
+  if (ra->rank != rb->rank)
+    return ra->rank < rb->rank ? -1 : 1;
+  return ra->patch < rb->patch ? -1 : ra->patch > rb->patch;
+}
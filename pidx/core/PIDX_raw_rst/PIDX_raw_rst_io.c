@@ -265,6 +265,31 @@ PIDX_return_code PIDX_raw_rst_buf_read_and_aggregate(PIDX_raw_rst_id rst_id)
 PIDX_return_code PIDX_raw_rst_buf_aggregated_write(PIDX_raw_rst_id rst_id)
 {
   int g = 0;
+
+  // The aggregators of the shared files write the extents of the variables of this group
+  if (rst_id->shared_file != NULL)
+  {
+    PIDX_shared_file shared_file = rst_id->shared_file;
+    unsigned char **buffer = malloc(sizeof(*buffer) * (shared_file->extent_count + 1));
+    for (int e = 0; e < shared_file->extent_count; e++)
+    {
+      int v = shared_file->extent[e].variable;
+      buffer[e] = NULL;
+      if (v >= rst_id->first_index && v <= rst_id->last_index)
+        buffer[e] = rst_id->idx->variable[v]->raw_io_restructured_super_patch[shared_file->extent[e].patch]->restructured_patch->buffer;
+    }
+
+    PIDX_return_code ret = PIDX_shared_file_write(shared_file, rst_id->first_index, rst_id->last_index, buffer);
+    free(buffer);
+    if (ret != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+
+    return PIDX_success;
+  }
+
   char *directory_path;
   directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
   memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
@@ -514,6 +514,26 @@ PIDX_return_code PIDX_raw_rst_meta_data_write(PIDX_raw_rst_id rst_id)
   MPI_Allgather(local_patch_offset, PIDX_MAX_DIMENSIONS * max_patch_count + 1, MPI_INT, global_patch_offset + 2, PIDX_MAX_DIMENSIONS * max_patch_count + 1, MPI_INT, rst_id->idx_c->simulation_comm);
   MPI_Allgather(local_patch_size, PIDX_MAX_DIMENSIONS * max_patch_count + 1, MPI_INT, global_patch_size + 2, PIDX_MAX_DIMENSIONS * max_patch_count + 1, MPI_INT, rst_id->idx_c->simulation_comm);
 
+  // With shared files the index also holds the file and byte offset of every super patch,
+  // the first extent of a super patch being its first variable
+  int writer_rank = (rst_id->idx_c->simulation_nprocs == 1) ? 0 : 1;
+  uint64_t *global_patch_place = NULL;
+  if (rst_id->shared_file != NULL)
+  {
+    uint64_t *local_patch_place = malloc(sizeof(uint64_t) * (2 * max_patch_count + 1));
+    memset(local_patch_place, 0, sizeof(uint64_t) * (2 * max_patch_count + 1));
+    for (i = 0; i < patch_count; i++)
+    {
+      local_patch_place[2 * i] = rst_id->shared_file->file;
+      local_patch_place[2 * i + 1] = rst_id->shared_file->extent[i * rst_id->idx->variable_count].offset;
+    }
+
+    if (rst_id->idx_c->simulation_rank == writer_rank)
+      global_patch_place = malloc(sizeof(uint64_t) * ((uint64_t)rst_id->idx_c->simulation_nprocs * 2 * max_patch_count + 1));
+    MPI_Gather(local_patch_place, 2 * max_patch_count * sizeof(uint64_t), MPI_BYTE, global_patch_place, 2 * max_patch_count * sizeof(uint64_t), MPI_BYTE, writer_rank, rst_id->idx_c->simulation_comm);
+    free(local_patch_place);
+  }
+
   global_patch_size[0] = rst_id->idx_c->simulation_nprocs;
   global_patch_offset[0] = rst_id->idx_c->simulation_nprocs;
   global_patch_size[1] = max_patch_count;
@@ -522,6 +542,7 @@ PIDX_return_code PIDX_raw_rst_meta_data_write(PIDX_raw_rst_id rst_id)
   char *directory_path;
   char offset_path[PATH_MAX];
   char size_path[PATH_MAX];
+  char index_path[PATH_MAX];
 
   directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
   memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
@@ -529,6 +550,7 @@ PIDX_return_code PIDX_raw_rst_meta_data_write(PIDX_raw_rst_id rst_id)
 
   sprintf(offset_path, "%s_OFFSET", directory_path);
   sprintf(size_path, "%s_SIZE", directory_path);
+  sprintf(index_path, "%s_INDEX", directory_path);
   free(directory_path);
   if (rst_id->idx_c->simulation_rank == 1 || rst_id->idx_c->simulation_nprocs == 1)
   {
@@ -549,10 +571,47 @@ PIDX_return_code PIDX_raw_rst_meta_data_write(PIDX_raw_rst_id rst_id)
       return PIDX_err_io;
     }
     close(fp);
+
+    // Spatial index over the same boxes, so readers do not have to intersect with every writer patch
+    uint32_t entry_count = 0;
+    PIDX_raw_rst_index_entry *entry = malloc(sizeof(*entry) * (rst_id->idx_c->simulation_nprocs * max_patch_count + 1));
+    for (int n = 0; n < rst_id->idx_c->simulation_nprocs; n++)
+    {
+      int pc_index = 2 + n * (max_patch_count * PIDX_MAX_DIMENSIONS + 1);
+      for (int m = 0; m < global_patch_offset[pc_index]; m++)
+      {
+        entry[entry_count].rank = n;
+        entry[entry_count].patch = m;
+        for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+        {
+          entry[entry_count].offset[d] = global_patch_offset[pc_index + m * PIDX_MAX_DIMENSIONS + d + 1];
+          entry[entry_count].size[d] = global_patch_size[pc_index + m * PIDX_MAX_DIMENSIONS + d + 1];
+        }
+        entry[entry_count].file = -1;
+        entry[entry_count].reserved = 0;
+        entry[entry_count].data_offset = 0;
+        if (global_patch_place != NULL)
+        {
+          entry[entry_count].file = (int32_t)global_patch_place[((uint64_t)n * max_patch_count + m) * 2];
+          entry[entry_count].data_offset = global_patch_place[((uint64_t)n * max_patch_count + m) * 2 + 1];
+        }
+        entry_count++;
+      }
+    }
+
+    PIDX_raw_rst_index index = PIDX_raw_rst_index_create(entry, entry_count);
+    PIDX_return_code ret = PIDX_raw_rst_index_write(index, index_path);
+    PIDX_raw_rst_index_free(index);
+    if (ret != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
   }
 
   free(local_patch_offset);
   free(local_patch_size);
+  free(global_patch_place);
 
   free(global_patch_offset);
   global_patch_offset = 0;
@@ -564,8 +623,53 @@ PIDX_return_code PIDX_raw_rst_meta_data_write(PIDX_raw_rst_id rst_id)
 }
 
 
+PIDX_return_code PIDX_raw_rst_shared_file_create(PIDX_raw_rst_id rst_id)
+{
+  PIDX_variable var0 = rst_id->idx->variable[rst_id->first_index];
+  int patch_count = var0->raw_io_restructured_super_patch_count;
+  int variable_count = rst_id->idx->variable_count;
+
+  // Every variable gets an extent, so all the groups of variables of a time step find the same placement
+  PIDX_shared_file_extent *extent = malloc(sizeof(*extent) * ((uint64_t)patch_count * variable_count + 1));
+  memset(extent, 0, sizeof(*extent) * ((uint64_t)patch_count * variable_count + 1));
+  for (int g = 0; g < patch_count; g++)
+  {
+    PIDX_patch out_patch = var0->raw_io_restructured_super_patch[g]->restructured_patch;
+    for (int v = 0; v < variable_count; v++)
+    {
+      PIDX_variable var = rst_id->idx->variable[v];
+      PIDX_shared_file_extent *e = &extent[g * variable_count + v];
+      e->patch = g;
+      e->variable = v;
+      e->size = out_patch->size[0] * out_patch->size[1] * out_patch->size[2] * (var->bpv/8) * var->vps;
+    }
+  }
+
+  char *directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
+  memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
+  strncpy(directory_path, rst_id->idx->filename, strlen(rst_id->idx->filename) - 4);
+
+  PIDX_return_code ret = PIDX_shared_file_create(rst_id->idx_c->simulation_comm, rst_id->idx->shared_file_count, directory_path, rst_id->idx->current_time_step, extent, patch_count * variable_count, &rst_id->shared_file);
+  free(directory_path);
+  free(extent);
+  if (ret != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  return PIDX_success;
+}
+
+
 PIDX_return_code PIDX_raw_rst_meta_data_destroy(PIDX_raw_rst_id rst_id)
 {
+  if (rst_id->shared_file != NULL)
+  {
+    PIDX_shared_file_free(rst_id->shared_file);
+    rst_id->shared_file = NULL;
+  }
+
   for (int v = rst_id->first_index; v <= rst_id->last_index; v++)
   {
     PIDX_variable var = rst_id->idx->variable[v];
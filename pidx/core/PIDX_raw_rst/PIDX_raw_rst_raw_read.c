@@ -46,44 +46,552 @@ static void bit64_reverse_endian(unsigned char* val, unsigned char *outbuf);
 static void bit32_reverse_endian(unsigned char* val, unsigned char *outbuf);
 #endif
 
-static int maximum_neighbor_count = 1024;
-static int intersectNDChunk(PIDX_patch A, PIDX_patch B);
+static PIDX_raw_rst_index load_legacy_index(PIDX_raw_rst_id rst_id, const char *size_path, const char *offset_path);
+static void writer_file_name(char *file_name, const char *directory_path, int time_step, uint32_t rank, uint32_t patch, int32_t file);
+static int create_box_type(uint64_t *box_offset, uint64_t *box_size, uint64_t *sub_offset, uint64_t *sub_size, uint64_t bytes_per_sample, MPI_Datatype *type);
 
 PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id)
 {
-  int temp_max_dim = 3;
+  int svi = rst_id->first_index;
+  int evi = rst_id->last_index;
 
-  if (rst_id->idx->pidx_version == 0)
-    temp_max_dim = 5;
+  char *directory_path;
+  char offset_path[PATH_MAX];
+  char size_path[PATH_MAX];
+  char index_path[PATH_MAX];
+  char file_name[PATH_MAX];
+
+  directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
+  memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
+  strncpy(directory_path, rst_id->idx->filename, strlen(rst_id->idx->filename) - 4);
+
+  sprintf(offset_path, "%s_OFFSET", directory_path);
+  sprintf(size_path, "%s_SIZE", directory_path);
+  sprintf(index_path, "%s_INDEX", directory_path);
+
+  // Datasets written before the _INDEX file existed get the same index built from _SIZE and _OFFSET
+  PIDX_raw_rst_index index = PIDX_raw_rst_index_load(index_path);
+  if (index == NULL)
+    index = load_legacy_index(rst_id, size_path, offset_path);
+  if (index == NULL)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    free(directory_path);
+    return PIDX_err_io;
+  }
+
+  PIDX_return_code ret = PIDX_err_rst;
+  uint64_t temp_buffer_size = 0;
+  unsigned char *temp_buffer = NULL;
+  PIDX_raw_rst_index_read *read = NULL;
+  int fpx = -1;
+
+  for (int pc1 = 0; pc1 < rst_id->idx->variable[svi]->sim_patch_count; pc1++)
+  {
+    PIDX_patch local_proc_patch = rst_id->idx->variable[svi]->sim_patch[pc1];
+
+    int read_count = 0;
+    if (PIDX_raw_rst_index_query(index, local_proc_patch, &read, &read_count) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      goto cleanup;
+    }
+
+    for (int i = 0; i < read_count; i++)
+    {
+      PIDX_raw_rst_index_read *r = &read[i];
+
+      writer_file_name(file_name, directory_path, rst_id->idx->current_time_step, r->rank, r->patch, r->file);
+      fpx = open(file_name, O_RDONLY);
+      if (fpx < 0)
+      {
+        fprintf(stderr, "Error opening file %s Error code %d\n", file_name, errno);
+        ret = PIDX_err_io;
+        goto cleanup;
+      }
+
+      // Only the samples from the first to the last one of the intersection are read
+      uint64_t first_sample = (r->file_size[0] * r->file_size[1] * (r->offset[2] - r->file_offset[2])) +
+          (r->file_size[0] * (r->offset[1] - r->file_offset[1])) +
+          (r->offset[0] - r->file_offset[0]);
+      uint64_t last_sample = (r->file_size[0] * r->file_size[1] * (r->offset[2] + r->size[2] - 1 - r->file_offset[2])) +
+          (r->file_size[0] * (r->offset[1] + r->size[1] - 1 - r->file_offset[1])) +
+          (r->offset[0] + r->size[0] - 1 - r->file_offset[0]);
+      uint64_t file_sample_count = r->file_size[0] * r->file_size[1] * r->file_size[2];
+
+      uint64_t other_offset = r->data_offset;
+      for (int v1 = 0; v1 < svi; v1++)
+      {
+        PIDX_variable var1 = rst_id->idx->variable[v1];
+        other_offset = other_offset + (var1->bpv/8) * var1->vps * file_sample_count;
+      }
+
+      for (int start_index = svi; start_index <= evi; start_index = start_index + 1)
+      {
+        PIDX_variable var = rst_id->idx->variable[start_index];
+        uint64_t bytes_per_sample = var->vps * (var->bpv/8);
+        uint64_t read_size = (last_sample - first_sample + 1) * bytes_per_sample;
+
+        if (read_size > temp_buffer_size)
+        {
+          unsigned char *temp = realloc(temp_buffer, read_size);
+          if (temp == NULL)
+          {
+            fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+            goto cleanup;
+          }
+          temp_buffer = temp;
+          temp_buffer_size = read_size;
+        }
+
+        uint64_t preadc = pread(fpx, temp_buffer, read_size, other_offset + first_sample * bytes_per_sample);
+        if (preadc != read_size)
+        {
+          fprintf(stderr, "[%s] [%d] Error in pread [%d %d]\n", __FILE__, __LINE__, (int)preadc, (int)read_size);
+          goto cleanup;
+        }
+        other_offset = other_offset + bytes_per_sample * file_sample_count;
+
+        uint64_t send_c = r->size[0];
+        for (uint64_t k1 = r->offset[2]; k1 < r->offset[2] + r->size[2]; k1++)
+        {
+          for (uint64_t j1 = r->offset[1]; j1 < r->offset[1] + r->size[1]; j1++)
+          {
+            uint64_t send_index = (r->file_size[0] * r->file_size[1] * (k1 - r->file_offset[2])) +
+                (r->file_size[0] * (j1 - r->file_offset[1])) +
+                (r->offset[0] - r->file_offset[0]) - first_sample;
+
+            uint64_t recv_o = (local_proc_patch->size[0] * local_proc_patch->size[1] * (k1 - local_proc_patch->offset[2])) + (local_proc_patch->size[0] * (j1 - local_proc_patch->offset[1])) + (r->offset[0] - local_proc_patch->offset[0]);
+
+            memcpy(var->sim_patch[pc1]->buffer + recv_o * bytes_per_sample, temp_buffer + send_index * bytes_per_sample, send_c * bytes_per_sample);
+
+#if INVERT_ENDIANESS
+            if (rst_id->idx->flip_endian == 1)
+            {
+              if (var->bpv/8 == 4 || var->bpv/8 == 12)
+              {
+                float temp;
+                float temp2;
+
+                for (int y = 0; y < send_c * bytes_per_sample / sizeof(float); y++)
+                {
+                  memcpy(&temp, var->sim_patch[pc1]->buffer + (recv_o * bytes_per_sample) + (y * sizeof(float)), sizeof(float));
+                  bit32_reverse_endian((unsigned char*)&temp, (unsigned char*)&temp2);
+                  memcpy(var->sim_patch[pc1]->buffer + (recv_o * bytes_per_sample) + (y * sizeof(float)), &temp2, sizeof(float));
+                }
+              }
+              else if (var->bpv/8 == 8 || var->bpv/8 == 24)
+              {
+                double temp;
+                double temp2;
+
+                for (int y = 0; y < send_c * bytes_per_sample / sizeof(double); y++)
+                {
+                  memcpy(&temp, var->sim_patch[pc1]->buffer + (recv_o * bytes_per_sample) + (y * sizeof(double)), sizeof(double));
+                  bit64_reverse_endian((unsigned char*)&temp, (unsigned char*)&temp2);
+                  memcpy(var->sim_patch[pc1]->buffer + (recv_o * bytes_per_sample) + (y * sizeof(double)), &temp2, sizeof(double));
+                }
+              }
+            }
+#endif
+          }
+        }
+      }
+      close(fpx);
+      fpx = -1;
+    }
+    free(read);
+    read = NULL;
+  }
+
+  ret = PIDX_success;
+
+cleanup:
+  if (fpx >= 0)
+    close(fpx);
+  free(read);
+  free(temp_buffer);
+  free(directory_path);
+  PIDX_raw_rst_index_free(index);
 
+  return ret;
+}
+
+
+
+PIDX_return_code PIDX_raw_rst_collective_raw_read(PIDX_raw_rst_id rst_id)
+{
   int svi = rst_id->first_index;
   int evi = rst_id->last_index;
+  int rank = rst_id->idx_c->simulation_rank;
+  int nprocs = rst_id->idx_c->simulation_nprocs;
+  MPI_Comm comm = rst_id->idx_c->simulation_comm;
+  PIDX_variable var0 = rst_id->idx->variable[svi];
+  int ret = 0;
 
-  char *idx_directory_path;
+  int reader_count = rst_id->idx->raw_read_reader_count;
+  if (reader_count > nprocs)
+    reader_count = nprocs;
+
+  char *directory_path;
   char offset_path[PATH_MAX];
   char size_path[PATH_MAX];
+  char index_path[PATH_MAX];
+  char file_name[PATH_MAX];
+
+  directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
+  memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
+  strncpy(directory_path, rst_id->idx->filename, strlen(rst_id->idx->filename) - 4);
+
+  sprintf(offset_path, "%s_OFFSET", directory_path);
+  sprintf(size_path, "%s_SIZE", directory_path);
+  sprintf(index_path, "%s_INDEX", directory_path);
+
+  // One process reads the index for everybody
+  PIDX_raw_rst_index index = NULL;
+  if (rank == 0)
+  {
+    index = PIDX_raw_rst_index_load(index_path);
+    if (index == NULL)
+      index = load_legacy_index(rst_id, size_path, offset_path);
+  }
+  index = PIDX_raw_rst_index_bcast(index, 0, comm);
+  if (index == NULL)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    free(directory_path);
+    return PIDX_err_io;
+  }
 
-  idx_directory_path = malloc(sizeof(*idx_directory_path) * PATH_MAX);
-  memset(idx_directory_path, 0, sizeof(*idx_directory_path) * PATH_MAX);
-  strncpy(idx_directory_path, rst_id->idx->filename, strlen(rst_id->idx->filename) - 4);
+  // The writer files are handed to the readers in runs (of the Z-order) of about the same volume.
+  // Every reader reads one file per round, the round of a file is its position among the files of its reader.
+  int *owner = malloc(sizeof(*owner) * (index->entry_count + 1));
+  int *round = malloc(sizeof(*round) * (index->entry_count + 1));
+  int *reader_file_count = malloc(sizeof(*reader_file_count) * reader_count);
+  memset(reader_file_count, 0, sizeof(*reader_file_count) * reader_count);
 
-  sprintf(offset_path, "%s_OFFSET", idx_directory_path);
-  sprintf(size_path, "%s_SIZE", idx_directory_path);
-  free(idx_directory_path);
+  uint64_t total_volume = 0;
+  for (uint32_t e = 0; e < index->entry_count; e++)
+    total_volume = total_volume + (uint64_t)index->entry[e].size[0] * index->entry[e].size[1] * index->entry[e].size[2];
+
+  int round_count = 0;
+  uint64_t volume = 0;
+  for (uint32_t e = 0; e < index->entry_count; e++)
+  {
+    uint64_t entry_volume = (uint64_t)index->entry[e].size[0] * index->entry[e].size[1] * index->entry[e].size[2];
+    int r = (total_volume == 0) ? 0 : (int)(((volume + entry_volume / 2) * reader_count) / total_volume);
+    if (r >= reader_count)
+      r = reader_count - 1;
+
+    owner[e] = (int)(((uint64_t)r * nprocs) / reader_count);
+    round[e] = reader_file_count[r]++;
+    if (round[e] + 1 > round_count)
+      round_count = round[e] + 1;
+    volume = volume + entry_volume;
+  }
+  free(reader_file_count);
+
+  int *reader_file = malloc(sizeof(*reader_file) * (round_count + 1));
+  memset(reader_file, -1, sizeof(*reader_file) * (round_count + 1));
+  int is_reader = 0;
+  for (uint32_t e = 0; e < index->entry_count; e++)
+  {
+    if (owner[e] == rank)
+    {
+      reader_file[round[e]] = e;
+      is_reader = 1;
+    }
+  }
+
+  // The readers need the patches of every process to know what to send
+  int patch_count = var0->sim_patch_count;
+  int *patch_counts = malloc(sizeof(*patch_counts) * nprocs);
+  int *byte_counts = malloc(sizeof(*byte_counts) * nprocs);
+  int *byte_offsets = malloc(sizeof(*byte_offsets) * nprocs);
+  MPI_Allgather(&patch_count, 1, MPI_INT, patch_counts, 1, MPI_INT, comm);
+
+  uint32_t total_patch_count = 0;
+  for (int n = 0; n < nprocs; n++)
+  {
+    byte_counts[n] = patch_counts[n] * sizeof(PIDX_raw_rst_index_entry);
+    byte_offsets[n] = total_patch_count * sizeof(PIDX_raw_rst_index_entry);
+    total_patch_count = total_patch_count + patch_counts[n];
+  }
+
+  PIDX_raw_rst_index_entry *local_box = malloc(sizeof(*local_box) * (patch_count + 1));
+  for (int p = 0; p < patch_count; p++)
+  {
+    local_box[p].rank = rank;
+    local_box[p].patch = p;
+    local_box[p].file = -1;
+    local_box[p].reserved = 0;
+    local_box[p].data_offset = 0;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      local_box[p].offset[d] = (uint32_t)var0->sim_patch[p]->offset[d];
+      local_box[p].size[d] = (uint32_t)var0->sim_patch[p]->size[d];
+    }
+  }
+
+  PIDX_raw_rst_index_entry *box = malloc(sizeof(*box) * (total_patch_count + 1));
+  MPI_Allgatherv(local_box, patch_count * sizeof(*local_box), MPI_BYTE, box, byte_counts, byte_offsets, MPI_BYTE, comm);
+  free(local_box);
+  free(patch_counts);
+  free(byte_counts);
+  free(byte_offsets);
+
+  PIDX_raw_rst_index patch_index = NULL;
+  if (is_reader)
+    patch_index = PIDX_raw_rst_index_create(box, total_patch_count);
+  else
+    free(box);
+
+  // The parts of the writer files every local patch is made of
+  PIDX_return_code result = PIDX_err_rst;
+  int var_count = evi - svi + 1;
+  uint64_t file_buffer_size = 0;
+  unsigned char *file_buffer = NULL;
+  PIDX_raw_rst_index_read *send = NULL;
+  MPI_Request *req = NULL;
+  MPI_Datatype *chunk_data_type = NULL;
+  int req_counter = 0;
+  int fpx = -1;
+
+  int *read_count = calloc(patch_count + 1, sizeof(*read_count));
+  PIDX_raw_rst_index_read **read = calloc(patch_count + 1, sizeof(*read));
+  for (int p = 0; p < patch_count; p++)
+  {
+    if (PIDX_raw_rst_index_query(index, var0->sim_patch[p], &read[p], &read_count[p]) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      goto cleanup;
+    }
+  }
+
+  for (int k = 0; k < round_count; k++)
+  {
+    int recv_count = 0;
+    for (int p = 0; p < patch_count; p++)
+      for (int i = 0; i < read_count[p]; i++)
+        if (round[read[p][i].entry] == k)
+          recv_count++;
+
+    int send_count = 0;
+    uint64_t file_sample_count = 0;
+    if (reader_file[k] != -1)
+    {
+      PIDX_raw_rst_index_entry *entry = &index->entry[reader_file[k]];
+      struct PIDX_patch_struct file_box;
+      memset(&file_box, 0, sizeof(file_box));
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        file_box.offset[d] = entry->offset[d];
+        file_box.size[d] = entry->size[d];
+      }
+      file_sample_count = file_box.size[0] * file_box.size[1] * file_box.size[2];
+
+      // Phase one: the variables of the pack are read from the writer file in one piece
+      uint64_t read_offset = entry->data_offset;
+      for (int v = 0; v < svi; v++)
+        read_offset = read_offset + (rst_id->idx->variable[v]->bpv/8) * rst_id->idx->variable[v]->vps * file_sample_count;
+
+      uint64_t read_size = 0;
+      for (int v = svi; v <= evi; v++)
+        read_size = read_size + (rst_id->idx->variable[v]->bpv/8) * rst_id->idx->variable[v]->vps * file_sample_count;
+
+      if (read_size > file_buffer_size)
+      {
+        unsigned char *temp = realloc(file_buffer, read_size);
+        if (temp == NULL)
+        {
+          fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+          goto cleanup;
+        }
+        file_buffer = temp;
+        file_buffer_size = read_size;
+      }
+
+      writer_file_name(file_name, directory_path, rst_id->idx->current_time_step, entry->rank, entry->patch, entry->file);
+      fpx = open(file_name, O_RDONLY);
+      if (fpx < 0)
+      {
+        fprintf(stderr, "Error opening file %s Error code %d\n", file_name, errno);
+        result = PIDX_err_io;
+        goto cleanup;
+      }
+      uint64_t preadc = pread(fpx, file_buffer, read_size, read_offset);
+      if (preadc != read_size)
+      {
+        fprintf(stderr, "[%s] [%d] Error in pread [%d %d]\n", __FILE__, __LINE__, (int)preadc, (int)read_size);
+        goto cleanup;
+      }
+      close(fpx);
+      fpx = -1;
+
+      if (PIDX_raw_rst_index_query(patch_index, &file_box, &send, &send_count) != PIDX_success)
+      {
+        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+        goto cleanup;
+      }
+    }
+
+    // Phase two: the parts are sent to the processes owning them, in (process, patch, variable) order on both sides
+    req = malloc(sizeof(*req) * ((send_count + recv_count) * var_count + 1));
+    chunk_data_type = malloc(sizeof(*chunk_data_type) * ((send_count + recv_count) * var_count + 1));
+    req_counter = 0;
+
+    for (int i = 0; i < send_count; i++)
+    {
+      PIDX_raw_rst_index_entry *entry = &index->entry[reader_file[k]];
+      uint64_t file_offset[PIDX_MAX_DIMENSIONS];
+      uint64_t file_size[PIDX_MAX_DIMENSIONS];
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        file_offset[d] = entry->offset[d];
+        file_size[d] = entry->size[d];
+      }
+
+      uint64_t var_offset = 0;
+      for (int v = svi; v <= evi; v++)
+      {
+        uint64_t bytes_per_sample = (rst_id->idx->variable[v]->bpv/8) * rst_id->idx->variable[v]->vps;
+        create_box_type(file_offset, file_size, send[i].offset, send[i].size, bytes_per_sample, &chunk_data_type[req_counter]);
+        req_counter++;
+
+        ret = MPI_Isend(file_buffer + var_offset, 1, chunk_data_type[req_counter - 1], send[i].rank, 123, comm, &req[req_counter - 1]);
+        if (ret != MPI_SUCCESS)
+        {
+          fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+          result = PIDX_err_mpi;
+          goto cleanup;
+        }
+        var_offset = var_offset + bytes_per_sample * file_sample_count;
+      }
+    }
+    free(send);
+    send = NULL;
+
+    for (int p = 0; p < patch_count; p++)
+    {
+      for (int i = 0; i < read_count[p]; i++)
+      {
+        PIDX_raw_rst_index_read *r = &read[p][i];
+        if (round[r->entry] != k)
+          continue;
+
+        for (int v = svi; v <= evi; v++)
+        {
+          PIDX_variable var = rst_id->idx->variable[v];
+          create_box_type(var->sim_patch[p]->offset, var->sim_patch[p]->size, r->offset, r->size, (var->bpv/8) * var->vps, &chunk_data_type[req_counter]);
+          req_counter++;
+
+          ret = MPI_Irecv(var->sim_patch[p]->buffer, 1, chunk_data_type[req_counter - 1], owner[r->entry], 123, comm, &req[req_counter - 1]);
+          if (ret != MPI_SUCCESS)
+          {
+            fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+            result = PIDX_err_mpi;
+            goto cleanup;
+          }
+        }
+      }
+    }
+
+    ret = MPI_Waitall(req_counter, req, MPI_STATUSES_IGNORE);
+    if (ret != MPI_SUCCESS)
+    {
+      fprintf(stderr, "Error: File [%s] Line [%d]\n", __FILE__, __LINE__);
+      result = PIDX_err_mpi;
+      goto cleanup;
+    }
+
+    for (int i = 0; i < req_counter; i++)
+      MPI_Type_free(&chunk_data_type[i]);
+    free(chunk_data_type);
+    free(req);
+    chunk_data_type = NULL;
+    req = NULL;
+    req_counter = 0;
+  }
+
+  result = PIDX_success;
+
+cleanup:
+  if (fpx >= 0)
+    close(fpx);
+  for (int i = 0; i < req_counter; i++)
+    MPI_Type_free(&chunk_data_type[i]);
+  free(chunk_data_type);
+  free(req);
+  free(send);
+  for (int p = 0; p < patch_count; p++)
+    free(read[p]);
+  free(read);
+  free(read_count);
+  free(file_buffer);
+  free(reader_file);
+  free(round);
+  free(owner);
+  free(directory_path);
+  PIDX_raw_rst_index_free(patch_index);
+  PIDX_raw_rst_index_free(index);
+
+  return result;
+}
+
+
+
+static int create_box_type(uint64_t *box_offset, uint64_t *box_size, uint64_t *sub_offset, uint64_t *sub_size, uint64_t bytes_per_sample, MPI_Datatype *type)
+{
+  // byte offsets of the rows go past 2 GiB in large patches, so they are MPI_Aint
+  int row_count = sub_size[1] * sub_size[2];
+  MPI_Aint *row_offset = malloc(sizeof(*row_offset) * (row_count + 1));
+  int *row_length = malloc(sizeof(*row_length) * (row_count + 1));
+
+  int count1 = 0;
+  for (uint64_t k1 = sub_offset[2]; k1 < sub_offset[2] + sub_size[2]; k1++)
+  {
+    for (uint64_t j1 = sub_offset[1]; j1 < sub_offset[1] + sub_size[1]; j1++)
+    {
+      uint64_t index = (box_size[0] * box_size[1] * (k1 - box_offset[2])) +
+          (box_size[0] * (j1 - box_offset[1])) +
+          (sub_offset[0] - box_offset[0]);
+      row_offset[count1] = (MPI_Aint)(index * bytes_per_sample);
+      row_length[count1] = sub_size[0] * bytes_per_sample;
+      count1++;
+    }
+  }
+
+  MPI_Type_create_hindexed(count1, row_length, row_offset, MPI_BYTE, type);
+  MPI_Type_commit(type);
+
+  free(row_offset);
+  free(row_length);
+
+  return PIDX_success;
+}
+
+
+
+static PIDX_raw_rst_index load_legacy_index(PIDX_raw_rst_id rst_id, const char *size_path, const char *offset_path)
+{
+  int temp_max_dim = 3;
+
+  if (rst_id->idx->pidx_version == 0)
+    temp_max_dim = 5;
 
   uint32_t number_cores = 0;
   int fp = open(size_path, O_RDONLY);
   if (fp < 0)
   {
     fprintf(stderr, "Error opening file %s Error code %d\n", size_path, errno);
-    return PIDX_err_io;
+    return NULL;
   }
 
   uint64_t read_count = pread(fp, &number_cores, sizeof(uint32_t), 0);
   if (read_count != sizeof(uint32_t))
   {
     fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
-    return PIDX_err_io;
+    return NULL;
   }
 
 #if INVERT_ENDIANESS
@@ -100,7 +608,7 @@ PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id)
   if (read_count != sizeof(uint32_t))
   {
     fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
-    return PIDX_err_io;
+    return NULL;
   }
 
 
@@ -113,7 +621,7 @@ PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id)
   }
 #endif
 
-  int buffer_read_size = (number_cores * (max_patch_count * temp_max_dim + 1)) * sizeof(uint32_t);
+  uint64_t buffer_read_size = ((uint64_t)number_cores * (max_patch_count * temp_max_dim + 1)) * sizeof(uint32_t);
 
   uint32_t *size_buffer = malloc(buffer_read_size);
   memset(size_buffer, 0, buffer_read_size);
@@ -122,7 +630,7 @@ PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id)
   if (read_count != buffer_read_size)
   {
     fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
-    return PIDX_err_io;
+    return NULL;
   }
 
 
@@ -144,11 +652,16 @@ PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id)
   memset(offset_buffer, 0, buffer_read_size);
 
   int fp1 = open(offset_path, O_RDONLY);
+  if (fp1 < 0)
+  {
+    fprintf(stderr, "Error opening file %s Error code %d\n", offset_path, errno);
+    return NULL;
+  }
   read_count = pread(fp1, offset_buffer, buffer_read_size, 2 * sizeof(uint32_t));
   if (read_count != buffer_read_size)
   {
     fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
-    return PIDX_err_io;
+    return NULL;
   }
   close(fp1);
 
@@ -163,275 +676,44 @@ PIDX_return_code PIDX_raw_rst_forced_raw_read(PIDX_raw_rst_id rst_id)
   }
 #endif
 
-  char *file_name;
-  file_name = malloc(PATH_MAX * sizeof(*file_name));
-  memset(file_name, 0, PATH_MAX * sizeof(*file_name));
-
-  char *directory_path;
-  char *data_set_path;
-
-  directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
-  memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
-
-  data_set_path = malloc(sizeof(*data_set_path) * PATH_MAX);
-  memset(data_set_path, 0, sizeof(*data_set_path) * PATH_MAX);
-
-  strncpy(directory_path, rst_id->idx->filename, strlen(rst_id->idx->filename) - 4);
-  sprintf(data_set_path, "%s/time%09d/", directory_path, rst_id->idx->current_time_step);
-
-  for (int pc1 = 0; pc1 < rst_id->idx->variable[svi]->sim_patch_count; pc1++)
+  // PC - - - - - - - - - -   PC - - - - - - - - - -  PC - - - - -
+  // 0  1 2 3 4 5 6 7 8 9 10   11 12 13 14 15 16 17 18 19 20 21  22
+  uint32_t entry_count = 0;
+  PIDX_raw_rst_index_entry *entry = malloc(sizeof(*entry) * ((uint64_t)number_cores * max_patch_count + 1));
+  for (uint32_t n = 0; n < number_cores; n++)
   {
-    PIDX_patch local_proc_patch = (PIDX_patch)malloc(sizeof (*local_proc_patch));
-    memset(local_proc_patch, 0, sizeof (*local_proc_patch));
-    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    uint64_t pc_index = (uint64_t)n * (max_patch_count * temp_max_dim + 1);
+    for (uint32_t m = 0; m < offset_buffer[pc_index]; m++)
     {
-      local_proc_patch->offset[d] = rst_id->idx->variable[svi]->sim_patch[pc1]->offset[d];
-      local_proc_patch->size[d] = rst_id->idx->variable[svi]->sim_patch[pc1]->size[d];
-    }
-
-    // PC - - - - - - - - - -   PC - - - - - - - - - -  PC - - - - -
-    // 0  1 2 3 4 5 6 7 8 9 10   11 12 13 14 15 16 17 18 19 20 21  22
-    PIDX_patch n_proc_patch = (PIDX_patch)malloc(sizeof (*n_proc_patch));
-    memset(n_proc_patch, 0, sizeof (*n_proc_patch));
-    int p_counter = 1;
-    int pc = 0, pc_index = 0;
-
-    PIDX_super_patch patch_grp;
-    patch_grp = malloc(sizeof(*(patch_grp)));
-    memset(patch_grp, 0, sizeof(*(patch_grp)));
-
-    int *source_patch_id = malloc(sizeof(int) * maximum_neighbor_count);
-    memset(source_patch_id, 0, sizeof(int) * maximum_neighbor_count);
-
-    patch_grp->source_patch = malloc(sizeof(*patch_grp->source_patch) * maximum_neighbor_count);
-    patch_grp->patch = malloc(sizeof(*patch_grp->patch) * maximum_neighbor_count);
-    patch_grp->restructured_patch = malloc(sizeof(*patch_grp->restructured_patch));
-    memset(patch_grp->source_patch, 0, sizeof(*patch_grp->source_patch) * maximum_neighbor_count);
-    memset(patch_grp->patch, 0, sizeof(*patch_grp->patch) * maximum_neighbor_count);
-    memset(patch_grp->restructured_patch, 0, sizeof(*patch_grp->restructured_patch));
-
-    int patch_count = 0;
-    for (int n = 0; n < number_cores; n++)
-    {
-      pc = (int)offset_buffer[n * (max_patch_count * temp_max_dim + 1)];
-      pc_index = n * (max_patch_count * temp_max_dim + 1);
-      for (int m = 0; m < pc; m++)
+      entry[entry_count].rank = n;
+      entry[entry_count].patch = m;
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
       {
-        for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-        {
-          n_proc_patch->offset[d] = (uint64_t)offset_buffer[pc_index + m * temp_max_dim + d + 1];
-          n_proc_patch->size[d] = (uint64_t)size_buffer[pc_index + m * temp_max_dim + d + 1];
-        }
-
-        if (intersectNDChunk(local_proc_patch, n_proc_patch))
-        {
-          //sprintf(file_name, "%s/time%09d/%d_%d", directory_path, rst_id->idx->current_time_step, n, m);
-          patch_grp->patch[patch_count] = malloc(sizeof(*(patch_grp->patch[patch_count])));
-          memset(patch_grp->patch[patch_count], 0, sizeof(*(patch_grp->patch[patch_count])));
-          for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-          {
-            //STEP 5 : offset and count of intersecting chunk of process with rank r and regular patch
-            if (n_proc_patch->offset[d] <= local_proc_patch->offset[d] && (n_proc_patch->offset[d] + n_proc_patch->size[d] - 1) <= (local_proc_patch->offset[d] + local_proc_patch->size[d] - 1))
-            {
-              patch_grp->patch[patch_count]->offset[d] = local_proc_patch->offset[d];
-              patch_grp->patch[patch_count]->size[d] = (n_proc_patch->offset[d] + n_proc_patch->size[d] - 1) - local_proc_patch->offset[d] + 1;
-            }
-            else if (local_proc_patch->offset[d] <= n_proc_patch->offset[d] && (n_proc_patch->offset[d] + n_proc_patch->size[d] - 1) >= (local_proc_patch->offset[d] + local_proc_patch->size[d] - 1))
-            {
-              patch_grp->patch[patch_count]->offset[d] = n_proc_patch->offset[d];
-              patch_grp->patch[patch_count]->size[d] = (local_proc_patch->offset[d] + local_proc_patch->size[d] - 1) - n_proc_patch->offset[d] + 1;
-            }
-            else if (( local_proc_patch->offset[d] + local_proc_patch->size[d] - 1) <= (n_proc_patch->offset[d] + n_proc_patch->size[d] - 1) && local_proc_patch->offset[d] >= n_proc_patch->offset[d])
-            {
-              patch_grp->patch[patch_count]->offset[d] = local_proc_patch->offset[d];
-              patch_grp->patch[patch_count]->size[d] = local_proc_patch->size[d];
-            }
-            else if (( n_proc_patch->offset[d] + n_proc_patch->size[d] - 1) <= (local_proc_patch->offset[d] + local_proc_patch->size[d] - 1) && n_proc_patch->offset[d] >= local_proc_patch->offset[d])
-            {
-              patch_grp->patch[patch_count]->offset[d] = n_proc_patch->offset[d];
-              patch_grp->patch[patch_count]->size[d] = n_proc_patch->size[d];
-            }
-          }
-          patch_grp->source_patch[patch_count].rank = n;
-          source_patch_id[patch_count] = m;
-          //fprintf(stderr, "patch_count %d -> %d %d %d\n", patch_count, patch_grp->patch[patch_count]->size[0], patch_grp->patch[patch_count]->size[1], patch_grp->patch[patch_count]->size[2]);
-
-          patch_count++;
-          if (patch_count >= maximum_neighbor_count)
-          {
-            maximum_neighbor_count = maximum_neighbor_count * 2;
-            //fprintf(stderr, "patch_count = %d maximum_neighbor_count = %d\n", patch_count, maximum_neighbor_count);
-
-            int *temp_buffer1 = realloc(source_patch_id, sizeof(int) * maximum_neighbor_count);
-            if (temp_buffer1 == NULL)
-            {
-              fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
-              return PIDX_err_rst;
-            }
-            else
-              source_patch_id = temp_buffer1;
-
-            PIDX_source_patch_index *temp_buffer2 = realloc(patch_grp->source_patch, maximum_neighbor_count * sizeof(*(patch_grp->source_patch)));
-            if (temp_buffer2 == NULL)
-            {
-              fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
-              return PIDX_err_rst;
-            }
-            else
-              patch_grp->source_patch = temp_buffer2;
-
-            PIDX_patch *temp_buffer3 = realloc(patch_grp->patch, maximum_neighbor_count * sizeof(*patch_grp->patch));
-            if (temp_buffer3 == NULL)
-            {
-              fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
-              return PIDX_err_rst;
-            }
-            else
-              patch_grp->patch = temp_buffer3;
-          }
-        }
-        p_counter++;
-      }
-    }
-
-    free(local_proc_patch);
-    local_proc_patch = 0;
-    free(n_proc_patch);
-    n_proc_patch = 0;
-
-    uint64_t send_c = 0;
-    uint64_t sim_patch_offsetx[PIDX_MAX_DIMENSIONS];
-    uint64_t sim_patch_countx[PIDX_MAX_DIMENSIONS];
-
-    unsigned char **temp_patch_buffer2;
-    temp_patch_buffer2 = malloc(sizeof(*temp_patch_buffer2) * (evi - svi + 1));
-    memset(temp_patch_buffer2, 0, sizeof(*temp_patch_buffer2) * (evi - svi + 1));
-
-    int other_offset = 0;
-    for (int start_index = svi; start_index <= evi; start_index = start_index + 1)
-    {
-      int index = start_index - svi;
-      PIDX_variable var = rst_id->idx->variable[start_index];
-
-      for (uint64_t i = 0; i < patch_count; i++)
-      {
-        pc_index = patch_grp->source_patch[i].rank * (max_patch_count * temp_max_dim + 1);
-        uint64_t total_sample_count = 1;
-        for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-        {
-          sim_patch_offsetx[d] = (uint64_t)offset_buffer[pc_index + source_patch_id[i] * temp_max_dim + d + 1];
-          sim_patch_countx[d] = (uint64_t)size_buffer[pc_index + source_patch_id[i] * temp_max_dim + d + 1];
-          total_sample_count = total_sample_count * (uint64_t)size_buffer[pc_index + source_patch_id[i] * temp_max_dim + d + 1];
-        }
-
-        temp_patch_buffer2[index] = malloc((uint64_t) sizeof(*(temp_patch_buffer2[index])) * total_sample_count * var->bpv/8 * var->vps);
-        memset(temp_patch_buffer2[index], 0, (uint64_t) sizeof(*(temp_patch_buffer2[index])) * total_sample_count * var->bpv/8 * var->vps);
-
-        sprintf(file_name, "%s/time%09d/%d_%d", directory_path, rst_id->idx->current_time_step, patch_grp->source_patch[i].rank, source_patch_id[i]);
-
-        int fpx = open(file_name, O_RDONLY);
-        other_offset = 0;
-        for (int v1 = 0; v1 < start_index; v1++)
-        {
-          PIDX_variable var1 = rst_id->idx->variable[v1];
-          other_offset = other_offset + ((var1->bpv/8) * var1->vps * sim_patch_countx[0] * sim_patch_countx[1] * sim_patch_countx[2]);
-        }
-
-        PIDX_variable var = rst_id->idx->variable[start_index];
-        uint64_t preadc = pread(fpx, temp_patch_buffer2[index], total_sample_count * var->vps * var->bpv/8, other_offset);
-        if (preadc != total_sample_count * var->vps * var->bpv/8)
-        {
-          fprintf(stderr, "[%s] [%d] Error in pread [%d %d]\n", __FILE__, __LINE__, (int)preadc, (int)send_c * var->bpv/8);
-          return PIDX_err_rst;
-        }
-        close(fpx);
-
-        uint64_t recv_o;
-        for (uint64_t k1 = patch_grp->patch[i]->offset[2]; k1 < patch_grp->patch[i]->offset[2] + patch_grp->patch[i]->size[2]; k1++)
-        {
-          for (uint64_t j1 = patch_grp->patch[i]->offset[1]; j1 < patch_grp->patch[i]->offset[1] + patch_grp->patch[i]->size[1]; j1++)
-          {
-            for (uint64_t i1 = patch_grp->patch[i]->offset[0]; i1 < patch_grp->patch[i]->offset[0] + patch_grp->patch[i]->size[0]; i1 = i1 + patch_grp->patch[i]->size[0])
-            {
-              uint64_t send_index = (sim_patch_countx[0] * sim_patch_countx[1] * (k1 - sim_patch_offsetx[2])) +
-                  (sim_patch_countx[0] * (j1 - sim_patch_offsetx[1])) +
-                  (i1 - sim_patch_offsetx[0]);
-
-
-              PIDX_variable var = rst_id->idx->variable[start_index];
-
-              send_c = (patch_grp->patch[i]->size[0]);
-              recv_o = (rst_id->idx->variable[start_index]->sim_patch[pc1]->size[0] * rst_id->idx->variable[start_index]->sim_patch[pc1]->size[1] * (k1 - rst_id->idx->variable[start_index]->sim_patch[pc1]->offset[2])) + (rst_id->idx->variable[start_index]->sim_patch[pc1]->size[0] * (j1 - rst_id->idx->variable[start_index]->sim_patch[pc1]->offset[1])) + (i1 - rst_id->idx->variable[start_index]->sim_patch[pc1]->offset[0]);
-
-              memcpy(rst_id->idx->variable[start_index]->sim_patch[pc1]->buffer + ((uint64_t) recv_o * var->vps * (var->bpv/8)), temp_patch_buffer2[index] + send_index * var->vps * (var->bpv/8), send_c * var->vps * (var->bpv/8));
-
-#if INVERT_ENDIANESS
-              if (rst_id->idx->flip_endian == 1)
-              {
-                if (var->bpv/8 == 4 || var->bpv/8 == 12)
-                {
-                  float temp;
-                  float temp2;
-
-                  for (int y = 0; y < send_c * var->vps * (var->bpv/8) / sizeof(float); y++)
-                  {
-                    memcpy(&temp, rst_id->idx->variable[start_index]->sim_patch[pc1]->buffer + (recv_o * var->vps * (var->bpv/8)) + (y * sizeof(float)), sizeof(float));
-                    bit32_reverse_endian((unsigned char*)&temp, (unsigned char*)&temp2);
-                    memcpy(rst_id->idx->variable[start_index]->sim_patch[pc1]->buffer + (recv_o * var->vps * (var->bpv/8)) + (y * sizeof(float)), &temp2, sizeof(float));
-                  }
-                }
-                else if (var->bpv/8 == 8 || var->bpv/8 == 24)
-                {
-                  double temp;
-                  double temp2;
-
-                  for (int y = 0; y < send_c * var->vps * (var->bpv/8) / sizeof(double); y++)
-                  {
-                    memcpy(&temp, rst_id->idx->variable[start_index]->sim_patch[pc1]->buffer + (recv_o * var->vps * (var->bpv/8)) + (y * sizeof(double)), sizeof(double));
-                    bit64_reverse_endian((unsigned char*)&temp, (unsigned char*)&temp2);
-                    memcpy(rst_id->idx->variable[start_index]->sim_patch[pc1]->buffer + (recv_o * var->vps * (var->bpv/8)) + (y * sizeof(double)), &temp2, sizeof(double));
-                  }
-                }
-              }
-#endif
-
-            }
-          }
-        }
-        free(patch_grp->patch[i]);
-        free(temp_patch_buffer2[index]);
+        entry[entry_count].offset[d] = offset_buffer[pc_index + m * temp_max_dim + d + 1];
+        entry[entry_count].size[d] = size_buffer[pc_index + m * temp_max_dim + d + 1];
       }
+      entry[entry_count].file = -1;
+      entry[entry_count].reserved = 0;
+      entry[entry_count].data_offset = 0;
+      entry_count++;
     }
-
-    free(temp_patch_buffer2);
-
-    free(patch_grp->source_patch);
-    free(patch_grp->patch);
-    free(patch_grp->restructured_patch);
-    free(patch_grp);
-    free(source_patch_id);
   }
 
-  free(file_name);
-  free(data_set_path);
-  free(directory_path);
-
   free(offset_buffer);
   free(size_buffer);
 
-  return PIDX_success;
+  return PIDX_raw_rst_index_create(entry, entry_count);
 }
 
 
 
-
-static int intersectNDChunk(PIDX_patch A, PIDX_patch B)
+// A patch is the file <rank>_<patch>, or is in the shared file number file
+static void writer_file_name(char *file_name, const char *directory_path, int time_step, uint32_t rank, uint32_t patch, int32_t file)
 {
-  int check_bit = 0;
-  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-    check_bit = check_bit || (A->offset[d] + A->size[d] - 1) < B->offset[d] || (B->offset[d] + B->size[d] - 1) < A->offset[d];
-
-  return !(check_bit);
+  if (file >= 0)
+    PIDX_shared_file_name(file_name, directory_path, time_step, file);
+  else
+    sprintf(file_name, "%s/time%09d/%d_%d", directory_path, time_step, rank, patch);
 }
 
 
@@ -57,4 +57,17 @@ struct PIDX_HZ_Agg_buffer_struct
 typedef struct PIDX_HZ_Agg_buffer_struct* Agg_buffer;
 
 
+/// Where an aggregator was placed (PIDX_get_aggregator_map)
+struct PIDX_aggregator_struct
+{
+  int agg_group;                                        ///< Aggregation group
+  int file_number;                                      ///< Binary file the aggregator writes (or reads)
+  int var_number;                                       ///< Variable of the aggregator
+  int rank;                                             ///< Rank of the aggregator in the simulation communicator
+  int node;                                             ///< Lowest simulation rank on the node of the aggregator, -1 if unknown
+  uint64_t buffer_size;                                 ///< Bytes aggregated
+};
+typedef struct PIDX_aggregator_struct PIDX_aggregator;
+
+
 #endif
@@ -272,7 +272,19 @@ void PIDX_blocks_print_layout(PIDX_block_layout layout, int bits_per_block)
 }
 
 
-int PIDX_blocks_is_block_present(int block_number, int bits_per_block, PIDX_block_layout layout)
+static int block_level(uint32_t block_number)
+{
+  int level = 0;
+  while (block_number)
+  {
+    level++;
+    block_number = block_number >> 1;
+  }
+  return level;
+}
+
+
+static int is_block_present(int block_number, int bits_per_block, PIDX_block_layout layout)
 {
   int res_level = 0, res_index = 0;
 
@@ -282,14 +294,13 @@ int PIDX_blocks_is_block_present(int block_number, int bits_per_block, PIDX_bloc
       return 1;
 
     return 0;
-    //res_level = bits_per_block;
-  }
-  else
-  {
-    res_level = log2 (block_number) + 1 + bits_per_block;
-    res_index = block_number % ((int) pow(2, (res_level - 1 - bits_per_block)));
   }
 
+  // block_number lies at hz level log2(block_number) + 1 + bits_per_block,
+  // res_index is its position within that level
+  res_level = block_level(block_number) + bits_per_block;
+  res_index = block_number & ((1 << (res_level - 1 - bits_per_block)) - 1);
+
   if (res_level < layout->resolution_from || res_level >= layout->resolution_to)
     return 0;
 
@@ -300,19 +311,107 @@ int PIDX_blocks_is_block_present(int block_number, int bits_per_block, PIDX_bloc
 }
 
 
+// Position of file_no among the indexed files, -1 if the index does not cover it
+static int index_file_slot(int file_no, PIDX_block_layout layout)
+{
+  int lo = 0, hi = layout->index_file_count - 1;
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (layout->existing_file_index[mid] == file_no)
+      return mid;
+    if (layout->existing_file_index[mid] < file_no)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return -1;
+}
+
+
+int PIDX_blocks_is_block_present(int block_number, int bits_per_block, PIDX_block_layout layout)
+{
+  if (layout->block_present != NULL && block_number >= 0)
+  {
+    int bpf = layout->index_blocks_per_file;
+    int slot = index_file_slot(block_number / bpf, layout);
+    if (slot != -1)
+      return layout->block_present[(uint64_t)slot * bpf + block_number % bpf];
+  }
+
+  return is_block_present(block_number, bits_per_block, layout);
+}
+
+
 int PIDX_blocks_find_negative_offset(int blocks_per_file, int bits_per_block, int block_number, PIDX_block_layout layout)
 {
   //PIDX_blocks_print_layout(layout);
   int b;
   int file_no = block_number/blocks_per_file;
   int block_offset = 0;
+
+  if (layout->block_negative_offset != NULL && blocks_per_file == layout->index_blocks_per_file)
+  {
+    int slot = index_file_slot(file_no, layout);
+    if (slot != -1)
+      return layout->block_negative_offset[(uint64_t)slot * blocks_per_file + block_number % blocks_per_file];
+  }
+
   for (b = file_no * blocks_per_file ; b < block_number; b++)
-    if (!PIDX_blocks_is_block_present(b, bits_per_block, layout))
+    if (!is_block_present(b, bits_per_block, layout))
       block_offset++;
   return block_offset;
 }
 
 
+int PIDX_blocks_create_index(PIDX_block_layout layout, int bits_per_block, int blocks_per_file)
+{
+  free(layout->block_present);
+  layout->block_present = 0;
+  free(layout->block_negative_offset);
+  layout->block_negative_offset = 0;
+  layout->index_file_count = 0;
+  layout->index_blocks_per_file = 0;
+
+  // lookups of layouts without files fall back to walking the layout
+  if (layout->hz_block_number_array == NULL || layout->existing_file_index == NULL || layout->efc <= 0 || blocks_per_file <= 0)
+    return PIDX_success;
+
+  // only the blocks of the files of the layout, bcpf entries each
+  uint64_t entry_count = (uint64_t)layout->efc * blocks_per_file;
+  layout->block_present = malloc(sizeof(*layout->block_present) * entry_count);
+  layout->block_negative_offset = malloc(sizeof(*layout->block_negative_offset) * entry_count);
+  if (layout->block_present == NULL || layout->block_negative_offset == NULL)
+  {
+    free(layout->block_present);
+    layout->block_present = 0;
+    free(layout->block_negative_offset);
+    layout->block_negative_offset = 0;
+    return PIDX_err_block;
+  }
+
+  for (int f = 0; f < layout->efc; f++)
+  {
+    int absent_count = 0;
+    int first_block = layout->existing_file_index[f] * blocks_per_file;
+    for (int b = 0; b < blocks_per_file; b++)
+    {
+      uint64_t entry = (uint64_t)f * blocks_per_file + b;
+      layout->block_present[entry] = (unsigned char)is_block_present(first_block + b, bits_per_block, layout);
+      layout->block_negative_offset[entry] = absent_count;
+
+      if (layout->block_present[entry] == 0)
+        absent_count++;
+    }
+  }
+
+  layout->index_file_count = layout->efc;
+  layout->index_blocks_per_file = blocks_per_file;
+
+  return PIDX_success;
+}
+
+
 void PIDX_blocks_free_layout(int bits_per_block, int maxh, PIDX_block_layout layout)
 {
   int j = 0;
@@ -331,6 +430,15 @@ void PIDX_blocks_free_layout(int bits_per_block, int maxh, PIDX_block_layout lay
   free(layout->hz_block_number_array);
   layout->hz_block_number_array = 0;
 
+  free(layout->block_present);
+  layout->block_present = 0;
+
+  free(layout->block_negative_offset);
+  layout->block_negative_offset = 0;
+
+  layout->index_file_count = 0;
+  layout->index_blocks_per_file = 0;
+
   return;
 }
 
@@ -353,4 +461,14 @@ void PIDX_free_layout(PIDX_block_layout layout)
 
   free(layout->file_index);
   layout->file_index = 0;
+
+  // the index is keyed by existing_file_index
+  free(layout->block_present);
+  layout->block_present = 0;
+
+  free(layout->block_negative_offset);
+  layout->block_negative_offset = 0;
+
+  layout->index_file_count = 0;
+  layout->index_blocks_per_file = 0;
 }
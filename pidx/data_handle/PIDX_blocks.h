@@ -59,6 +59,13 @@ struct PIDX_block_layout_struct
 
   /// Indices of filled blocks
   int **hz_block_number_array;
+
+  /// Per block lookup index over the existing files (built by PIDX_blocks_create_index),
+  /// block b of file existing_file_index[i] is entry i * index_blocks_per_file + b
+  int index_file_count;         /// number of files covered by the index
+  int index_blocks_per_file;    /// blocks per file the index was built for
+  unsigned char *block_present; /// presence bitmap, one entry per block of the indexed files
+  int *block_negative_offset;   /// number of absent blocks before a block within its file
 };
 typedef struct PIDX_block_layout_struct* PIDX_block_layout;
 
@@ -105,6 +112,20 @@ int PIDX_blocks_is_block_present(int block_number, int bits_per_block, PIDX_bloc
 int PIDX_blocks_find_negative_offset(int blocks_per_file, int bits_per_block, int block_number, PIDX_block_layout layout);
 
 
+///
+/// \brief PIDX_blocks_create_index Builds the presence bitmap and the per file
+/// prefix count of absent blocks of the files the layout holds, so that
+/// PIDX_blocks_is_block_present and PIDX_blocks_find_negative_offset become
+/// lookups (blocks of other files fall back to walking the layout). Must be called
+/// once the hz_block_number_array and existing_file_index of the layout are final.
+/// \param layout
+/// \param bits_per_block
+/// \param blocks_per_file
+/// \return Error code
+///
+int PIDX_blocks_create_index(PIDX_block_layout layout, int bits_per_block, int blocks_per_file);
+
+
 
 ///
 /// \brief PIDX_blocks_free_layout
@@ -160,7 +160,7 @@ struct idx_blocks_struct
   int **block_bitmap;
 
   // you can ignore this, it is only used in one case (serial run), it stores offset of every block, for every variable in every idx file
-  int ***block_offset_bitmap;
+  uint64_t ***block_offset_bitmap;
 };
 typedef struct idx_blocks_struct* idx_blocks;
 
@@ -57,12 +57,30 @@ struct idx_file_struct
 
 
   int variable_pipe_length;                         /// pipes (combines) "variable_pipe_length" variables for io
+  int pipelined_io;                                 /// 1 overlaps hz encoding and aggregation of a variable pack with file io of the previous pack
   int variable_tracker[512];                        /// Which one of the 256 variables are present
   PIDX_variable variable[512];                      /// pointer to variable
   uint32_t variable_count;                          /// The number of variables contained in the dataset
   uint32_t particles_position_variable_index;       /// The index of the variable containing the particles position
+  int particles_lod_level_count;                    /// Levels of detail of the particle files (0 or 1 writes a single level)
 
   Agg_buffer **agg_buffer;                          /// aggregation related struct
+  int aggregation_mode;                             /// PIDX_AGG_ONE_SIDED (default), PIDX_AGG_ALLTOALLV or PIDX_AGG_NEIGHBOR_ALLTOALLV
+  int aggregator_placement;                         /// PIDX_AGG_PLACEMENT_UNIFORM (default) or PIDX_AGG_PLACEMENT_NODE_AWARE
+  struct PIDX_agg_node_map_struct *agg_node_map;   /// Node of every partition rank, kept while the partition is unchanged (node aware placement)
+  PIDX_aggregator *aggregator_map;                  /// Latest placement of the aggregators of every variable (of the partition)
+  int aggregator_count;
+  int steady_state_io;                              /// 1 reuses restructuring plans, aggregators, aggregation buffers and windows across flushes
+  struct PIDX_agg_cache_list_struct *agg_cache;     /// Aggregation state of the flushes of this file (steady state io without meta data cache)
+  struct PIDX_idx_rst_plan_list_struct *idx_rst_plan;   /// Restructuring plans of the flushes of this file (steady state io without meta data cache)
+  int raw_read_reader_count;                        /// 0 (default) every process reads the raw files it needs, n > 0 n processes read whole files and send the parts
+  int shared_file_count;                            /// 0 (default) one particle or raw file per process and patch, n > 0 n aggregators each write one shared file
+
+  int async_io;                                     /// 1 defers completion of the aggregator writes to the next flush or close
+  struct PIDX_file_io_async_struct *async_io_state; /// aggregator writes in flight (async_io)
+
+  int thread_count;                                 /// Number of threads used for HZ encoding and zfp compression (0 or 1 is serial, needs OpenMP)
+  uint64_t memory_budget;                           /// Bytes a process may hold during a write (0 is no budget)
 
 
   char filename[1024];                              /// The idx file path
@@ -89,6 +107,9 @@ struct idx_file_struct
   int compression_type;
   int compression_factor;
   float compression_bit_rate;
+  double compression_parameter;                     /// precision or error tolerance of the variable rate zfp modes
+  unsigned char* compression_scratch;               /// zfp output buffer reused across variables (no meta data cache)
+  uint64_t compression_scratch_size;
   uint64_t chunk_size[PIDX_MAX_DIMENSIONS];
 
 
@@ -72,6 +72,7 @@ struct PIDX_patch_struct
     unsigned char** read_particle_buffer;
   };
   uint64_t read_particle_buffer_capacity;
+  int read_particle_level;                            ///< finest level of detail of the particles to read (PIDX_PARTICLES_ALL_LOD_LEVELS for all)
 };
 typedef struct PIDX_patch_struct* PIDX_patch;
 
@@ -79,6 +79,7 @@ struct PIDX_timming_struct
   double *hz_buffer_free_start, *hz_buffer_free_end;
   double *hz_cleanup_start, *hz_cleanup_end;
   double **hz_io_start, **hz_io_end;
+  int hz_cache_hit_count, hz_cache_miss_count;
 
   double *chunk_init_start, *chunk_init_end;
   double *chunk_meta_start, *chunk_meta_end;
@@ -98,6 +99,13 @@ struct PIDX_timming_struct
   double **agg_meta_cleanup_start, **agg_meta_cleanup_end;
 
   double *io_start, *io_end;
+  double *io_wait_start, *io_wait_end;
+
+  // bytes held by the process in every phase (PIDX_MEMORY_SIM to PIDX_MEMORY_AGG), their peaks
+  // and the peak of all the phases held at once
+  uint64_t memory[PIDX_MEMORY_PHASE_COUNT];
+  uint64_t memory_peak[PIDX_MEMORY_PHASE_COUNT];
+  uint64_t memory_high_water_mark;
 };
 typedef struct PIDX_timming_struct* PIDX_time;
 
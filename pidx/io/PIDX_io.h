@@ -76,6 +76,15 @@ struct PIDX_io_descriptor
   // for restructuring and partitioning
   PIDX_restructured_grid restructured_grid;         ///< contains information of the restructured grid
 
+  // for writes at a reduced resolution, the simulation patches are replaced by their downsampled copies
+  int reduced_resolution_factor;                    ///< finest HZ levels left out by the write (0 at full resolution)
+  uint64_t full_bounds[PIDX_MAX_DIMENSIONS];        ///< bounds of the dataset at full resolution
+  uint64_t full_box_bounds[PIDX_MAX_DIMENSIONS];    ///< box bounds of the dataset at full resolution
+  uint32_t full_partition_size[PIDX_MAX_DIMENSIONS];///< partition size at full resolution
+  int full_bits_per_block;                          ///< bits per block at full resolution
+  int *full_patch_count;                            ///< per variable, number of simulation patches at full resolution
+  PIDX_patch **full_patch;                          ///< per variable, the simulation patches at full resolution
+
   // Timming
   PIDX_time time;                                   ///< For detailed time profiling of all phases
 };
@@ -0,0 +1,582 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+#include "../../PIDX_inc.h"
+
+// Samples of the box present at the resolution: every stride-th sample starting from first
+struct box_lattice_struct
+{
+  uint64_t stride[PIDX_MAX_DIMENSIONS];
+  uint64_t first[PIDX_MAX_DIMENSIONS];
+  uint64_t count[PIDX_MAX_DIMENSIONS];
+  int level_count;          /// HZ levels of the resolution
+};
+typedef struct box_lattice_struct box_lattice;
+
+
+// Samples of a block that fall in the box, as runs contiguous both in the block and in the buffer
+struct query_span_struct
+{
+  uint32_t block_offset;
+  uint32_t count;
+  uint64_t buffer_offset;
+};
+typedef struct query_span_struct query_span;
+
+
+// A block of the query, with its place in the file once the header is known
+struct query_block_struct
+{
+  uint64_t block_number;
+  uint64_t span_start;
+  uint64_t span_count;
+  int file_index;
+  uint64_t offset;
+  uint64_t size;
+};
+typedef struct query_block_struct query_block;
+
+
+// A binary file of the query, opened once, with its header
+struct query_file_struct
+{
+  int file_number;
+  int fp;
+  uint32_t *headers;
+};
+typedef struct query_file_struct query_file;
+
+
+struct query_block_list_struct
+{
+  int count;
+  int max_count;
+  query_block *block;
+};
+typedef struct query_block_list_struct query_block_list;
+
+
+// State of a box query kept across the reads of its levels
+struct idx_box_query_struct
+{
+  idx_dataset idx;
+  int vi;
+  int layout;
+  unsigned char *buffer;
+  box_lattice lattice;
+  uint64_t offset[PIDX_MAX_DIMENSIONS];
+  uint64_t dims[PIDX_MAX_DIMENSIONS];
+
+  int levels_read;                  /// Levels of the box already in the buffer
+
+  char filename_template[PATH_MAX];
+  int file_count;
+  query_file *files;                /// Files opened by the query, each header read once
+
+  uint64_t max_span_count;
+  query_span *spans;
+  uint64_t read_buffer_size;
+  unsigned char *read_buffer;
+};
+
+
+static void create_lattice(idx_dataset idx, int reduced_resolution, uint64_t* offset, uint64_t* dims, box_lattice *lattice);
+static int add_block(query_block_list *list, uint64_t block_number);
+static int find_level_blocks(idx_dataset idx, box_lattice *lattice, uint64_t hz_from, uint64_t hz_count, query_block_list *list);
+static int find_block_spans(idx_dataset idx, box_lattice *lattice, int layout, uint64_t hz_from, uint64_t hz_to, query_block *block, query_span **spans, uint64_t *span_count, uint64_t *max_span_count);
+static int open_query_file(idx_dataset idx, const char *filename_template, query_file **files, int *file_count, int file_number);
+static int compare_query_blocks(const void *a, const void *b);
+
+
+PIDX_return_code idx_box_query_size(idx_dataset idx, int reduced_resolution, uint64_t* offset, uint64_t* dims, uint64_t* sample_count)
+{
+  box_lattice lattice;
+  create_lattice(idx, reduced_resolution, offset, dims, &lattice);
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    sample_count[d] = lattice.count[d];
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code idx_box_query_create(idx_dataset idx, int vi, int reduced_resolution, uint64_t* offset, uint64_t* dims, unsigned char* buffer, int layout, idx_box_query* query)
+{
+  if (idx->compression_type != PIDX_NO_COMPRESSION)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_unsupported_compression_type;
+  }
+
+  *query = malloc(sizeof (*(*query)));
+  memset(*query, 0, sizeof (*(*query)));
+
+  (*query)->idx = idx;
+  (*query)->vi = vi;
+  (*query)->layout = layout;
+  (*query)->buffer = buffer;
+  memcpy((*query)->offset, offset, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  memcpy((*query)->dims, dims, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  create_lattice(idx, reduced_resolution, offset, dims, &(*query)->lattice);
+
+  generate_file_name_template(idx->maxh, idx->bits_per_block, idx->filename, idx->current_time_step, (*query)->filename_template);
+
+  (*query)->max_span_count = 1024;
+  (*query)->spans = malloc((*query)->max_span_count * sizeof(*(*query)->spans));
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code idx_box_query_read_levels(idx_box_query query, int level_to)
+{
+  idx_dataset idx = query->idx;
+  box_lattice *lattice = &query->lattice;
+
+  if (level_to > lattice->level_count)
+    level_to = lattice->level_count;
+
+  // Block 0 holds the first bits_per_block + 1 levels, they are read together
+  if (query->levels_read == 0 && level_to < idx->bits_per_block + 1)
+    level_to = (lattice->level_count < idx->bits_per_block + 1) ? lattice->level_count : idx->bits_per_block + 1;
+
+  if (level_to <= query->levels_read)
+    return PIDX_success;
+
+  if (lattice->count[0] * lattice->count[1] * lattice->count[2] == 0)
+  {
+    query->levels_read = level_to;
+    return PIDX_success;
+  }
+
+  // level m holds the HZ addresses [2^(m-1), 2^m)
+  uint64_t hz_from = (query->levels_read == 0) ? 0 : (uint64_t)1 << (query->levels_read - 1);
+  uint64_t hz_to = (uint64_t)1 << (level_to - 1);
+
+  // The blocks of a level are found by splitting its HZ range in halves, an aligned HZ range
+  // of a level being a box of the samples of that level.
+  query_block_list list;
+  memset(&list, 0, sizeof(list));
+  PIDX_return_code ret = PIDX_err_block;
+  if (hz_from == 0)
+  {
+    if (add_block(&list, 0) != PIDX_success)
+      goto cleanup;
+  }
+
+  for (uint64_t level_from = (hz_from > idx->samples_per_block) ? hz_from : idx->samples_per_block; level_from < hz_to; level_from = level_from * 2)
+  {
+    if (find_level_blocks(idx, lattice, level_from, level_from, &list) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      ret = PIDX_err_block;
+      goto cleanup;
+    }
+  }
+
+  // The samples of every block that fall in the box
+  uint64_t span_count = 0;
+  int block_count = 0;
+  for (int b = 0; b < list.count; b++)
+  {
+    if (find_block_spans(idx, lattice, query->layout, hz_from, hz_to, &list.block[b], &query->spans, &span_count, &query->max_span_count) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      ret = PIDX_err_block;
+      goto cleanup;
+    }
+
+    // the bounding box of a block can touch the box without any of its samples falling in it
+    if (list.block[b].span_count != 0)
+      list.block[block_count++] = list.block[b];
+  }
+
+  // Locating the blocks in the files of the time step
+  int large_offsets = PIDX_header_io_large_offsets(idx);
+  int read_count = 0;
+  for (int b = 0; b < block_count; b++)
+  {
+    query_block *block = &list.block[b];
+    int file_index = open_query_file(idx, query->filename_template, &query->files, &query->file_count, block->block_number / idx->blocks_per_file);
+    if (file_index < 0)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      ret = PIDX_err_io;
+      goto cleanup;
+    }
+
+    int block_index = (block->block_number % idx->blocks_per_file) + (idx->blocks_per_file * query->vi);
+    block->file_index = file_index;
+    block->offset = PIDX_header_io_get_block_offset(query->files[file_index].headers, block_index, large_offsets);
+    block->size = PIDX_header_io_get_block_size(query->files[file_index].headers, block_index, large_offsets);
+
+    // blocks outside of the bounds of the dataset are not written
+    if (block->size != 0)
+      list.block[read_count++] = *block;
+  }
+
+  qsort(list.block, read_count, sizeof(*list.block), compare_query_blocks);
+
+  int bytes_per_sample = (idx->variable[query->vi]->bpv / 8) * idx->variable[query->vi]->vps;
+  query_span *spans = query->spans;
+
+  int first = 0;
+  while (first < read_count)
+  {
+    // extend the read over the blocks that follow it in the same file
+    int last = first;
+    uint64_t read_size = list.block[first].size;
+    while (last + 1 < read_count && list.block[last + 1].file_index == list.block[first].file_index && list.block[last + 1].offset == list.block[first].offset + read_size)
+    {
+      last++;
+      read_size = read_size + list.block[last].size;
+    }
+
+    if (read_size > query->read_buffer_size)
+    {
+      unsigned char *temp = realloc(query->read_buffer, read_size);
+      if (temp == NULL)
+      {
+        fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+        ret = PIDX_err_io;
+        goto cleanup;
+      }
+      query->read_buffer = temp;
+      query->read_buffer_size = read_size;
+    }
+    unsigned char *read_buffer = query->read_buffer;
+
+    // the last block of a file ends with its last sample inside the bounds of the dataset
+    ssize_t preadc = pread(query->files[list.block[first].file_index].fp, read_buffer, read_size, list.block[first].offset);
+    if (preadc < 0)
+    {
+      fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
+      ret = PIDX_err_io;
+      goto cleanup;
+    }
+    if ((uint64_t)preadc < read_size)
+      memset(read_buffer + preadc, 0, read_size - preadc);
+
+    // copy the samples of the blocks straight to the buffer
+    for (int r = first; r <= last; r++)
+    {
+      query_block *block = &list.block[r];
+      unsigned char *block_buffer = read_buffer + (block->offset - list.block[first].offset);
+      for (uint64_t s = block->span_start; s < block->span_start + block->span_count; s++)
+      {
+        if (((uint64_t)spans[s].block_offset + spans[s].count) * bytes_per_sample > block->size)
+        {
+          fprintf(stderr, "[%s] [%d] Block %lld is smaller than expected.\n", __FILE__, __LINE__, (long long)block->block_number);
+          ret = PIDX_err_io;
+          goto cleanup;
+        }
+        memcpy(query->buffer + (spans[s].buffer_offset * bytes_per_sample), block_buffer + ((uint64_t)spans[s].block_offset * bytes_per_sample), (uint64_t)spans[s].count * bytes_per_sample);
+      }
+    }
+
+    first = last + 1;
+  }
+
+  query->levels_read = level_to;
+  ret = PIDX_success;
+
+cleanup:
+  free(list.block);
+
+  return ret;
+}
+
+
+
+PIDX_return_code idx_box_query_progress(idx_box_query query, int* levels_read, int* level_count, uint64_t* buffer_offset, uint64_t* buffer_stride)
+{
+  *levels_read = query->levels_read;
+  *level_count = query->lattice.level_count;
+
+  // The samples of the levels read so far are every stride-th sample of the box at their resolution
+  box_lattice read_lattice;
+  create_lattice(query->idx, query->idx->maxh - query->levels_read, query->offset, query->dims, &read_lattice);
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    buffer_offset[d] = (read_lattice.first[d] - query->lattice.first[d]) / query->lattice.stride[d];
+    buffer_stride[d] = read_lattice.stride[d] / query->lattice.stride[d];
+  }
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code idx_box_query_destroy(idx_box_query query)
+{
+  for (int f = 0; f < query->file_count; f++)
+  {
+    close(query->files[f].fp);
+    free(query->files[f].headers);
+  }
+  free(query->files);
+  free(query->read_buffer);
+  free(query->spans);
+  free(query);
+
+  return PIDX_success;
+}
+
+
+
+static void create_lattice(idx_dataset idx, int reduced_resolution, uint64_t* offset, uint64_t* dims, box_lattice *lattice)
+{
+  int levels = idx->maxh - reduced_resolution;
+  if (levels < 1)
+    levels = 1;
+  if (levels > idx->maxh)
+    levels = idx->maxh;
+
+  // every level left out halves the samples along its axis
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    lattice->stride[d] = 1;
+  for (int m = levels; m < idx->maxh; m++)
+    lattice->stride[(int)idx->bitPattern[m]] = lattice->stride[(int)idx->bitPattern[m]] * 2;
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    lattice->first[d] = ((offset[d] + lattice->stride[d] - 1) / lattice->stride[d]) * lattice->stride[d];
+    if (offset[d] + dims[d] > lattice->first[d])
+      lattice->count[d] = (offset[d] + dims[d] - lattice->first[d] + lattice->stride[d] - 1) / lattice->stride[d];
+    else
+      lattice->count[d] = 0;
+  }
+
+  lattice->level_count = levels;
+}
+
+
+
+static int add_block(query_block_list *list, uint64_t block_number)
+{
+  if (list->count == list->max_count)
+  {
+    list->max_count = (list->max_count == 0) ? 64 : list->max_count * 2;
+    query_block *temp = realloc(list->block, list->max_count * sizeof(*temp));
+    if (temp == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+      return PIDX_err_block;
+    }
+    list->block = temp;
+  }
+
+  memset(&list->block[list->count], 0, sizeof(list->block[list->count]));
+  list->block[list->count].block_number = block_number;
+  list->count++;
+
+  return PIDX_success;
+}
+
+
+
+static int find_level_blocks(idx_dataset idx, box_lattice *lattice, uint64_t hz_from, uint64_t hz_count, query_block_list *list)
+{
+  uint64_t lo[PIDX_MAX_DIMENSIONS];
+  uint64_t hi[PIDX_MAX_DIMENSIONS];
+  Hz_to_xyz(idx->bitPattern, idx->maxh - 1, hz_from, lo);
+  Hz_to_xyz(idx->bitPattern, idx->maxh - 1, hz_from + hz_count - 1, hi);
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (lattice->count[d] == 0 || hi[d] < lattice->first[d] || lo[d] > lattice->first[d] + (lattice->count[d] - 1) * lattice->stride[d])
+      return PIDX_success;
+  }
+
+  if (hz_count <= idx->samples_per_block)
+    return add_block(list, hz_from / idx->samples_per_block);
+
+  if (find_level_blocks(idx, lattice, hz_from, hz_count / 2, list) != PIDX_success)
+    return PIDX_err_block;
+
+  return find_level_blocks(idx, lattice, hz_from + hz_count / 2, hz_count / 2, list);
+}
+
+
+
+static int find_block_spans(idx_dataset idx, box_lattice *lattice, int layout, uint64_t hz_from, uint64_t hz_to, query_block *block, query_span **spans, uint64_t *span_count, uint64_t *max_span_count)
+{
+  uint64_t xyz[PIDX_MAX_DIMENSIONS];
+  uint64_t *n = lattice->count;
+
+  // only the samples of the levels [hz_from, hz_to) of the block
+  uint64_t block_from = block->block_number * idx->samples_per_block;
+  uint64_t k_from = (hz_from > block_from) ? hz_from - block_from : 0;
+
+  block->span_start = *span_count;
+  for (uint64_t k = k_from; k < idx->samples_per_block; k++)
+  {
+    uint64_t hz = block_from + k;
+    if (hz >= hz_to)
+      break;
+
+    Hz_to_xyz(idx->bitPattern, idx->maxh - 1, hz, xyz);
+
+    uint64_t p[PIDX_MAX_DIMENSIONS];
+    int inside = 1;
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      if (xyz[d] < lattice->first[d])
+      {
+        inside = 0;
+        break;
+      }
+      p[d] = (xyz[d] - lattice->first[d]) / lattice->stride[d];
+      if (p[d] >= n[d])
+      {
+        inside = 0;
+        break;
+      }
+    }
+    if (!inside)
+      continue;
+
+    uint64_t index;
+    if (layout == PIDX_column_major)
+      index = (n[2] * n[1] * p[0]) + (n[2] * p[1]) + p[2];
+    else
+      index = (n[0] * n[1] * p[2]) + (n[0] * p[1]) + p[0];
+
+    // extend the last span of the block if the sample follows it both in the block and in the buffer
+    if (*span_count > block->span_start)
+    {
+      query_span *span = &(*spans)[*span_count - 1];
+      if (span->block_offset + span->count == k && span->buffer_offset + span->count == index)
+      {
+        span->count++;
+        continue;
+      }
+    }
+
+    if (*span_count == *max_span_count)
+    {
+      *max_span_count = *max_span_count * 2;
+      query_span *temp = realloc(*spans, *max_span_count * sizeof(*temp));
+      if (temp == NULL)
+      {
+        fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+        return PIDX_err_block;
+      }
+      *spans = temp;
+    }
+
+    (*spans)[*span_count].block_offset = k;
+    (*spans)[*span_count].count = 1;
+    (*spans)[*span_count].buffer_offset = index;
+    (*span_count)++;
+  }
+  block->span_count = *span_count - block->span_start;
+
+  return PIDX_success;
+}
+
+
+
+// Returns the index of the binary file in files, opening it and reading its header if needed
+static int open_query_file(idx_dataset idx, const char *filename_template, query_file **files, int *file_count, int file_number)
+{
+  for (int f = 0; f < *file_count; f++)
+  {
+    if ((*files)[f].file_number == file_number)
+      return f;
+  }
+
+  char file_name[PATH_MAX];
+  if (generate_file_name(idx->blocks_per_file, (char*)filename_template, file_number, file_name, PATH_MAX) == 1)
+  {
+    fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  query_file *temp = realloc(*files, (*file_count + 1) * sizeof(*temp));
+  if (temp == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+  *files = temp;
+
+  query_file *qf = &(*files)[*file_count];
+  qf->file_number = file_number;
+  qf->fp = open(file_name, O_RDONLY);
+  if (qf->fp < 0)
+  {
+    fprintf(stderr, "Error opening file %s Error code %d\n", file_name, errno);
+    return -1;
+  }
+
+  uint64_t total_header_size = (10 + (10 * idx->blocks_per_file)) * sizeof (uint32_t) * idx->variable_count;
+  qf->headers = malloc(total_header_size);
+  if (pread(qf->fp, qf->headers, total_header_size, 0) != total_header_size)
+  {
+    fprintf(stderr, "[%s] [%d] pread() failed for filename %s.\n", __FILE__, __LINE__, file_name);
+    close(qf->fp);
+    free(qf->headers);
+    return -1;
+  }
+
+  (*file_count)++;
+
+  return *file_count - 1;
+}
+
+
+
+static int compare_query_blocks(const void *a, const void *b)
+{
+  const query_block *ba = a;
+  const query_block *bb = b;
+
+  if (ba->file_index != bb->file_index)
+    return (ba->file_index < bb->file_index) ? -1 : 1;
+  if (ba->offset != bb->offset)
+    return (ba->offset < bb->offset) ? -1 : 1;
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+#ifndef __BOX_QUERY_H
+#define __BOX_QUERY_H
+
+
+// Number of samples along every axis of the box [offset, offset + dims) at the resolution with the
+// reduced_resolution finest HZ levels left out
+PIDX_return_code idx_box_query_size(idx_dataset idx, int reduced_resolution, uint64_t* offset, uint64_t* dims, uint64_t* sample_count);
+
+
+typedef struct idx_box_query_struct* idx_box_query;
+
+
+// Query of variable vi in the box [offset, offset + dims) straight from the binary files of the time step, without
+// restructuring, aggregation or any communication. The buffer holds idx_box_query_size samples in the given layout.
+PIDX_return_code idx_box_query_create(idx_dataset idx, int vi, int reduced_resolution, uint64_t* offset, uint64_t* dims, unsigned char* buffer, int layout, idx_box_query* query);
+
+
+// Reads the levels of the box up to level_to (excluded) that were not read yet. Only the blocks holding samples of
+// those levels in the box are read, adjacent blocks in one read. The levels of block 0 are always read together.
+PIDX_return_code idx_box_query_read_levels(idx_box_query query, int level_to);
+
+
+// Levels read so far out of the levels of the query, and the samples of the buffer they filled along every axis:
+// every buffer_stride-th sample starting from buffer_offset
+PIDX_return_code idx_box_query_progress(idx_box_query query, int* levels_read, int* level_count, uint64_t* buffer_offset, uint64_t* buffer_stride);
+
+
+PIDX_return_code idx_box_query_destroy(idx_box_query query);
+
+#endif
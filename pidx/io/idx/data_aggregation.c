@@ -40,6 +40,8 @@
  */
 #include "../../PIDX_inc.h"
 
+static PIDX_return_code update_aggregator_map(PIDX_io file, int svi, int evi, int* node);
+
 
 
 PIDX_return_code aggregation_setup(PIDX_io file, int svi, int evi)
@@ -72,21 +74,168 @@ PIDX_return_code aggregation_setup(PIDX_io file, int svi, int evi)
       return PIDX_err_agg;
     }
     time->agg_meta_end[svi][j] = PIDX_get_time();
+  }
+
+  // steady state io reuses the aggregators, buffers and windows of the previous flush, but only if every process
+  // of the partition still finds them (with async io the buffers are handed over to the writes in flight)
+  PIDX_agg_cache_list cache_list = NULL;
+  int reuse = 0;
+  if (idx->steady_state_io == 1 && idx->async_io == 0)
+  {
+    PIDX_agg_cache_list *list = (file->meta_data_cache != NULL) ? &file->meta_data_cache->agg_cache : &idx->agg_cache;
+    if (*list == NULL)
+    {
+      *list = malloc(sizeof(*(*list)));
+      memset(*list, 0, sizeof(*(*list)));
+    }
+    cache_list = *list;
+
+    reuse = 1;
+    for (int j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+    {
+      if (PIDX_agg_cache_find(cache_list, file->agg_id[svi][j], file->idx_b->block_layout_by_agg_group[j], j) == NULL)
+        reuse = 0;
+    }
+
+    if (MPI_Allreduce(MPI_IN_PLACE, &reuse, 1, MPI_INT, MPI_MIN, file->idx_c->partition_comm) != MPI_SUCCESS)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_agg;
+    }
+  }
+
+  // node aware placement balances the bytes of all the groups of the pack across the nodes
+  int *node = NULL;
+  uint64_t *rank_load = NULL;
+  if (idx->aggregator_placement == PIDX_AGG_PLACEMENT_NODE_AWARE)
+  {
+    node = malloc(file->idx_c->partition_nprocs * sizeof(*node));
+    rank_load = calloc(file->idx_c->partition_nprocs, sizeof(*rank_load));
 
+    // the nodes are only exchanged again when the processes of the partition change
+    if (PIDX_agg_find_nodes(file->idx_c, &idx->agg_node_map, node) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      free(node);
+      free(rank_load);
+      return PIDX_err_agg;
+    }
+  }
+
+  for (int j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+  {
     time->agg_buf_start[svi][j] = PIDX_get_time();
 
     //ret = PIDX_agg_create_global_partition_localized_aggregation_buffer(file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j], j);
     //ret = PIDX_agg_create_local_partition_localized_aggregation_buffer(file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j], j);
-    ret = PIDX_agg_buf_create_local_uniform_dist(file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j]);
+    if (reuse == 1)
+      ret = PIDX_agg_cache_restore(PIDX_agg_cache_find(cache_list, file->agg_id[svi][j], file->idx_b->block_layout_by_agg_group[j], j), file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j], node);
+    else if (idx->aggregator_placement == PIDX_AGG_PLACEMENT_NODE_AWARE)
+      ret = PIDX_agg_buf_create_node_aware_dist(file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j], node, rank_load);
+    else
+      ret = PIDX_agg_buf_create_local_uniform_dist(file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j]);
 
     if (ret != PIDX_success)
     {
       fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      free(node);
+      free(rank_load);
       return PIDX_err_agg;
     }
+
+    if (cache_list != NULL && reuse == 0)
+    {
+      if (PIDX_agg_cache_store(cache_list, file->agg_id[svi][j], idx->agg_buffer[svi][j], file->idx_b->block_layout_by_agg_group[j], j, node) != PIDX_success)
+      {
+        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+        free(node);
+        free(rank_load);
+        return PIDX_err_agg;
+      }
+    }
     time->agg_buf_end[svi][j] = PIDX_get_time();
   }
 
+  if (update_aggregator_map(file, svi, evi, node) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    free(node);
+    free(rank_load);
+    return PIDX_err_agg;
+  }
+
+  free(node);
+  free(rank_load);
+
+  // with pipelined io the buffers of the previous pack may still be held
+  uint64_t agg_bytes = time->memory[PIDX_MEMORY_AGG];
+  for (int j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+    agg_bytes = agg_bytes + idx->agg_buffer[svi][j]->buffer_size;
+  PIDX_memory_set(time, PIDX_MEMORY_AGG, agg_bytes);
+
+  return PIDX_success;
+}
+
+
+
+// Replaces the entries of the variables svi to evi in the aggregator map
+static PIDX_return_code update_aggregator_map(PIDX_io file, int svi, int evi, int* node)
+{
+  idx_dataset idx = file->idx;
+
+  int count = 0;
+  for (int a = 0; a < idx->aggregator_count; a++)
+  {
+    if (idx->aggregator_map[a].var_number < svi || idx->aggregator_map[a].var_number > evi)
+      idx->aggregator_map[count++] = idx->aggregator_map[a];
+  }
+
+  int new_count = 0;
+  for (int j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+    new_count += file->idx_b->block_layout_by_agg_group[j]->efc * (evi - svi + 1);
+
+  PIDX_aggregator *temp_map = realloc(idx->aggregator_map, (count + new_count) * sizeof(*temp_map));
+  if (temp_map == NULL && count + new_count != 0)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_agg;
+  }
+  idx->aggregator_map = temp_map;
+
+  // the map is reported in simulation ranks
+  MPI_Group partition_group, simulation_group;
+  MPI_Comm_group(file->idx_c->partition_comm, &partition_group);
+  MPI_Comm_group(file->idx_c->simulation_comm, &simulation_group);
+
+  for (int j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+  {
+    PIDX_block_layout lbl = file->idx_b->block_layout_by_agg_group[j];
+    PIDX_agg_id id = file->agg_id[svi][j];
+    int chunk_size = idx->chunk_size[0] * idx->chunk_size[1] * idx->chunk_size[2];
+
+    for (int k = 0; k < lbl->efc; k++)
+    {
+      for (int i = svi; i <= evi; i++)
+      {
+        int ranks[2] = {id->agg_r[k][i - svi], (node != NULL) ? node[id->agg_r[k][i - svi]] : MPI_UNDEFINED};
+        int simulation_ranks[2] = {MPI_UNDEFINED, MPI_UNDEFINED};
+        MPI_Group_translate_ranks(partition_group, (node != NULL) ? 2 : 1, ranks, simulation_group, simulation_ranks);
+
+        PIDX_aggregator *agg = &idx->aggregator_map[count++];
+        agg->agg_group = j;
+        agg->file_number = lbl->existing_file_index[k];
+        agg->var_number = i;
+        agg->rank = simulation_ranks[0];
+        agg->node = (node != NULL) ? simulation_ranks[1] : -1;
+        agg->buffer_size = (uint64_t)lbl->bcpf[agg->file_number] * idx->samples_per_block * ((chunk_size * idx->variable[i]->bpv/8) / idx->compression_factor);
+      }
+    }
+  }
+  idx->aggregator_count = count;
+
+  MPI_Group_free(&partition_group);
+  MPI_Group_free(&simulation_group);
+
   return PIDX_success;
 }
 
@@ -126,10 +275,15 @@ PIDX_return_code aggregation(PIDX_io file, int svi, int mode )
 
 PIDX_return_code aggregation_cleanup(PIDX_io file, int start_index)
 {
+  uint64_t agg_bytes = file->time->memory[PIDX_MEMORY_AGG];
+
   for (uint32_t i = file->idx_b->file0_agg_group_from_index; i < file->idx_b->agg_level; i++)
   {
     uint32_t i_1 = i - file->idx_b->file0_agg_group_from_index;
-    if (PIDX_agg_buf_destroy(file->idx->agg_buffer[start_index][i_1]) != PIDX_success)
+    agg_bytes = agg_bytes - file->idx->agg_buffer[start_index][i_1]->buffer_size;
+
+    // in steady state io the buffer belongs to the aggregation cache
+    if (file->agg_id[start_index][i_1]->cache == NULL && PIDX_agg_buf_destroy(file->idx->agg_buffer[start_index][i_1]) != PIDX_success)
     {
       fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
       return PIDX_err_agg;
@@ -138,6 +292,7 @@ PIDX_return_code aggregation_cleanup(PIDX_io file, int start_index)
     free(file->idx->agg_buffer[start_index][i_1]);
     PIDX_agg_finalize(file->agg_id[start_index][i_1]);
   }
+  PIDX_memory_set(file->time, PIDX_MEMORY_AGG, agg_bytes);
 
   return PIDX_success;
 }
@@ -75,3 +75,105 @@ PIDX_return_code file_io(PIDX_io file, int svi, int mode)
 
   return PIDX_success;
 }
+
+
+
+PIDX_return_code file_io_async(PIDX_io file, int svi)
+{
+  assert(file->idx_b->file0_agg_group_from_index == 0);
+  PIDX_time time = file->time;
+
+  time->io_start[svi] = PIDX_get_time();
+  for (uint32_t j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+  {
+    Agg_buffer temp_agg = file->idx->agg_buffer[svi][j];
+    PIDX_block_layout temp_layout = file->idx_b->block_layout_by_agg_group[j];
+
+    file->io_id[svi][j] = PIDX_file_io_init(file->idx, file->idx_c, file->fs_block_size, svi, svi);
+
+    if (file->idx_dbg->debug_do_io == 1)
+    {
+      // the write is only issued here, the io id (file handle and request) stays alive until file_io_wait
+      if (PIDX_file_io_async_write(file->io_id[svi][j], temp_agg, temp_layout, &file->io_id[svi][j]->request, &file->io_id[svi][j]->fh, file->idx->filename_template_partition) != PIDX_success)
+      {
+        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+        return PIDX_err_io;
+      }
+    }
+  }
+  time->io_end[svi] = PIDX_get_time();
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code file_io_wait(PIDX_io file, int svi)
+{
+  assert(file->idx_b->file0_agg_group_from_index == 0);
+  PIDX_time time = file->time;
+
+  time->io_wait_start[svi] = PIDX_get_time();
+  for (uint32_t j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+  {
+    if (PIDX_file_io_async_wait(file->io_id[svi][j]) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+    PIDX_file_io_finalize(file->io_id[svi][j]);
+  }
+  time->io_wait_end[svi] = PIDX_get_time();
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code file_io_deferred(PIDX_io file, int svi)
+{
+  assert(file->idx_b->file0_agg_group_from_index == 0);
+  PIDX_time time = file->time;
+
+  if (file->idx->async_io_state == NULL)
+    file->idx->async_io_state = PIDX_file_io_async_create();
+
+  time->io_start[svi] = PIDX_get_time();
+  for (uint32_t j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+  {
+    Agg_buffer temp_agg = file->idx->agg_buffer[svi][j];
+    PIDX_block_layout temp_layout = file->idx_b->block_layout_by_agg_group[j];
+
+    file->io_id[svi][j] = PIDX_file_io_init(file->idx, file->idx_c, file->fs_block_size, svi, svi);
+
+    if (file->idx_dbg->debug_do_io == 1)
+    {
+      // the aggregation buffer is handed over to async_io_state and released once the write completes
+      if (PIDX_file_io_async_defer_write(file->io_id[svi][j], file->idx->async_io_state, temp_agg, temp_layout, file->idx->filename_template_partition) != PIDX_success)
+      {
+        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+        return PIDX_err_io;
+      }
+    }
+    PIDX_file_io_finalize(file->io_id[svi][j]);
+  }
+  time->io_end[svi] = PIDX_get_time();
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code file_io_complete_deferred(idx_dataset idx)
+{
+  if (idx->async_io_state == NULL)
+    return PIDX_success;
+
+  if (PIDX_file_io_async_complete(idx->async_io_state) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  return PIDX_success;
+}
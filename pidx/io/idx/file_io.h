@@ -43,4 +43,21 @@
 
 PIDX_return_code file_io(PIDX_io file, int start_index, int mode);
 
+
+// Issues non-blocking writes of the aggregation buffers of the pack starting at start_index
+PIDX_return_code file_io_async(PIDX_io file, int start_index);
+
+
+// Completes the writes issued by file_io_async (the aggregation buffers can be freed afterwards)
+PIDX_return_code file_io_wait(PIDX_io file, int start_index);
+
+
+// Issues non-blocking writes of the pack starting at start_index without waiting for them,
+// they are completed by file_io_complete_deferred (at the next flush or at close)
+PIDX_return_code file_io_deferred(PIDX_io file, int start_index);
+
+
+// Completes all the writes issued by file_io_deferred
+PIDX_return_code file_io_complete_deferred(idx_dataset idx);
+
 #endif
@@ -52,6 +52,7 @@ static PIDX_return_code compress_and_encode(PIDX_io file);
 static PIDX_return_code encode_and_uncompress(PIDX_io file);
 static PIDX_return_code hz_cleanup(PIDX_io file);
 static PIDX_return_code chunk_cleanup(PIDX_io file);
+static void track_memory(PIDX_io file);
 
 
 
@@ -194,7 +195,7 @@ static PIDX_return_code compression_init(PIDX_io file, int svi, int evi)
 
   time->compression_init_start[cvi] = PIDX_get_time();
   // Create the compression ID
-  file->comp_id = PIDX_compression_init(file->idx, file->idx_c, svi, evi);
+  file->comp_id = PIDX_compression_init(file->idx, file->idx_c, file->meta_data_cache, svi, evi);
   time->compression_init_end[cvi] = PIDX_get_time();
 
   return PIDX_success;
@@ -256,6 +257,8 @@ static PIDX_return_code buffer_create(PIDX_io file)
   }
   time->hz_buffer_end[cvi] = PIDX_get_time();
 
+  track_memory(file);
+
   return PIDX_success;
 }
 
@@ -328,6 +331,8 @@ static PIDX_return_code compress_and_encode(PIDX_io file)
   }
   time->chunk_buffer_free_end[cvi] = PIDX_get_time();
 
+  PIDX_memory_set(time, PIDX_MEMORY_CHUNK, 0);
+
   return PIDX_success;
 }
 
@@ -399,6 +404,8 @@ static PIDX_return_code encode_and_uncompress(PIDX_io file)
   }
   time->chunk_buffer_free_end[cvi] = PIDX_get_time();
 
+  PIDX_memory_set(time, PIDX_MEMORY_CHUNK, 0);
+
   return PIDX_success;
 }
 
@@ -417,6 +424,8 @@ static PIDX_return_code hz_cleanup(PIDX_io file)
   }
   time->hz_buffer_free_end[cvi] = PIDX_get_time();
 
+  PIDX_memory_set(time, PIDX_MEMORY_HZ, 0);
+
 
   time->hz_cleanup_start[cvi] = PIDX_get_time();
   ret = PIDX_hz_encode_meta_data_destroy(file->hz_id);
@@ -426,6 +435,9 @@ static PIDX_return_code hz_cleanup(PIDX_io file)
     return PIDX_err_rst;
   }
 
+  time->hz_cache_hit_count += file->hz_id->cache_hit_count;
+  time->hz_cache_miss_count += file->hz_id->cache_miss_count;
+
   PIDX_hz_encode_finalize(file->hz_id);
   time->hz_cleanup_end[cvi] = PIDX_get_time();
 
@@ -453,3 +465,30 @@ static PIDX_return_code chunk_cleanup(PIDX_io file)
 
   return PIDX_success;
 }
+
+
+
+// Bytes of the chunking and HZ buffers of the variables being encoded
+static void track_memory(PIDX_io file)
+{
+  uint64_t chunk_bytes = 0, hz_bytes = 0;
+  if (file->idx->variable[cvi]->restructured_super_patch_count == 1)
+  {
+    uint64_t *cs = file->idx->chunk_size;
+    for (int v = cvi; v <= levi; v++)
+    {
+      PIDX_variable var = file->idx->variable[v];
+      uint64_t bytes_per_sample = (var->bpv / 8) * var->vps;
+
+      uint64_t *size = var->chunked_super_patch->restructured_patch->size;
+      chunk_bytes = chunk_bytes + ((size[0] + cs[0] - 1) / cs[0]) * cs[0] * ((size[1] + cs[1] - 1) / cs[1]) * cs[1] * ((size[2] + cs[2] - 1) / cs[2]) * cs[2] * bytes_per_sample;
+
+      uint64_t bytes_per_hz_sample = (bytes_per_sample * cs[0] * cs[1] * cs[2]) / file->idx->compression_factor;
+      for (int c = 0; c < file->idx->maxh - file->hz_id->resolution_to; c++)
+        hz_bytes = hz_bytes + (var->hz_buffer->end_hz_index[c] - var->hz_buffer->start_hz_index[c] + 1) * bytes_per_hz_sample;
+    }
+  }
+
+  PIDX_memory_set(file->time, PIDX_MEMORY_CHUNK, chunk_bytes);
+  PIDX_memory_set(file->time, PIDX_MEMORY_HZ, hz_bytes);
+}
@@ -43,13 +43,16 @@
 #include "../../PIDX_inc.h"
 
 static int cvi = 0;
+static int levi = 0;
 static PIDX_return_code free_idx_rst_box(PIDX_io file);
+static void track_memory(PIDX_io file, int with_staging_buffers);
 
 // Initialiazation of metadata and creation of buffers for restructuring phase
 PIDX_return_code idx_restructure_setup(PIDX_io file, int svi, int evi)
 {
   PIDX_time time = file->time;
   cvi = svi;
+  levi = evi;
 
   // Initialize the restructuring phase
   time->rst_init_start[cvi] = PIDX_get_time();
@@ -59,11 +62,46 @@ PIDX_return_code idx_restructure_setup(PIDX_io file, int svi, int evi)
 
   // Populates the relevant meta-data
   time->rst_meta_data_create_start[cvi] = PIDX_get_time();
+
+  // steady state io reuses the plan of the previous flush (and skips gathering all the patch extents),
+  // but only if the decomposition has not changed on any process
+  PIDX_idx_rst_plan_list plan_list = NULL;
+  int reuse = 0;
+  if (file->idx->steady_state_io == 1)
+  {
+    PIDX_idx_rst_plan_list *list = (file->meta_data_cache != NULL) ? &file->meta_data_cache->idx_rst_plan : &file->idx->idx_rst_plan;
+    if (*list == NULL)
+    {
+      *list = malloc(sizeof(*(*list)));
+      memset(*list, 0, sizeof(*(*list)));
+    }
+    plan_list = *list;
+
+    reuse = (PIDX_idx_rst_plan_find(plan_list, file->idx_rst_id) != NULL);
+    if (MPI_Allreduce(MPI_IN_PLACE, &reuse, 1, MPI_INT, MPI_MIN, file->idx_c->simulation_comm) != MPI_SUCCESS)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
+
+    if (reuse == 1)
+      file->idx_rst_id->plan = PIDX_idx_rst_plan_find(plan_list, file->idx_rst_id);
+  }
+
   if (PIDX_idx_rst_meta_data_create(file->idx_rst_id) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
     return PIDX_err_rst;
   }
+
+  if (plan_list != NULL && reuse == 0)
+  {
+    if (PIDX_idx_rst_plan_store(plan_list, file->idx_rst_id) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
+  }
   time->rst_meta_data_create_end[cvi] = PIDX_get_time();
 
 
@@ -84,6 +122,7 @@ PIDX_return_code idx_restructure_setup(PIDX_io file, int svi, int evi)
   }
   time->rst_buffer_end[cvi] = PIDX_get_time();
 
+  track_memory(file, 1);
 
   return PIDX_success;
 }
@@ -122,6 +161,8 @@ PIDX_return_code idx_restructure(PIDX_io file, int mode)
       ret = PIDX_idx_rst_buf_destroy(file->idx_rst_id);
       if (ret != PIDX_success) {fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__); return PIDX_err_rst;}
       time->rst_buff_agg_free_end[cvi] = PIDX_get_time();
+
+      track_memory(file, 0);
     }
   }
 
@@ -215,6 +256,9 @@ PIDX_return_code idx_restructure_cleanup(PIDX_io file)
   PIDX_idx_rst_finalize(file->idx_rst_id);
   free_idx_rst_box(file);
 
+  // the io is done with the simulation patches as well
+  PIDX_memory_set(time, PIDX_MEMORY_RST, 0);
+  PIDX_memory_set(time, PIDX_MEMORY_SIM, 0);
 
   time->rst_cleanup_end[cvi] = PIDX_get_time();
 
@@ -279,6 +323,213 @@ PIDX_return_code free_restructured_communicators(PIDX_io file)
 }
 
 
+PIDX_return_code idx_restructure_reduced_resolution_setup(PIDX_io file, int svi, int evi)
+{
+  if (file->idx_b->reduced_resolution_factor <= 0)
+    return PIDX_success;
+
+  // The levels left out are the last ones of the bitstring of the dataset at full resolution
+  if (set_rst_box_size_for_write(file, svi) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_rst;
+  }
+
+  if (populate_bit_string(file, PIDX_WRITE) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_rst;
+  }
+  free_idx_rst_box(file);
+
+  // at least one level after the V is kept
+  int maxh = strlen(file->idx->bitSequence);
+  int factor = file->idx_b->reduced_resolution_factor;
+  if (factor > maxh - 2)
+    factor = maxh - 2;
+  if (factor <= 0)
+    return PIDX_success;
+
+  // every level left out halves the samples along its axis
+  uint64_t stride[PIDX_MAX_DIMENSIONS] = {1, 1, 1};
+  for (int m = maxh - factor; m < maxh; m++)
+    stride[file->idx->bitSequence[m] - '0'] = stride[file->idx->bitSequence[m] - '0'] * 2;
+
+  file->reduced_resolution_factor = file->idx_b->reduced_resolution_factor;
+  memcpy(file->full_bounds, file->idx->bounds, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  memcpy(file->full_box_bounds, file->idx->box_bounds, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  memcpy(file->full_partition_size, file->idx->partition_size, PIDX_MAX_DIMENSIONS * sizeof(uint32_t));
+
+  // the sample (x, y, z) of the coarse dataset is the sample (x, y, z) * stride of the full resolution one
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    file->idx->bounds[d] = (file->idx->bounds[d] + stride[d] - 1) / stride[d];
+    file->idx->box_bounds[d] = (file->idx->box_bounds[d] + stride[d] - 1) / stride[d];
+    file->idx->partition_size[d] = (file->idx->partition_size[d] > stride[d]) ? file->idx->partition_size[d] / stride[d] : 1;
+  }
+
+  // same block size rule as PIDX_file_create, applied to the coarse volume
+  file->full_bits_per_block = file->idx->bits_per_block;
+  uint64_t coarse_volume = file->idx->bounds[0] * file->idx->bounds[1] * file->idx->bounds[2];
+  if (coarse_volume < file->idx->samples_per_block)
+  {
+    file->idx->samples_per_block = getPowerOf2(coarse_volume) >> 1;
+    file->idx->bits_per_block = getNumBits(file->idx->samples_per_block) - 1;
+    if (file->idx->bits_per_block <= 0)
+    {
+      file->idx->bits_per_block = 0;
+      file->idx->samples_per_block = 1;
+    }
+  }
+
+  file->full_patch_count = malloc((evi - svi) * sizeof(*file->full_patch_count));
+  file->full_patch = malloc((evi - svi) * sizeof(*file->full_patch));
+
+  for (int v = svi; v < evi; v++)
+  {
+    PIDX_variable var = file->idx->variable[v];
+    int bytes_per_sample = (var->bpv / 8) * var->vps;
+
+    file->full_patch_count[v - svi] = var->sim_patch_count;
+    file->full_patch[v - svi] = malloc(var->sim_patch_count * sizeof(*file->full_patch[v - svi]));
+    memcpy(file->full_patch[v - svi], var->sim_patch, var->sim_patch_count * sizeof(*file->full_patch[v - svi]));
+
+    int patch_count = 0;
+    for (int p = 0; p < file->full_patch_count[v - svi]; p++)
+    {
+      PIDX_patch full = file->full_patch[v - svi][p];
+
+      // samples of the patch on the coarse lattice
+      uint64_t first[PIDX_MAX_DIMENSIONS];
+      uint64_t count[PIDX_MAX_DIMENSIONS];
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        first[d] = ((full->offset[d] + stride[d] - 1) / stride[d]) * stride[d];
+        count[d] = (full->offset[d] + full->size[d] > first[d]) ? (full->offset[d] + full->size[d] - first[d] + stride[d] - 1) / stride[d] : 0;
+      }
+      if (count[0] * count[1] * count[2] == 0)
+        continue;
+
+      PIDX_patch coarse = malloc(sizeof(*coarse));
+      memcpy(coarse, full, sizeof(*coarse));
+      coarse->buffer = malloc(count[0] * count[1] * count[2] * bytes_per_sample);
+      for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        coarse->offset[d] = first[d] / stride[d];
+        coarse->size[d] = count[d];
+      }
+
+      // strided gather of the patch, in the layout of the variable
+      uint64_t *n = full->size;
+      uint64_t index = 0;
+      for (uint64_t k = 0; k < count[2]; k++)
+        for (uint64_t j = 0; j < count[1]; j++)
+          for (uint64_t i = 0; i < count[0]; i++)
+          {
+            uint64_t x = first[0] - full->offset[0] + i * stride[0];
+            uint64_t y = first[1] - full->offset[1] + j * stride[1];
+            uint64_t z = first[2] - full->offset[2] + k * stride[2];
+
+            uint64_t src, dst;
+            if (var->data_layout == PIDX_column_major)
+            {
+              src = (n[2] * n[1] * x) + (n[2] * y) + z;
+              dst = (count[2] * count[1] * i) + (count[2] * j) + k;
+            }
+            else
+            {
+              src = (n[0] * n[1] * z) + (n[0] * y) + x;
+              dst = index;
+            }
+            memcpy(coarse->buffer + dst * bytes_per_sample, full->buffer + src * bytes_per_sample, bytes_per_sample);
+            index++;
+          }
+
+      var->sim_patch[patch_count++] = coarse;
+    }
+    var->sim_patch_count = patch_count;
+  }
+
+  // the coarse dataset is written at its full resolution
+  file->idx_b->reduced_resolution_factor = 0;
+
+  return PIDX_success;
+}
+
+
+
+PIDX_return_code idx_restructure_reduced_resolution_cleanup(PIDX_io file, int svi, int evi)
+{
+  if (file->reduced_resolution_factor == 0)
+    return PIDX_success;
+
+  for (int v = svi; v < evi; v++)
+  {
+    PIDX_variable var = file->idx->variable[v];
+    for (int p = 0; p < var->sim_patch_count; p++)
+    {
+      free(var->sim_patch[p]->buffer);
+      free(var->sim_patch[p]);
+    }
+
+    var->sim_patch_count = file->full_patch_count[v - svi];
+    memcpy(var->sim_patch, file->full_patch[v - svi], var->sim_patch_count * sizeof(*file->full_patch[v - svi]));
+    free(file->full_patch[v - svi]);
+  }
+  free(file->full_patch);
+  free(file->full_patch_count);
+  file->full_patch = NULL;
+  file->full_patch_count = NULL;
+
+  memcpy(file->idx->bounds, file->full_bounds, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  memcpy(file->idx->box_bounds, file->full_box_bounds, PIDX_MAX_DIMENSIONS * sizeof(uint64_t));
+  memcpy(file->idx->partition_size, file->full_partition_size, PIDX_MAX_DIMENSIONS * sizeof(uint32_t));
+  file->idx->bits_per_block = file->full_bits_per_block;
+  file->idx->samples_per_block = (uint64_t)1 << file->full_bits_per_block;
+
+  file->idx_b->reduced_resolution_factor = file->reduced_resolution_factor;
+  file->reduced_resolution_factor = 0;
+
+  return PIDX_success;
+}
+
+
+
+// Bytes of the simulation patches and of the restructuring buffers of the variables being restructured
+static void track_memory(PIDX_io file, int with_staging_buffers)
+{
+  uint64_t sim_bytes = 0, rst_bytes = 0;
+  for (int v = cvi; v <= levi; v++)
+  {
+    PIDX_variable var = file->idx->variable[v];
+    uint64_t bytes_per_sample = (var->bpv / 8) * var->vps;
+
+    for (int p = 0; p < var->sim_patch_count; p++)
+      sim_bytes = sim_bytes + var->sim_patch[p]->size[0] * var->sim_patch[p]->size[1] * var->sim_patch[p]->size[2] * bytes_per_sample;
+
+    if (var->restructured_super_patch_count != 1)
+      continue;
+
+    PIDX_patch out_patch = var->restructured_super_patch->restructured_patch;
+    rst_bytes = rst_bytes + out_patch->size[0] * out_patch->size[1] * out_patch->size[2] * bytes_per_sample;
+
+    // the patches received from the other processes, before they are combined into the super patch
+    if (with_staging_buffers == 1)
+    {
+      for (uint32_t j = 0; j < var->restructured_super_patch->patch_count; j++)
+      {
+        PIDX_patch patch = var->restructured_super_patch->patch[j];
+        rst_bytes = rst_bytes + patch->size[0] * patch->size[1] * patch->size[2] * bytes_per_sample;
+      }
+    }
+  }
+
+  PIDX_memory_set(file->time, PIDX_MEMORY_SIM, sim_bytes);
+  PIDX_memory_set(file->time, PIDX_MEMORY_RST, rst_bytes);
+}
+
+
+
 static PIDX_return_code free_idx_rst_box(PIDX_io file)
 {
   uint64_t *rgp = file->restructured_grid->total_patch_count;
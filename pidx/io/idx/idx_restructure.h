@@ -96,6 +96,32 @@ PIDX_return_code idx_restructure_forced_read(PIDX_io file, int svi, int evi);
 
 
 
+///
+/// \brief idx_restructure_reduced_resolution_setup With a resolution set on a file being written, leaves out the
+/// finest levels before restructuring: every simulation patch is replaced by its samples on the coarser lattice
+/// (a strided gather), and the dataset becomes the coarse grid whose bitstring is the full one without its last
+/// levels. Restructuring, hz encoding and aggregation then only handle the levels kept, and the .idx file records
+/// the coarse box and the truncated bitstring.
+/// \param file
+/// \param svi
+/// \param evi
+/// \return
+///
+PIDX_return_code idx_restructure_reduced_resolution_setup(PIDX_io file, int svi, int evi);
+
+
+
+///
+/// \brief idx_restructure_reduced_resolution_cleanup Restores the full resolution patches and bounds
+/// \param file
+/// \param svi
+/// \param evi
+/// \return
+///
+PIDX_return_code idx_restructure_reduced_resolution_cleanup(PIDX_io file, int svi, int evi);
+
+
+
 PIDX_return_code idx_restructure_rst_comm_create(PIDX_io file, int svi);
 
 
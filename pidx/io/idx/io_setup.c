@@ -42,6 +42,8 @@
 
 #include "../../PIDX_inc.h"
 
+static void fit_pack_to_memory_budget(PIDX_io file, int svi, int evi);
+
 
 PIDX_return_code select_io_mode(PIDX_io file)
 {
@@ -143,5 +145,90 @@ PIDX_return_code find_agg_level(PIDX_io file, int svi, int evi)
   //if (file->idx_c->partition_rank == 0)
   //  fprintf(stderr, "agg level %d pipe length %d\n", file->idx_b->agg_level, file->idx->variable_pipe_length);
 
+  // With a memory budget, fewer variables are worked at once, and then fewer levels are aggregated
+  if (file->idx->memory_budget != 0)
+    fit_pack_to_memory_budget(file, svi, evi);
+
   return PIDX_success;
 }
+
+
+
+static void fit_pack_to_memory_budget(PIDX_io file, int svi, int evi)
+{
+  // bytes held for the whole flush (simulation patches and restructured super patches), estimates of the
+  // bytes of one variable of a pack (chunked super patch and HZ buffers) and bytes per sample
+  uint64_t bytes[4] = {0, 0, 0, 0};
+  bytes[0] = file->time->memory[PIDX_MEMORY_SIM] + file->time->memory[PIDX_MEMORY_RST];
+
+  uint64_t *cs = file->idx->chunk_size;
+  for (int v = svi; v < evi; v++)
+  {
+    PIDX_variable var = file->idx->variable[v];
+    if (var->restructured_super_patch_count != 1)
+      continue;
+
+    uint64_t bytes_per_sample = (var->bpv / 8) * var->vps;
+    uint64_t *size = var->restructured_super_patch->restructured_patch->size;
+
+    uint64_t chunk_bytes = ((size[0] + cs[0] - 1) / cs[0]) * cs[0] * ((size[1] + cs[1] - 1) / cs[1]) * cs[1] * ((size[2] + cs[2] - 1) / cs[2]) * cs[2] * bytes_per_sample;
+    uint64_t hz_bytes = getPowerOf2(size[0]) * getPowerOf2(size[1]) * getPowerOf2(size[2]) * bytes_per_sample / file->idx->compression_factor;
+
+    if (chunk_bytes > bytes[1])
+      bytes[1] = chunk_bytes;
+    if (hz_bytes > bytes[2])
+      bytes[2] = hz_bytes;
+    if (bytes_per_sample > bytes[3])
+      bytes[3] = bytes_per_sample;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, bytes, 4, MPI_UINT64_T, MPI_MAX, file->idx_c->partition_comm);
+
+  // an aggregator holds the blocks of one file of one variable, and a process can be an aggregator
+  // in every aggregation group
+  int group_count = file->idx_b->file0_agg_group_count + file->idx_b->nfile0_agg_group_count;
+  uint64_t *group_bytes = malloc(group_count * sizeof(*group_bytes));
+  for (int j = 0; j < group_count; j++)
+  {
+    PIDX_block_layout layout = file->idx_b->block_layout_by_agg_group[j];
+    int max_block_count = 0;
+    for (int k = 0; k < layout->efc; k++)
+      if (layout->bcpf[layout->existing_file_index[k]] > max_block_count)
+        max_block_count = layout->bcpf[layout->existing_file_index[k]];
+
+    group_bytes[j] = max_block_count * file->idx->samples_per_block * cs[0] * cs[1] * cs[2] * bytes[3] / file->idx->compression_factor;
+  }
+
+  // with pipelined io the aggregation buffers of two packs are held at once
+  int agg_packs = (file->idx->pipelined_io == 1 && file->idx->async_io == 0) ? 2 : 1;
+
+  uint64_t need = 0;
+  while (1)
+  {
+    uint64_t agg_bytes = 0;
+    for (int j = file->idx_b->file0_agg_group_from_index; j < file->idx_b->agg_level; j++)
+      agg_bytes = agg_bytes + group_bytes[j];
+
+    // the chunked super patches are freed once encoded, before the aggregation buffers are created
+    uint64_t pack_count = file->idx->variable_pipe_length + 1;
+    uint64_t encode_bytes = pack_count * (bytes[1] + bytes[2]);
+    uint64_t agg_phase_bytes = pack_count * bytes[2] + agg_packs * agg_bytes;
+    need = bytes[0] + ((encode_bytes > agg_phase_bytes) ? encode_bytes : agg_phase_bytes);
+    if (need <= file->idx->memory_budget)
+      break;
+
+    if (file->idx->variable_pipe_length > 0)
+      file->idx->variable_pipe_length--;
+    else if (file->idx_b->agg_level > file->idx_b->file0_agg_group_from_index)
+      file->idx_b->agg_level--;
+    else
+      break;
+  }
+  free(group_bytes);
+
+  // the peak of the restructuring phase is already known
+  if (file->time->memory_high_water_mark > need)
+    need = file->time->memory_high_water_mark;
+
+  if (need > file->idx->memory_budget && file->idx_c->partition_rank == 0)
+    fprintf(stderr, "Warning: memory budget of %llu bytes exceeded, a process needs about %llu bytes\n", (unsigned long long)file->idx->memory_budget, (unsigned long long)need);
+}
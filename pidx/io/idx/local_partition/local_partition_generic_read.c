@@ -40,8 +40,79 @@
  */
 #include "../../../PIDX_inc.h"
 
+// Meta data of a partition, parsed once per read from its .idx file
+struct local_partition_struct
+{
+  int exists;
+  int color;
+  uint32_t partition_size[PIDX_MAX_DIMENSIONS];
+  uint32_t partition_offset[PIDX_MAX_DIMENSIONS];
+  int bits_per_block;
+  char bitSequence[512];
+  char filename_partition[1024];
+  char filename_template_partition[1024];   /// filename template of the current time step
+};
+typedef struct local_partition_struct local_partition;
+
+
+// A binary file of a partition, opened once per read, with its header
+struct binary_file_struct
+{
+  int partition;
+  int file_number;
+  MPI_File fp;
+  uint32_t *headers;
+};
+typedef struct binary_file_struct binary_file;
+
+
+// Samples of a block that fall in the box, as runs contiguous both in the block and in the box
+struct block_span_struct
+{
+  uint32_t block_offset;    /// First sample of the run in the block
+  uint32_t count;           /// Number of samples in the run
+  uint64_t box_offset;      /// First sample of the run in the box
+};
+typedef struct block_span_struct block_span;
+
+
+// A block that intersects the box, with its spans
+struct box_block_struct
+{
+  int block_number;
+  uint64_t span_start;      /// First span of the block
+  uint64_t span_count;      /// Number of spans of the block
+};
+typedef struct box_block_struct box_block;
+
+
+// A block read, sorted by file and file offset to merge adjacent reads
+struct block_read_struct
+{
+  int file_index;           /// Index of the binary file in the open files
+  uint64_t offset;          /// Offset of the block in the file
+  uint64_t size;            /// Size of the block in the file
+  int box_block_index;      /// Block of the box
+};
+typedef struct block_read_struct block_read;
+
+
+struct open_files_struct
+{
+  int count;
+  binary_file *file;
+};
+typedef struct open_files_struct open_files;
+
+
 static PIDX_return_code parse_local_partition_idx_file(PIDX_io file, int partition_index);
-static PIDX_return_code read_block(PIDX_io file, int vi, int p, int block_number, uint64_t *patch_offset, uint64_t *patch_size, unsigned char* patch_buffer);
+static PIDX_return_code parse_all_partitions(PIDX_io file, local_partition *partition, int partition_count);
+static void apply_partition(PIDX_io file, local_partition *partition);
+static PIDX_return_code find_box_blocks(PIDX_io file, uint64_t *box_offset, uint64_t *box_size, box_block **blocks, int *block_count, block_span **spans);
+static PIDX_return_code read_box_blocks(PIDX_io file, open_files *files, int partition, int vi, box_block *blocks, int block_count, block_span *spans, unsigned char* box_buffer);
+static int open_binary_file(PIDX_io file, open_files *files, int partition, int file_number);
+static PIDX_return_code close_binary_files(open_files *files);
+static int compare_block_reads(const void *a, const void *b);
 
 
 PIDX_return_code PIDX_local_partition_idx_generic_read(PIDX_io file, int svi, int evi)
@@ -51,9 +122,9 @@ PIDX_return_code PIDX_local_partition_idx_generic_read(PIDX_io file, int svi, in
   // If an intersection is found, find the intersection bounding box
   // and make box query in that particular partition.
   // The box query is performed by finding out which idx block are present
-  // corresponding to the intersection box, make those reads, and
-  // iterate through the elements of the block and if the sample is in the
-  // box, copy it to the patch buffer.
+  // corresponding to the intersection box, and where their samples go in the box.
+  // The blocks are then read for every variable (adjacent blocks in one read) and
+  // scattered to the box.
 
 
   // Use this function to compute maxh and also the maximum number of files
@@ -63,156 +134,521 @@ PIDX_return_code PIDX_local_partition_idx_generic_read(PIDX_io file, int svi, in
     return PIDX_err_file;
   }
 
-  for (uint32_t si = svi; si < evi; si++)
+  PIDX_return_code ret = PIDX_success;
+  box_block *blocks = NULL;
+  block_span *spans = NULL;
+  unsigned char* intersected_box_buffer = NULL;
+
+  // The binary files are opened (and their header read) once
+  open_files files;
+  memset(&files, 0, sizeof(files));
+
+  // The partition .idx files are parsed once for all the patches and variables
+  int partition_count = file->idx->partition_count[0] * file->idx->partition_count[1] * file->idx->partition_count[2];
+  local_partition *partition = malloc(partition_count * sizeof(*partition));
+  memset(partition, 0, partition_count * sizeof(*partition));
+  if (parse_all_partitions(file, partition, partition_count) != PIDX_success)
   {
-    PIDX_variable var = file->idx->variable[si];
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    ret = PIDX_err_file;
+    goto cleanup;
+  }
 
-    // Iterate through all the patches
-    for (uint32_t p = 0; p < file->idx->variable[si]->sim_patch_count; p++)
+  // All the variables share the patches of the first one
+  PIDX_variable var0 = file->idx->variable[svi];
+
+  // Iterate through all the patches
+  for (uint32_t p = 0; p < var0->sim_patch_count; p++)
+  {
+    // for every patch iterate through all the partitions
+    for (uint32_t par = 0; par < partition_count; par++)
     {
-      // for every patch iterate through all the partitions
-      for (uint32_t par = 0; par < file->idx->partition_count[0] * file->idx->partition_count[1] * file->idx->partition_count[2]; par++)
+      // If the particular partition does not exist then move to the next partition
+      if (partition[par].exists == 0)
+        continue;
+
+      apply_partition(file, &partition[par]);
+
+      // Checking if the simulation patch intersects with the partition
+      int d = 0, check_bit = 0;
+      for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+        check_bit = check_bit || (var0->sim_patch[p]->offset[d] + var0->sim_patch[p]->size[d] - 1) < file->idx->partition_offset[d] || (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) < var0->sim_patch[p]->offset[d];
+
+      // if the patch does not intersect with the partition
+      if (check_bit)
+        continue;
+
+      // find intersection bounding box
+      uint64_t intersected_box_offset[PIDX_MAX_DIMENSIONS];
+      uint64_t intersected_box_size[PIDX_MAX_DIMENSIONS];
+
+      for (uint32_t d = 0; d < PIDX_MAX_DIMENSIONS; d++)
       {
-        // If the particular partition does not exist then move to the next partition
-        if (parse_local_partition_idx_file(file, par) != PIDX_success)
-            continue;
-
-        // populate the local partition template using the current time step index
-        char dirname[1024], basename[1024];
-        VisusSplitFilename(file->idx->filename_template_partition, dirname, basename);
-        sprintf(file->idx->filename_template_partition, "%s/time%09d/%s", dirname, file->idx->current_time_step, basename );
-
-        // Checking if the simulation patch intersects with the partition
-        int d = 0, check_bit = 0;
-        for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-          check_bit = check_bit || (var->sim_patch[p]->offset[d] + var->sim_patch[p]->size[d] - 1) < file->idx->partition_offset[d] || (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) < var->sim_patch[p]->offset[d];
-
-        // if the patch intersects with the partition
-        if (!check_bit)
+        if (var0->sim_patch[p]->offset[d] <= file->idx->partition_offset[d] && (var0->sim_patch[p]->offset[d] + var0->sim_patch[p]->size[d] - 1) <= (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1))
+        {
+          intersected_box_offset[d] = file->idx->partition_offset[d];
+          intersected_box_size[d] = (var0->sim_patch[p]->offset[d] + var0->sim_patch[p]->size[d] - 1) - file->idx->partition_offset[d] + 1;
+        }
+        else if (file->idx->partition_offset[d] <= var0->sim_patch[p]->offset[d] && (var0->sim_patch[p]->offset[d] + var0->sim_patch[p]->size[d] - 1) >= (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1))
+        {
+          intersected_box_offset[d] = var0->sim_patch[p]->offset[d];
+          intersected_box_size[d] = (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) - var0->sim_patch[p]->offset[d] + 1;
+        }
+        else if (( file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) <= (var0->sim_patch[p]->offset[d] + var0->sim_patch[p]->size[d] - 1) && file->idx->partition_offset[d] >= var0->sim_patch[p]->offset[d])
         {
-          // find intersection bounding box
-          uint64_t intersected_box_offset[PIDX_MAX_DIMENSIONS];
-          uint64_t intersected_box_size[PIDX_MAX_DIMENSIONS];
+          intersected_box_offset[d] = file->idx->partition_offset[d];
+          intersected_box_size[d] = file->idx->partition_size[d];
+        }
+        else if (( var0->sim_patch[p]->offset[d] + var0->sim_patch[p]->size[d] - 1) <= (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) && var0->sim_patch[p]->offset[d] >= file->idx->partition_offset[d])
+        {
+          intersected_box_offset[d] = var0->sim_patch[p]->offset[d];
+          intersected_box_size[d] = var0->sim_patch[p]->size[d];
+        }
 
-          for (uint32_t d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-          {
-            if (var->sim_patch[p]->offset[d] <= file->idx->partition_offset[d] && (var->sim_patch[p]->offset[d] + var->sim_patch[p]->size[d] - 1) <= (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1))
-            {
-              intersected_box_offset[d] = file->idx->partition_offset[d];
-              intersected_box_size[d] = (var->sim_patch[p]->offset[d] + var->sim_patch[p]->size[d] - 1) - file->idx->partition_offset[d] + 1;
-            }
-            else if (file->idx->partition_offset[d] <= var->sim_patch[p]->offset[d] && (var->sim_patch[p]->offset[d] + var->sim_patch[p]->size[d] - 1) >= (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1))
-            {
-              intersected_box_offset[d] = var->sim_patch[p]->offset[d];
-              intersected_box_size[d] = (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) - var->sim_patch[p]->offset[d] + 1;
-            }
-            else if (( file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) <= (var->sim_patch[p]->offset[d] + var->sim_patch[p]->size[d] - 1) && file->idx->partition_offset[d] >= var->sim_patch[p]->offset[d])
-            {
-              intersected_box_offset[d] = file->idx->partition_offset[d];
-              intersected_box_size[d] = file->idx->partition_size[d];
-            }
-            else if (( var->sim_patch[p]->offset[d] + var->sim_patch[p]->size[d] - 1) <= (file->idx->partition_offset[d] + file->idx->partition_size[d] - 1) && var->sim_patch[p]->offset[d] >= file->idx->partition_offset[d])
-            {
-              intersected_box_offset[d] = var->sim_patch[p]->offset[d];
-              intersected_box_size[d] = var->sim_patch[p]->size[d];
-            }
-
-            intersected_box_offset[d] = intersected_box_offset[d] - file->idx->partition_offset[d];
-          }
+        intersected_box_offset[d] = intersected_box_offset[d] - file->idx->partition_offset[d];
+      }
 
-          // intersection bounding box
-          int bounding_box[2][5] = {{0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}};
-          for (uint32_t i = 0; i < PIDX_MAX_DIMENSIONS; i++)
-          {
-            bounding_box[0][i] = intersected_box_offset[i];
-            bounding_box[1][i] = intersected_box_offset[i] + intersected_box_size[i];
-          }
+      // the blocks of the intersection box and where their samples go are the same for all the variables
+      int block_count = 0;
+      if (find_box_blocks(file, intersected_box_offset, intersected_box_size, &blocks, &block_count, &spans) != PIDX_success)
+      {
+        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+        ret = PIDX_err_file;
+        goto cleanup;
+      }
 
-          // allocate buffer to hold data corresponding to the intersection bounding box
-          int bytes_for_datatype = ((file->idx->variable[si]->bpv / 8) * file->idx->variable[si]->vps);
-          unsigned char* intersected_box_buffer = malloc(intersected_box_size[0] * intersected_box_size[1] * intersected_box_size[2] * bytes_for_datatype);
+      // Adjust the intersection box to the global index space
+      uint64_t global_box_offset[PIDX_MAX_DIMENSIONS];
+      for (uint32_t d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+        global_box_offset[d] = intersected_box_offset[d] + file->idx->partition_offset[d];
 
-          // For the intersection bounding box, find out what all idx box to query
-          PIDX_block_layout per_patch_local_block_layout = malloc(sizeof (*per_patch_local_block_layout));
-          memset(per_patch_local_block_layout, 0, sizeof (*per_patch_local_block_layout));
-          if (PIDX_blocks_initialize_layout(per_patch_local_block_layout, 0, file->idx->maxh, file->idx->maxh, file->idx->bits_per_block) != PIDX_success)
-          {
-            fprintf(stderr, "[%s] [%d ]Error in PIDX_blocks_initialize_layout", __FILE__, __LINE__);
-            return PIDX_err_file;
-          }
+      for (uint32_t si = svi; si < evi; si++)
+      {
+        PIDX_variable var = file->idx->variable[si];
 
-          if (PIDX_blocks_create_layout (bounding_box, file->idx->maxh, file->idx->bits_per_block,  file->idx->bitPattern, per_patch_local_block_layout, file->idx_b->reduced_resolution_factor) != PIDX_success)
+        // allocate buffer to hold data corresponding to the intersection bounding box
+        int bytes_for_datatype = ((var->bpv / 8) * var->vps);
+        intersected_box_buffer = malloc(intersected_box_size[0] * intersected_box_size[1] * intersected_box_size[2] * bytes_for_datatype);
+
+        if (read_box_blocks(file, &files, par, si, blocks, block_count, spans, intersected_box_buffer) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          ret = PIDX_err_io;
+          goto cleanup;
+        }
+
+        // copy the data from the intersected bounding box the the application patch
+        uint64_t index = 0, recv_o = 0, send_o = 0, send_c = 0;
+        for (uint64_t k1 = global_box_offset[2]; k1 < global_box_offset[2] + intersected_box_size[2]; k1++)
+        {
+          for (uint64_t j1 = global_box_offset[1]; j1 < global_box_offset[1] + intersected_box_size[1]; j1++)
           {
-            fprintf(stderr, "[%s] [%d ]Error in PIDX_blocks_create_layout", __FILE__, __LINE__);
-            return PIDX_err_file;
+            index = ((intersected_box_size[0])* (intersected_box_size[1]) * (k1 - global_box_offset[2])) + ((intersected_box_size[0]) * (j1 - global_box_offset[1]));
+            send_o = index * bytes_for_datatype;
+            send_c = (intersected_box_size[0]);
+            recv_o = (var->sim_patch[p]->size[0] * var->sim_patch[p]->size[1] * (k1 - var->sim_patch[p]->offset[2])) + (var->sim_patch[p]->size[0] * (j1 - var->sim_patch[p]->offset[1])) + (global_box_offset[0] - var->sim_patch[p]->offset[0]);
+
+            memcpy(var->sim_patch[p]->buffer + (recv_o * bytes_for_datatype), intersected_box_buffer + send_o, send_c * bytes_for_datatype);
           }
+        }
+        free(intersected_box_buffer);
+        intersected_box_buffer = NULL;
+      }
 
+      free(blocks);
+      free(spans);
+      blocks = NULL;
+      spans = NULL;
+    }
+  }
 
-          uint32_t ctr = 1;
-          uint32_t block_number = 0;
+cleanup:
+  free(intersected_box_buffer);
+  free(blocks);
+  free(spans);
+  free(partition);
 
-          // read the first block, the first block contains data from a lot of hz levels, so just make one accumulated read
-          if (read_block(file, si, p, block_number, intersected_box_offset, intersected_box_size, intersected_box_buffer) != PIDX_success)
-          {
-            fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-            return PIDX_err_io;
-          }
+  if (close_binary_files(&files) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
 
-          // Iterate through the blocks from HZ level file->idx->bits_per_block + 1 to per_patch_local_block_layout->resolution_to
-          for (uint32_t i = file->idx->bits_per_block + 1 ; i < per_patch_local_block_layout->resolution_to ; i++)
-          {
-            for (uint32_t j = 0 ; j < ctr ; j++)
-            {
-              if (per_patch_local_block_layout->hz_block_number_array[i][j] != 0)
-              {
-                block_number = per_patch_local_block_layout->hz_block_number_array[i][j];
-
-                // Iterating through all other blocks
-                if (read_block(file, si, p, block_number, intersected_box_offset, intersected_box_size, intersected_box_buffer) != PIDX_success)
-                {
-                  fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-                  return PIDX_err_io;
-                }
-              }
-            }
-            ctr = ctr * 2;
-          }
+  return ret;
+}
 
-          // With the reads completed, free the block bitmap
-          PIDX_blocks_free_layout(file->idx->bits_per_block, file->idx->maxh, per_patch_local_block_layout);
-          free(per_patch_local_block_layout);
 
-          // Adjust the intersection box to the global index space
-          for (uint32_t d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-            intersected_box_offset[d] = intersected_box_offset[d] + file->idx->partition_offset[d];
 
-          // copy the data from the intersected bounding box the the application patch
-          uint32_t index = 0, recv_o = 0, send_o = 0, send_c = 0;
-          for (uint32_t k1 = intersected_box_offset[2]; k1 < intersected_box_offset[2] + intersected_box_size[2]; k1++)
-          {
-            for (uint32_t j1 = intersected_box_offset[1]; j1 < intersected_box_offset[1] + intersected_box_size[1]; j1++)
-            {
-              for (uint32_t i1 = intersected_box_offset[0]; i1 < intersected_box_offset[0] + intersected_box_size[0]; i1 = i1 + intersected_box_size[0])
-              {
-                index = ((intersected_box_size[0])* (intersected_box_size[1]) * (k1 - intersected_box_offset[2])) + ((intersected_box_size[0]) * (j1 - intersected_box_offset[1])) + (i1 - intersected_box_offset[0]);
-                send_o = index * var->vps * (var->bpv/8);
-                send_c = (intersected_box_size[0]);
-                recv_o = (file->idx->variable[si]->sim_patch[p]->size[0] * file->idx->variable[si]->sim_patch[p]->size[1] * (k1 - file->idx->variable[si]->sim_patch[p]->offset[2])) + (file->idx->variable[si]->sim_patch[p]->size[0] * (j1 - file->idx->variable[si]->sim_patch[p]->offset[1])) + (i1 - file->idx->variable[si]->sim_patch[p]->offset[0]);
-
-                memcpy(file->idx->variable[si]->sim_patch[p]->buffer + (recv_o * var->vps * (var->bpv/8)), intersected_box_buffer + send_o, send_c * var->vps * (var->bpv/8));
-              }
-            }
-          }
-          free(intersected_box_buffer);
+static PIDX_return_code parse_all_partitions(PIDX_io file, local_partition *partition, int partition_count)
+{
+  for (int par = 0; par < partition_count; par++)
+  {
+    // If the particular partition does not exist then it is skipped by the reads
+    if (parse_local_partition_idx_file(file, par) != PIDX_success)
+      continue;
+
+    // populate the local partition template using the current time step index
+    char dirname[1024], basename[1024];
+    VisusSplitFilename(file->idx->filename_template_partition, dirname, basename);
+    sprintf(file->idx->filename_template_partition, "%s/time%09d/%s", dirname, file->idx->current_time_step, basename );
+
+    partition[par].exists = 1;
+    partition[par].color = file->idx_c->color;
+    partition[par].bits_per_block = file->idx->bits_per_block;
+    memcpy(partition[par].partition_size, file->idx->partition_size, sizeof(partition[par].partition_size));
+    memcpy(partition[par].partition_offset, file->idx->partition_offset, sizeof(partition[par].partition_offset));
+    memcpy(partition[par].bitSequence, file->idx->bitSequence, sizeof(partition[par].bitSequence));
+    memcpy(partition[par].filename_partition, file->idx->filename_partition, sizeof(partition[par].filename_partition));
+    memcpy(partition[par].filename_template_partition, file->idx->filename_template_partition, sizeof(partition[par].filename_template_partition));
+  }
+
+  return PIDX_success;
+}
+
+
+
+// Sets the meta data of the partition on the file, as parsing its .idx file would
+static void apply_partition(PIDX_io file, local_partition *partition)
+{
+  file->idx_c->color = partition->color;
+  memcpy(file->idx->partition_size, partition->partition_size, sizeof(partition->partition_size));
+  memcpy(file->idx->partition_offset, partition->partition_offset, sizeof(partition->partition_offset));
+
+  file->idx->bits_per_block = partition->bits_per_block;
+  file->idx->samples_per_block = (int)pow(2, file->idx->bits_per_block);
+
+  memcpy(file->idx->bitSequence, partition->bitSequence, sizeof(partition->bitSequence));
+  file->idx->maxh = strlen(file->idx->bitSequence);
+  for (uint32_t i = 0; i <= file->idx->maxh; i++)
+    file->idx->bitPattern[i] = RegExBitmaskBit(file->idx->bitSequence, i);
+
+  memcpy(file->idx->filename_partition, partition->filename_partition, sizeof(partition->filename_partition));
+  memcpy(file->idx->filename_template_partition, partition->filename_template_partition, sizeof(partition->filename_template_partition));
+
+  return;
+}
+
+
+
+// Finds the blocks of the current partition that intersect the box, and splits their samples that fall in the box
+// into spans. Hz_to_xyz is evaluated once per sample here instead of once per sample and variable.
+static PIDX_return_code find_box_blocks(PIDX_io file, uint64_t *box_offset, uint64_t *box_size, box_block **blocks, int *block_count, block_span **spans)
+{
+  // intersection bounding box
+  int bounding_box[2][5] = {{0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}};
+  for (uint32_t i = 0; i < PIDX_MAX_DIMENSIONS; i++)
+  {
+    bounding_box[0][i] = box_offset[i];
+    bounding_box[1][i] = box_offset[i] + box_size[i];
+  }
+
+  // For the intersection bounding box, find out what all idx box to query
+  PIDX_block_layout per_patch_local_block_layout = malloc(sizeof (*per_patch_local_block_layout));
+  memset(per_patch_local_block_layout, 0, sizeof (*per_patch_local_block_layout));
+  if (PIDX_blocks_initialize_layout(per_patch_local_block_layout, 0, file->idx->maxh, file->idx->maxh, file->idx->bits_per_block) != PIDX_success)
+  {
+    fprintf(stderr, "[%s] [%d ]Error in PIDX_blocks_initialize_layout", __FILE__, __LINE__);
+    free(per_patch_local_block_layout);
+    return PIDX_err_file;
+  }
+
+  if (PIDX_blocks_create_layout (bounding_box, file->idx->maxh, file->idx->bits_per_block,  file->idx->bitPattern, per_patch_local_block_layout, file->idx_b->reduced_resolution_factor) != PIDX_success)
+  {
+    fprintf(stderr, "[%s] [%d ]Error in PIDX_blocks_create_layout", __FILE__, __LINE__);
+    PIDX_blocks_free_layout(file->idx->bits_per_block, file->idx->maxh, per_patch_local_block_layout);
+    free(per_patch_local_block_layout);
+    return PIDX_err_file;
+  }
+
+  // the first block contains data from a lot of hz levels, it is always read
+  int max_block_count = 1;
+  uint32_t ctr = 1;
+  for (uint32_t i = file->idx->bits_per_block + 1 ; i < per_patch_local_block_layout->resolution_to ; i++)
+  {
+    max_block_count = max_block_count + ctr;
+    ctr = ctr * 2;
+  }
+
+  *blocks = malloc(max_block_count * sizeof(*(*blocks)));
+  (*blocks)[0].block_number = 0;
+  *block_count = 1;
+
+  // Iterate through the blocks from HZ level file->idx->bits_per_block + 1 to per_patch_local_block_layout->resolution_to
+  ctr = 1;
+  for (uint32_t i = file->idx->bits_per_block + 1 ; i < per_patch_local_block_layout->resolution_to ; i++)
+  {
+    for (uint32_t j = 0 ; j < ctr ; j++)
+    {
+      if (per_patch_local_block_layout->hz_block_number_array[i][j] != 0)
+        (*blocks)[(*block_count)++].block_number = per_patch_local_block_layout->hz_block_number_array[i][j];
+    }
+    ctr = ctr * 2;
+  }
+
+  // With the block numbers known, free the block bitmap
+  PIDX_blocks_free_layout(file->idx->bits_per_block, file->idx->maxh, per_patch_local_block_layout);
+  free(per_patch_local_block_layout);
+
+  // the samples of the blocks that fall in the box, merged into spans
+  uint64_t span_count = 0;
+  uint64_t max_span_count = 1024;
+  *spans = malloc(max_span_count * sizeof(*(*spans)));
+
+  uint64_t xyz[PIDX_MAX_DIMENSIONS];
+  for (int b = 0; b < *block_count; b++)
+  {
+    (*blocks)[b].span_start = span_count;
+
+    for (uint64_t k = 0; k < file->idx->samples_per_block; k++)
+    {
+      uint64_t hz = ((*blocks)[b].block_number * file->idx->samples_per_block) + k;
+      Hz_to_xyz(file->idx->bitPattern, file->idx->maxh, hz, xyz);
+
+      // check if the sample in the block is within the box query
+      if ( ((xyz[0] < box_offset[0] || xyz[0] >= box_offset[0] + box_size[0]) || (xyz[1] < box_offset[1] || xyz[1] >= box_offset[1] + box_size[1]) || (xyz[2] < box_offset[2] || xyz[2] >= box_offset[2] + box_size[2]) ) )
+        continue;
+
+      uint64_t index = (box_size[0] * box_size[1] * (xyz[2] - box_offset[2])) + (box_size[0] * (xyz[1] - box_offset[1])) + (xyz[0] - box_offset[0]);
+
+      // extend the last span of the block if the sample follows it both in the block and in the box
+      if (span_count > (*blocks)[b].span_start)
+      {
+        block_span *last = &(*spans)[span_count - 1];
+        if (last->block_offset + last->count == k && last->box_offset + last->count == index)
+        {
+          last->count++;
+          continue;
         }
       }
+
+      if (span_count == max_span_count)
+      {
+        max_span_count = max_span_count * 2;
+        block_span *temp_spans = realloc(*spans, max_span_count * sizeof(*temp_spans));
+        if (temp_spans == NULL)
+        {
+          fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+          return PIDX_err_file;
+        }
+        *spans = temp_spans;
+      }
+
+      (*spans)[span_count].block_offset = k;
+      (*spans)[span_count].count = 1;
+      (*spans)[span_count].box_offset = index;
+      span_count++;
+    }
+
+    (*blocks)[b].span_count = span_count - (*blocks)[b].span_start;
+  }
+
+  return PIDX_success;
+}
+
+
+
+// Reads the blocks of the box for variable vi, merging the blocks that are adjacent in a file into one read
+static PIDX_return_code read_box_blocks(PIDX_io file, open_files *files, int partition, int vi, box_block *blocks, int block_count, block_span *spans, unsigned char* box_buffer)
+{
+  int large_offsets = PIDX_header_io_large_offsets(file->idx);
+  int bytes_for_datatype = ((file->idx->variable[vi]->bpv / 8) * file->idx->variable[vi]->vps);
+
+  PIDX_return_code ret = PIDX_err_io;
+  unsigned char* read_buffer = NULL;
+  block_read *reads = malloc(block_count * sizeof(*reads));
+  for (int b = 0; b < block_count; b++)
+  {
+    int file_number = blocks[b].block_number / file->idx->blocks_per_file;
+    int file_index = open_binary_file(file, files, partition, file_number);
+    if (file_index < 0)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      goto cleanup;
+    }
+
+    // use the header to find the offset in file that contains data corresponding to the block
+    uint32_t *headers = files->file[file_index].headers;
+    int block_index = (blocks[b].block_number % file->idx->blocks_per_file) + (file->idx->blocks_per_file * vi);
+    reads[b].file_index = file_index;
+    reads[b].offset = PIDX_header_io_get_block_offset(headers, block_index, large_offsets);
+    reads[b].size = PIDX_header_io_get_block_size(headers, block_index, large_offsets);
+    reads[b].box_block_index = b;
+    assert (reads[b].size != 0);
+  }
+
+  qsort(reads, block_count, sizeof(*reads), compare_block_reads);
+
+  int first = 0;
+  while (first < block_count)
+  {
+    // extend the read over the blocks that follow it in the same file
+    int last = first;
+    uint64_t read_size = reads[first].size;
+    while (last + 1 < block_count && reads[last + 1].file_index == reads[first].file_index && reads[last + 1].offset == reads[first].offset + read_size && read_size + reads[last + 1].size <= INT_MAX)
+    {
+      last++;
+      read_size = read_size + reads[last].size;
+    }
+
+    read_buffer = malloc(read_size);
+    if (read_buffer == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      goto cleanup;
+    }
+
+    MPI_Status status;
+    if (MPI_File_read_at(files->file[reads[first].file_index].fp, reads[first].offset, read_buffer, (int)read_size, MPI_BYTE, &status) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_read_at() failed.\n", (long long) reads[first].offset, __FILE__, __LINE__);
+      goto cleanup;
+    }
+
+    // copy the data from the block space to the box space
+    for (int r = first; r <= last; r++)
+    {
+      unsigned char *block_buffer = read_buffer + (reads[r].offset - reads[first].offset);
+      box_block *block = &blocks[reads[r].box_block_index];
+
+      for (uint64_t s = block->span_start; s < block->span_start + block->span_count; s++)
+        memcpy(box_buffer + (spans[s].box_offset * bytes_for_datatype), block_buffer + ((uint64_t)spans[s].block_offset * bytes_for_datatype), (uint64_t)spans[s].count * bytes_for_datatype);
     }
+
+    free(read_buffer);
+    read_buffer = NULL;
+    first = last + 1;
+  }
+
+  ret = PIDX_success;
+
+cleanup:
+  free(read_buffer);
+  free(reads);
+
+  return ret;
+}
+
+
+
+// Returns the index of the binary file in the open files, opening it and reading its header if needed
+static int open_binary_file(PIDX_io file, open_files *files, int partition, int file_number)
+{
+  for (int f = 0; f < files->count; f++)
+  {
+    if (files->file[f].partition == partition && files->file[f].file_number == file_number)
+      return f;
+  }
+
+  // populate the name of the binary file to read
+  char file_name[PATH_MAX];
+  if (generate_file_name(file->idx->blocks_per_file, file->idx->filename_template_partition, file_number, file_name, PATH_MAX) == 1)
+  {
+    fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
+    return -1;
   }
 
+  char directory_path[PATH_MAX];
+  memset(directory_path, 0, sizeof(directory_path));
+
+  char full_path_file_name[PATH_MAX];
+  int path_length = 0;
+  char *lastdir = strrchr(file->idx->filename, '/');
+  if (lastdir != NULL && file_name[0] == '.') { // if using relative paths use absolute path
+    strncpy(directory_path, file->idx->filename, lastdir - file->idx->filename + 1);
+    path_length = snprintf(full_path_file_name, sizeof(full_path_file_name), "%s/%s", directory_path,file_name);
+  }
+  else{
+    path_length = snprintf(full_path_file_name, sizeof(full_path_file_name), "%s", file_name);
+  }
+  if (path_length < 0 || path_length >= (int)sizeof(full_path_file_name))
+  {
+    fprintf(stderr, "[%s] [%d] path of file number %d is too long.\n", __FILE__, __LINE__, file_number);
+    return -1;
+  }
+
+  binary_file *temp_file = realloc(files->file, (files->count + 1) * sizeof(*temp_file));
+  if (temp_file == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+  files->file = temp_file;
+
+  binary_file *bf = &files->file[files->count];
+  bf->partition = partition;
+  bf->file_number = file_number;
+
+  // open the binary file
+  if (MPI_File_open(MPI_COMM_SELF, full_path_file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &bf->fp) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_open() file number %d filename %s failed.\n", __FILE__, __LINE__, file_number, full_path_file_name);
+    return -1;
+  }
+
+  // read the header
+  MPI_Status status;
+  int total_header_size = (10 + (10 * file->idx->blocks_per_file)) * sizeof (uint32_t) * file->idx->variable_count;
+  bf->headers = malloc(total_header_size);
+  memset(bf->headers, 0, total_header_size);
+
+  if (MPI_File_read_at(bf->fp, 0, bf->headers, total_header_size , MPI_BYTE, &status) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_read_at() failed for filename %s.\n", __FILE__, __LINE__, file_name);
+    MPI_File_close(&bf->fp);
+    free(bf->headers);
+    return -1;
+  }
+
+  int read_count = 0;
+  MPI_Get_count(&status, MPI_BYTE, &read_count);
+  if (read_count != total_header_size)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_read_at() failed. %d != %d\n", __FILE__, __LINE__, read_count, total_header_size);
+    MPI_File_close(&bf->fp);
+    free(bf->headers);
+    return -1;
+  }
+
+  files->count++;
+
+  return files->count - 1;
+}
+
+
+
+static PIDX_return_code close_binary_files(open_files *files)
+{
+  for (int f = 0; f < files->count; f++)
+  {
+    if (MPI_File_close(&files->file[f].fp) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_close() failed.\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+    free(files->file[f].headers);
+  }
+  free(files->file);
+
   return PIDX_success;
 }
 
 
+
+static int compare_block_reads(const void *a, const void *b)
+{
+  const block_read *ra = a;
+  const block_read *rb = b;
+
+  if (ra->file_index != rb->file_index)
+    return (ra->file_index < rb->file_index) ? -1 : 1;
+  if (ra->offset != rb->offset)
+    return (ra->offset < rb->offset) ? -1 : 1;
+
+  return 0;
+}
+
+
+
 static PIDX_return_code parse_local_partition_idx_file(PIDX_io file, int partition_index)
 {
   // Parse the partition idx file to get partition specific meta data
@@ -308,100 +744,3 @@ static PIDX_return_code parse_local_partition_idx_file(PIDX_io file, int partiti
 
   return PIDX_success;
 }
-
-
-static PIDX_return_code read_block(PIDX_io file, int vi, int p, int block_number, uint64_t* patch_offset, uint64_t* patch_size, unsigned char* patch_buffer)
-{
-  MPI_File fp = 0;
-  MPI_Status status;
-
-  // populate the name of the binary file to read
-  char file_name[PATH_MAX];
-  int file_number = block_number / file->idx->blocks_per_file;
-  if (generate_file_name(file->idx->blocks_per_file, file->idx->filename_template_partition, file_number, file_name, PATH_MAX) == 1)
-  {
-    fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
-    return PIDX_err_io;
-  }
-  
-  char *directory_path;
-
-  directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
-  memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
-
-  char full_path_file_name[PATH_MAX];
-  char *lastdir = strrchr(file->idx->filename, '/');
-  if (lastdir != NULL && file_name[0] == '.') { // if using relative paths use absolute path
-    strncpy(directory_path, file->idx->filename, lastdir - file->idx->filename + 1);
-    sprintf(full_path_file_name, "%s/%s", directory_path,file_name);
-  }
-  else{ 
-    sprintf(full_path_file_name, "%s", file_name);
-  }
-
-  // open the binary file
-  if (MPI_File_open(MPI_COMM_SELF, full_path_file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fp) != MPI_SUCCESS)
-  {
-    fprintf(stderr, "[%s] [%d] MPI_File_open() block number %d file number %d filename %s failed.\n", __FILE__, __LINE__, block_number, file_number, full_path_file_name);
-    return PIDX_err_io;
-  }
-
-  // read the header
-  uint32_t *headers;
-  int total_header_size = (10 + (10 * file->idx->blocks_per_file)) * sizeof (uint32_t) * file->idx->variable_count;
-  headers = malloc(total_header_size);
-  memset(headers, 0, total_header_size);
-
-  if (MPI_File_read_at(fp, 0, headers, total_header_size , MPI_BYTE, &status) != MPI_SUCCESS)
-  {
-    fprintf(stderr, "Data offset = [%s] [%d] MPI_File_write_at() failed for filename %s.\n", __FILE__, __LINE__, file_name);
-    return PIDX_err_io;
-  }
-
-  int read_count = 0;
-  MPI_Get_count(&status, MPI_BYTE, &read_count);
-  if (read_count != total_header_size)
-  {
-    fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed. %d != %dd\n", __FILE__, __LINE__, read_count, total_header_size);
-    return PIDX_err_io;
-  }
-
-  // use the header to find the offset in file that contains data corresponding to block_number
-  uint64_t data_offset = htonl(headers[12 + (( (block_number % file->idx->blocks_per_file) + (file->idx->blocks_per_file * vi))*10 )]);
-  uint64_t data_size = htonl(headers[14 + (( (block_number % file->idx->blocks_per_file) + (file->idx->blocks_per_file * vi))*10 )]);
-  assert (data_size != 0);
-
-  // read the data
-  int bytes_for_datatype = ((file->idx->variable[vi]->bpv / 8) * file->idx->variable[vi]->vps);
-  unsigned char* block_buffer = malloc(file->idx->samples_per_block * bytes_for_datatype);
-  if (MPI_File_read_at(fp, data_offset, block_buffer, data_size, MPI_BYTE, &status) != MPI_SUCCESS)
-  {
-    fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_write_at() failed for filename %s.\n", (long long)  data_offset, __FILE__, __LINE__, file_name);
-    return PIDX_err_io;
-  }
-
-  // copy the data from the block space to the box space
-  uint64_t xyz[PIDX_MAX_DIMENSIONS];
-  for (uint64_t k = 0; k < file->idx->samples_per_block; k++)
-  {
-    uint64_t hz = (block_number * file->idx->samples_per_block) + k;
-    Hz_to_xyz(file->idx->bitPattern, file->idx->maxh, hz, xyz);
-
-    // check if the sample in the block is within the box query
-    if ( ((xyz[0] < patch_offset[0] || xyz[0] >= patch_offset[0] + patch_size[0]) || (xyz[1] < patch_offset[1] || xyz[1] >= patch_offset[1] + patch_size[1]) || (xyz[2] < patch_offset[2] || xyz[2] >= patch_offset[2] + patch_size[2]) ) )
-      continue;
-
-    uint64_t index = (patch_size[0] * patch_size[1] * (xyz[2] - patch_offset[2])) + (patch_size[0] * (xyz[1] - patch_offset[1])) + (xyz[0] - patch_offset[0]);
-    memcpy(patch_buffer + (index * bytes_for_datatype), block_buffer + (k * bytes_for_datatype), bytes_for_datatype);
-
-  }
-
-  MPI_File_close(&fp);
-
-  // free buffers
-  free(headers);
-  free(block_buffer);
-  free(directory_path);
-
-  return PIDX_success;
-}
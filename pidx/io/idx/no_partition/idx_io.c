@@ -49,34 +49,44 @@ PIDX_return_code PIDX_idx_write(PIDX_io file, int svi, int evi)
   // Steps 5-14 apply to variables of the idx file
   // Steps 15-16 are cleanup steps applying on the entire idx file
 
+  // Step 0: With a reduced resolution, downsample the patches and write the coarse dataset of the levels kept
+  if (idx_restructure_reduced_resolution_setup(file, svi, evi) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_file;
+  }
+
+  // from here on the errors go through Step 17, which restores the full resolution dataset
+  PIDX_return_code ret = PIDX_err_file;
+
   // Step 1: Compute the restructuring box (grid) size
   // We need to identify the restructuring box size (super patch first because we directly use that to populate the
   // bitstring, which is first written out to the .idx file and used in almost every phase of IO
   if (set_rst_box_size_for_write(file, svi) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_file;
+    goto reduced_resolution_cleanup;
   }
 
   // Step 2: Setting the stage for restructuring (meta data)
   if (idx_restructure_setup(file, svi, evi - 1) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_file;
+    goto reduced_resolution_cleanup;
   }
 
   // Step 3: Perform data restructuring
   if (idx_restructure(file, PIDX_WRITE) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_file;
+    goto reduced_resolution_cleanup;
   }
 
   // Step 4: Group the processes holding the super patch into new communicator rst_comm
   if (idx_restructure_rst_comm_create(file, svi) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_file;
+    goto reduced_resolution_cleanup;
   }
 
   // proceed only if a process holds a superpatch, others just wait at completion of io
@@ -87,12 +97,15 @@ PIDX_return_code PIDX_idx_write(PIDX_io file, int svi, int evi)
     if (populate_block_layout_and_buffers(file, svi, evi, PIDX_WRITE, PIDX_IDX_IO) != PIDX_success)
     {
       fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-      return PIDX_err_file;
+      goto reduced_resolution_cleanup;
     }
 
     // variable_pipe_length is computed based on the configuration of the run. If there are enough number of processes
     // then all the variables are aggregated at once and then variable_pipe_length is (variable_count - 1), otherwise
     // the variables are worked in smaller packs.
+    // In pipelined mode (pipelined_io) the file io of a pack is only issued inside the loop, and completed after the
+    // next pack has been hz encoded and aggregated, so at most two packs of aggregation buffers are alive at once.
+    int pending_si = -1;
     for (uint32_t si = svi; si < evi; si = si + (file->idx->variable_pipe_length + 1))
     {
       uint32_t ei = ((si + file->idx->variable_pipe_length) >= (evi)) ? (evi - 1) : (si + file->idx->variable_pipe_length);
@@ -102,14 +115,14 @@ PIDX_return_code PIDX_idx_write(PIDX_io file, int svi, int evi)
       if (hz_encode_setup(file, si, ei) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        goto reduced_resolution_cleanup;
       }
 
       // Step 7: Perform HZ encoding
       if (hz_encode(file, PIDX_WRITE) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        goto reduced_resolution_cleanup;
       }
 
       // Step 8: This is not performed by default, it only happens when aggregation is
@@ -117,42 +130,83 @@ PIDX_return_code PIDX_idx_write(PIDX_io file, int svi, int evi)
       if (hz_io(file, PIDX_WRITE) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        goto reduced_resolution_cleanup;
       }
 
       // Step 9: Setup aggregation data buffers
       if (aggregation_setup(file, si, ei) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        goto reduced_resolution_cleanup;
       }
 
       // Step 10: Performs data aggregation
       if (aggregation(file, si, PIDX_WRITE) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        goto reduced_resolution_cleanup;
       }
 
-      // Step 11: Performs actual file io
-      if (file_io(file, si, PIDX_WRITE) != PIDX_success)
+      // with async_io the writes are never waited for inside the flush, so there is nothing to pipeline
+      if (file->idx->pipelined_io == 1 && file->idx->async_io == 0)
       {
-        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        // Step 11: Cleanup hz buffers and ids (the data now lives in the aggregation buffers)
+        if (hz_encode_cleanup(file) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          goto reduced_resolution_cleanup;
+        }
+
+        // Step 12: complete the file io of the previous pack and free its aggregation buffers
+        if (pending_si != -1)
+        {
+          if (file_io_wait(file, pending_si) != PIDX_success || aggregation_cleanup(file, pending_si) != PIDX_success)
+          {
+            fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+            goto reduced_resolution_cleanup;
+          }
+        }
+
+        // Step 13: issue the file io of this pack, it completes while the next pack is encoded and aggregated
+        if (file_io_async(file, si) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          goto reduced_resolution_cleanup;
+        }
+        pending_si = si;
       }
-
-      // Step 12: free aggregation buffers
-      if (aggregation_cleanup(file, si) != PIDX_success)
+      else
       {
-        fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        // Step 11: Performs actual file io (only issued with async_io, it completes at the next flush or at close)
+        if ((file->idx->async_io == 1 ? file_io_deferred(file, si) : file_io(file, si, PIDX_WRITE)) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          goto reduced_resolution_cleanup;
+        }
+
+        // Step 12: free aggregation buffers
+        if (aggregation_cleanup(file, si) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          goto reduced_resolution_cleanup;
+        }
+
+        // Step 13: Cleanup hz buffers and ids
+        if (hz_encode_cleanup(file) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          goto reduced_resolution_cleanup;
+        }
       }
+    }
 
-      // Step 13: Cleanup hz buffers and ids
-      if (hz_encode_cleanup(file) != PIDX_success)
+    // Drain the pipeline: complete the file io of the last pack
+    if (pending_si != -1)
+    {
+      if (file_io_wait(file, pending_si) != PIDX_success || aggregation_cleanup(file, pending_si) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-        return PIDX_err_file;
+        goto reduced_resolution_cleanup;
       }
     }
 
@@ -160,7 +214,7 @@ PIDX_return_code PIDX_idx_write(PIDX_io file, int svi, int evi)
     if (destroy_block_layout_and_buffers(file, svi, evi) != PIDX_success)
     {
       fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-      return PIDX_err_file;
+      goto reduced_resolution_cleanup;
     }
   }
 
@@ -168,17 +222,27 @@ PIDX_return_code PIDX_idx_write(PIDX_io file, int svi, int evi)
   if (free_restructured_communicators(file) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_file;
+    goto reduced_resolution_cleanup;
   }
 
   // Step 16: cleanup restructuring buffers
   if (idx_restructure_cleanup(file) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    goto reduced_resolution_cleanup;
+  }
+
+  ret = PIDX_success;
+
+  // Step 17: back to the full resolution patches and bounds
+reduced_resolution_cleanup:
+  if (idx_restructure_reduced_resolution_cleanup(file, svi, evi) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
     return PIDX_err_file;
   }
 
-  return PIDX_success;
+  return ret;
 }
 
 
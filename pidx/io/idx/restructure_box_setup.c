@@ -43,6 +43,7 @@
 static PIDX_return_code populate_restructured_grid(PIDX_io file);
 static void guess_restructured_box_size(PIDX_io file, int svi);
 static void adjust_restructured_box_size(PIDX_io file);
+static void fit_restructured_box_to_memory_budget(PIDX_io file, int svi);
 static PIDX_return_code set_reg_patch_size_from_bit_string(PIDX_io file);
 
 
@@ -60,6 +61,9 @@ PIDX_return_code set_rst_box_size_for_write(PIDX_io file, int svi)
   // number of box always less than or equal to total number of processes
   adjust_restructured_box_size(file);
 
+  // With a memory budget, the box is made smaller (more processes hold a super patch) until it fits
+  fit_restructured_box_to_memory_budget(file, svi);
+
   // Assign rank to each of the restructured super patch
   if (populate_restructured_grid(file) != PIDX_success)
   {
@@ -164,6 +168,58 @@ static void adjust_restructured_box_size(PIDX_io file)
 
 
 
+static void fit_restructured_box_to_memory_budget(PIDX_io file, int svi)
+{
+  if (file->idx->memory_budget == 0)
+    return;
+
+  // bytes per sample of all the variables of the flush and of the largest one, and the bytes of the
+  // simulation patches of the process holding the most
+  uint64_t bytes[3] = {0, 0, 0};
+  for (uint32_t v = svi; v < file->idx->variable_count; v++)
+  {
+    PIDX_variable var = file->idx->variable[v];
+    if (var->sim_patch_count == 0)
+      continue;
+
+    uint64_t bytes_per_sample = (var->bpv / 8) * var->vps;
+    bytes[0] = bytes[0] + bytes_per_sample;
+    if (bytes_per_sample > bytes[1])
+      bytes[1] = bytes_per_sample;
+
+    for (int p = 0; p < var->sim_patch_count; p++)
+      bytes[2] = bytes[2] + var->sim_patch[p]->size[0] * var->sim_patch[p]->size[1] * var->sim_patch[p]->size[2] * bytes_per_sample;
+  }
+  MPI_Allreduce(MPI_IN_PLACE, bytes, 3, MPI_UINT64_T, MPI_MAX, file->idx_c->simulation_comm);
+
+  // a super patch is held twice while restructuring (the received patches and the super patch), and a
+  // variable of it twice more while encoding (the chunked super patch and the HZ buffers)
+  uint64_t *ps = file->restructured_grid->patch_size;
+  uint64_t *tpc = file->restructured_grid->total_patch_count;
+  while (bytes[2] + ps[0] * ps[1] * ps[2] * (2 * bytes[0] + 2 * bytes[1]) > file->idx->memory_budget)
+  {
+    // halve the longest side, as long as there are enough processes to hold the super patches
+    int d = 0;
+    for (int i = 1; i < PIDX_MAX_DIMENSIONS; i++)
+      if (ps[i] > ps[d])
+        d = i;
+
+    if (ps[d] / 2 < file->idx->chunk_size[d] || ps[d] / 2 == 0)
+      break;
+
+    uint64_t count = tpc[0] * tpc[1] * tpc[2] / tpc[d] * (uint64_t)ceil((float)file->idx->box_bounds[d] / (ps[d] / 2));
+    if (count > file->idx_c->simulation_nprocs)
+      break;
+
+    ps[d] = ps[d] / 2;
+    tpc[d] = ceil((float)file->idx->box_bounds[d] / ps[d]);
+  }
+
+  return;
+}
+
+
+
 static PIDX_return_code populate_restructured_grid(PIDX_io file)
 {
   // TODO: cache computation
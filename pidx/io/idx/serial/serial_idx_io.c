@@ -487,6 +487,12 @@ static PIDX_return_code populate_idx_layout_serial(PIDX_io file, int start_var_i
     }
   }
 
+  if (PIDX_blocks_create_index(block_layout, file->idx->bits_per_block, file->idx->blocks_per_file) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_file;
+  }
+
   return PIDX_success;
 }
 
@@ -699,6 +705,12 @@ static PIDX_return_code populate_idx_block_layout(PIDX_io file, PIDX_block_layou
   //if (file->idx_c->simulation_rank == 0)
   //  PIDX_blocks_print_layout(block_layout, file->idx->bits_per_block);
 
+  if (PIDX_blocks_create_index(block_layout, file->idx->bits_per_block, file->idx->blocks_per_file) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_file;
+  }
+
   return PIDX_success;
 }
 
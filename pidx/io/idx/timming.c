@@ -186,6 +186,11 @@ void PIDX_init_timming_buffers1(PIDX_time time, int variable_count, int layout_c
   time->io_end = malloc (sizeof(double) * variable_count);
   memset(time->io_end, 0, sizeof(double) * variable_count);
 
+  time->io_wait_start = malloc (sizeof(double) * variable_count);
+  memset(time->io_wait_start, 0, sizeof(double) * variable_count);
+  time->io_wait_end = malloc (sizeof(double) * variable_count);
+  memset(time->io_wait_end, 0, sizeof(double) * variable_count);
+
 
   // Aggregation phase timings
   time->agg_init_start = malloc (sizeof(double*) * variable_count);
@@ -258,6 +263,26 @@ void PIDX_init_timming_buffers1(PIDX_time time, int variable_count, int layout_c
     memset(time->hz_io_end[i], 0, sizeof(double) * layout_count);
   }
 
+  // Memory accounting (per flush)
+  memset(time->memory, 0, sizeof(time->memory));
+  memset(time->memory_peak, 0, sizeof(time->memory_peak));
+  time->memory_high_water_mark = 0;
+}
+
+
+
+void PIDX_memory_set(PIDX_time time, int phase, uint64_t bytes)
+{
+  time->memory[phase] = bytes;
+  if (bytes > time->memory_peak[phase])
+    time->memory_peak[phase] = bytes;
+
+  uint64_t held = 0;
+  for (int i = 0; i < PIDX_MEMORY_PHASE_COUNT; i++)
+    held = held + time->memory[i];
+
+  if (held > time->memory_high_water_mark)
+    time->memory_high_water_mark = held;
 }
 
 
@@ -338,6 +363,8 @@ void PIDX_delete_timming_buffers1(PIDX_time time, int variable_count)
 
   free(time->io_start);
   free(time->io_end);
+  free(time->io_wait_start);
+  free(time->io_wait_end);
 
   free(time->agg_init_start);
   free(time->agg_init_end);
@@ -60,4 +60,15 @@ void PIDX_init_timming_buffers1(PIDX_time time, int variable_count, int layout_c
 ///
 void PIDX_delete_timming_buffers1(PIDX_time time, int variable_count);
 
+
+
+///
+/// \brief PIDX_memory_set Records the bytes now held by the process in a phase of the io, and updates
+/// the peak of the phase and the peak of all the phases held at once (the high water mark)
+/// \param time
+/// \param phase PIDX_MEMORY_SIM, PIDX_MEMORY_RST, PIDX_MEMORY_CHUNK, PIDX_MEMORY_HZ or PIDX_MEMORY_AGG
+/// \param bytes
+///
+void PIDX_memory_set(PIDX_time time, int phase, uint64_t bytes);
+
 #endif
@@ -41,7 +41,8 @@
 
 #include "../../PIDX_inc.h"
 static PIDX_return_code group_meta_data_init(PIDX_io file, int svi, int evi);
-static PIDX_return_code PIDX_meta_data_write(PIDX_io file, int svi);
+static PIDX_return_code PIDX_meta_data_write(PIDX_io file, int svi, PIDX_shared_file shared_file, const int *patch_extent);
+static PIDX_return_code shared_file_write(PIDX_io file, int svi, int evi);
 static PIDX_return_code PIDX_meta_data_read(PIDX_io file, int svi);
 
 PIDX_return_code PIDX_particle_file_per_process_write(PIDX_io file, int svi, int evi)
@@ -56,8 +57,11 @@ PIDX_return_code PIDX_particle_file_per_process_write(PIDX_io file, int svi, int
   }
   time->header_io_end = PIDX_get_time();
 
+  if (file->idx->shared_file_count > 0)
+    return shared_file_write(file, svi, evi);
+
   time->particle_meta_data_io_start = MPI_Wtime();
-  if (PIDX_meta_data_write(file, svi) != PIDX_success)
+  if (PIDX_meta_data_write(file, svi, NULL, NULL) != PIDX_success)
   {
     fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
     return PIDX_err_file;
@@ -78,7 +82,7 @@ PIDX_return_code PIDX_particle_file_per_process_write(PIDX_io file, int svi, int
 
     int fp = open(file_name, O_CREAT | O_WRONLY, 0664);
 
-    uint64_t data_offset = 0;
+    unsigned char **buffer = malloc(sizeof(*buffer) * (evi - svi));
     for (int si = svi; si < evi; si++)
     {
       PIDX_variable var = file->idx->variable[si];
@@ -105,15 +109,16 @@ PIDX_return_code PIDX_particle_file_per_process_write(PIDX_io file, int svi, int
       printf("[%s] [%d] = %d %d %d\n", var->type_name, var->sim_patch[p]->particle_count * sample_count * (bits_per_sample/CHAR_BIT), var->sim_patch[p]->particle_count, sample_count, (bits_per_sample/CHAR_BIT));
 #endif
 
-      uint64_t buffer_size = var->sim_patch[p]->particle_count * sample_count * (bits_per_sample/CHAR_BIT);
-      uint64_t write_count = pwrite(fp, var->sim_patch[p]->buffer, buffer_size, data_offset);
-      if (write_count != buffer_size)
-      {
-        fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
-        return PIDX_err_io;
-      }
-      data_offset = data_offset + buffer_size;
+      buffer[si - svi] = var->sim_patch[p]->buffer;
+    }
+
+    // Particles are written in Z-order of the patch, followed by the brick index used by box reads
+    if (PIDX_particles_rst_sorted_write(file->idx, fp, buffer, svi, evi, var0->sim_patch[p]->particle_count, var0->sim_patch[p]->physical_offset, var0->sim_patch[p]->physical_size, 0) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_io;
     }
+    free(buffer);
 
     close(fp);
   }
@@ -126,6 +131,103 @@ PIDX_return_code PIDX_particle_file_per_process_write(PIDX_io file, int svi, int
 
 
 
+// The sorted particle files of all the patches become extents of the shared files
+static PIDX_return_code shared_file_write(PIDX_io file, int svi, int evi)
+{
+  PIDX_time time = file->time;
+  PIDX_variable var0 = file->idx->variable[svi];
+  int patch_count = var0->sim_patch_count;
+  int var_count = evi - svi;
+
+  time->particle_data_io_start = MPI_Wtime();
+  PIDX_buffer *packed = malloc(sizeof(*packed) * (patch_count + 1));
+  int *patch_extent = malloc(sizeof(*patch_extent) * (patch_count + 1));
+  PIDX_shared_file_extent *extent = malloc(sizeof(*extent) * (patch_count * (var_count + 1) + 1));
+  unsigned char **extent_buffer = malloc(sizeof(*extent_buffer) * (patch_count * (var_count + 1) + 1));
+  memset(extent, 0, sizeof(*extent) * (patch_count * (var_count + 1) + 1));
+
+  int extent_count = 0;
+  for (int p = 0; p < patch_count; p++)
+  {
+    unsigned char **buffer = malloc(sizeof(*buffer) * var_count);
+    for (int si = svi; si < evi; si++)
+    {
+      file->idx->variable_tracker[si] = 1;
+      buffer[si - svi] = file->idx->variable[si]->sim_patch[p]->buffer;
+    }
+
+    packed[p] = PIDX_buffer_create_empty();
+    if (PIDX_particles_rst_sorted_pack(file->idx, buffer, svi, evi, var0->sim_patch[p]->particle_count, var0->sim_patch[p]->physical_offset, var0->sim_patch[p]->physical_size, &packed[p]) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_io;
+    }
+    free(buffer);
+
+    // One extent per variable, then one for the brick index if the particles were sorted
+    uint64_t packed_offset = 0;
+    patch_extent[p] = extent_count;
+    for (int si = svi; si <= evi; si++)
+    {
+      uint64_t size = packed[p].size - packed_offset;
+      if (si < evi)
+      {
+        PIDX_variable var = file->idx->variable[si];
+        size = var0->sim_patch[p]->particle_count * (var->bpv/CHAR_BIT) * var->vps;
+      }
+      else if (size == 0)
+        break;
+
+      extent[extent_count].patch = p;
+      extent[extent_count].variable = (si < evi) ? (uint32_t)si : PIDX_SHARED_FILE_INDEX_VARIABLE;
+      extent[extent_count].size = size;
+      extent_buffer[extent_count] = packed[p].buffer + packed_offset;
+      packed_offset = packed_offset + size;
+      extent_count++;
+    }
+  }
+
+  char *directory_path = malloc(sizeof(*directory_path) * PATH_MAX);
+  memset(directory_path, 0, sizeof(*directory_path) * PATH_MAX);
+  strncpy(directory_path, file->idx->filename, strlen(file->idx->filename) - 4);
+
+  PIDX_shared_file shared_file = NULL;
+  if (PIDX_shared_file_create(file->idx_c->simulation_comm, file->idx->shared_file_count, directory_path, file->idx->current_time_step, extent, extent_count, &shared_file) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+  free(directory_path);
+  free(extent);
+
+  // OFFSET_SIZE holds where every patch is in the shared files
+  time->particle_meta_data_io_start = MPI_Wtime();
+  if (PIDX_meta_data_write(file, svi, shared_file, patch_extent) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_file;
+  }
+  time->particle_meta_data_io_end = MPI_Wtime();
+
+  if (PIDX_shared_file_write(shared_file, 0, PIDX_SHARED_FILE_INDEX_VARIABLE, extent_buffer) != PIDX_success)
+  {
+    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+    return PIDX_err_io;
+  }
+
+  PIDX_shared_file_free(shared_file);
+  for (int p = 0; p < patch_count; p++)
+    PIDX_buffer_free(&packed[p]);
+  free(packed);
+  free(patch_extent);
+  free(extent_buffer);
+  time->particle_data_io_end = MPI_Wtime();
+
+  return PIDX_success;
+}
+
+
+
 PIDX_return_code PIDX_particle_file_per_process_read(PIDX_io file, int svi, int evi)
 {
   PIDX_time time = file->time;
@@ -204,12 +306,16 @@ PIDX_return_code PIDX_particle_file_per_process_read(PIDX_io file, int svi, int
  *   box.lower: 3*f64
  *   box.upper: 3*f64
  *   local particle count: f64
+ *   with shared files (see PIDX_set_shared_file_count), the place of the patch:
+ *     shared file number: f64
+ *     byte offset in the shared file: f64
+ *     bytes of the patch (variables and brick index): f64
  *
  * TODO: Wouldn't this be a lot easier to construct and write if we had
  * some structs for the types? Then we also wouldn't need to store the
  * counts as f64 (they should be u64).
  */
-static PIDX_return_code PIDX_meta_data_write(PIDX_io file, int svi)
+static PIDX_return_code PIDX_meta_data_write(PIDX_io file, int svi, PIDX_shared_file shared_file, const int *patch_extent)
 {
   double *global_patch;
   PIDX_variable var0 = file->idx->variable[svi];
@@ -217,25 +323,39 @@ static PIDX_return_code PIDX_meta_data_write(PIDX_io file, int svi)
   int patch_count = var0->sim_patch_count;
   MPI_Allreduce(&patch_count, &max_patch_count, 1, MPI_INT, MPI_MAX, file->idx_c->simulation_comm);
 
-  double *local_patch = malloc(sizeof(double) * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1));
-  memset(local_patch, 0, sizeof(double) * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1));
+  const int entry_size = 2 * PIDX_MAX_DIMENSIONS + 1 + (shared_file != NULL ? 3 : 0);
+  double *local_patch = malloc(sizeof(double) * (max_patch_count * entry_size + 1));
+  memset(local_patch, 0, sizeof(double) * (max_patch_count * entry_size + 1));
 
   local_patch[0] = (double)patch_count;
   for (int i = 0; i < patch_count; i++)
   {
     for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-      local_patch[i * (2 * PIDX_MAX_DIMENSIONS + 1) + d + 1] = var0->sim_patch[i]->physical_offset[d];
+      local_patch[i * entry_size + d + 1] = var0->sim_patch[i]->physical_offset[d];
 
     for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
-      local_patch[i * (2 * PIDX_MAX_DIMENSIONS + 1) + PIDX_MAX_DIMENSIONS + d + 1] = var0->sim_patch[i]->physical_size[d];
+      local_patch[i * entry_size + PIDX_MAX_DIMENSIONS + d + 1] = var0->sim_patch[i]->physical_size[d];
 
-    local_patch[i * (2 * PIDX_MAX_DIMENSIONS + 1) + 2*PIDX_MAX_DIMENSIONS + 1] = var0->sim_patch[i]->particle_count;
+    local_patch[i * entry_size + 2*PIDX_MAX_DIMENSIONS + 1] = var0->sim_patch[i]->particle_count;
+
+    if (shared_file != NULL)
+    {
+      int last_extent = (i + 1 < patch_count) ? patch_extent[i + 1] : shared_file->extent_count;
+      uint64_t patch_size = 0;
+      for (int e = patch_extent[i]; e < last_extent; e++)
+        patch_size = patch_size + shared_file->extent[e].size;
+
+      local_patch[i * entry_size + 2*PIDX_MAX_DIMENSIONS + 2] = shared_file->file;
+      local_patch[i * entry_size + 2*PIDX_MAX_DIMENSIONS + 3] = (double)shared_file->extent[patch_extent[i]].offset;
+      local_patch[i * entry_size + 2*PIDX_MAX_DIMENSIONS + 4] = (double)patch_size;
+    }
   }
 
-  global_patch = malloc((file->idx_c->simulation_nprocs * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1) + 2) * sizeof(double));
-  memset(global_patch, 0,(file->idx_c->simulation_nprocs * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1) + 2) * sizeof(double));
+  uint64_t global_size = ((uint64_t)file->idx_c->simulation_nprocs * (max_patch_count * entry_size + 1) + 2) * sizeof(double);
+  global_patch = malloc(global_size);
+  memset(global_patch, 0, global_size);
 
-  MPI_Allgather(local_patch, (2 * PIDX_MAX_DIMENSIONS + 1) * max_patch_count + 1, MPI_DOUBLE, global_patch + 2, (2 * PIDX_MAX_DIMENSIONS + 1) * max_patch_count + 1, MPI_DOUBLE, file->idx_c->simulation_comm);
+  MPI_Allgather(local_patch, entry_size * max_patch_count + 1, MPI_DOUBLE, global_patch + 2, entry_size * max_patch_count + 1, MPI_DOUBLE, file->idx_c->simulation_comm);
 
   global_patch[0] = (double)file->idx_c->simulation_nprocs;
   global_patch[1] = (double)max_patch_count;
@@ -251,11 +371,11 @@ static PIDX_return_code PIDX_meta_data_write(PIDX_io file, int svi)
   {
     int fp = open(file_path, O_CREAT | O_WRONLY, 0664);
 
-    //for (int i = 0; i < (file->idx_c->simulation_nprocs * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1) + 2); i++)
+    //for (int i = 0; i < (file->idx_c->simulation_nprocs * (max_patch_count * entry_size + 1) + 2); i++)
     //  printf("[%d] [np %d] ----> %f\n", i, file->idx_c->simulation_nprocs, global_patch[i]);
 
-    uint64_t write_count = pwrite(fp, global_patch, (file->idx_c->simulation_nprocs * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1) + 2) * sizeof(double), 0);
-    if (write_count != (file->idx_c->simulation_nprocs * (max_patch_count * (2 * PIDX_MAX_DIMENSIONS + 1) + 1) + 2) * sizeof(double))
+    uint64_t write_count = pwrite(fp, global_patch, global_size, 0);
+    if (write_count != global_size)
     {
       fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
       return PIDX_err_io;
@@ -41,7 +41,6 @@
 #include "../../PIDX_inc.h"
 
 static int intersectNDChunk(PIDX_patch A, PIDX_patch B);
-static int pointInChunk(PIDX_patch p, const double *pos);
 
 
 
@@ -76,7 +75,9 @@ PIDX_return_code PIDX_particle_vis_read(PIDX_io file, int svi, int evi)
     return PIDX_err_io;
   }
 
-  int buffer_read_size = (number_cores * ((int)max_patch_count * (2 * max_dim + 1) + 1)) * sizeof(double);
+  // With shared files every entry also holds the file, offset and size of the patch
+  const int entry_size = 2 * max_dim + 1 + (file->idx->shared_file_count > 0 ? 3 : 0);
+  int buffer_read_size = (number_cores * ((int)max_patch_count * entry_size + 1)) * sizeof(double);
 
   double *size_buffer = malloc(buffer_read_size);
   memset(size_buffer, 0, buffer_read_size);
@@ -108,6 +109,8 @@ PIDX_return_code PIDX_particle_vis_read(PIDX_io file, int svi, int evi)
   for (uint64_t i = 0; i < num_vars_to_read; ++i) {
     tmp_var_read_bufs[i] = PIDX_buffer_create_empty();
   }
+  PIDX_buffer pos_read_buf = PIDX_buffer_create_empty();
+  PIDX_buffer selected_buf = PIDX_buffer_create_empty();
 
   // We use a PIDX_buffer to manage growing the user provided buffers which hold
   // the output patch information as well.
@@ -123,6 +126,14 @@ PIDX_return_code PIDX_particle_vis_read(PIDX_io file, int svi, int evi)
       local_proc_patch->physical_size[d] = file->idx->variable[svi]->sim_patch[pc1]->physical_size[d];
     }
 
+    // Closed bounds of the box to read
+    double box_lo[PIDX_MAX_DIMENSIONS], box_hi[PIDX_MAX_DIMENSIONS];
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      box_lo[d] = local_proc_patch->physical_offset[d];
+      box_hi[d] = local_proc_patch->physical_offset[d] + local_proc_patch->physical_size[d];
+    }
+
     for (int i = 0; i < num_vars_to_read; ++i)
     {
       PIDX_variable var = file->idx->variable[i + svi];
@@ -140,17 +151,17 @@ PIDX_return_code PIDX_particle_vis_read(PIDX_io file, int svi, int evi)
     int patch_count = 0;
     for (int n = 0; n < number_cores; n++)
     {
-      int pc = (int)size_buffer[n * ((int)max_patch_count * (2 * max_dim + 1) + 1)];
-      int pc_index = n * ((int)max_patch_count * (2 * max_dim + 1) + 1);
+      int pc = (int)size_buffer[n * ((int)max_patch_count * entry_size + 1)];
+      int pc_index = n * ((int)max_patch_count * entry_size + 1);
       //if (file->idx_c->simulation_rank == 0)
-      //  printf("Index %d PC %d\n", n * ((int)max_patch_count * (2 * max_dim + 1) + 1), pc);
+      //  printf("Index %d PC %d\n", n * ((int)max_patch_count * entry_size + 1), pc);
       for (int m = 0; m < pc; m++)
       {
         for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
         {
-          n_proc_patch->physical_offset[d] = size_buffer[pc_index + m * (2 * max_dim + 1) + d + 1];
-          n_proc_patch->physical_size[d] = size_buffer[pc_index + m * (2 * max_dim + 1) + max_dim + d + 1];
-          n_proc_patch->particle_count = (int)size_buffer[pc_index + m * (2 * max_dim + 1) + max_dim + d + 1 + 1];
+          n_proc_patch->physical_offset[d] = size_buffer[pc_index + m * entry_size + d + 1];
+          n_proc_patch->physical_size[d] = size_buffer[pc_index + m * entry_size + max_dim + d + 1];
+          n_proc_patch->particle_count = (int)size_buffer[pc_index + m * entry_size + max_dim + d + 1 + 1];
         }
 
         if (file->idx_c->simulation_rank == 0)
@@ -160,83 +171,121 @@ PIDX_return_code PIDX_particle_vis_read(PIDX_io file, int svi, int evi)
 
         if (intersectNDChunk(local_proc_patch, n_proc_patch))
         {
-          sprintf(file_name, "%s/time%09d/%d_%d", directory_path, file->idx->current_time_step, n, m);
-          int fpx = open(file_name, O_RDONLY);
-
-          // TODO WILL: For particles we need to rethink how we do this loop, we'll need to
-          // check that the particle position is inside our query box, and only then get
-          // the variable from the file. So there's a few options: we could store some mask
-          // of which particles in the patch we're reading and compute this in a pre-pass
-          // where we read (and optionally keep) the positions, and then read all the other
-          // vars based on this mask. Or, we can go through for each particle and do the
-          // test and read its data on a particle-by-particle basis (that is copying from the patch,
-          // though this will then mean we load all vars the user wants for the patch up front,
-          // and then do this loop through and copy over)
-          // The first option may be easier to extend on to doing some acceleration structures
-          // where we can then now that a whole subtree of particles are inside/outside the
-          // query. We can also compute once up front the indices to write the particles
-          // within the region to by doing a scan, then we can read the whole patch for
-          // that attrib, and copy over the data.
-          // The latter will be easier to implement, and since the patches are not large
-          // it should be fine to do.
-
-          // First read all vars from the patch that we want to read, then filter by
-          // the box query
-          for (int vid = 0; vid < num_vars_to_read; ++vid)
+          // The patch is either a whole file or the bytes [base, base + size) of a shared file
+          uint64_t base = 0;
+          uint64_t size = 0;
+          if (file->idx->shared_file_count > 0)
           {
-            int other_offset = 0;
-            for (int v1 = 0; v1 < vid; v1++)
-            {
-              PIDX_variable var1 = file->idx->variable[v1];
-              other_offset = other_offset + ((var1->bpv/8) * var1->vps * n_proc_patch->particle_count);
-            }
-            PIDX_variable var = file->idx->variable[vid + svi];
-            const uint64_t bytes_per_sample = var->vps * var->bpv/8;
-
-            const uint64_t proc_particle_read_size = n_proc_patch->particle_count * bytes_per_sample;
-            PIDX_buffer *tmp_buf = &tmp_var_read_bufs[vid];
-            PIDX_buffer_resize(tmp_buf, proc_particle_read_size);
+            PIDX_shared_file_name(file_name, directory_path, file->idx->current_time_step, (int)size_buffer[pc_index + m * entry_size + 2 * max_dim + 2]);
+            base = (uint64_t)size_buffer[pc_index + m * entry_size + 2 * max_dim + 3];
+            size = (uint64_t)size_buffer[pc_index + m * entry_size + 2 * max_dim + 4];
+          }
+          else
+            sprintf(file_name, "%s/time%09d/%d_%d", directory_path, file->idx->current_time_step, n, m);
 
-            const uint64_t preadc = pread(fpx, tmp_buf->buffer, proc_particle_read_size, other_offset);
-            if (preadc != proc_particle_read_size)
+          int fpx = open(file_name, O_RDONLY);
+          if (fpx == -1)
+          {
+            fprintf(stderr, "[%s] [%d] open() failed for %s.\n", __FILE__, __LINE__, file_name);
+            return PIDX_err_io;
+          }
+          if (file->idx->shared_file_count <= 0)
+            size = lseek(fpx, 0, SEEK_END);
+
+          // Sorted files end with a brick index, then only the runs of particles of the
+          // bricks intersecting the box, up to the requested level of detail, are read.
+          // Older files are read as a single run.
+          PIDX_particles_rst_index index = PIDX_particles_rst_index_load(fpx, base, size, n_proc_patch->particle_count);
+          PIDX_particles_rst_index_run *run = NULL;
+          int run_count = 0;
+          if (index != NULL)
+          {
+            if (PIDX_particles_rst_index_query(index, local_proc_patch, file->idx->variable[svi]->sim_patch[pc1]->read_particle_level, &run, &run_count) != PIDX_success)
             {
-              fprintf(stderr, "[%s] [%d] Error in pread [%d %d]\n", __FILE__, __LINE__, (int)preadc,
-                  (int)proc_particle_read_size);
+              fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
               return PIDX_err_rst;
             }
+            PIDX_particles_rst_index_free(index);
+          }
+          else
+          {
+            run = malloc(sizeof(*run));
+            run[0].first = 0;
+            run[0].count = n_proc_patch->particle_count;
+            run[0].inside = 0;
+            run_count = 1;
           }
 
-          // QUESTION for SID: the setup for the sim patch count info doesn't make much sense
-          // it seems. I'm not sure how the patches are added?
-          // TODO FURTHERMORE: When we're reading and filtering the non-positional vars in
-          // a box query we still need to know the positions of the particles to do the filtering
-          // correctly. So regardless of what the user requests to read, we always must read the
-          // positions
-          
-          // We use the "particles_position_variable_index" to know which variable contains
-          // the vector position data
-          PIDX_buffer *pos_var_buf = &tmp_var_read_bufs[file->idx->particles_position_variable_index];
-          PIDX_variable pos_var = file->idx->variable[file->idx->particles_position_variable_index];
-          const uint64_t bytes_per_pos = pos_var->vps * pos_var->bpv/8;
-
-          for (uint64_t i = 0; i < n_proc_patch->particle_count; ++i)
+          // The variables are stored one after the other, each with particle_count samples
+          for (int r = 0; r < run_count; r++)
           {
-            // TODO WILL: This assumes position_var->vps == PIDX_MAX_DIMENSIONS
-            if (pointInChunk(local_proc_patch, (double*)(pos_var_buf->buffer + i * bytes_per_pos)))
+            // The positions are needed to filter the particles even if they are not read
+            const int pvi = file->idx->particles_position_variable_index;
+            for (int vid = -1; vid < (int)num_vars_to_read; ++vid)
+            {
+              const int v = (vid == -1) ? pvi : vid + svi;
+              if (vid == -1 && (run[r].inside || (pvi >= svi && pvi < evi)))
+                continue;
+
+              uint64_t other_offset = 0;
+              for (int v1 = 0; v1 < v; v1++)
+              {
+                PIDX_variable var1 = file->idx->variable[v1];
+                other_offset = other_offset + ((var1->bpv/8) * var1->vps * n_proc_patch->particle_count);
+              }
+              PIDX_variable var = file->idx->variable[v];
+              const uint64_t bytes_per_sample = var->vps * var->bpv/8;
+
+              const uint64_t proc_particle_read_size = run[r].count * bytes_per_sample;
+              PIDX_buffer *tmp_buf = (vid == -1) ? &pos_read_buf : &tmp_var_read_bufs[vid];
+              PIDX_buffer_resize(tmp_buf, proc_particle_read_size);
+
+              const uint64_t preadc = pread(fpx, tmp_buf->buffer, proc_particle_read_size, base + other_offset + run[r].first * bytes_per_sample);
+              if (preadc != proc_particle_read_size)
+              {
+                fprintf(stderr, "[%s] [%d] Error in pread [%d %d]\n", __FILE__, __LINE__, (int)preadc,
+                    (int)proc_particle_read_size);
+                return PIDX_err_rst;
+              }
+            }
+
+            // Runs of bricks inside the box are copied whole
+            if (run[r].inside)
             {
               for (int vid = 0; vid < num_vars_to_read; ++vid)
               {
                 PIDX_variable var = file->idx->variable[vid + svi];
                 const uint64_t bytes_per_sample = var->vps * var->bpv/8;
-                PIDX_buffer *var_buf = &read_var_buffers[vid];
-                PIDX_buffer_append(var_buf, tmp_var_read_bufs[vid].buffer + i * bytes_per_sample,
-                    bytes_per_sample);
+                PIDX_buffer_append(&read_var_buffers[vid], tmp_var_read_bufs[vid].buffer, run[r].count * bytes_per_sample);
 
-                *var->sim_patch[pc1]->read_particle_count += 1;
+                *var->sim_patch[pc1]->read_particle_count += run[r].count;
                 var->sim_patch[pc1]->particle_count = *var->sim_patch[pc1]->read_particle_count;
               }
+              continue;
+            }
+
+            // We use the "particles_position_variable_index" to know which variable contains
+            // the vector position data
+            PIDX_buffer *pos_var_buf = (pvi >= svi && pvi < evi) ? &tmp_var_read_bufs[pvi - svi] : &pos_read_buf;
+
+            // Selects the particles of the run inside the box, then gathers every variable with them
+            // TODO WILL: This assumes position_var->vps == PIDX_MAX_DIMENSIONS
+            PIDX_buffer_resize(&selected_buf, run[r].count * sizeof(uint64_t));
+            uint64_t *selected = (uint64_t*)selected_buf.buffer;
+            const uint64_t selected_count = PIDX_particles_rst_select((double*)pos_var_buf->buffer, run[r].count, box_lo, box_hi, selected);
+
+            for (int vid = 0; vid < num_vars_to_read; ++vid)
+            {
+              PIDX_variable var = file->idx->variable[vid + svi];
+              const uint64_t bytes_per_sample = var->vps * var->bpv/8;
+              PIDX_buffer *var_buf = &read_var_buffers[vid];
+              PIDX_particles_rst_gather(PIDX_buffer_extend(var_buf, selected_count * bytes_per_sample), tmp_var_read_bufs[vid].buffer, selected, selected_count, bytes_per_sample);
+
+              *var->sim_patch[pc1]->read_particle_count += selected_count;
+              var->sim_patch[pc1]->particle_count = *var->sim_patch[pc1]->read_particle_count;
             }
           }
+          free(run);
 
           close(fpx);
           patch_count++;
@@ -264,6 +313,8 @@ PIDX_return_code PIDX_particle_vis_read(PIDX_io file, int svi, int evi)
     PIDX_buffer_free(&tmp_var_read_bufs[i]);
   }
   free(tmp_var_read_bufs);
+  PIDX_buffer_free(&pos_read_buf);
+  PIDX_buffer_free(&selected_buf);
   free(read_var_buffers);
 
   free(file_name);
@@ -287,14 +338,4 @@ static int intersectNDChunk(PIDX_patch A, PIDX_patch B)
 
   return !check_bit;
 }
-static int pointInChunk(PIDX_patch p, const double *pos)
-{
-  int contains_point = 1;
-  for (int d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
-    contains_point = contains_point
-      && pos[d] >= p->physical_offset[d]
-      && pos[d] <= p->physical_offset[d] + p->physical_size[d];
-
-  return contains_point;
-}
 
@@ -74,6 +74,16 @@ PIDX_return_code raw_restructure_setup(PIDX_io file, int svi, int evi, int mode)
   //{
     if (mode == PIDX_WRITE)
     {
+      // The super patches of all the processes go to a few shared files instead of one file each
+      if (file->idx->shared_file_count > 0)
+      {
+        if (PIDX_raw_rst_shared_file_create(file->raw_rst_id) != PIDX_success)
+        {
+          fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+          return PIDX_err_rst;
+        }
+      }
+
       if (PIDX_raw_rst_meta_data_write(file->raw_rst_id) != PIDX_success)
       {
         fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
@@ -268,10 +278,21 @@ PIDX_return_code raw_restructure_forced_read(PIDX_io file, int svi, int evi)
 {
   file->raw_rst_id = PIDX_raw_rst_init(file->idx, file->idx_c, file->idx_dbg, file->restructured_grid, svi, evi);
 
-  if (PIDX_raw_rst_forced_raw_read(file->raw_rst_id) != PIDX_success)
+  if (file->idx->raw_read_reader_count > 0)
   {
-    fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
-    return PIDX_err_rst;
+    if (PIDX_raw_rst_collective_raw_read(file->raw_rst_id) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
+  }
+  else
+  {
+    if (PIDX_raw_rst_forced_raw_read(file->raw_rst_id) != PIDX_success)
+    {
+      fprintf(stderr,"File %s Line %d\n", __FILE__, __LINE__);
+      return PIDX_err_rst;
+    }
   }
 
   if (PIDX_raw_rst_finalize(file->raw_rst_id) != PIDX_success)
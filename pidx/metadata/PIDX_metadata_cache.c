@@ -54,13 +54,14 @@ PIDX_return_code PIDX_create_metadata_cache(PIDX_metadata_cache* cache)
 
 PIDX_return_code PIDX_free_metadata_cache(PIDX_metadata_cache cache)
 {
-  if (cache->is_set == 1)
-  {
-      free(cache->hz_level);
-      free(cache->index_level);
-      free(cache->xyz_mapped_index);
-  }
-
+  free(cache->level_start);
+  free(cache->row_span);
+  free(cache->spans);
+  free(cache->compression_scratch);
+  if (PIDX_agg_cache_free(cache->agg_cache) != PIDX_success)
+    return PIDX_err_agg;
+  if (PIDX_idx_rst_plan_free(cache->idx_rst_plan) != PIDX_success)
+    return PIDX_err_rst;
   free(cache);
   return PIDX_success;
 }
@@ -52,13 +52,42 @@
 #define __PIDX_METADATA_CACHE_H
 
 
+/// A run of samples that are contiguous both in memory (in the restructured patch) and in one
+/// HZ level. The patch index of a span is implicit: spans are stored in memory order.
+struct PIDX_hz_span_struct
+{
+  uint64_t hz_offset;       /// HZ index of the first sample relative to level_start[level]
+  uint16_t count;           /// Number of samples in the run
+  uint8_t level;            /// HZ level of the run
+  uint8_t skip;             /// 1 if the samples are not written (reduced resolution)
+};
+typedef struct PIDX_hz_span_struct PIDX_hz_span;
+
+
 struct PIDX_metadata_cache_struct
 {
   int is_set;               /// flag to specify if cache buffer is populated
-  int element_count;        /// Number of elements (tuples) in the cache
-  int *xyz_mapped_index;    /// The xyz index (application row-order index)
-  int *hz_level;            /// Corresponding HZ index to the xyz index
-  int *index_level;         /// The hz index level
+
+  /// The spans are only replayed if the encoding matches this key
+  int patch_offset[PIDX_MAX_DIMENSIONS];  /// Offset of the chunked restructured patch
+  int patch_size[PIDX_MAX_DIMENSIONS];    /// Size of the chunked restructured patch
+  int chunk_size[PIDX_MAX_DIMENSIONS];    /// Chunk size (compression)
+  char bitSequence[512];                  /// Bitmask of the dataset
+  int resolution_to;                      /// Number of finest HZ levels left out
+  int data_layout;                        /// Row or column major patch
+
+  uint64_t *level_start;    /// First HZ index of every level in the patch
+  uint64_t row_count;       /// Number of memory rows of the patch
+  uint64_t row_length;      /// Number of samples in a memory row
+  uint64_t *row_span;       /// First span of every row (row_count + 1 entries)
+  uint64_t span_count;      /// Number of spans in the cache
+  PIDX_hz_span *spans;      /// The patch as HZ spans, in memory order
+
+  unsigned char *compression_scratch;     /// zfp output buffer reused across variables and time steps
+  uint64_t compression_scratch_size;      /// Size in bytes of compression_scratch
+
+  struct PIDX_agg_cache_list_struct *agg_cache;   /// Aggregation state reused across time steps (steady state io)
+  struct PIDX_idx_rst_plan_list_struct *idx_rst_plan;   /// Restructuring plans reused across time steps (steady state io)
 };
 typedef struct PIDX_metadata_cache_struct* PIDX_metadata_cache;
 
@@ -44,7 +44,9 @@
 /// with the requested version
 PIDX_return_code PIDX_metadata_parse(FILE *fp, PIDX_file* file, char* version)
 {
-  if (strcmp(version, "6.1") == 0)
+  // 6.2 only changes the binary file header (64 bit block offsets and sizes),
+  // the .idx metadata is the same as 6.1
+  if (strcmp(version, "6.2") == 0 || strcmp(version, "6.1") == 0)
     return PIDX_metadata_parse_v6_1(fp, file);
   else if (strcmp(version, "6") == 0)
     return PIDX_metadata_parse_v6_0(fp, file);
@@ -206,6 +206,24 @@ PIDX_return_code PIDX_metadata_parse_v6_1(FILE *fp, PIDX_file* file)
       (*file)->idx->particles_position_variable_index = atoi(line);
     }
 
+    if (strcmp(line, "(particles lod levels)") == 0)
+    {
+      if ( fgets(line, sizeof line, fp) == NULL)
+        return PIDX_err_file;
+      line[strcspn(line, "\r\n")] = 0;
+
+      (*file)->idx->particles_lod_level_count = atoi(line);
+    }
+
+    if (strcmp(line, "(shared files)") == 0)
+    {
+      if ( fgets(line, sizeof line, fp) == NULL)
+        return PIDX_err_file;
+      line[strcspn(line, "\r\n")] = 0;
+
+      (*file)->idx->shared_file_count = atoi(line);
+    }
+
     if (strcmp(line, "(fields)") == 0)
     {
       if ( fgets(line, sizeof line, fp) == NULL)
@@ -291,6 +309,14 @@ PIDX_return_code PIDX_metadata_parse_v6_1(FILE *fp, PIDX_file* file)
       }
     }
 
+    if (strcmp(line, "(compression parameter)") == 0)
+    {
+      if ( fgets(line, sizeof line, fp) == NULL)
+        return PIDX_err_file;
+      line[strcspn(line, "\r\n")] = 0;
+      (*file)->idx->compression_parameter = atof(line);
+    }
+
     if (strcmp(line, "(compressed box)") == 0)
     {
       if ( fgets(line, sizeof line, fp) == NULL)
@@ -17,13 +17,17 @@ void PIDX_buffer_free(PIDX_buffer *b)
   b->capacity = 0;
 }
 void PIDX_buffer_append(PIDX_buffer *b, const unsigned char *data, const uint64_t size)
+{
+  memcpy(PIDX_buffer_extend(b, size), data, size);
+}
+unsigned char* PIDX_buffer_extend(PIDX_buffer *b, const uint64_t size)
 {
   if (b->capacity - b->size < size) {
     b->capacity = Max2ab(b->capacity + size, b->capacity * 1.5);
     b->buffer = realloc(b->buffer, b->capacity);
   }
-  memcpy(b->buffer + b->size, data, size);
   b->size += size;
+  return b->buffer + b->size - size;
 }
 void PIDX_buffer_resize(PIDX_buffer *b, const uint64_t size)
 {
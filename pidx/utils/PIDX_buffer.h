@@ -30,6 +30,8 @@ PIDX_buffer PIDX_buffer_create_empty();
 PIDX_buffer PIDX_buffer_create_with_capacity(uint64_t capacity);
 void PIDX_buffer_free(PIDX_buffer *b);
 void PIDX_buffer_append(PIDX_buffer *b, const unsigned char *data, const uint64_t size);
+// Appends size uninitialized bytes and returns them
+unsigned char* PIDX_buffer_extend(PIDX_buffer *b, const uint64_t size);
 void PIDX_buffer_resize(PIDX_buffer *b, const uint64_t size);
 
 #endif
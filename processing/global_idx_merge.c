@@ -104,6 +104,7 @@ static char type_name[128][512];
 static int bpv[128];
 static int vps[128];
 static int variable_count = 0;
+static int large_offsets = 1;
 static int fs_block_size = 0;
 static int maxh = 0;
 static int max_file_count = 0;
@@ -115,6 +116,12 @@ static unsigned long long getPowerOf2(int x);
 static int generate_file_name(int blocks_per_file, char* filename_template, int file_number, char* filename, int maxlen) ;
 static double get_time();
 
+// Block entries of the binary file headers (pidx/core/PIDX_header/PIDX_header_io.h), PIDX.h clashes with
+// the helpers of this file
+uint64_t PIDX_header_io_get_block_offset(const uint32_t* headers, int block_index, int large_offsets);
+uint64_t PIDX_header_io_get_block_size(const uint32_t* headers, int block_index, int large_offsets);
+void PIDX_header_io_set_block(uint32_t* headers, int block_index, uint64_t offset, uint64_t size);
+
 static char *usage = "Serial Usage: ./checkpoint -g 32x32x32 -l 32x32x32 -v 3 -t 16 -f output_idx_file_name\n"
                      "Parallel Usage: mpirun -n 8 ./checkpoint -g 32x32x32 -l 16x16x16 -f output_idx_file_name -v 3 -t 16\n"
                      "  -g: global dimensions\n"
@@ -221,6 +228,7 @@ static int IDX_file_open(const char* filename)
 
   current_time_step = 0;
   compression_type = 0;
+  large_offsets = 1;
 
   bits_per_block = 0;
   blocks_per_file = 0;
@@ -256,6 +264,17 @@ static int IDX_file_open(const char* filename)
       //fprintf(stderr, "%s", line);
       line[strcspn(line, "\r\n")] = 0;
 
+      if (strcmp(line, "(version)") == 0)
+      {
+        if( fgets(line, sizeof line, fp) == NULL)
+          return (-1);
+        line[strcspn(line, "\r\n")] = 0;
+
+        // 64 bit block offsets and sizes from version 6.2 on
+        if (strcmp(line, "6") == 0 || strcmp(line, "6.1") == 0)
+          large_offsets = 0;
+      }
+
       if (strcmp(line, "(box)") == 0)
       {
         if( fgets(line, sizeof line, fp) == NULL)
@@ -810,16 +829,15 @@ int main(int argc, char **argv)
               off_t data_offset = 0;
               for (bpf = 0; bpf < shared_block_count; bpf++)
               {
-                data_offset = ntohl(read_binheader[ic][(bpf + var * blocks_per_file)*10 + 12]);
-                data_size = ntohl(read_binheader[ic][(bpf + var * blocks_per_file)*10 + 14]);
-                fprintf(stderr, "[%s] [Partition %d Block %d Variable %d] --> Offset %d Count %d\n", partition_file_name, ic, bpf, var, (int)data_offset, (int)data_size);
+                data_offset = PIDX_header_io_get_block_offset(read_binheader[ic], bpf + var * blocks_per_file, large_offsets);
+                data_size = PIDX_header_io_get_block_size(read_binheader[ic], bpf + var * blocks_per_file, large_offsets);
+                fprintf(stderr, "[%s] [Partition %d Block %d Variable %d] --> Offset %lld Count %lld\n", partition_file_name, ic, bpf, var, (long long)data_offset, (long long)data_size);
 
                 if (data_offset != 0 && data_size != 0)
                 {
                   pread(fd, read_data_buffer[ic] + (bpf * samples_per_block * (bpv[var] / 8)), data_size, data_offset);
 
-                  write_binheader[((bpf + var * blocks_per_file)*10 + 12)] = htonl(write_binheader_length + (bpf * data_size) + var * shared_block_count);
-                  write_binheader[((bpf + var * blocks_per_file)*10 + 14)] = htonl(data_size);
+                  PIDX_header_io_set_block(write_binheader, bpf + var * blocks_per_file, (uint64_t)write_binheader_length + (bpf * data_size) + var * shared_block_count, data_size);
 
                   // Merge happening while the shared block is being read
                   // Hardcoded stupid merge
@@ -91,6 +91,7 @@ static char type_name[128][512];
 static int bpv[128];
 static int vps[128];
 static int variable_count = 0;
+static int large_offsets = 1;
 static int fs_block_size = 0;
 static int maxh = 0;
 static int max_file_count = 0;
@@ -215,6 +216,7 @@ static PIDX_return_code IDX_file_open(const char* filename)
 
   current_time_step = 0;
   compression_type = PIDX_NO_COMPRESSION;
+  large_offsets = 1;
 
   bits_per_block = PIDX_default_bits_per_block;
   blocks_per_file = PIDX_default_blocks_per_file;
@@ -250,6 +252,17 @@ static PIDX_return_code IDX_file_open(const char* filename)
       //fprintf(stderr, "%s", line);
       line[strcspn(line, "\r\n")] = 0;
 
+      if (strcmp(line, "(version)") == 0)
+      {
+        if( fgets(line, sizeof line, fp) == NULL)
+          return PIDX_err_file;
+        line[strcspn(line, "\r\n")] = 0;
+
+        // 64 bit block offsets and sizes from version 6.2 on
+        if (strcmp(line, "6") == 0 || strcmp(line, "6.1") == 0)
+          large_offsets = 0;
+      }
+
       if (strcmp(line, "(box)") == 0)
       {
         if( fgets(line, sizeof line, fp) == NULL)
@@ -694,12 +707,12 @@ int main(int argc, char **argv)
           file_initialize_time_step(ts, output_file_name, output_file_template);
           generate_file_name(blocks_per_file, output_file_template, fc, new_file_name, PATH_MAX);
 
-          int* block_header_offset = malloc(idx_count[0] * idx_count[1] * idx_count[2] * sizeof(int));
-          memset(block_header_offset, 0, idx_count[0] * idx_count[1] * idx_count[2] * sizeof(int));
+          uint64_t* block_header_offset = malloc(idx_count[0] * idx_count[1] * idx_count[2] * sizeof(*block_header_offset));
+          memset(block_header_offset, 0, idx_count[0] * idx_count[1] * idx_count[2] * sizeof(*block_header_offset));
 
 
-          int** block_header_block_offset = malloc(idx_count[0] * idx_count[1] * idx_count[2] * sizeof(int*));
-          memset(block_header_block_offset, 0, idx_count[0] * idx_count[1] * idx_count[2] * sizeof(int*));
+          uint64_t** block_header_block_offset = malloc(idx_count[0] * idx_count[1] * idx_count[2] * sizeof(*block_header_block_offset));
+          memset(block_header_block_offset, 0, idx_count[0] * idx_count[1] * idx_count[2] * sizeof(*block_header_block_offset));
 
           size_t totl_data_size = 0;
           off_t totl_data_offset = 0;
@@ -723,11 +736,11 @@ int main(int argc, char **argv)
             {
               // file exists
               uint32_t* read_binheader;
-              uint32_t adjusted_offset;
+              uint64_t adjusted_offset;
               int read_binheader_count;
 
-              block_header_block_offset[ic] = malloc(blocks_per_file * sizeof(int));
-              memset(block_header_block_offset[ic], 0, blocks_per_file * sizeof(int));
+              block_header_block_offset[ic] = malloc(blocks_per_file * sizeof(*block_header_block_offset[ic]));
+              memset(block_header_block_offset[ic], 0, blocks_per_file * sizeof(*block_header_block_offset[ic]));
 
               read_binheader_count = 10 + 10 * blocks_per_file * variable_count;
               read_binheader = (uint32_t*) malloc(sizeof (*read_binheader)*(read_binheader_count));
@@ -761,14 +774,14 @@ int main(int argc, char **argv)
               int read_block_counter = 0;
 
               int prev_ic = 0;
-              int previous_block_offset = 0;
+              uint64_t previous_block_offset = 0;
               for (prev_ic = 0; prev_ic < ic; prev_ic++)
                 previous_block_offset = previous_block_offset + block_header_offset[prev_ic];
 
               for (bpf = 0; bpf < blocks_per_file; bpf++)
               {
-                data_offset = ntohl(read_binheader[(bpf + var * blocks_per_file)*10 + 12]);
-                data_size = ntohl(read_binheader[(bpf + var * blocks_per_file)*10 + 14]);
+                data_offset = PIDX_header_io_get_block_offset(read_binheader, bpf + var * blocks_per_file, large_offsets);
+                data_size = PIDX_header_io_get_block_size(read_binheader, bpf + var * blocks_per_file, large_offsets);
                 fprintf(stderr, "[%s] [%d %d %d] --> %d %d\n", partition_file_name, bpf, var, blocks_per_file, (int)data_offset, (int)data_size);
 
                 if (data_offset != 0 && data_size != 0)
@@ -778,10 +791,13 @@ int main(int argc, char **argv)
 
                   adjusted_offset = data_offset + previous_block_offset;
 
-                  write_binheader[((bpf + var * blocks_per_file)*10 + 12)] = htonl(adjusted_offset);
-                  write_binheader[((bpf + var * blocks_per_file)*10 + 14)] = htonl(data_size);
+                  // the merged file keeps the version of the partitions, older headers only hold 32 bit offsets
+                  if (large_offsets == 0 && adjusted_offset > UINT32_MAX)
+                    terminate_with_error_msg("Merged offset of block %d does not fit the version 6.1 header\n", bpf);
+
+                  PIDX_header_io_set_block(write_binheader, bpf + var * blocks_per_file, adjusted_offset, data_size);
 
-                  fprintf(stderr, "IC %d RBC %d WBC %d RO %d WO %d AO %d [%d + %d]\n", ic, read_block_counter, write_block_counter, (read_block_counter * (int)pow(2, bits_per_block) * (bpv[var] / 8)), (write_block_counter * (int)pow(2, bits_per_block) * (bpv[var] / 8)), adjusted_offset, (int)data_offset, previous_block_offset);
+                  fprintf(stderr, "IC %d RBC %d WBC %d RO %d WO %d AO %lld [%lld + %lld]\n", ic, read_block_counter, write_block_counter, (read_block_counter * (int)pow(2, bits_per_block) * (bpv[var] / 8)), (write_block_counter * (int)pow(2, bits_per_block) * (bpv[var] / 8)), (long long)adjusted_offset, (long long)data_offset, (long long)previous_block_offset);
                   memcpy(write_data_buffer + (write_block_counter * (int)pow(2, bits_per_block) * (bpv[var] / 8)), read_data_buffer + (read_block_counter * (int)pow(2, bits_per_block) * (bpv[var] / 8)), (int)pow(2, bits_per_block) * (bpv[var] / 8));
 
                   read_block_counter++;
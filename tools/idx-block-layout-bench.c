@@ -0,0 +1,247 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/*
+  Micro-benchmark for the block layout lookups used while writing the IDX
+  headers (write_meta_data) and while aggregating (write_samples). For every
+  block of every file the benchmark queries the block presence and the
+  negative offset (number of absent blocks preceding it in its file), once
+  with the walking implementation that predates the lookup index and once
+  with the index built by PIDX_blocks_create_index.
+
+  Usage: ./idxblocklayoutbench -b bits_per_block -p blocks_per_file -f file_count -d density
+    -b: bits per block (default 15)
+    -p: blocks per file (power of two, default 4096)
+    -f: number of files (power of two, default 4)
+    -d: percentage of blocks that are present (default 50)
+*/
+
+#include <unistd.h>
+#include <stdint.h>
+#include <PIDX.h>
+
+static int bits_per_block = 15;
+static int blocks_per_file = 4096;
+static int file_count = 4;
+static int density = 50;
+static char *usage = "Serial Usage: ./idxblocklayoutbench -b 15 -p 4096 -f 4 -d 50\n"
+                     "  -b: bits per block\n"
+                     "  -p: blocks per file (power of two)\n"
+                     "  -f: number of files (power of two)\n"
+                     "  -d: percentage of blocks that are present\n";
+
+static void parse_args(int argc, char **argv);
+static int is_power_of_two(int value);
+static int legacy_is_block_present(int block_number, int bits_per_block, PIDX_block_layout layout);
+static int legacy_find_negative_offset(int blocks_per_file, int bits_per_block, int block_number, PIDX_block_layout layout);
+static double run_queries(PIDX_block_layout layout, int block_count, int use_legacy, uint64_t *checksum);
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  parse_args(argc, argv);
+
+  int block_count = blocks_per_file * file_count;
+  int maxh = bits_per_block + 1;
+  while ((1 << (maxh - 1 - bits_per_block)) < block_count)
+    maxh++;
+
+  PIDX_block_layout layout = malloc(sizeof (*layout));
+  memset(layout, 0, sizeof (*layout));
+  if (PIDX_blocks_initialize_layout(layout, 0, maxh, maxh, bits_per_block) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_blocks_initialize_layout\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+
+  // Deterministic pseudo random sparsity, block 0 is always present
+  uint32_t seed = 12345;
+  int present_count = 1;
+  int level_size = 1;
+  for (int m = bits_per_block + 1; m < maxh; m++)
+  {
+    for (int t = 0; t < level_size; t++)
+    {
+      seed = seed * 1103515245 + 12345;
+      if ((int)((seed >> 16) % 100) < density)
+      {
+        layout->hz_block_number_array[m][t] = level_size + t;
+        present_count++;
+      }
+    }
+    level_size = level_size * 2;
+  }
+
+  // The index covers the files of the layout, here all of them
+  layout->efc = file_count;
+  layout->existing_file_index = malloc(sizeof(*layout->existing_file_index) * file_count);
+  for (int f = 0; f < file_count; f++)
+    layout->existing_file_index[f] = f;
+
+  uint64_t legacy_checksum = 0, index_checksum = 0;
+  double legacy_time = run_queries(layout, block_count, 1, &legacy_checksum);
+
+  double index_start = MPI_Wtime();
+  if (PIDX_blocks_create_index(layout, bits_per_block, blocks_per_file) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_blocks_create_index\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  double index_build_time = MPI_Wtime() - index_start;
+
+  double index_time = run_queries(layout, block_count, 0, &index_checksum);
+
+  fprintf(stdout, "Blocks per file %d files %d (%d of %d blocks present) bits per block %d maxh %d\n", blocks_per_file, file_count, present_count, block_count, bits_per_block, maxh);
+  fprintf(stdout, "Walking layout  %f s\n", legacy_time);
+  fprintf(stdout, "Lookup index    %f s (+ %f s to build the index)\n", index_time, index_build_time);
+  fprintf(stdout, "Speedup         %.1fx\n", legacy_time / (index_time + index_build_time));
+
+  int ret = 0;
+  if (legacy_checksum != index_checksum)
+  {
+    fprintf(stderr, "Mismatch between walking layout and lookup index (%llu vs %llu)\n", (unsigned long long)legacy_checksum, (unsigned long long)index_checksum);
+    ret = 1;
+  }
+
+  PIDX_free_layout(layout);
+  PIDX_blocks_free_layout(bits_per_block, maxh, layout);
+  free(layout);
+
+  MPI_Finalize();
+  return ret;
+}
+
+
+static void parse_args(int argc, char **argv)
+{
+  char flags[] = "b:p:f:d:";
+  int one_opt = 0;
+
+  while ((one_opt = getopt(argc, argv, flags)) != EOF)
+  {
+    switch (one_opt)
+    {
+    case('b'):
+      bits_per_block = atoi(optarg);
+      break;
+
+    case('p'):
+      blocks_per_file = atoi(optarg);
+      break;
+
+    case('f'):
+      file_count = atoi(optarg);
+      break;
+
+    case('d'):
+      density = atoi(optarg);
+      break;
+
+    default:
+      fprintf(stderr, "Wrong Usage\n%s", usage);
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+  }
+
+  if (!is_power_of_two(blocks_per_file) || !is_power_of_two(file_count) || bits_per_block < 1 || density < 0 || density > 100)
+  {
+    fprintf(stderr, "Wrong Usage\n%s", usage);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+}
+
+
+static int is_power_of_two(int value)
+{
+  return value > 0 && (value & (value - 1)) == 0;
+}
+
+
+// Presence test as done before the lookup index (floating point level math)
+static int legacy_is_block_present(int block_number, int bits_per_block, PIDX_block_layout layout)
+{
+  int res_level = 0, res_index = 0;
+
+  if (block_number == 0)
+    return (layout->resolution_from <= bits_per_block);
+
+  res_level = log2 (block_number) + 1 + bits_per_block;
+  res_index = block_number % ((int) pow(2, (res_level - 1 - bits_per_block)));
+
+  if (res_level < layout->resolution_from || res_level >= layout->resolution_to)
+    return 0;
+
+  return (layout->hz_block_number_array[res_level][res_index] == block_number);
+}
+
+
+// Negative offset as done before the lookup index (walks the file up to the block)
+static int legacy_find_negative_offset(int blocks_per_file, int bits_per_block, int block_number, PIDX_block_layout layout)
+{
+  int file_no = block_number / blocks_per_file;
+  int block_offset = 0;
+  for (int b = file_no * blocks_per_file ; b < block_number; b++)
+    if (!legacy_is_block_present(b, bits_per_block, layout))
+      block_offset++;
+  return block_offset;
+}
+
+
+// Same access pattern as write_meta_data: offset queried for every present block
+static double run_queries(PIDX_block_layout layout, int block_count, int use_legacy, uint64_t *checksum)
+{
+  double start = MPI_Wtime();
+  uint64_t sum = 0;
+
+  for (int b = 0; b < block_count; b++)
+  {
+    int present = use_legacy ? legacy_is_block_present(b, bits_per_block, layout) : PIDX_blocks_is_block_present(b, bits_per_block, layout);
+    if (present)
+    {
+      int offset = use_legacy ? legacy_find_negative_offset(blocks_per_file, bits_per_block, b, layout) : PIDX_blocks_find_negative_offset(blocks_per_file, bits_per_block, b, layout);
+      sum = sum + (uint64_t)(b - offset) * (b + 1);
+    }
+  }
+
+  *checksum = sum;
+  return MPI_Wtime() - start;
+}
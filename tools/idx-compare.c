@@ -39,7 +39,6 @@
  * 
  */
 
-#define _XOPEN_SOURCE 500
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
@@ -54,6 +53,7 @@
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
+#include <PIDX.h>
 
 /**
  * \file idx-compare.c
@@ -62,7 +62,8 @@
  * \date   10/09/14
  *
  * Compares samples between two idx binary file, assumes that
- * the data is in double format
+ * the data is in double format. An optional fifth argument gives
+ * the metadata version of the files (6.2 and later by default)
  *
  */
 
@@ -100,6 +101,11 @@ int main(int argc, char **argv)
   
   blocks_per_file = atoi(argv[3]);
   variable_count = atoi(argv[4]);
+
+  // 64 bit block offsets and sizes from version 6.2 on
+  int large_offsets = 1;
+  if (argc > 5 && (strcmp(argv[5], "6") == 0 || strcmp(argv[5], "6.1") == 0))
+    large_offsets = 0;
   
   zero_count = malloc(sizeof(uint64_t) * variable_count);
   non_zero_equal_count = malloc(sizeof(uint64_t) * variable_count);
@@ -131,14 +137,14 @@ int main(int argc, char **argv)
   {
     for (j = 0 ; j < blocks_per_file; j++)
     {
-      data_length1 = ntohl(binheader1[(j + blocks_per_file * var) * 10 + 14]);
-      data_offset1 = ntohl(binheader1[(j + blocks_per_file * var) * 10 + 12]);
+      data_length1 = PIDX_header_io_get_block_size(binheader1, j + blocks_per_file * var, large_offsets);
+      data_offset1 = PIDX_header_io_get_block_offset(binheader1, j + blocks_per_file * var, large_offsets);
       data_buffer1 = (double*)malloc(data_length1);
       memset(data_buffer1, 0, data_length1);
       assert(data_buffer1 != NULL);
       
-      data_length2 = ntohl(binheader2[(j + blocks_per_file * var) * 10 + 14]);
-      data_offset2 = ntohl(binheader2[(j + blocks_per_file * var) * 10 + 12]);
+      data_length2 = PIDX_header_io_get_block_size(binheader2, j + blocks_per_file * var, large_offsets);
+      data_offset2 = PIDX_header_io_get_block_offset(binheader2, j + blocks_per_file * var, large_offsets);
       data_buffer2 = (double*)malloc(data_length2);
       memset(data_buffer2, 0, data_length2);
       assert(data_buffer2 != NULL);
@@ -108,8 +108,10 @@ int main(int argc, char **argv)
     {
       data_length1 = 0;
       data_offset1 = 0;
-      data_length1 = ntohl(binheader1[(j + blocks_per_file * var) * 10 + 14]);
-      data_offset1 = ntohl(binheader1[(j + blocks_per_file * var) * 10 + 12]);
+      // high 32 bits (metadata version 6.2 and later) follow the low 32 bits,
+      // older PIDX headers leave these words zero
+      data_length1 = ntohl(binheader1[(j + blocks_per_file * var) * 10 + 14]) | ((uint64_t)ntohl(binheader1[(j + blocks_per_file * var) * 10 + 15]) << 32);
+      data_offset1 = ntohl(binheader1[(j + blocks_per_file * var) * 10 + 12]) | ((uint64_t)ntohl(binheader1[(j + blocks_per_file * var) * 10 + 13]) << 32);
       fprintf(stderr, "[%d] Block %d: Offset %lld Count %lld\n", var, j, (unsigned long long)data_offset1, (unsigned long long)data_length1);
 
       double *data_buffer = malloc(data_length1);
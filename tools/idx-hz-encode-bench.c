@@ -0,0 +1,332 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/*
+  Benchmark for the HZ encoding of a single (restructured) patch. The patch is
+  encoded once with the per sample, bit by bit encoder that PIDX_hz_encode_write
+  used to run, and once with PIDX_hz_encode_write itself (axis lookup tables,
+  clz based level and copies of contiguous runs). Both HZ buffers are compared.
+
+  Usage: ./idxhzencodebench -l 256x256x256 -b 4
+    -l: patch size (the patch is placed at the origin of a dataset of the same size)
+    -b: bytes per sample (4 or 8)
+    -t: threads used by PIDX_hz_encode_write and PIDX_hz_encode_read
+*/
+
+#include <unistd.h>
+#include <stdint.h>
+#include <PIDX.h>
+
+static int patch_size[PIDX_MAX_DIMENSIONS] = {256, 256, 256};
+static int bytes_per_sample = 4;
+static int thread_count = 1;
+static char *usage = "Serial Usage: ./idxhzencodebench -l 256x256x256 -b 4 -t 1\n"
+                     "  -l: patch size\n"
+                     "  -b: bytes per sample (4 or 8)\n"
+                     "  -t: number of threads\n";
+
+static void parse_args(int argc, char **argv);
+static void legacy_hz_encode(idx_dataset idx, unsigned char* patch, unsigned char** hz_buffer, uint64_t* start_hz_index);
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  parse_args(argc, argv);
+
+  uint64_t sample_count = (uint64_t)patch_size[0] * patch_size[1] * patch_size[2];
+
+  idx_dataset idx = malloc(sizeof (*idx));
+  memset(idx, 0, sizeof (*idx));
+
+  Point3D bounds;
+  bounds.x = getPowerOf2(patch_size[0]);
+  bounds.y = getPowerOf2(patch_size[1]);
+  bounds.z = getPowerOf2(patch_size[2]);
+  GuessBitmaskPattern(idx->bitSequence, bounds);
+  idx->maxh = strlen(idx->bitSequence);
+  for (int i = 0; i <= idx->maxh; i++)
+    idx->bitPattern[i] = RegExBitmaskBit(idx->bitSequence, i);
+
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    idx->chunk_size[d] = 1;
+    idx->box_bounds[d] = patch_size[d];
+  }
+  idx->compression_factor = 1;
+  idx->thread_count = thread_count;
+
+  // restructured (and chunked) patch holding the data of the process
+  PIDX_variable var = malloc(sizeof (*var));
+  memset(var, 0, sizeof (*var));
+  var->vps = 1;
+  var->bpv = bytes_per_sample * 8;
+  var->data_layout = PIDX_row_major;
+  var->sim_patch_count = 1;
+  var->restructured_super_patch_count = 1;
+
+  var->chunked_super_patch = malloc(sizeof (*var->chunked_super_patch));
+  memset(var->chunked_super_patch, 0, sizeof (*var->chunked_super_patch));
+  var->chunked_super_patch->restructured_patch = malloc(sizeof (*var->chunked_super_patch->restructured_patch));
+  memset(var->chunked_super_patch->restructured_patch, 0, sizeof (*var->chunked_super_patch->restructured_patch));
+
+  PIDX_patch patch = var->chunked_super_patch->restructured_patch;
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    patch->size[d] = patch_size[d];
+  patch->buffer = malloc(sample_count * bytes_per_sample);
+  for (uint64_t s = 0; s < sample_count * bytes_per_sample; s++)
+    patch->buffer[s] = (unsigned char)(s * 2654435761u >> 24);
+
+  // HZ buffers, level l holds the HZ orders [2^(l-1), 2^l)
+  var->hz_buffer = malloc(sizeof (*var->hz_buffer));
+  memset(var->hz_buffer, 0, sizeof (*var->hz_buffer));
+  var->hz_buffer->start_hz_index = malloc(sizeof(uint64_t) * idx->maxh);
+  var->hz_buffer->buffer = malloc(sizeof(unsigned char*) * idx->maxh);
+  unsigned char **legacy_buffer = malloc(sizeof(unsigned char*) * idx->maxh);
+  for (int l = 0; l < idx->maxh; l++)
+  {
+    uint64_t level_samples = (l == 0) ? 1 : ((uint64_t)1 << (l - 1));
+    var->hz_buffer->start_hz_index[l] = (l == 0) ? 0 : ((uint64_t)1 << (l - 1));
+    var->hz_buffer->buffer[l] = calloc(level_samples, bytes_per_sample);
+    legacy_buffer[l] = calloc(level_samples, bytes_per_sample);
+  }
+
+  idx->variable[0] = var;
+  idx->variable_count = 1;
+
+  struct PIDX_hz_encode_struct hz_id;
+  memset(&hz_id, 0, sizeof (hz_id));
+  hz_id.idx = idx;
+  hz_id.first_index = 0;
+  hz_id.last_index = 0;
+  hz_id.resolution_to = 0;
+
+  double legacy_start = MPI_Wtime();
+  legacy_hz_encode(idx, patch->buffer, legacy_buffer, var->hz_buffer->start_hz_index);
+  double legacy_time = MPI_Wtime() - legacy_start;
+
+  double encode_start = MPI_Wtime();
+  if (PIDX_hz_encode_write(&hz_id) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_hz_encode_write\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  double encode_time = MPI_Wtime() - encode_start;
+
+  int ret = 0;
+  for (int l = 0; l < idx->maxh; l++)
+  {
+    uint64_t level_samples = (l == 0) ? 1 : ((uint64_t)1 << (l - 1));
+    if (memcmp(legacy_buffer[l], var->hz_buffer->buffer[l], level_samples * bytes_per_sample) != 0)
+    {
+      fprintf(stderr, "HZ buffers differ at level %d\n", l);
+      ret = 1;
+    }
+  }
+
+  // first time step builds the cache of HZ spans, the next ones replay it
+  PIDX_metadata_cache cache;
+  PIDX_create_metadata_cache(&cache);
+  hz_id.meta_data_cache = cache;
+
+  double cache_build_start = MPI_Wtime();
+  if (PIDX_hz_encode_write(&hz_id) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_hz_encode_write\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  double cache_build_time = MPI_Wtime() - cache_build_start;
+
+  for (int l = 0; l < idx->maxh; l++)
+  {
+    uint64_t level_samples = (l == 0) ? 1 : ((uint64_t)1 << (l - 1));
+    memset(var->hz_buffer->buffer[l], 0, level_samples * bytes_per_sample);
+  }
+
+  double cache_replay_start = MPI_Wtime();
+  if (PIDX_hz_encode_write(&hz_id) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_hz_encode_write\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  double cache_replay_time = MPI_Wtime() - cache_replay_start;
+
+  for (int l = 0; l < idx->maxh; l++)
+  {
+    uint64_t level_samples = (l == 0) ? 1 : ((uint64_t)1 << (l - 1));
+    if (memcmp(legacy_buffer[l], var->hz_buffer->buffer[l], level_samples * bytes_per_sample) != 0)
+    {
+      fprintf(stderr, "Cached HZ buffers differ at level %d\n", l);
+      ret = 1;
+    }
+  }
+  uint64_t span_count = cache->span_count;
+  hz_id.meta_data_cache = NULL;
+  PIDX_free_metadata_cache(cache);
+
+  // decode the HZ buffers back into the patch
+  unsigned char *original = malloc(sample_count * bytes_per_sample);
+  memcpy(original, patch->buffer, sample_count * bytes_per_sample);
+  memset(patch->buffer, 0, sample_count * bytes_per_sample);
+
+  double decode_start = MPI_Wtime();
+  if (PIDX_hz_encode_read(&hz_id) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_hz_encode_read\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  double decode_time = MPI_Wtime() - decode_start;
+
+  if (memcmp(original, patch->buffer, sample_count * bytes_per_sample) != 0)
+  {
+    fprintf(stderr, "Decoded patch differs from the original\n");
+    ret = 1;
+  }
+  free(original);
+
+  fprintf(stdout, "Patch %dx%dx%d (%d bytes per sample) bitmask %s threads %d\n", patch_size[0], patch_size[1], patch_size[2], bytes_per_sample, idx->bitSequence, thread_count);
+  fprintf(stdout, "Bitwise encoder      %f s\n", legacy_time);
+  fprintf(stdout, "PIDX_hz_encode_write %f s\n", encode_time);
+  fprintf(stdout, "PIDX_hz_encode_read  %f s\n", decode_time);
+  fprintf(stdout, "Cache build          %f s (%llu spans, %llu bytes)\n", cache_build_time, (unsigned long long)span_count, (unsigned long long)(span_count * sizeof(PIDX_hz_span)));
+  fprintf(stdout, "Cache replay         %f s\n", cache_replay_time);
+  fprintf(stdout, "Speedup              %.2fx\n", legacy_time / encode_time);
+
+  for (int l = 0; l < idx->maxh; l++)
+  {
+    free(var->hz_buffer->buffer[l]);
+    free(legacy_buffer[l]);
+  }
+  free(legacy_buffer);
+  free(var->hz_buffer->buffer);
+  free(var->hz_buffer->start_hz_index);
+  free(var->hz_buffer);
+  free(patch->buffer);
+  free(patch);
+  free(var->chunked_super_patch);
+  free(var);
+  free(idx);
+
+  MPI_Finalize();
+  return ret;
+}
+
+
+static void parse_args(int argc, char **argv)
+{
+  char flags[] = "l:b:t:";
+  int one_opt = 0;
+
+  while ((one_opt = getopt(argc, argv, flags)) != EOF)
+  {
+    switch (one_opt)
+    {
+    case('l'):
+      if ((sscanf(optarg, "%dx%dx%d", &patch_size[0], &patch_size[1], &patch_size[2]) == EOF) || (patch_size[0] < 1 || patch_size[1] < 1 || patch_size[2] < 1))
+      {
+        fprintf(stderr, "Wrong Usage\n%s", usage);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+      break;
+
+    case('b'):
+      bytes_per_sample = atoi(optarg);
+      break;
+
+    case('t'):
+      thread_count = atoi(optarg);
+      break;
+
+    default:
+      fprintf(stderr, "Wrong Usage\n%s", usage);
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+  }
+
+  if ((bytes_per_sample != 4 && bytes_per_sample != 8) || thread_count < 1)
+  {
+    fprintf(stderr, "Wrong Usage\n%s", usage);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+}
+
+
+// Per sample encoder as PIDX_hz_encode_write ran it before the lookup tables
+static void legacy_hz_encode(idx_dataset idx, unsigned char* patch, unsigned char** hz_buffer, uint64_t* start_hz_index)
+{
+  int maxH = idx->maxh;
+  int number_levels = maxH - 1;
+  Point3D xyzuv_Index;
+
+  for (uint64_t k = 0; k < patch_size[2]; k++)
+    for (uint64_t j = 0; j < patch_size[1]; j++)
+      for (uint64_t i = 0; i < patch_size[0]; i++)
+      {
+        uint64_t index = ((uint64_t)patch_size[0] * patch_size[1] * k) + (patch_size[0] * j) + i;
+
+        xyzuv_Index.x = i;
+        xyzuv_Index.y = j;
+        xyzuv_Index.z = k;
+
+        uint64_t z_order = 0;
+        Point3D zero;
+        memset(&zero, 0, sizeof (Point3D));
+
+        for (int cnt = 0; memcmp(&xyzuv_Index, &zero, sizeof (Point3D)); cnt++, number_levels--)
+        {
+          int bit = idx->bitPattern[number_levels];
+          z_order |= ((uint64_t) PGET(xyzuv_Index, bit) & 1) << cnt;
+          PGET(xyzuv_Index, bit) >>= 1;
+        }
+
+        number_levels = maxH - 1;
+        uint64_t lastbitmask = ((uint64_t) 1) << number_levels;
+        z_order |= lastbitmask;
+        while (!(1 & z_order)) z_order >>= 1;
+        z_order >>= 1;
+
+        uint64_t hz_order = z_order;
+        int level = getLeveL(hz_order);
+
+        uint64_t hz_index = hz_order - start_hz_index[level];
+        memcpy(hz_buffer[level] + (hz_index * bytes_per_sample), patch + (index * bytes_per_sample), bytes_per_sample);
+      }
+}
@@ -0,0 +1,268 @@
+/*
+ * BSD 3-Clause License
+ * 
+ * Copyright (c) 2010-2018 ViSUS L.L.C., 
+ * Scientific Computing and Imaging Institute of the University of Utah
+ * 
+ * ViSUS L.L.C., 50 W. Broadway, Ste. 300, 84101-2044 Salt Lake City, UT
+ * University of Utah, 72 S Central Campus Dr, Room 3750, 84112 Salt Lake City, UT
+ *  
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ * 
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * * Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * For additional information about this project contact: pascucci@acm.org
+ * For support: support@visus.net
+ * 
+ */
+
+/*
+  Benchmark for the particle binning of the particle restructuring and reads.
+  Random particles are packed into one message per restructured patch, once
+  the way the restructuring used to do it (every particle tested against every
+  restructured patch with a point in box test, copying the variables one
+  particle at a time), and once with PIDX_particles_rst_bin,
+  PIDX_particles_rst_bin_sort and PIDX_particles_rst_gather. Both messages are
+  compared. The box selection of the reads is timed against the point in box
+  test as well.
+
+  The variables are the ones of the particle examples (position, 3 doubles,
+  int, 9 doubles tensor, id).
+
+  Usage: ./idxparticlebinbench -n 4000000 -g 2x2x2
+    -n: number of particles
+    -g: number of restructured patches along each axis
+*/
+
+#include <unistd.h>
+#include <stdint.h>
+#include <PIDX.h>
+
+#define VARIABLE_COUNT 7
+
+static uint64_t particle_count = 4000000;
+static uint64_t grid_size[PIDX_MAX_DIMENSIONS] = {2, 2, 2};
+static const uint64_t bytes_per_sample[VARIABLE_COUNT] = {24, 8, 8, 8, 4, 72, 8};
+static char *usage = "Serial Usage: ./idxparticlebinbench -n 4000000 -g 2x2x2\n"
+                     "  -n: number of particles\n"
+                     "  -g: number of restructured patches along each axis\n";
+
+static void parse_args(int argc, char **argv);
+static int point_in_box(const double *lo, const double *hi, const double *pos);
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  parse_args(argc, argv);
+
+  const uint64_t bin_count = grid_size[0] * grid_size[1] * grid_size[2];
+  const double origin[PIDX_MAX_DIMENSIONS] = {0, 0, 0};
+  const double cell_size[PIDX_MAX_DIMENSIONS] = {16, 16, 16};
+
+  uint64_t particle_size = 0;
+  unsigned char *data[VARIABLE_COUNT];
+  for (int v = 0; v < VARIABLE_COUNT; v++)
+  {
+    particle_size = particle_size + bytes_per_sample[v];
+    data[v] = malloc(particle_count * bytes_per_sample[v] + 1);
+    for (uint64_t s = 0; s < particle_count * bytes_per_sample[v]; s++)
+      data[v][s] = (unsigned char)((s + v) * 2654435761u >> 24);
+  }
+
+  // positions spread over the whole grid
+  double *position = (double*)data[0];
+  srand(12345);
+  for (uint64_t p = 0; p < particle_count; p++)
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      position[p * PIDX_MAX_DIMENSIONS + d] = ((double)rand() / RAND_MAX) * cell_size[d] * grid_size[d] * 0.999999;
+
+  unsigned char *legacy_message = malloc(particle_count * particle_size + 1);
+  unsigned char *message = malloc(particle_count * particle_size + 1);
+
+  // Point in box test of every particle against every restructured patch
+  double legacy_start = MPI_Wtime();
+  uint64_t offset = 0;
+  for (uint64_t b = 0; b < bin_count; b++)
+  {
+    uint64_t cell[PIDX_MAX_DIMENSIONS] = {b % grid_size[0], (b / grid_size[0]) % grid_size[1], b / (grid_size[0] * grid_size[1])};
+    double lo[PIDX_MAX_DIMENSIONS], hi[PIDX_MAX_DIMENSIONS];
+    for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    {
+      lo[d] = origin[d] + cell[d] * cell_size[d];
+      hi[d] = lo[d] + cell_size[d];
+    }
+
+    uint64_t count = 0;
+    for (uint64_t p = 0; p < particle_count; p++)
+      if (point_in_box(lo, hi, position + p * PIDX_MAX_DIMENSIONS))
+        count++;
+
+    uint64_t var_offset = offset;
+    for (int v = 0; v < VARIABLE_COUNT; v++)
+    {
+      uint64_t c = 0;
+      for (uint64_t p = 0; p < particle_count; p++)
+        if (point_in_box(lo, hi, position + p * PIDX_MAX_DIMENSIONS))
+          memcpy(legacy_message + var_offset + (c++) * bytes_per_sample[v], data[v] + p * bytes_per_sample[v], bytes_per_sample[v]);
+      var_offset = var_offset + count * bytes_per_sample[v];
+    }
+    offset = var_offset;
+  }
+  double legacy_time = MPI_Wtime() - legacy_start;
+
+  // Binning kernel
+  uint32_t *bin = malloc(particle_count * sizeof(*bin) + 1);
+  uint64_t *order = malloc(particle_count * sizeof(*order) + 1);
+  uint64_t *bin_particle_count = malloc(bin_count * sizeof(*bin_particle_count));
+
+  double bin_start = MPI_Wtime();
+  if (PIDX_particles_rst_bin(position, particle_count, origin, cell_size, grid_size, bin) != PIDX_success)
+  {
+    fprintf(stderr, "Error in PIDX_particles_rst_bin\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  double bin_time = MPI_Wtime() - bin_start;
+
+  double sort_start = MPI_Wtime();
+  PIDX_particles_rst_bin_sort(bin, particle_count, bin_count, bin_particle_count, order);
+  double sort_time = MPI_Wtime() - sort_start;
+
+  double gather_start = MPI_Wtime();
+  offset = 0;
+  uint64_t first = 0;
+  for (uint64_t b = 0; b < bin_count; b++)
+  {
+    for (int v = 0; v < VARIABLE_COUNT; v++)
+    {
+      PIDX_particles_rst_gather(message + offset, data[v], order + first, bin_particle_count[b], bytes_per_sample[v]);
+      offset = offset + bin_particle_count[b] * bytes_per_sample[v];
+    }
+    first = first + bin_particle_count[b];
+  }
+  double gather_time = MPI_Wtime() - gather_start;
+
+  int ret = 0;
+  if (memcmp(legacy_message, message, particle_count * particle_size) != 0)
+  {
+    fprintf(stderr, "Messages differ\n");
+    ret = 1;
+  }
+
+  // Selection of the particles of the first restructured patch
+  double lo[PIDX_MAX_DIMENSIONS], hi[PIDX_MAX_DIMENSIONS];
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    lo[d] = origin[d];
+    hi[d] = origin[d] + cell_size[d];
+  }
+
+  double legacy_select_start = MPI_Wtime();
+  uint64_t legacy_selected_count = 0;
+  for (uint64_t p = 0; p < particle_count; p++)
+    if (point_in_box(lo, hi, position + p * PIDX_MAX_DIMENSIONS))
+      order[legacy_selected_count++] = p;
+  double legacy_select_time = MPI_Wtime() - legacy_select_start;
+
+  uint64_t *selected = malloc(particle_count * sizeof(*selected) + 1);
+  double select_start = MPI_Wtime();
+  uint64_t selected_count = PIDX_particles_rst_select(position, particle_count, lo, hi, selected);
+  double select_time = MPI_Wtime() - select_start;
+
+  if (selected_count != legacy_selected_count || memcmp(selected, order, selected_count * sizeof(*selected)) != 0)
+  {
+    fprintf(stderr, "Selections differ\n");
+    ret = 1;
+  }
+
+  double kernel_time = bin_time + sort_time + gather_time;
+  fprintf(stdout, "Particles %llu (%llu bytes each) restructured patches %llux%llux%llu\n", (unsigned long long)particle_count, (unsigned long long)particle_size, (unsigned long long)grid_size[0], (unsigned long long)grid_size[1], (unsigned long long)grid_size[2]);
+  fprintf(stdout, "Point in box packing      %f s\n", legacy_time);
+  fprintf(stdout, "PIDX_particles_rst_bin    %f s (%.1f M particles/s)\n", bin_time, particle_count / bin_time / 1e6);
+  fprintf(stdout, "PIDX_particles_rst_bin_sort %f s\n", sort_time);
+  fprintf(stdout, "PIDX_particles_rst_gather %f s\n", gather_time);
+  fprintf(stdout, "Speedup                   %.2fx\n", legacy_time / kernel_time);
+  fprintf(stdout, "Point in box selection    %f s\n", legacy_select_time);
+  fprintf(stdout, "PIDX_particles_rst_select %f s (%llu particles)\n", select_time, (unsigned long long)selected_count);
+
+  for (int v = 0; v < VARIABLE_COUNT; v++)
+    free(data[v]);
+  free(legacy_message);
+  free(message);
+  free(bin);
+  free(order);
+  free(selected);
+  free(bin_particle_count);
+
+  MPI_Finalize();
+  return ret;
+}
+
+
+static void parse_args(int argc, char **argv)
+{
+  char flags[] = "n:g:";
+  int one_opt = 0;
+
+  while ((one_opt = getopt(argc, argv, flags)) != EOF)
+  {
+    switch (one_opt)
+    {
+    case('n'):
+      if (sscanf(optarg, "%llu", (unsigned long long*)&particle_count) != 1 || particle_count < 1)
+      {
+        fprintf(stderr, "Wrong Usage\n%s", usage);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+      break;
+
+    case('g'):
+      if ((sscanf(optarg, "%llux%llux%llu", (unsigned long long*)&grid_size[0], (unsigned long long*)&grid_size[1], (unsigned long long*)&grid_size[2]) != 3) || (grid_size[0] < 1 || grid_size[1] < 1 || grid_size[2] < 1))
+      {
+        fprintf(stderr, "Wrong Usage\n%s", usage);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+      }
+      break;
+
+    default:
+      fprintf(stderr, "Wrong Usage\n%s", usage);
+      MPI_Abort(MPI_COMM_WORLD, -1);
+    }
+  }
+}
+
+
+// The test of the restructuring and of the reads before the binning kernel (closed bounds)
+static int point_in_box(const double *lo, const double *hi, const double *pos)
+{
+  int contains_point = 1;
+  for (int d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
+    contains_point = contains_point
+      && pos[d] >= lo[d]
+      && pos[d] <= hi[d];
+
+  return contains_point;
+}
@@ -189,6 +189,7 @@ int main(int argc, char **argv)
   char filename_template[1024];
   int variable_count = 0;
   int resolution = 0;
+  int large_offsets = 1;
 
   FILE *fp = fopen(argv[1], "r");
   while (fgets(line, sizeof (line), fp) != NULL)
@@ -202,6 +203,11 @@ int main(int argc, char **argv)
     {
       if ( fgets(line, sizeof line, fp) == NULL)
         return 0;
+      line[strcspn(line, "\r\n")] = 0;
+
+      // 64 bit block offsets and sizes from version 6.2 on
+      if (strcmp(line, "6") == 0 || strcmp(line, "6.1") == 0)
+        large_offsets = 0;
     }
 
     if (strcmp(line, "(box)") == 0)
@@ -591,6 +597,11 @@ int main(int argc, char **argv)
             {
               data_offset = ntohl(binheader[(bpf + var * blocks_per_file)*10 + 12]);
               data_size = ntohl(binheader[(bpf + var * blocks_per_file)*10 + 14]);
+              if (large_offsets)
+              {
+                data_offset = data_offset | ((uint64_t)ntohl(binheader[(bpf + var * blocks_per_file)*10 + 13]) << 32);
+                data_size = data_size | ((uint64_t)ntohl(binheader[(bpf + var * blocks_per_file)*10 + 15]) << 32);
+              }
 
               fprintf(stderr, "[F %d %s] [V %d] [B %d] Offset %lld Count %ld\n", fi, bin_file, var, bpf, (long long)data_offset, (long)data_size);
 